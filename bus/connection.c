@@ -37,6 +37,14 @@ struct _BusConnection {
     GList  *names;
 
     guint  filter_id;
+
+    /* the numbers of messages received from and sent to the connection,
+     * counted by the filter in the GDBus worker thread */
+    volatile gint n_received;
+    volatile gint n_sent;
+    /* the bytes of message bodies the daemon forwarded or dispatched to
+     * the connection */
+    guint64 n_bytes_forwarded;
 };
 
 struct _BusConnectionClass {
@@ -239,3 +247,33 @@ bus_connection_set_filter (BusConnection             *connection,
         /* Note: g_dbus_connection_add_filter seems not to return zero as a valid id. */
     }
 }
+
+void
+bus_connection_count_message (BusConnection *connection,
+                              gboolean       incoming)
+{
+    if (incoming)
+        g_atomic_int_inc (&connection->n_received);
+    else
+        g_atomic_int_inc (&connection->n_sent);
+}
+
+void
+bus_connection_add_forwarded_bytes (BusConnection *connection,
+                                    gsize          bytes)
+{
+    connection->n_bytes_forwarded += bytes;
+}
+
+void
+bus_connection_get_stats (BusConnection *connection,
+                          guint         *n_received,
+                          guint         *n_sent,
+                          guint64       *n_bytes_forwarded)
+{
+    g_assert (BUS_IS_CONNECTION (connection));
+
+    *n_received = (guint) g_atomic_int_get (&connection->n_received);
+    *n_sent = (guint) g_atomic_int_get (&connection->n_sent);
+    *n_bytes_forwarded = connection->n_bytes_forwarded;
+}
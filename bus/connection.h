@@ -123,6 +123,37 @@ void             bus_connection_set_filter          (BusConnection      *connect
                                                      gpointer            user_data,
                                                      GDestroyNotify      user_data_free_func);
 
+/**
+ * bus_connection_count_message:
+ * @incoming: TRUE for a message received from the connection, FALSE for a message sent to it.
+ *
+ * Count a message passing the filter of the connection. This function is thread safe, and the counters wrap around.
+ */
+void             bus_connection_count_message       (BusConnection      *connection,
+                                                     gboolean            incoming);
+
+/**
+ * bus_connection_add_forwarded_bytes:
+ * @bytes: the size of the body of a message forwarded or dispatched to the connection.
+ *
+ * Count the bytes the daemon sent to the connection on behalf of other connections.
+ */
+void             bus_connection_add_forwarded_bytes (BusConnection      *connection,
+                                                     gsize               bytes);
+
+/**
+ * bus_connection_get_stats:
+ * @n_received: the number of messages received from the connection.
+ * @n_sent: the number of messages sent to the connection.
+ * @n_bytes_forwarded: the bytes forwarded or dispatched to the connection.
+ *
+ * Get the message counters of the connection.
+ */
+void             bus_connection_get_stats           (BusConnection      *connection,
+                                                     guint              *n_received,
+                                                     guint              *n_sent,
+                                                     guint64            *n_bytes_forwarded);
+
 G_END_DECLS
 #endif
 
@@ -63,9 +63,17 @@ struct _BusDBusImpl {
 
     GMutex *dispatch_lock;
     GList *dispatch_queue;
+    /* the length of dispatch_queue, protected by dispatch_lock */
+    guint dispatch_queue_length;
 
     GMutex *forward_lock;
     GList *forward_queue;
+    /* the length of forward_queue, protected by forward_lock */
+    guint forward_queue_length;
+
+    /* the numbers of messages forwarded and dispatched by rule */
+    guint64 n_forwarded;
+    guint64 n_dispatched;
 
     /* a list of BusMethodCall to be used to reply when services are
        really available */
@@ -1368,16 +1376,27 @@ bus_dbus_impl_service_method_call (IBusService           *service,
         { "StartServiceByName", bus_dbus_impl_start_service_by_name },
     };
 
+    /* A map from a method name to its index + 1 in methods. */
+    static GHashTable *methods_table = NULL;
+
     gint i;
-    for (i = 0; i < G_N_ELEMENTS (methods); i++) {
-        if (g_strcmp0 (method_name, methods[i].method_name) == 0) {
-            BusConnection *connection = bus_connection_lookup (dbus_connection);
-            g_assert (BUS_IS_CONNECTION (connection));
-            methods[i].method (dbus, connection, parameters, invocation);
-            return;
+    if (methods_table == NULL) {
+        methods_table = g_hash_table_new (g_str_hash, g_str_equal);
+        for (i = 0; i < G_N_ELEMENTS (methods); i++) {
+            g_hash_table_insert (methods_table,
+                                 (gpointer) methods[i].method_name,
+                                 GINT_TO_POINTER (i + 1));
         }
     }
 
+    i = GPOINTER_TO_INT (g_hash_table_lookup (methods_table, method_name)) - 1;
+    if (i >= 0) {
+        BusConnection *connection = bus_connection_lookup (dbus_connection);
+        g_assert (BUS_IS_CONNECTION (connection));
+        methods[i].method (dbus, connection, parameters, invocation);
+        return;
+    }
+
     /* unsupported methods */
     g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
                                            "org.freedesktop.DBus does not support %s", method_name);
@@ -1457,6 +1476,8 @@ bus_dbus_impl_connection_filter_cb (GDBusConnection *dbus_connection,
     BusConnection *connection = bus_connection_lookup (dbus_connection);
     g_assert (connection != NULL);
 
+    bus_connection_count_message (connection, incoming);
+
     if (incoming) {
         /* is incoming message */
 
@@ -1697,6 +1718,15 @@ bus_dbus_impl_get_connection_by_name (BusDBusImpl    *dbus,
     }
 }
 
+/* Return the size of the body of message, which is cheap for a message
+ * received from a connection since its body is already serialized. */
+static gsize
+bus_dbus_message_get_body_size (GDBusMessage *message)
+{
+    GVariant *body = g_dbus_message_get_body (message);
+    return body != NULL ? g_variant_get_size (body) : 0;
+}
+
 typedef struct _BusForwardData BusForwardData;
 struct _BusForwardData {
     GDBusMessage *message;
@@ -1716,6 +1746,7 @@ bus_dbus_impl_forward_message_idle_cb (BusDBusImpl   *dbus)
     g_mutex_lock (dbus->forward_lock);
     BusForwardData *data = (BusForwardData *) dbus->forward_queue->data;
     dbus->forward_queue = g_list_delete_link (dbus->forward_queue, dbus->forward_queue);
+    dbus->forward_queue_length--;
     gboolean has_message = (dbus->forward_queue != NULL);
     g_mutex_unlock (dbus->forward_lock);
 
@@ -1734,8 +1765,12 @@ bus_dbus_impl_forward_message_idle_cb (BusDBusImpl   *dbus)
                                         data->message,
                                         G_DBUS_SEND_MESSAGE_FLAGS_PRESERVE_SERIAL,
                                         NULL, &error);
-            if (retval)
+            if (retval) {
+                dbus->n_forwarded++;
+                bus_connection_add_forwarded_bytes (dest_connection,
+                        bus_dbus_message_get_body_size (data->message));
                 break;
+            }
             g_warning ("forward message failed:  %s.", error->message);
             g_error_free (error);
         }
@@ -1787,6 +1822,7 @@ bus_dbus_impl_forward_message (BusDBusImpl   *dbus,
     g_mutex_lock (dbus->forward_lock);
     gboolean is_running = (dbus->forward_queue != NULL);
     dbus->forward_queue = g_list_append (dbus->forward_queue, data);
+    dbus->forward_queue_length++;
     g_mutex_unlock (dbus->forward_lock);
 
     if (!is_running) {
@@ -1838,6 +1874,7 @@ bus_dbus_impl_dispatch_message_by_rule_idle_cb (BusDBusImpl *dbus)
         g_list_free_full (dbus->dispatch_queue,
                           (GDestroyNotify) bus_dispatch_data_free);
         dbus->dispatch_queue = NULL;
+        dbus->dispatch_queue_length = 0;
         g_mutex_unlock (dbus->dispatch_lock);
         return FALSE; /* return FALSE to prevent this callback to be called again. */
     }
@@ -1846,6 +1883,7 @@ bus_dbus_impl_dispatch_message_by_rule_idle_cb (BusDBusImpl *dbus)
     g_mutex_lock (dbus->dispatch_lock);
     BusDispatchData *data = (BusDispatchData *) dbus->dispatch_queue->data;
     dbus->dispatch_queue = g_list_delete_link (dbus->dispatch_queue, dbus->dispatch_queue);
+    dbus->dispatch_queue_length--;
     gboolean has_message = (dbus->dispatch_queue != NULL);
     g_mutex_unlock (dbus->dispatch_lock);
 
@@ -1860,6 +1898,8 @@ bus_dbus_impl_dispatch_message_by_rule_idle_cb (BusDBusImpl *dbus)
     }
 
     /* send message to each recipients */
+    gsize body_size = recipients != NULL ?
+            bus_dbus_message_get_body_size (data->message) : 0;
     for (link = recipients; link != NULL; link = link->next) {
         BusConnection *connection = (BusConnection *) link->data;
         if (G_LIKELY (connection != data->skip_connection)) {
@@ -1867,6 +1907,8 @@ bus_dbus_impl_dispatch_message_by_rule_idle_cb (BusDBusImpl *dbus)
                                             data->message,
                                             G_DBUS_SEND_MESSAGE_FLAGS_PRESERVE_SERIAL,
                                             NULL, NULL);
+            dbus->n_dispatched++;
+            bus_connection_add_forwarded_bytes (connection, body_size);
         }
     }
     g_list_free (recipients);
@@ -1905,6 +1947,7 @@ bus_dbus_impl_dispatch_message_by_rule (BusDBusImpl     *dbus,
     gboolean is_running = (dbus->dispatch_queue != NULL);
     dbus->dispatch_queue = g_list_append (dbus->dispatch_queue,
                     bus_dispatch_data_new (message, skip_connection));
+    dbus->dispatch_queue_length++;
     g_mutex_unlock (dbus->dispatch_lock);
     if (!is_running) {
         g_idle_add_full (G_PRIORITY_DEFAULT,
@@ -1974,3 +2017,63 @@ bus_dbus_impl_unregister_object (BusDBusImpl *dbus,
     return TRUE;
 }
 
+void
+bus_dbus_impl_get_stats (BusDBusImpl     *dbus,
+                         GVariantBuilder *counters)
+{
+    guint forward_queue_length;
+    guint dispatch_queue_length;
+
+    g_assert (BUS_IS_DBUS_IMPL (dbus));
+
+    g_mutex_lock (dbus->forward_lock);
+    forward_queue_length = dbus->forward_queue_length;
+    g_mutex_unlock (dbus->forward_lock);
+
+    g_mutex_lock (dbus->dispatch_lock);
+    dispatch_queue_length = dbus->dispatch_queue_length;
+    g_mutex_unlock (dbus->dispatch_lock);
+
+    g_variant_builder_add (counters, "{st}", "connections",
+                           (guint64) g_list_length (dbus->connections));
+    g_variant_builder_add (counters, "{st}", "match-rules",
+                           (guint64) g_list_length (dbus->rules));
+    g_variant_builder_add (counters, "{st}", "forward-queue",
+                           (guint64) forward_queue_length);
+    g_variant_builder_add (counters, "{st}", "dispatch-queue",
+                           (guint64) dispatch_queue_length);
+    g_variant_builder_add (counters, "{st}", "forwarded", dbus->n_forwarded);
+    g_variant_builder_add (counters, "{st}", "dispatched", dbus->n_dispatched);
+}
+
+GVariant *
+bus_dbus_impl_get_connection_stats (BusDBusImpl *dbus)
+{
+    GVariantBuilder builder;
+    GList *p;
+
+    g_assert (BUS_IS_DBUS_IMPL (dbus));
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sasuut)"));
+    for (p = dbus->connections; p != NULL; p = p->next) {
+        BusConnection *connection = (BusConnection *) p->data;
+        const gchar *unique_name = bus_connection_get_unique_name (connection);
+        const GList *names;
+        GVariantBuilder names_builder;
+        guint n_received, n_sent;
+        guint64 n_bytes_forwarded;
+
+        g_variant_builder_init (&names_builder, G_VARIANT_TYPE ("as"));
+        for (names = bus_connection_get_names (connection); names != NULL; names = names->next)
+            g_variant_builder_add (&names_builder, "s", (const gchar *) names->data);
+
+        bus_connection_get_stats (connection, &n_received, &n_sent, &n_bytes_forwarded);
+        g_variant_builder_add (&builder, "(sasuut)",
+                               unique_name != NULL ? unique_name : "",
+                               &names_builder,
+                               n_received,
+                               n_sent,
+                               n_bytes_forwarded);
+    }
+    return g_variant_builder_end (&builder);
+}
@@ -123,6 +123,24 @@ gboolean         bus_dbus_impl_register_object  (BusDBusImpl    *dbus,
  */
 gboolean         bus_dbus_impl_unregister_object(BusDBusImpl    *dbus,
                                                  IBusService    *object);
+
+/**
+ * bus_dbus_impl_get_stats:
+ * @counters: a GVariantBuilder of type a{st} to add the counters to.
+ *
+ * Add the numbers of connections, match rules, queued, forwarded and dispatched messages to counters.
+ */
+void             bus_dbus_impl_get_stats        (BusDBusImpl    *dbus,
+                                                 GVariantBuilder
+                                                                *counters);
+
+/**
+ * bus_dbus_impl_get_connection_stats:
+ * @returns: A floating GVariant of type a(sasuut), the unique name, well-known names, numbers of received and sent
+ *           messages, and forwarded bytes of each connection.
+ */
+GVariant        *bus_dbus_impl_get_connection_stats
+                                                (BusDBusImpl    *dbus);
 G_END_DECLS
 #endif
 
@@ -22,6 +22,8 @@
 
 #include "engineproxy.h"
 
+#include <string.h>
+
 #include "global.h"
 #include "ibusimpl.h"
 #include "marshalers.h"
@@ -55,8 +57,54 @@ struct _BusEngineProxy {
     IBusText *surrounding_text;
     guint     surrounding_cursor_pos;
     guint     selection_anchor_pos;
+
+    /* the window of surrounding text the engine wants around the cursor,
+     * announced by its "SurroundingTextWindow" signal. An engine which
+     * announces it also accepts the "UpdateSurroundingText" edits. */
+    gboolean  surrounding_text_incremental;
+    guint     surrounding_chars_before;
+    guint     surrounding_chars_after;
+
+    /* the number of ProcessKeyEvent calls which timed out and are not
+     * replied by the engine yet. */
+    guint     stalled_key_events;
+
+    /* the "a(uuu)" key filter published by the engine, or NULL if the
+     * engine wants all key events. */
+    GVariant *key_filter;
+
+    /* the properties last registered by the engine, with the updates
+     * applied, and their serialized form. The serialized form is dropped
+     * by updates and rebuilt when it is needed again. */
+    IBusPropList *prop_list;
+    GVariant     *prop_list_variant;
 };
 
+/* Statistics of ProcessKeyEvent timeouts of an engine. They are kept per
+ * engine name, so that they survive the engine proxies of input contexts. */
+typedef struct _KeyEventStats KeyEventStats;
+struct _KeyEventStats {
+    /* the calls replied as "not handled" because the engine did not reply
+     * in time or still had a timed out call pending. */
+    guint timeouts;
+    /* the replies received after the timeout. */
+    guint late_replies;
+    /* the late replies in which the engine handled the key. */
+    guint late_handled;
+};
+
+typedef struct _ProcessKeyEventData ProcessKeyEventData;
+struct _ProcessKeyEventData {
+    BusEngineProxy *engine;
+    GSimpleAsyncResult *simple;
+    guint timeout_id;
+};
+
+static GHashTable *key_event_stats = NULL;
+
+/* The number of the engine proxies alive. */
+static guint n_engines = 0;
+
 struct _BusEngineProxyClass {
     IBusProxyClass parent;
     /* class members */
@@ -67,6 +115,7 @@ enum {
     FORWARD_KEY_EVENT,
     DELETE_SURROUNDING_TEXT,
     REQUIRE_SURROUNDING_TEXT,
+    SURROUNDING_TEXT_WINDOW,
     UPDATE_PREEDIT_TEXT,
     SHOW_PREEDIT_TEXT,
     HIDE_PREEDIT_TEXT,
@@ -82,6 +131,10 @@ enum {
     CURSOR_DOWN_LOOKUP_TABLE,
     REGISTER_PROPERTIES,
     UPDATE_PROPERTY,
+    UPDATE_PROPERTY_STATE,
+    UPDATE_KEY_FILTER,
+    DIRECT_CHANNEL_CONNECTED,
+    DIRECT_CHANNEL_DISCONNECTED,
     LAST_SIGNAL,
 };
 
@@ -192,6 +245,46 @@ bus_engine_proxy_class_init (BusEngineProxyClass *class)
             G_TYPE_NONE,
             0);
 
+    engine_signals[SURROUNDING_TEXT_WINDOW] =
+        g_signal_new (I_("surrounding-text-window"),
+            G_TYPE_FROM_CLASS (class),
+            G_SIGNAL_RUN_LAST,
+            0,
+            NULL, NULL,
+            bus_marshal_VOID__VOID,
+            G_TYPE_NONE,
+            0);
+
+    engine_signals[UPDATE_KEY_FILTER] =
+        g_signal_new (I_("update-key-filter"),
+            G_TYPE_FROM_CLASS (class),
+            G_SIGNAL_RUN_LAST,
+            0,
+            NULL, NULL,
+            bus_marshal_VOID__VOID,
+            G_TYPE_NONE,
+            0);
+
+    engine_signals[DIRECT_CHANNEL_CONNECTED] =
+        g_signal_new (I_("direct-channel-connected"),
+            G_TYPE_FROM_CLASS (class),
+            G_SIGNAL_RUN_LAST,
+            0,
+            NULL, NULL,
+            bus_marshal_VOID__VOID,
+            G_TYPE_NONE,
+            0);
+
+    engine_signals[DIRECT_CHANNEL_DISCONNECTED] =
+        g_signal_new (I_("direct-channel-disconnected"),
+            G_TYPE_FROM_CLASS (class),
+            G_SIGNAL_RUN_LAST,
+            0,
+            NULL, NULL,
+            bus_marshal_VOID__VOID,
+            G_TYPE_NONE,
+            0);
+
     engine_signals[UPDATE_PREEDIT_TEXT] =
         g_signal_new (I_("update-preedit-text"),
             G_TYPE_FROM_CLASS (class),
@@ -352,6 +445,20 @@ bus_engine_proxy_class_init (BusEngineProxyClass *class)
             1,
             IBUS_TYPE_PROPERTY);
 
+    engine_signals[UPDATE_PROPERTY_STATE] =
+        g_signal_new (I_("update-property-state"),
+            G_TYPE_FROM_CLASS (class),
+            G_SIGNAL_RUN_LAST,
+            0,
+            NULL, NULL,
+            bus_marshal_VOID__STRING_UINT_BOOLEAN_BOOLEAN,
+            G_TYPE_NONE,
+            4,
+            G_TYPE_STRING,
+            G_TYPE_UINT,
+            G_TYPE_BOOLEAN,
+            G_TYPE_BOOLEAN);
+
     text_empty = ibus_text_new_from_static_string ("");
     g_object_ref_sink (text_empty);
 }
@@ -360,6 +467,7 @@ static void
 bus_engine_proxy_init (BusEngineProxy *engine)
 {
     engine->surrounding_text = g_object_ref_sink (text_empty);
+    n_engines++;
 }
 
 static void
@@ -399,6 +507,8 @@ bus_engine_proxy_real_destroy (IBusProxy *proxy)
 {
     BusEngineProxy *engine = (BusEngineProxy *)proxy;
 
+    n_engines--;
+
     if (engine->desc) {
         g_object_unref (engine->desc);
         engine->desc = NULL;
@@ -409,11 +519,26 @@ bus_engine_proxy_real_destroy (IBusProxy *proxy)
         engine->keymap = NULL;
     }
 
+    if (engine->key_filter) {
+        g_variant_unref (engine->key_filter);
+        engine->key_filter = NULL;
+    }
+
     if (engine->surrounding_text) {
         g_object_unref (engine->surrounding_text);
         engine->surrounding_text = NULL;
     }
 
+    if (engine->prop_list) {
+        g_object_unref (engine->prop_list);
+        engine->prop_list = NULL;
+    }
+
+    if (engine->prop_list_variant) {
+        g_variant_unref (engine->prop_list_variant);
+        engine->prop_list_variant = NULL;
+    }
+
     IBUS_PROXY_CLASS (bus_engine_proxy_parent_class)->destroy ((IBusProxy *)engine);
 }
 
@@ -425,166 +550,330 @@ _g_object_unref_if_floating (gpointer instance)
 }
 
 /**
- * bus_engine_proxy_g_signal:
+ * bus_engine_proxy_cache_properties:
  *
- * Handle all D-Bus signals from the engine process. This function emits corresponding glib signal for the D-Bus signal.
+ * Cache the properties registered by the engine. The serialized properties are compared with the cached ones first, so they are
+ * deserialized only if they are changed. Return the cached properties.
  */
-static void
-bus_engine_proxy_g_signal (GDBusProxy  *proxy,
-                           const gchar *sender_name,
-                           const gchar *signal_name,
-                           GVariant    *parameters)
+static IBusPropList *
+bus_engine_proxy_cache_properties (BusEngineProxy *engine,
+                                   GVariant       *variant)
 {
-    BusEngineProxy *engine = (BusEngineProxy *)proxy;
-
-    /* The list of nullary D-Bus signals. */
-    static const struct {
-        const gchar *signal_name;
-        const guint  signal_id;
-    } signals [] = {
-        { "ShowPreeditText",        SHOW_PREEDIT_TEXT },
-        { "HidePreeditText",        HIDE_PREEDIT_TEXT },
-        { "ShowAuxiliaryText",      SHOW_AUXILIARY_TEXT },
-        { "HideAuxiliaryText",      HIDE_AUXILIARY_TEXT },
-        { "ShowLookupTable",        SHOW_LOOKUP_TABLE },
-        { "HideLookupTable",        HIDE_LOOKUP_TABLE },
-        { "PageUpLookupTable",      PAGE_UP_LOOKUP_TABLE },
-        { "PageDownLookupTable",    PAGE_DOWN_LOOKUP_TABLE },
-        { "CursorUpLookupTable",    CURSOR_UP_LOOKUP_TABLE },
-        { "CursorDownLookupTable",  CURSOR_DOWN_LOOKUP_TABLE },
-        { "RequireSurroundingText", REQUIRE_SURROUNDING_TEXT },
-    };
+    if (engine->prop_list != NULL && engine->prop_list_variant == NULL) {
+        engine->prop_list_variant =
+            ibus_serializable_serialize ((IBusSerializable *)engine->prop_list);
+        g_variant_ref_sink (engine->prop_list_variant);
+    }
 
-    gint i;
-    for (i = 0; i < G_N_ELEMENTS (signals); i++) {
-        if (g_strcmp0 (signal_name, signals[i].signal_name) == 0) {
-            g_signal_emit (engine, engine_signals[signals[i].signal_id], 0);
-            return;
-        }
+    if (engine->prop_list_variant != NULL &&
+        g_variant_equal (engine->prop_list_variant, variant)) {
+        return engine->prop_list;
     }
 
-    /* Handle D-Bus signals with parameters. Deserialize them and emit a glib signal. */
-    if (g_strcmp0 (signal_name, "CommitText") == 0) {
-        GVariant *arg0 = NULL;
-        g_variant_get (parameters, "(v)", &arg0);
-        g_return_if_fail (arg0 != NULL);
-
-        IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (arg0));
-        g_variant_unref (arg0);
-        g_return_if_fail (text != NULL);
-        g_signal_emit (engine, engine_signals[COMMIT_TEXT], 0, text);
-        _g_object_unref_if_floating (text);
+    IBusPropList *prop_list = IBUS_PROP_LIST (ibus_serializable_deserialize (variant));
+    g_return_val_if_fail (prop_list != NULL, NULL);
+
+    if (engine->prop_list)
+        g_object_unref (engine->prop_list);
+    engine->prop_list = (IBusPropList *) g_object_ref_sink (prop_list);
+
+    if (engine->prop_list_variant)
+        g_variant_unref (engine->prop_list_variant);
+    engine->prop_list_variant = g_variant_ref (variant);
+
+    return engine->prop_list;
+}
+
+/**
+ * bus_engine_proxy_update_cached_property:
+ *
+ * Apply an update of a property to the cached properties.
+ */
+static void
+bus_engine_proxy_update_cached_property (BusEngineProxy *engine,
+                                         IBusProperty   *prop)
+{
+    IBusProperty *cached;
+
+    if (engine->prop_list == NULL)
         return;
-    }
 
-    if (g_strcmp0 (signal_name, "ForwardKeyEvent") == 0) {
-        guint32 keyval = 0;
-        guint32 keycode = 0;
-        guint32 states = 0;
-        g_variant_get (parameters, "(uuu)", &keyval, &keycode, &states);
-
-        g_signal_emit (engine,
-                       engine_signals[FORWARD_KEY_EVENT],
-                       0,
-                       keyval,
-                       keycode,
-                       states);
+    cached = ibus_prop_list_lookup (engine->prop_list,
+                                    ibus_property_get_key (prop));
+    /* ibus_property_update does not support changing the type. */
+    if (cached == NULL ||
+        ibus_property_get_prop_type (cached) != ibus_property_get_prop_type (prop))
         return;
+
+    ibus_property_update (cached, prop);
+
+    if (engine->prop_list_variant) {
+        g_variant_unref (engine->prop_list_variant);
+        engine->prop_list_variant = NULL;
     }
+}
 
-    if (g_strcmp0 (signal_name, "DeleteSurroundingText") == 0) {
-        gint  offset_from_cursor = 0;
-        guint nchars = 0;
-        g_variant_get (parameters, "(iu)", &offset_from_cursor, &nchars);
+static void
+_engine_commit_text (BusEngineProxy *engine,
+                     GVariant       *parameters)
+{
+    GVariant *arg0 = NULL;
+    g_variant_get (parameters, "(v)", &arg0);
+    g_return_if_fail (arg0 != NULL);
+
+    IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (arg0));
+    g_variant_unref (arg0);
+    g_return_if_fail (text != NULL);
+    g_signal_emit (engine, engine_signals[COMMIT_TEXT], 0, text);
+    _g_object_unref_if_floating (text);
+}
 
-        g_signal_emit (engine,
-                       engine_signals[DELETE_SURROUNDING_TEXT],
-                       0, offset_from_cursor, nchars);
-        return;
+static void
+_engine_forward_key_event (BusEngineProxy *engine,
+                           GVariant       *parameters)
+{
+    guint32 keyval = 0;
+    guint32 keycode = 0;
+    guint32 states = 0;
+    g_variant_get (parameters, "(uuu)", &keyval, &keycode, &states);
+
+    g_signal_emit (engine,
+                   engine_signals[FORWARD_KEY_EVENT],
+                   0,
+                   keyval,
+                   keycode,
+                   states);
+}
+
+static void
+_engine_update_key_filter (BusEngineProxy *engine,
+                           GVariant       *parameters)
+{
+    if (engine->key_filter)
+        g_variant_unref (engine->key_filter);
+    engine->key_filter = g_variant_get_child_value (parameters, 0);
+    /* an empty filter means the engine wants all key events */
+    if (g_variant_n_children (engine->key_filter) == 0) {
+        g_variant_unref (engine->key_filter);
+        engine->key_filter = NULL;
     }
+    g_signal_emit (engine, engine_signals[UPDATE_KEY_FILTER], 0);
+}
+
+static void
+_engine_surrounding_text_window (BusEngineProxy *engine,
+                                 GVariant       *parameters)
+{
+    g_variant_get (parameters, "(uu)",
+                   &engine->surrounding_chars_before,
+                   &engine->surrounding_chars_after);
+    engine->surrounding_text_incremental = TRUE;
+    g_signal_emit (engine, engine_signals[SURROUNDING_TEXT_WINDOW], 0);
+}
 
-    if (g_strcmp0 (signal_name, "UpdatePreeditText") == 0) {
-        GVariant *arg0 = NULL;
-        guint cursor_pos = 0;
-        gboolean visible = FALSE;
-        guint mode = 0;
+static void
+_engine_delete_surrounding_text (BusEngineProxy *engine,
+                                 GVariant       *parameters)
+{
+    gint  offset_from_cursor = 0;
+    guint nchars = 0;
+    g_variant_get (parameters, "(iu)", &offset_from_cursor, &nchars);
 
-        g_variant_get (parameters, "(vubu)", &arg0, &cursor_pos, &visible, &mode);
-        g_return_if_fail (arg0 != NULL);
+    g_signal_emit (engine,
+                   engine_signals[DELETE_SURROUNDING_TEXT],
+                   0, offset_from_cursor, nchars);
+}
 
-        IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (arg0));
-        g_variant_unref (arg0);
-        g_return_if_fail (text != NULL);
+static void
+_engine_update_preedit_text (BusEngineProxy *engine,
+                             GVariant       *parameters)
+{
+    GVariant *arg0 = NULL;
+    guint cursor_pos = 0;
+    gboolean visible = FALSE;
+    guint mode = 0;
 
-        g_signal_emit (engine,
-                       engine_signals[UPDATE_PREEDIT_TEXT],
-                       0, text, cursor_pos, visible, mode);
+    g_variant_get (parameters, "(vubu)", &arg0, &cursor_pos, &visible, &mode);
+    g_return_if_fail (arg0 != NULL);
 
-        _g_object_unref_if_floating (text);
-        return;
-    }
+    IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (arg0));
+    g_variant_unref (arg0);
+    g_return_if_fail (text != NULL);
 
-    if (g_strcmp0 (signal_name, "UpdateAuxiliaryText") == 0) {
-        GVariant *arg0 = NULL;
-        gboolean visible = FALSE;
+    g_signal_emit (engine,
+                   engine_signals[UPDATE_PREEDIT_TEXT],
+                   0, text, cursor_pos, visible, mode);
 
-        g_variant_get (parameters, "(vb)", &arg0, &visible);
-        g_return_if_fail (arg0 != NULL);
+    _g_object_unref_if_floating (text);
+}
 
-        IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (arg0));
-        g_variant_unref (arg0);
-        g_return_if_fail (text != NULL);
+static void
+_engine_update_auxiliary_text (BusEngineProxy *engine,
+                               GVariant       *parameters)
+{
+    GVariant *arg0 = NULL;
+    gboolean visible = FALSE;
 
-        g_signal_emit (engine, engine_signals[UPDATE_AUXILIARY_TEXT], 0, text, visible);
-        _g_object_unref_if_floating (text);
-        return;
-    }
+    g_variant_get (parameters, "(vb)", &arg0, &visible);
+    g_return_if_fail (arg0 != NULL);
 
-    if (g_strcmp0 (signal_name, "UpdateLookupTable") == 0) {
-        GVariant *arg0 = NULL;
-        gboolean visible = FALSE;
+    IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (arg0));
+    g_variant_unref (arg0);
+    g_return_if_fail (text != NULL);
 
-        g_variant_get (parameters, "(vb)", &arg0, &visible);
-        g_return_if_fail (arg0 != NULL);
+    g_signal_emit (engine, engine_signals[UPDATE_AUXILIARY_TEXT], 0, text, visible);
+    _g_object_unref_if_floating (text);
+}
 
-        IBusLookupTable *table = IBUS_LOOKUP_TABLE (ibus_serializable_deserialize (arg0));
-        g_variant_unref (arg0);
-        g_return_if_fail (table != NULL);
+static void
+_engine_update_lookup_table (BusEngineProxy *engine,
+                             GVariant       *parameters)
+{
+    GVariant *arg0 = NULL;
+    gboolean visible = FALSE;
 
-        g_signal_emit (engine, engine_signals[UPDATE_LOOKUP_TABLE], 0, table, visible);
-        _g_object_unref_if_floating (table);
-        return;
-    }
+    g_variant_get (parameters, "(vb)", &arg0, &visible);
+    g_return_if_fail (arg0 != NULL);
 
-    if (g_strcmp0 (signal_name, "RegisterProperties") == 0) {
-        GVariant *arg0 = NULL;
-        g_variant_get (parameters, "(v)", &arg0);
-        g_return_if_fail (arg0 != NULL);
+    IBusLookupTable *table = IBUS_LOOKUP_TABLE (ibus_serializable_deserialize (arg0));
+    g_variant_unref (arg0);
+    g_return_if_fail (table != NULL);
 
-        IBusPropList *prop_list = IBUS_PROP_LIST (ibus_serializable_deserialize (arg0));
-        g_variant_unref (arg0);
-        g_return_if_fail (prop_list != NULL);
+    g_signal_emit (engine, engine_signals[UPDATE_LOOKUP_TABLE], 0, table, visible);
+    _g_object_unref_if_floating (table);
+}
 
-        g_signal_emit (engine, engine_signals[REGISTER_PROPERTIES], 0, prop_list);
-        _g_object_unref_if_floating (prop_list);
-        return;
+static void
+_engine_register_properties (BusEngineProxy *engine,
+                             GVariant       *parameters)
+{
+    GVariant *arg0 = NULL;
+    g_variant_get (parameters, "(v)", &arg0);
+    g_return_if_fail (arg0 != NULL);
+
+    IBusPropList *prop_list = bus_engine_proxy_cache_properties (engine, arg0);
+    g_variant_unref (arg0);
+    g_return_if_fail (prop_list != NULL);
+
+    g_signal_emit (engine, engine_signals[REGISTER_PROPERTIES], 0, prop_list);
+}
+
+static void
+_engine_update_property (BusEngineProxy *engine,
+                         GVariant       *parameters)
+{
+    GVariant *arg0 = NULL;
+    g_variant_get (parameters, "(v)", &arg0);
+    g_return_if_fail (arg0 != NULL);
+
+    IBusProperty *prop = IBUS_PROPERTY (ibus_serializable_deserialize (arg0));
+    g_variant_unref (arg0);
+    g_return_if_fail (prop != NULL);
+
+    bus_engine_proxy_update_cached_property (engine, prop);
+    g_signal_emit (engine, engine_signals[UPDATE_PROPERTY], 0, prop);
+    _g_object_unref_if_floating (prop);
+}
+
+static void
+_engine_update_property_state (BusEngineProxy *engine,
+                               GVariant       *parameters)
+{
+    const gchar *key = NULL;
+    guint state = 0;
+    gboolean visible = FALSE;
+    gboolean sensitive = FALSE;
+
+    g_variant_get (parameters, "(&subb)",
+                   &key, &state, &visible, &sensitive);
+
+    if (engine->prop_list != NULL &&
+        ibus_prop_list_update_property_state (engine->prop_list,
+                                              key,
+                                              state,
+                                              visible,
+                                              sensitive) &&
+        engine->prop_list_variant != NULL) {
+        g_variant_unref (engine->prop_list_variant);
+        engine->prop_list_variant = NULL;
     }
+    g_signal_emit (engine, engine_signals[UPDATE_PROPERTY_STATE], 0,
+                   key, state, visible, sensitive);
+}
 
-    if (g_strcmp0 (signal_name, "UpdateProperty") == 0) {
-        GVariant *arg0 = NULL;
-        g_variant_get (parameters, "(v)", &arg0);
-        g_return_if_fail (arg0 != NULL);
+/**
+ * bus_engine_proxy_g_signal:
+ *
+ * Handle all D-Bus signals from the engine process. This function emits corresponding glib signal for the D-Bus signal.
+ */
+static void
+bus_engine_proxy_g_signal (GDBusProxy  *proxy,
+                           const gchar *sender_name,
+                           const gchar *signal_name,
+                           GVariant    *parameters)
+{
+    BusEngineProxy *engine = (BusEngineProxy *)proxy;
 
-        IBusProperty *prop = IBUS_PROPERTY (ibus_serializable_deserialize (arg0));
-        g_variant_unref (arg0);
-        g_return_if_fail (prop != NULL);
+    /* The list of D-Bus signals. Nullary signals just emit the glib signal
+     * signal_id, the others are deserialized by signal_callback. */
+    static const struct {
+        const gchar *signal_name;
+        const guint  signal_id;
+        void (* signal_callback) (BusEngineProxy *, GVariant *);
+    } signals [] = {
+        { "CommitText",             COMMIT_TEXT,            _engine_commit_text },
+        { "ForwardKeyEvent",        FORWARD_KEY_EVENT,      _engine_forward_key_event },
+        { "UpdatePreeditText",      UPDATE_PREEDIT_TEXT,    _engine_update_preedit_text },
+        { "UpdateAuxiliaryText",    UPDATE_AUXILIARY_TEXT,  _engine_update_auxiliary_text },
+        { "UpdateLookupTable",      UPDATE_LOOKUP_TABLE,    _engine_update_lookup_table },
+        { "RegisterProperties",     REGISTER_PROPERTIES,    _engine_register_properties },
+        { "UpdateProperty",         UPDATE_PROPERTY,        _engine_update_property },
+        { "UpdatePropertyState",    UPDATE_PROPERTY_STATE,  _engine_update_property_state },
+        { "UpdateKeyFilter",        UPDATE_KEY_FILTER,      _engine_update_key_filter },
+        { "SurroundingTextWindow",  SURROUNDING_TEXT_WINDOW,
+                                                            _engine_surrounding_text_window },
+        { "DeleteSurroundingText",  DELETE_SURROUNDING_TEXT,
+                                                            _engine_delete_surrounding_text },
+        { "ShowPreeditText",        SHOW_PREEDIT_TEXT,      NULL },
+        { "HidePreeditText",        HIDE_PREEDIT_TEXT,      NULL },
+        { "ShowAuxiliaryText",      SHOW_AUXILIARY_TEXT,    NULL },
+        { "HideAuxiliaryText",      HIDE_AUXILIARY_TEXT,    NULL },
+        { "ShowLookupTable",        SHOW_LOOKUP_TABLE,      NULL },
+        { "HideLookupTable",        HIDE_LOOKUP_TABLE,      NULL },
+        { "PageUpLookupTable",      PAGE_UP_LOOKUP_TABLE,   NULL },
+        { "PageDownLookupTable",    PAGE_DOWN_LOOKUP_TABLE, NULL },
+        { "CursorUpLookupTable",    CURSOR_UP_LOOKUP_TABLE, NULL },
+        { "CursorDownLookupTable",  CURSOR_DOWN_LOOKUP_TABLE,
+                                                            NULL },
+        { "RequireSurroundingText", REQUIRE_SURROUNDING_TEXT,
+                                                            NULL },
+        { "DirectChannelConnected", DIRECT_CHANNEL_CONNECTED,
+                                                            NULL },
+        { "DirectChannelDisconnected",
+                                    DIRECT_CHANNEL_DISCONNECTED,
+                                                            NULL },
+    };
 
-        g_signal_emit (engine, engine_signals[UPDATE_PROPERTY], 0, prop);
-        _g_object_unref_if_floating (prop);
-        return;
+    /* A map from a signal name to its index + 1 in signals. */
+    static GHashTable *signals_table = NULL;
+
+    gint i;
+    if (signals_table == NULL) {
+        signals_table = g_hash_table_new (g_str_hash, g_str_equal);
+        for (i = 0; i < G_N_ELEMENTS (signals); i++) {
+            g_hash_table_insert (signals_table,
+                                 (gpointer) signals[i].signal_name,
+                                 GINT_TO_POINTER (i + 1));
+        }
     }
 
-    g_return_if_reached ();
+    i = GPOINTER_TO_INT (g_hash_table_lookup (signals_table, signal_name)) - 1;
+    g_return_if_fail (i >= 0);
+
+    if (signals[i].signal_callback != NULL)
+        signals[i].signal_callback (engine, parameters);
+    else
+        g_signal_emit (engine, engine_signals[signals[i].signal_id], 0);
 }
 
 static BusEngineProxy *
@@ -893,6 +1182,109 @@ bus_engine_proxy_new_finish (GAsyncResult   *res,
     return (BusEngineProxy *) g_simple_async_result_get_op_res_gpointer(simple);
 }
 
+static KeyEventStats *
+bus_engine_proxy_get_key_event_stats (BusEngineProxy *engine)
+{
+    const gchar *name = ibus_engine_desc_get_name (engine->desc);
+    KeyEventStats *stats;
+
+    if (key_event_stats == NULL)
+        key_event_stats = g_hash_table_new (g_str_hash, g_str_equal);
+
+    stats = (KeyEventStats *) g_hash_table_lookup (key_event_stats, name);
+    if (stats == NULL) {
+        stats = g_slice_new0 (KeyEventStats);
+        g_hash_table_insert (key_event_stats, g_strdup (name), stats);
+    }
+    return stats;
+}
+
+static void
+_process_key_event_data_free (ProcessKeyEventData *data)
+{
+    g_object_unref (data->engine);
+    if (data->simple)
+        g_object_unref (data->simple);
+    g_slice_free (ProcessKeyEventData, data);
+}
+
+/**
+ * _process_key_event_timeout_cb:
+ *
+ * Reply "not handled" to the client when the engine does not reply in
+ * g_key_event_timeout milliseconds, so the key is passed through.
+ */
+static gboolean
+_process_key_event_timeout_cb (ProcessKeyEventData *data)
+{
+    KeyEventStats *stats = bus_engine_proxy_get_key_event_stats (data->engine);
+
+    data->timeout_id = 0;
+    data->engine->stalled_key_events++;
+    stats->timeouts++;
+
+    if (stats->timeouts == 1) {
+        g_warning ("Engine %s did not process a key event in %d ms.",
+                   ibus_engine_desc_get_name (data->engine->desc),
+                   g_key_event_timeout);
+    }
+
+    g_simple_async_result_set_op_res_gpointer (data->simple,
+                                               g_variant_new ("(b)", FALSE),
+                                               (GDestroyNotify) g_variant_unref);
+    g_simple_async_result_complete (data->simple);
+    g_object_unref (data->simple);
+    data->simple = NULL;
+    return FALSE;
+}
+
+static void
+_process_key_event_reply_cb (GDBusProxy          *proxy,
+                             GAsyncResult        *res,
+                             ProcessKeyEventData *data)
+{
+    GError *error = NULL;
+    GVariant *value = g_dbus_proxy_call_finish (proxy, res, &error);
+
+    if (data->simple == NULL) {
+        /* The client got "not handled" already, so the key was passed
+         * through even if the engine handled it. */
+        KeyEventStats *stats = bus_engine_proxy_get_key_event_stats (data->engine);
+        gboolean handled = FALSE;
+
+        data->engine->stalled_key_events--;
+        stats->late_replies++;
+        if (value != NULL)
+            g_variant_get (value, "(b)", &handled);
+        if (handled)
+            stats->late_handled++;
+        g_debug ("Late reply of ProcessKeyEvent from engine %s, handled=%d",
+                 ibus_engine_desc_get_name (data->engine->desc), handled);
+
+        if (value != NULL)
+            g_variant_unref (value);
+        if (error != NULL)
+            g_error_free (error);
+        _process_key_event_data_free (data);
+        return;
+    }
+
+    if (data->timeout_id != 0)
+        g_source_remove (data->timeout_id);
+
+    if (value != NULL) {
+        g_simple_async_result_set_op_res_gpointer (data->simple,
+                                                   value,
+                                                   (GDestroyNotify) g_variant_unref);
+    }
+    else {
+        g_simple_async_result_set_from_error (data->simple, error);
+        g_error_free (error);
+    }
+    g_simple_async_result_complete (data->simple);
+    _process_key_event_data_free (data);
+}
+
 void
 bus_engine_proxy_process_key_event (BusEngineProxy      *engine,
                                     guint                keyval,
@@ -916,16 +1308,125 @@ bus_engine_proxy_process_key_event (BusEngineProxy      *engine,
         }
     }
 
+    GSimpleAsyncResult *simple =
+            g_simple_async_result_new ((GObject *) engine,
+                                       callback,
+                                       user_data,
+                                       bus_engine_proxy_process_key_event);
+
+    if (g_key_event_timeout > 0 && engine->stalled_key_events > 0) {
+        /* The engine has not replied a timed out key event yet, so do not
+         * make the client wait for it again. */
+        bus_engine_proxy_get_key_event_stats (engine)->timeouts++;
+        g_simple_async_result_set_op_res_gpointer (simple,
+                                                   g_variant_new ("(b)", FALSE),
+                                                   (GDestroyNotify) g_variant_unref);
+        g_simple_async_result_complete_in_idle (simple);
+        g_object_unref (simple);
+        return;
+    }
+
+    ProcessKeyEventData *data = g_slice_new0 (ProcessKeyEventData);
+    data->engine = (BusEngineProxy *) g_object_ref (engine);
+    data->simple = simple;
+
     g_dbus_proxy_call ((GDBusProxy *)engine,
                        "ProcessKeyEvent",
                        g_variant_new ("(uuu)", keyval, keycode, state),
                        G_DBUS_CALL_FLAGS_NONE,
                        -1,
                        NULL,
+                       (GAsyncReadyCallback) _process_key_event_reply_cb,
+                       data);
+
+    if (g_key_event_timeout > 0) {
+        data->timeout_id = g_timeout_add (g_key_event_timeout,
+                                          (GSourceFunc) _process_key_event_timeout_cb,
+                                          data);
+    }
+}
+
+GVariant *
+bus_engine_proxy_process_key_event_finish (BusEngineProxy *engine,
+                                           GAsyncResult   *res,
+                                           GError        **error)
+{
+    GSimpleAsyncResult *simple = (GSimpleAsyncResult *) res;
+
+    g_assert (BUS_IS_ENGINE_PROXY (engine));
+    g_assert (g_simple_async_result_is_valid (res, (GObject *) engine,
+                                              bus_engine_proxy_process_key_event));
+
+    if (g_simple_async_result_propagate_error (simple, error))
+        return NULL;
+    return g_variant_ref (g_simple_async_result_get_op_res_gpointer (simple));
+}
+
+void
+bus_engine_proxy_open_direct_channel (BusEngineProxy      *engine,
+                                      GCancellable        *cancellable,
+                                      GAsyncReadyCallback  callback,
+                                      gpointer             user_data)
+{
+    g_assert (BUS_IS_ENGINE_PROXY (engine));
+
+    g_dbus_proxy_call ((GDBusProxy *)engine,
+                       "OpenDirectChannel",
+                       NULL,
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1,
+                       cancellable,
                        callback,
                        user_data);
 }
 
+gchar *
+bus_engine_proxy_open_direct_channel_finish (BusEngineProxy *engine,
+                                             GAsyncResult   *res,
+                                             GError        **error)
+{
+    g_assert (BUS_IS_ENGINE_PROXY (engine));
+
+    GVariant *value = g_dbus_proxy_call_finish ((GDBusProxy *)engine,
+                                                 res,
+                                                 error);
+    if (value == NULL)
+        return NULL;
+
+    gchar *address = NULL;
+    g_variant_get (value, "(s)", &address);
+    g_variant_unref (value);
+    return address;
+}
+
+GVariant *
+bus_engine_proxy_get_all_key_event_stats (void)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(uuu)}"));
+
+    if (key_event_stats != NULL) {
+        GHashTableIter iter;
+        gpointer key, value;
+        g_hash_table_iter_init (&iter, key_event_stats);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+            KeyEventStats *stats = (KeyEventStats *) value;
+            g_variant_builder_add (&builder, "{s(uuu)}",
+                                   (const gchar *) key,
+                                   stats->timeouts,
+                                   stats->late_replies,
+                                   stats->late_handled);
+        }
+    }
+    return g_variant_builder_end (&builder);
+}
+
+guint
+bus_engine_proxy_get_n_engines (void)
+{
+    return n_engines;
+}
+
 void
 bus_engine_proxy_set_cursor_location (BusEngineProxy *engine,
                                       gint            x,
@@ -1055,6 +1556,29 @@ void bus_engine_proxy_property_hide (BusEngineProxy *engine,
                        NULL);
 }
 
+static void
+bus_engine_proxy_update_surrounding_text_cb (GDBusProxy     *proxy,
+                                             GAsyncResult   *res,
+                                             BusEngineProxy *engine)
+{
+    GError *error = NULL;
+    GVariant *retval = g_dbus_proxy_call_finish (proxy, res, &error);
+
+    if (retval != NULL) {
+        g_variant_unref (retval);
+    }
+    else {
+        /* the engine does not have the text the edit was made from, so
+         * send the whole text next time. */
+        if (engine->surrounding_text) {
+            g_object_unref (engine->surrounding_text);
+            engine->surrounding_text = NULL;
+        }
+        g_error_free (error);
+    }
+    g_object_unref (engine);
+}
+
 void bus_engine_proxy_set_surrounding_text (BusEngineProxy *engine,
                                             IBusText       *text,
                                             guint           cursor_pos,
@@ -1067,13 +1591,45 @@ void bus_engine_proxy_set_surrounding_text (BusEngineProxy *engine,
         g_strcmp0 (text->text, engine->surrounding_text->text) != 0 ||
         cursor_pos != engine->surrounding_cursor_pos ||
         anchor_pos != engine->selection_anchor_pos) {
-        GVariant *variant = ibus_serializable_serialize ((IBusSerializable *)text);
+        gchar *replacement = NULL;
+        guint start = 0;
+        guint end = 0;
+
+        /* send only the edited part if it is smaller than the text */
+        if (engine->surrounding_text_incremental && engine->surrounding_text) {
+            replacement = ibus_text_get_edit (engine->surrounding_text,
+                                              text, &start, &end);
+            if (strlen (replacement) >= strlen (text->text)) {
+                g_free (replacement);
+                replacement = NULL;
+            }
+        }
+
         if (engine->surrounding_text)
             g_object_unref (engine->surrounding_text);
         engine->surrounding_text = (IBusText *) g_object_ref_sink (text);
         engine->surrounding_cursor_pos = cursor_pos;
         engine->selection_anchor_pos = anchor_pos;
 
+        if (replacement != NULL) {
+            g_dbus_proxy_call ((GDBusProxy *)engine,
+                               "UpdateSurroundingText",
+                               g_variant_new ("(uusuu)",
+                                              start,
+                                              end,
+                                              replacement,
+                                              cursor_pos,
+                                              anchor_pos),
+                               G_DBUS_CALL_FLAGS_NONE,
+                               -1,
+                               NULL,
+                               (GAsyncReadyCallback) bus_engine_proxy_update_surrounding_text_cb,
+                               g_object_ref (engine));
+            g_free (replacement);
+            return;
+        }
+
+        GVariant *variant = ibus_serializable_serialize ((IBusSerializable *)text);
         g_dbus_proxy_call ((GDBusProxy *)engine,
                            "SetSurroundingText",
                            g_variant_new ("(vuu)",
@@ -1088,6 +1644,20 @@ void bus_engine_proxy_set_surrounding_text (BusEngineProxy *engine,
     }
 }
 
+gboolean
+bus_engine_proxy_get_surrounding_text_window (BusEngineProxy *engine,
+                                              guint          *chars_before,
+                                              guint          *chars_after)
+{
+    g_assert (BUS_IS_ENGINE_PROXY (engine));
+
+    if (!engine->surrounding_text_incremental)
+        return FALSE;
+    *chars_before = engine->surrounding_chars_before;
+    *chars_after = engine->surrounding_chars_after;
+    return TRUE;
+}
+
 /* a macro to generate a function to call a nullary D-Bus method. */
 #define DEFINE_FUNCTION(Name, name)                         \
     void                                                    \
@@ -1203,6 +1773,22 @@ bus_engine_proxy_get_desc (BusEngineProxy *engine)
     return engine->desc;
 }
 
+GVariant *
+bus_engine_proxy_get_key_filter (BusEngineProxy *engine)
+{
+    g_assert (BUS_IS_ENGINE_PROXY (engine));
+
+    return engine->key_filter;
+}
+
+IBusPropList *
+bus_engine_proxy_get_properties (BusEngineProxy *engine)
+{
+    g_assert (BUS_IS_ENGINE_PROXY (engine));
+
+    return engine->prop_list;
+}
+
 gboolean
 bus_engine_proxy_is_enabled (BusEngineProxy *engine)
 {
@@ -81,6 +81,21 @@ BusEngineProxy  *bus_engine_proxy_new_finish        (GAsyncResult          *res,
  */
 IBusEngineDesc  *bus_engine_proxy_get_desc          (BusEngineProxy        *engine);
 
+/**
+ * bus_engine_proxy_get_key_filter:
+ * @returns: The "a(uuu)" key filter published by the engine with the
+ * UpdateKeyFilter signal, or NULL if the engine wants all key events.
+ */
+GVariant        *bus_engine_proxy_get_key_filter    (BusEngineProxy        *engine);
+
+/**
+ * bus_engine_proxy_get_properties:
+ * @returns: The properties last registered by the engine with the
+ * RegisterProperties signal and updated by the UpdateProperty and
+ * UpdatePropertyState signals, or NULL if the engine did not register any.
+ */
+IBusPropList    *bus_engine_proxy_get_properties    (BusEngineProxy        *engine);
+
 /**
  * bus_engine_proxy_process_key_event:
  * @callback: a function to be called when the method invocation is done.
@@ -93,6 +108,58 @@ void             bus_engine_proxy_process_key_event (BusEngineProxy        *engi
                                                      guint                  state,
                                                      GAsyncReadyCallback    callback,
                                                      gpointer               user_data);
+
+/**
+ * bus_engine_proxy_process_key_event_finish:
+ * @returns: A "(b)" GVariant telling if the key is handled, or NULL on error.
+ *
+ * Finish bus_engine_proxy_process_key_event(). When the --key-event-timeout
+ * option is set and the engine does not reply in time, the result is
+ * "not handled", so the client passes the key through.
+ */
+GVariant        *bus_engine_proxy_process_key_event_finish
+                                                    (BusEngineProxy        *engine,
+                                                     GAsyncResult          *res,
+                                                     GError               **error);
+
+/**
+ * bus_engine_proxy_open_direct_channel:
+ *
+ * Call "OpenDirectChannel" method of an engine asynchronously. The engine
+ * starts a private D-Bus server for the client of the input context.
+ */
+void             bus_engine_proxy_open_direct_channel
+                                                    (BusEngineProxy        *engine,
+                                                     GCancellable          *cancellable,
+                                                     GAsyncReadyCallback    callback,
+                                                     gpointer               user_data);
+
+/**
+ * bus_engine_proxy_open_direct_channel_finish:
+ * @returns: The address of the private D-Bus server of the engine, or NULL
+ * on error. The caller has to free it.
+ */
+gchar           *bus_engine_proxy_open_direct_channel_finish
+                                                    (BusEngineProxy        *engine,
+                                                     GAsyncResult          *res,
+                                                     GError               **error);
+
+/**
+ * bus_engine_proxy_get_all_key_event_stats:
+ * @returns: A floating "a{s(uuu)}" GVariant, which maps engine names to the
+ * numbers of key events timed out, late replies and late replies which
+ * handled the key.
+ */
+GVariant        *bus_engine_proxy_get_all_key_event_stats
+                                                    (void);
+
+/**
+ * bus_engine_proxy_get_n_engines:
+ * @returns: The number of the engine proxies alive, i.e. the engines created
+ * in the engine processes.
+ */
+guint            bus_engine_proxy_get_n_engines     (void);
+
 /**
  * bus_engine_proxy_set_cursor_location:
  *
@@ -215,7 +282,9 @@ gboolean         bus_engine_proxy_is_enabled        (BusEngineProxy *engine);
 /**
  * bus_engine_proxy_set_surrounding_text:
  *
- * Call "SetSurroundingText" method of an engine asynchronously.
+ * Call "SetSurroundingText" method of an engine asynchronously, or
+ * "UpdateSurroundingText" with the edited part of the text if the engine
+ * accepts it.
  */
 void             bus_engine_proxy_set_surrounding_text
                                                     (BusEngineProxy *engine,
@@ -223,6 +292,16 @@ void             bus_engine_proxy_set_surrounding_text
                                                      guint           cursor_pos,
                                                      guint           anchor_pos);
 
+/**
+ * bus_engine_proxy_get_surrounding_text_window:
+ * @returns: TRUE if the engine announced the window of surrounding text it
+ * wants. The window is stored in chars_before and chars_after.
+ */
+gboolean         bus_engine_proxy_get_surrounding_text_window
+                                                    (BusEngineProxy *engine,
+                                                     guint          *chars_before,
+                                                     guint          *chars_after);
+
 /**
  * bus_engine_proxy_process_hand_writing_event:
  *
@@ -29,6 +29,10 @@ gchar *g_cache = "auto";
 gboolean g_mempro = FALSE;
 gboolean g_verbose = FALSE;
 gint   g_gdbus_timeout = 5000;
+gint   g_key_event_timeout = 0;
+gint   g_engine_idle_timeout = 0;
+gint   g_focus_change_delay = 0;
+gboolean g_direct_channel = FALSE;
 #ifdef G_THREADS_ENABLED
 gint   g_monitor_timeout = 0;
 #endif
@@ -34,6 +34,10 @@ extern gchar *g_cache;
 extern gboolean g_mempro;
 extern gboolean g_verbose;
 extern gint   g_gdbus_timeout;
+extern gint   g_key_event_timeout;
+extern gint   g_engine_idle_timeout;
+extern gint   g_focus_change_delay;
+extern gboolean g_direct_channel;
 #ifdef G_THREADS_ENABLED
 extern gint   g_monitor_timeout;
 #endif
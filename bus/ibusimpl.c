@@ -35,6 +35,7 @@
 #include "global.h"
 #include "inputcontext.h"
 #include "panelproxy.h"
+#include "recorder.h"
 #include "registry.h"
 #include "server.h"
 #include "types.h"
@@ -53,6 +54,10 @@ struct _BusIBusImpl {
     
     /* a list of engines that are started by a user (without the --ibus command line flag.) */
     GList *register_engine_list;
+    /* a mapping from an engine name to the first engine of the name in register_engine_list. */
+    GHashTable *register_engine_table;
+    /* the serialized register_engine_list, made when it is requested first. */
+    GVariant *register_engines_variant;
 
     /* if TRUE, ibus-daemon uses a keysym translated by the system (i.e. XKB) as-is.
      * otherwise, ibus-daemon itself converts keycode into keysym. */
@@ -65,6 +70,12 @@ struct _BusIBusImpl {
     BusInputContext *focused_context;
     BusPanelProxy   *panel;
 
+    /* the context to be focused when focus_change_id fires, or NULL for the
+     * fake context. focus changes within g_focus_change_delay milliseconds
+     * are coalesced into it. */
+    BusInputContext *pending_focused_context;
+    guint            focus_change_id;
+
     /* a default keymap of ibus-daemon (usually "us") which is used only when use_sys_layout is FALSE. */
     IBusKeymap      *keymap;
 
@@ -124,6 +135,10 @@ static gboolean  ibus_ibus_impl_service_set_property
                                                GError            **error);
 #endif
 static void     bus_ibus_impl_registry_changed  (BusIBusImpl        *ibus);
+static void     bus_ibus_impl_engines_changed   (BusIBusImpl        *ibus,
+                                                 GPtrArray          *added,
+                                                 GPtrArray          *removed,
+                                                 GPtrArray          *updated);
 static void     bus_ibus_impl_global_engine_changed
                                                 (BusIBusImpl        *ibus);
 static void     bus_ibus_impl_set_context_engine_from_desc
@@ -141,6 +156,9 @@ static IBusEngineDesc
 static void     bus_ibus_impl_set_focused_context
                                                 (BusIBusImpl        *ibus,
                                                  BusInputContext    *context);
+static void     bus_ibus_impl_request_focused_context
+                                                (BusIBusImpl        *ibus,
+                                                 BusInputContext    *context);
 /* some callback functions */
 static void     _context_engine_changed_cb      (BusInputContext    *context,
                                                  BusIBusImpl        *ibus);
@@ -196,8 +214,27 @@ static const gchar introspection_xml[] =
     "    <method name='IsGlobalEngineEnabled'>\n"
     "      <arg direction='out' type='b' name='enabled' />\n"
     "    </method>\n"
+    "    <method name='GetEngineKeyEventStats'>\n"
+    "      <arg direction='out' type='a{s(uuu)}' name='stats' />\n"
+    "    </method>\n"
+    "    <method name='GetMemoryStats'>\n"
+    "      <arg direction='out' type='t' name='total' />\n"
+    "      <arg direction='out' type='a(ssu)' name='contexts' />\n"
+    "    </method>\n"
+    "    <method name='Stats'>\n"
+    "      <arg direction='out' type='a{st}' name='counters' />\n"
+    "      <arg direction='out' type='a(sasuut)' name='connections' />\n"
+    "    </method>\n"
+    "    <method name='DumpFlightRecorder'>\n"
+    "      <arg direction='out' type='s' name='path' />\n"
+    "    </method>\n"
     "    <signal name='RegistryChanged'>\n"
     "    </signal>\n"
+    "    <signal name='EnginesChanged'>\n"
+    "      <arg type='as' name='added' />\n"
+    "      <arg type='as' name='removed' />\n"
+    "      <arg type='as' name='updated' />\n"
+    "    </signal>\n"
     "    <signal name='GlobalEngineChanged'>\n"
     "      <arg type='s' name='engine_name' />\n"
     "    </signal>\n"
@@ -326,8 +363,12 @@ bus_ibus_impl_init (BusIBusImpl *ibus)
     bus_input_context_focus_in (ibus->fake_context);
 
     ibus->register_engine_list = NULL;
+    ibus->register_engine_table = g_hash_table_new (g_str_hash, g_str_equal);
+    ibus->register_engines_variant = NULL;
     ibus->contexts = NULL;
     ibus->focused_context = NULL;
+    ibus->pending_focused_context = NULL;
+    ibus->focus_change_id = 0;
     ibus->panel = NULL;
     ibus->registry = bus_registry_new ();
 
@@ -408,6 +449,16 @@ bus_ibus_impl_destroy (BusIBusImpl *ibus)
     g_list_free_full (ibus->register_engine_list, g_object_unref);
     ibus->register_engine_list = NULL;
 
+    if (ibus->register_engine_table != NULL) {
+        g_hash_table_destroy (ibus->register_engine_table);
+        ibus->register_engine_table = NULL;
+    }
+
+    if (ibus->register_engines_variant != NULL) {
+        g_variant_unref (ibus->register_engines_variant);
+        ibus->register_engines_variant = NULL;
+    }
+
     if (ibus->factory_dict != NULL) {
         g_hash_table_destroy (ibus->factory_dict);
         ibus->factory_dict = NULL;
@@ -418,6 +469,16 @@ bus_ibus_impl_destroy (BusIBusImpl *ibus)
         ibus->keymap = NULL;
     }
 
+    if (ibus->focus_change_id != 0) {
+        g_source_remove (ibus->focus_change_id);
+        ibus->focus_change_id = 0;
+    }
+
+    if (ibus->pending_focused_context != NULL) {
+        g_object_unref (ibus->pending_focused_context);
+        ibus->pending_focused_context = NULL;
+    }
+
     g_free (ibus->global_engine_name);
     ibus->global_engine_name = NULL;
 
@@ -450,17 +511,8 @@ static IBusEngineDesc *
 _find_engine_desc_by_name (BusIBusImpl *ibus,
                            const gchar *engine_name)
 {
-    IBusEngineDesc *desc = NULL;
-    GList *p;
-
-    /* find engine in registered engine list */
-    for (p = ibus->register_engine_list; p != NULL; p = p->next) {
-        desc = (IBusEngineDesc *) p->data;
-        if (g_strcmp0 (ibus_engine_desc_get_name (desc), engine_name) == 0)
-            return desc;
-    }
-
-    return NULL;
+    return (IBusEngineDesc *) g_hash_table_lookup (ibus->register_engine_table,
+                                                   engine_name);
 }
 
 /**
@@ -569,6 +621,70 @@ bus_ibus_impl_set_focused_context (BusIBusImpl     *ibus,
         g_object_unref (engine);
 }
 
+static gboolean
+_focus_change_timeout_cb (BusIBusImpl *ibus)
+{
+    ibus->focus_change_id = 0;
+
+    BusInputContext *context = ibus->pending_focused_context;
+    ibus->pending_focused_context = NULL;
+
+    bus_ibus_impl_set_focused_context (ibus, context);
+
+    if (context != NULL)
+        g_object_unref (context);
+    return FALSE;
+}
+
+/**
+ * bus_ibus_impl_request_focused_context:
+ *
+ * Set the current focused context, after g_focus_change_delay milliseconds if
+ * the delay is enabled. Window managers and browsers often move the focus
+ * several times in a row, e.g. A -> B -> A. Only the context focused last in
+ * the delay is passed to the panel and gets the global engine, so a burst
+ * ending on the same context costs nothing.
+ */
+static void
+bus_ibus_impl_request_focused_context (BusIBusImpl     *ibus,
+                                       BusInputContext *context)
+{
+    if (g_focus_change_delay <= 0) {
+        bus_ibus_impl_set_focused_context (ibus, context);
+        return;
+    }
+
+    if (ibus->focus_change_id == 0 && ibus->focused_context == context)
+        return;
+
+    if (context != NULL)
+        g_object_ref (context);
+    if (ibus->pending_focused_context != NULL)
+        g_object_unref (ibus->pending_focused_context);
+    ibus->pending_focused_context = context;
+
+    /* The timer is not restarted by later changes, so a stream of focus
+     * changes can not keep the panel and the engine stale for long. */
+    if (ibus->focus_change_id == 0) {
+        ibus->focus_change_id =
+                g_timeout_add (g_focus_change_delay,
+                               (GSourceFunc) _focus_change_timeout_cb,
+                               ibus);
+    }
+}
+
+void
+bus_ibus_impl_flush_focus_change (BusIBusImpl *ibus)
+{
+    g_assert (BUS_IS_IBUS_IMPL (ibus));
+
+    if (ibus->focus_change_id == 0)
+        return;
+
+    g_source_remove (ibus->focus_change_id);
+    _focus_change_timeout_cb (ibus);
+}
+
 static void
 bus_ibus_impl_set_global_engine (BusIBusImpl    *ibus,
                                  BusEngineProxy *engine)
@@ -705,7 +821,7 @@ _context_focus_in_cb (BusInputContext *context,
         return;
     }
 
-    bus_ibus_impl_set_focused_context (ibus, context);
+    bus_ibus_impl_request_focused_context (ibus, context);
 }
 
 /**
@@ -726,8 +842,10 @@ _context_focus_out_cb (BusInputContext    *context,
         return;
     }
 
-    /* Do noting if it is not focused context. */
-    if (ibus->focused_context != context) {
+    /* Do noting if it is not focused context, or not the context to be focused. */
+    if (ibus->focus_change_id != 0 ?
+            ibus->pending_focused_context != context :
+            ibus->focused_context != context) {
         return;
     }
 
@@ -736,7 +854,7 @@ _context_focus_out_cb (BusInputContext    *context,
         /* Do not change the focused context, if use_global_engine option is enabled.
          * If focused context swith to NULL, users can not swith engine in panel anymore.
          **/
-        bus_ibus_impl_set_focused_context (ibus, NULL);
+        bus_ibus_impl_request_focused_context (ibus, NULL);
     }
 }
 
@@ -752,8 +870,16 @@ _context_destroy_cb (BusInputContext    *context,
     g_assert (BUS_IS_IBUS_IMPL (ibus));
     g_assert (BUS_IS_INPUT_CONTEXT (context));
 
+    if (ibus->focus_change_id != 0 && context == ibus->pending_focused_context) {
+        g_object_unref (ibus->pending_focused_context);
+        ibus->pending_focused_context = NULL;
+    }
+
     if (context == ibus->focused_context) {
-        bus_ibus_impl_set_focused_context (ibus, NULL);
+        if (ibus->focus_change_id != 0)
+            bus_ibus_impl_flush_focus_change (ibus);
+        else
+            bus_ibus_impl_set_focused_context (ibus, NULL);
     }
 
     ibus->contexts = g_list_remove (ibus->contexts, context);
@@ -870,16 +996,49 @@ _component_destroy_cb (BusComponent *component,
     ibus->registered_components = g_list_remove (ibus->registered_components, component);
 
     /* remove engines from engine_list */
+    GPtrArray *removed = g_ptr_array_new ();
+    GPtrArray *updated = g_ptr_array_new ();
+    GList *dropped = NULL;
     GList *engines = bus_component_get_engines (component);
     GList *p;
     for (p = engines; p != NULL; p = p->next) {
         if (g_list_find (ibus->register_engine_list, p->data)) {
+            const gchar *name = ibus_engine_desc_get_name ((IBusEngineDesc *) p->data);
             ibus->register_engine_list = g_list_remove (ibus->register_engine_list, p->data);
-            g_object_unref (p->data);
+            dropped = g_list_prepend (dropped, p->data);
+            if (g_hash_table_lookup (ibus->register_engine_table, name) == p->data) {
+                GList *p1;
+                g_hash_table_remove (ibus->register_engine_table, name);
+                for (p1 = ibus->register_engine_list; p1 != NULL; p1 = p1->next) {
+                    const gchar *name1 = ibus_engine_desc_get_name ((IBusEngineDesc *) p1->data);
+                    if (g_strcmp0 (name1, name) == 0) {
+                        g_hash_table_insert (ibus->register_engine_table,
+                                             (gpointer) name1, p1->data);
+                        break;
+                    }
+                }
+            }
+            /* another component may still provide an engine with the name */
+            if (_find_engine_desc_by_name (ibus, name) != NULL)
+                g_ptr_array_add (updated, (gpointer) name);
+            else
+                g_ptr_array_add (removed, (gpointer) name);
         }
     }
     g_list_free (engines);
 
+    if (ibus->register_engines_variant != NULL) {
+        g_variant_unref (ibus->register_engines_variant);
+        ibus->register_engines_variant = NULL;
+    }
+
+    bus_ibus_impl_engines_changed (ibus, NULL, removed, updated);
+    g_ptr_array_free (removed, TRUE);
+    g_ptr_array_free (updated, TRUE);
+
+    /* the names are owned by the dropped engine descs */
+    g_list_free_full (dropped, g_object_unref);
+
     g_object_unref (component);
 
     bus_ibus_impl_check_global_engine (ibus);
@@ -925,11 +1084,34 @@ _ibus_register_component (BusIBusImpl           *ibus,
 
     ibus->registered_components = g_list_append (ibus->registered_components,
                                                 g_object_ref_sink (buscomp));
+    GPtrArray *added = g_ptr_array_new ();
+    GPtrArray *updated = g_ptr_array_new ();
     GList *engines = bus_component_get_engines (buscomp);
+    GList *p;
+    for (p = engines; p != NULL; p = p->next) {
+        const gchar *name = ibus_engine_desc_get_name ((IBusEngineDesc *) p->data);
+        if (_find_engine_desc_by_name (ibus, name) != NULL) {
+            g_ptr_array_add (updated, (gpointer) name);
+        }
+        else {
+            g_ptr_array_add (added, (gpointer) name);
+            g_hash_table_insert (ibus->register_engine_table,
+                                 (gpointer) name, p->data);
+        }
+    }
     g_list_foreach (engines, (GFunc) g_object_ref, NULL);
     ibus->register_engine_list = g_list_concat (ibus->register_engine_list,
                                                engines);
 
+    if (ibus->register_engines_variant != NULL) {
+        g_variant_unref (ibus->register_engines_variant);
+        ibus->register_engines_variant = NULL;
+    }
+
+    bus_ibus_impl_engines_changed (ibus, added, NULL, updated);
+    g_ptr_array_free (added, TRUE);
+    g_ptr_array_free (updated, TRUE);
+
     g_signal_connect (buscomp, "destroy", G_CALLBACK (_component_destroy_cb), ibus);
 
     g_dbus_method_invocation_return_value (invocation, NULL);
@@ -945,16 +1127,9 @@ _ibus_list_engines (BusIBusImpl           *ibus,
                     GVariant              *parameters,
                     GDBusMethodInvocation *invocation)
 {
-    GVariantBuilder builder;
-    g_variant_builder_init (&builder, G_VARIANT_TYPE ("av"));
-
-    GList *engines = bus_registry_get_engines (ibus->registry);
-    GList *p;
-    for (p = engines; p != NULL; p = p->next) {
-        g_variant_builder_add (&builder, "v", ibus_serializable_serialize ((IBusSerializable *) p->data));
-    }
-    g_list_free (engines);
-    g_dbus_method_invocation_return_value (invocation, g_variant_new ("(av)", &builder));
+    GVariant *engines = bus_registry_get_engines_variant (ibus->registry);
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new_tuple (&engines, 1));
 }
 
 /**
@@ -976,15 +1151,20 @@ _ibus_get_engines_by_names (BusIBusImpl           *ibus,
     GVariantBuilder builder;
     g_variant_builder_init (&builder, G_VARIANT_TYPE ("av"));
     while (names[i] != NULL) {
-        IBusEngineDesc *desc = bus_registry_find_engine_by_name (
-                ibus->registry, names[i++]);
-        if (desc == NULL)
+        GVariant *variant = bus_registry_get_engine_variant (
+                ibus->registry, names[i]);
+        /* engines of registered components are not in the registry */
+        if (variant == NULL) {
+            IBusEngineDesc *desc = _find_engine_desc_by_name (ibus, names[i]);
+            if (desc != NULL)
+                variant = ibus_serializable_serialize ((IBusSerializable *)desc);
+        }
+        i++;
+        if (variant == NULL)
             continue;
-        g_variant_builder_add (
-                &builder,
-                "v",
-                ibus_serializable_serialize ((IBusSerializable *)desc));
+        g_variant_builder_add (&builder, "v", variant);
     }
+    g_free (names);
     g_dbus_method_invocation_return_value (invocation, g_variant_new ("(av)", &builder));
 }
 
@@ -998,14 +1178,19 @@ _ibus_list_active_engines (BusIBusImpl           *ibus,
                            GVariant              *parameters,
                            GDBusMethodInvocation *invocation)
 {
-    GVariantBuilder builder;
-    g_variant_builder_init (&builder, G_VARIANT_TYPE ("av"));
+    if (ibus->register_engines_variant == NULL) {
+        GVariantBuilder builder;
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("av"));
 
-    GList *p;
-    for (p = ibus->register_engine_list; p != NULL; p = p->next) {
-        g_variant_builder_add (&builder, "v", ibus_serializable_serialize ((IBusSerializable *) p->data));
+        GList *p;
+        for (p = ibus->register_engine_list; p != NULL; p = p->next) {
+            g_variant_builder_add (&builder, "v", ibus_serializable_serialize ((IBusSerializable *) p->data));
+        }
+        ibus->register_engines_variant = g_variant_builder_end (&builder);
+        g_variant_ref_sink (ibus->register_engines_variant);
     }
-    g_dbus_method_invocation_return_value (invocation, g_variant_new ("(av)", &builder));
+    g_dbus_method_invocation_return_value (invocation,
+            g_variant_new_tuple (&ibus->register_engines_variant, 1));
 }
 
 /**
@@ -1227,6 +1412,110 @@ _ibus_is_global_engine_enabled (BusIBusImpl           *ibus,
                     g_variant_new ("(b)", enabled));
 }
 
+/**
+ * _ibus_get_engine_key_event_stats:
+ *
+ * Implement the "GetEngineKeyEventStats" method call of the org.freedesktop.IBus interface.
+ * It returns the numbers of timed out key events, late replies and late replies
+ * which handled the key for each engine, see the --key-event-timeout option.
+ */
+static void
+_ibus_get_engine_key_event_stats (BusIBusImpl           *ibus,
+                                  GVariant              *parameters,
+                                  GDBusMethodInvocation *invocation)
+{
+    GVariant *stats = bus_engine_proxy_get_all_key_event_stats ();
+    g_dbus_method_invocation_return_value (invocation,
+                    g_variant_new_tuple (&stats, 1));
+}
+
+/**
+ * _ibus_get_memory_stats:
+ *
+ * Implement the "GetMemoryStats" method call of the org.freedesktop.IBus interface.
+ * It returns the total bytes used by the input contexts, and the object path, client name
+ * and bytes of each of them.
+ */
+static void
+_ibus_get_memory_stats (BusIBusImpl           *ibus,
+                        GVariant              *parameters,
+                        GDBusMethodInvocation *invocation)
+{
+    GVariantBuilder builder;
+    guint64 total = 0;
+    GList *p;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssu)"));
+    for (p = ibus->contexts; p != NULL; p = p->next) {
+        BusInputContext *context = (BusInputContext *) p->data;
+        gsize size = bus_input_context_get_memory_size (context);
+        const gchar *client = bus_input_context_get_client (context);
+
+        total += size;
+        g_variant_builder_add (&builder, "(ssu)",
+                               ibus_service_get_object_path ((IBusService *) context),
+                               client != NULL ? client : "",
+                               (guint32) size);
+    }
+
+    g_dbus_method_invocation_return_value (invocation,
+                    g_variant_new ("(ta(ssu))", total, &builder));
+}
+
+/**
+ * _ibus_stats:
+ *
+ * Implement the "Stats" method call of the org.freedesktop.IBus interface.
+ * It returns the counters of the daemon, like the numbers of input contexts, engines and
+ * queued messages, and the numbers of messages and forwarded bytes of each connection.
+ * The message counters only increase, so the caller samples them twice to get the rates.
+ */
+static void
+_ibus_stats (BusIBusImpl           *ibus,
+             GVariant              *parameters,
+             GDBusMethodInvocation *invocation)
+{
+    GVariantBuilder counters;
+
+    g_variant_builder_init (&counters, G_VARIANT_TYPE ("a{st}"));
+    g_variant_builder_add (&counters, "{st}", "contexts",
+                           (guint64) g_list_length (ibus->contexts));
+    g_variant_builder_add (&counters, "{st}", "engines",
+                           (guint64) bus_engine_proxy_get_n_engines ());
+    bus_dbus_impl_get_stats (BUS_DEFAULT_DBUS, &counters);
+
+    g_dbus_method_invocation_return_value (invocation,
+                    g_variant_new ("(a{st}@a(sasuut))",
+                                   &counters,
+                                   bus_dbus_impl_get_connection_stats (BUS_DEFAULT_DBUS)));
+}
+
+/**
+ * _ibus_dump_flight_recorder:
+ *
+ * Implement the "DumpFlightRecorder" method call of the org.freedesktop.IBus interface.
+ * It writes the recent events of the daemon into the default file in the ibus cache directory of the user,
+ * and returns its path. The caller can not choose the file, so the daemon does not overwrite files for other
+ * processes. See bus/recorder.h for the format.
+ */
+static void
+_ibus_dump_flight_recorder (BusIBusImpl           *ibus,
+                            GVariant              *parameters,
+                            GDBusMethodInvocation *invocation)
+{
+    const gchar *written = bus_recorder_dump ();
+    if (written == NULL) {
+        g_dbus_method_invocation_return_error (invocation,
+                        G_DBUS_ERROR,
+                        G_DBUS_ERROR_FAILED,
+                        "Can not write the flight recorder.");
+        return;
+    }
+
+    g_dbus_method_invocation_return_value (invocation,
+                    g_variant_new ("(s)", written));
+}
+
 /**
  * bus_ibus_impl_service_method_call:
  *
@@ -1249,36 +1538,58 @@ bus_ibus_impl_service_method_call (IBusService           *service,
         return;
     }
 
-    /* all methods in the xml definition above should be listed here. */
+    /* all methods in the xml definition above should be listed here. The
+     * methods working on the focused context or the global engine, e.g.
+     * SetGlobalEngine from the panel, apply the pending focus change first,
+     * so they see the last focused context. */
     static const struct {
         const gchar *method_name;
         void (* method_callback) (BusIBusImpl *, GVariant *, GDBusMethodInvocation *);
+        gboolean flush_focus_change;
     } methods [] =  {
         /* IBus interface */
-        { "GetAddress",            _ibus_get_address },
-        { "CreateInputContext",    _ibus_create_input_context },
-        { "CurrentInputContext",   _ibus_current_input_context },
-        { "RegisterComponent",     _ibus_register_component },
-        { "ListEngines",           _ibus_list_engines },
-        { "GetEnginesByNames",     _ibus_get_engines_by_names },
-        { "ListActiveEngines",     _ibus_list_active_engines },
-        { "Exit",                  _ibus_exit },
-        { "Ping",                  _ibus_ping },
-        { "GetUseSysLayout",       _ibus_get_use_sys_layout },
-        { "GetUseGlobalEngine",    _ibus_get_use_global_engine },
-        { "GetGlobalEngine",       _ibus_get_global_engine },
-        { "SetGlobalEngine",       _ibus_set_global_engine },
-        { "IsGlobalEngineEnabled", _ibus_is_global_engine_enabled },
+        { "GetAddress",            _ibus_get_address,              FALSE },
+        { "CreateInputContext",    _ibus_create_input_context,     FALSE },
+        { "CurrentInputContext",   _ibus_current_input_context,    TRUE },
+        { "RegisterComponent",     _ibus_register_component,       TRUE },
+        { "ListEngines",           _ibus_list_engines,             FALSE },
+        { "GetEnginesByNames",     _ibus_get_engines_by_names,     FALSE },
+        { "ListActiveEngines",     _ibus_list_active_engines,      FALSE },
+        { "Exit",                  _ibus_exit,                     FALSE },
+        { "Ping",                  _ibus_ping,                     FALSE },
+        { "GetUseSysLayout",       _ibus_get_use_sys_layout,       FALSE },
+        { "GetUseGlobalEngine",    _ibus_get_use_global_engine,    FALSE },
+        { "GetGlobalEngine",       _ibus_get_global_engine,        TRUE },
+        { "SetGlobalEngine",       _ibus_set_global_engine,        TRUE },
+        { "IsGlobalEngineEnabled", _ibus_is_global_engine_enabled, TRUE },
+        { "GetEngineKeyEventStats", _ibus_get_engine_key_event_stats,
+                                                                   FALSE },
+        { "GetMemoryStats",        _ibus_get_memory_stats,         FALSE },
+        { "Stats",                 _ibus_stats,                    FALSE },
+        { "DumpFlightRecorder",    _ibus_dump_flight_recorder,     FALSE },
     };
 
+    /* A map from a method name to its index + 1 in methods. */
+    static GHashTable *methods_table = NULL;
+
     gint i;
-    for (i = 0; i < G_N_ELEMENTS (methods); i++) {
-        if (g_strcmp0 (methods[i].method_name, method_name) == 0) {
-            methods[i].method_callback ((BusIBusImpl *) service, parameters, invocation);
-            return;
+    if (methods_table == NULL) {
+        methods_table = g_hash_table_new (g_str_hash, g_str_equal);
+        for (i = 0; i < G_N_ELEMENTS (methods); i++) {
+            g_hash_table_insert (methods_table,
+                                 (gpointer) methods[i].method_name,
+                                 GINT_TO_POINTER (i + 1));
         }
     }
 
+    i = GPOINTER_TO_INT (g_hash_table_lookup (methods_table, method_name)) - 1;
+    if (i >= 0) {
+        if (methods[i].flush_focus_change)
+            bus_ibus_impl_flush_focus_change ((BusIBusImpl *) service);
+        methods[i].method_callback ((BusIBusImpl *) service, parameters, invocation);
+        return;
+    }
+
     /* notreached - unknown method calls that are not in the introspection_xml should be handled by the GDBus library. */
     g_return_if_reached ();
 }
@@ -1355,6 +1666,50 @@ bus_ibus_impl_registry_changed (BusIBusImpl *ibus)
     bus_ibus_impl_emit_signal (ibus, "RegistryChanged", NULL);
 }
 
+/**
+ * bus_ibus_impl_engines_changed:
+ * @added: (allow-none): names of the engines which are newly available.
+ * @removed: (allow-none): names of the engines which are not available anymore.
+ * @updated: (allow-none): names of the engines whose descriptions changed.
+ *
+ * Emit the EnginesChanged signal, so clients caching the engine
+ * descriptions only need to refetch the engines with the given names.
+ */
+static void
+bus_ibus_impl_engines_changed (BusIBusImpl *ibus,
+                               GPtrArray   *added,
+                               GPtrArray   *removed,
+                               GPtrArray   *updated)
+{
+    GPtrArray *arrays[] = { added, removed, updated };
+    GVariantBuilder builders[3];
+    gboolean changed = FALSE;
+    guint i, j;
+
+    for (i = 0; i < G_N_ELEMENTS (arrays); i++) {
+        g_variant_builder_init (&builders[i], G_VARIANT_TYPE ("as"));
+        if (arrays[i] == NULL)
+            continue;
+        for (j = 0; j < arrays[i]->len; j++) {
+            g_variant_builder_add (&builders[i], "s",
+                                   g_ptr_array_index (arrays[i], j));
+            changed = TRUE;
+        }
+    }
+
+    if (!changed) {
+        for (i = 0; i < G_N_ELEMENTS (arrays); i++)
+            g_variant_builder_clear (&builders[i]);
+        return;
+    }
+
+    bus_ibus_impl_emit_signal (ibus, "EnginesChanged",
+                               g_variant_new ("(asasas)",
+                                              &builders[0],
+                                              &builders[1],
+                                              &builders[2]));
+}
+
 static void
 bus_ibus_impl_global_engine_changed (BusIBusImpl *ibus)
 {
@@ -1384,5 +1739,6 @@ bus_ibus_impl_get_focused_input_context (BusIBusImpl *ibus)
 {
     g_assert (BUS_IS_IBUS_IMPL (ibus));
 
+    bus_ibus_impl_flush_focus_change (ibus);
     return ibus->focused_context;
 }
@@ -82,5 +82,14 @@ gboolean         bus_ibus_impl_is_embed_preedit_text
 BusInputContext *bus_ibus_impl_get_focused_input_context
                                                     (BusIBusImpl        *ibus);
 
+/**
+ * bus_ibus_impl_flush_focus_change:
+ *
+ * Apply the focus change delayed by g_focus_change_delay now, if there is
+ * one, so the global engine is attached to the last focused context. It is
+ * called before a key event is routed to an engine.
+ */
+void             bus_ibus_impl_flush_focus_change   (BusIBusImpl        *ibus);
+
 G_END_DECLS
 #endif
@@ -28,6 +28,7 @@
 #include "global.h"
 #include "ibusimpl.h"
 #include "marshalers.h"
+#include "recorder.h"
 #include "types.h"
 
 struct _SetEngineByDescData {
@@ -41,6 +42,8 @@ struct _SetEngineByDescData {
      * we cancel the cancellable above as well. */
     GCancellable *origin_cancellable;
     gulong cancelled_handler_id;
+    /* TRUE if the engine detached from the idle context is created again */
+    gboolean reattach;
 };
 typedef struct _SetEngineByDescData SetEngineByDescData;
 
@@ -51,8 +54,8 @@ struct _BusInputContext {
     BusConnection *connection;
     BusEngineProxy *engine;
     gchar *client;
-
-    gboolean has_focus;
+    /* the number in the object path, used in the flight recorder */
+    guint id;
 
     /* client capabilities */
     guint capabilities;
@@ -67,28 +70,71 @@ struct _BusInputContext {
     guint prev_keyval;
     guint prev_modifiers;
 
+    /* the number of key events waiting for the reply of the engine */
+    guint pending_key_events;
+
     /* preedit text */
     IBusText *preedit_text;
     guint     preedit_cursor_pos;
-    gboolean  preedit_visible;
     guint     preedit_mode;
 
-    /* auxiliary text */
+    /* auxiliary text and lookup table, which are kept only if the panel
+     * shows them, otherwise they are the shared empty ones */
     IBusText *auxiliary_text;
-    gboolean  auxiliary_visible;
-
-    /* lookup table */
     IBusLookupTable *lookup_table;
-    gboolean lookup_table_visible;
 
-    /* filter release */
-    gboolean filter_release;
+    /* the surrounding text last sent by the client, which its
+     * "UpdateSurroundingText" edits apply to */
+    IBusText *surrounding_text;
+    guint     surrounding_cursor_pos;
+    guint     selection_anchor_pos;
+    /* TRUE after an edit could not be applied, until the client sends the
+     * whole text again */
+    gboolean  surrounding_text_stale;
 
-    /* is fake context */
-    gboolean fake;
+    /* increased when the direct channel is closed, to drop a pending
+     * OpenDirectChannel request */
+    guint direct_channel_serial;
 
     /* incompleted set engine by desc request */
     SetEngineByDescData *data;
+
+    /* the timer to detach the engine of a context without IBUS_CAP_FOCUS,
+     * when the client has not called any method for g_engine_idle_timeout
+     * seconds */
+    guint engine_idle_id;
+    /* the desc of the detached engine, which is created again on the next
+     * key event */
+    IBusEngineDesc *idle_engine_desc;
+    /* the key events received while the detached engine is created again,
+     * or NULL */
+    GQueue *reattach_key_events;
+
+    guint has_focus : 1;
+    guint preedit_visible : 1;
+    guint auxiliary_visible : 1;
+    guint lookup_table_visible : 1;
+
+    /* is fake context */
+    guint fake : 1;
+
+    /* TRUE if a key filter of the engine is sent to the client */
+    guint key_filter_published : 1;
+
+    /* TRUE if the surrounding text window of the engine is sent to the
+     * client */
+    guint surrounding_window_published : 1;
+
+    /* TRUE if the address of the direct channel is sent to the client, but
+     * the engine has not confirmed the connection yet */
+    guint direct_channel_requested : 1;
+
+    /* TRUE if the client talks to the engine through a direct channel */
+    guint direct_channel : 1;
+
+    /* TRUE if the client called a method since the last check of
+     * engine_idle_id */
+    guint engine_active : 1;
 };
 
 struct _BusInputContextClass {
@@ -118,6 +164,7 @@ enum {
     CURSOR_DOWN_LOOKUP_TABLE,
     REGISTER_PROPERTIES,
     UPDATE_PROPERTY,
+    UPDATE_PROPERTY_STATE,
     ENGINE_CHANGED,
     REQUEST_ENGINE,
     LAST_SIGNAL,
@@ -143,6 +190,18 @@ static void     bus_input_context_service_method_call
                                                  GVariant               *parameters,
                                                  GDBusMethodInvocation  *invocation);
 static void     bus_input_context_unset_engine  (BusInputContext        *context);
+static void     bus_input_context_clear_idle_engine
+                                                (BusInputContext        *context);
+static gboolean _ic_engine_idle_timeout_cb      (BusInputContext        *context);
+static void     bus_input_context_start_engine_idle_timer
+                                                (BusInputContext        *context);
+static void     bus_input_context_reattach_idle_engine
+                                                (BusInputContext        *context);
+static void     bus_input_context_process_reattach_key_events
+                                                (BusInputContext        *context);
+static void     bus_input_context_drop_reattach_key_events
+                                                (BusInputContext        *context);
+static void     cancel_set_engine_by_desc       (SetEngineByDescData    *data);
 static void     bus_input_context_commit_text   (BusInputContext        *context,
                                                  IBusText               *text);
 static void     bus_input_context_update_preedit_text
@@ -185,6 +244,12 @@ static void     bus_input_context_register_properties
 static void     bus_input_context_update_property
                                                 (BusInputContext        *context,
                                                  IBusProperty           *prop);
+static void     bus_input_context_update_property_state
+                                                (BusInputContext        *context,
+                                                 const gchar            *key,
+                                                 guint                   state,
+                                                 gboolean                visible,
+                                                 gboolean                sensitive);
 static void     _engine_destroy_cb              (BusEngineProxy         *factory,
                                                  BusInputContext        *context);
 
@@ -192,6 +257,9 @@ static IBusText *text_empty = NULL;
 static IBusLookupTable *lookup_table_empty = NULL;
 static IBusPropList    *props_empty = NULL;
 
+/* The number of the engines detached from the idle contexts. */
+static guint n_idle_engines = 0;
+
 /* The interfaces available in this class, which consists of a list of methods this class implements and
  * a list of signals this class may emit. Method calls to the interface that are not defined in this XML
  * will be automatically rejected by the GDBus library (see src/ibusservice.c for details.) */
@@ -205,6 +273,11 @@ static const gchar introspection_xml[] =
     "      <arg direction='in'  type='u' name='state' />"
     "      <arg direction='out' type='b' name='handled' />"
     "    </method>"
+    "    <method name='OpenDirectChannel'>"
+    "      <arg direction='out' type='s' name='address' />"
+    "      <arg direction='out' type='o' name='path' />"
+    "    </method>"
+    "    <method name='CloseDirectChannel' />"
     "    <method name='SetCursorLocation'>"
     "      <arg direction='in' type='i' name='x' />"
     "      <arg direction='in' type='i' name='y' />"
@@ -238,11 +311,22 @@ static const gchar introspection_xml[] =
     "      <arg direction='in' type='u' name='cursor_pos' />"
     "      <arg direction='in' type='u' name='anchor_pos' />"
     "    </method>"
+    "    <method name='UpdateSurroundingText'>"
+    "      <arg direction='in' type='u' name='start' />"
+    "      <arg direction='in' type='u' name='end' />"
+    "      <arg direction='in' type='s' name='text' />"
+    "      <arg direction='in' type='u' name='cursor_pos' />"
+    "      <arg direction='in' type='u' name='anchor_pos' />"
+    "    </method>"
 
     /* signals */
     "    <signal name='CommitText'>"
     "      <arg type='v' name='text' />"
     "    </signal>"
+    "    <signal name='SurroundingTextWindow'>"
+    "      <arg type='u' name='chars_before' />"
+    "      <arg type='u' name='chars_after' />"
+    "    </signal>"
     "    <signal name='ForwardKeyEvent'>"
     "      <arg type='u' name='keyval' />"
     "      <arg type='u' name='keycode' />"
@@ -277,6 +361,16 @@ static const gchar introspection_xml[] =
     "    <signal name='UpdateProperty'>"
     "      <arg type='v' name='prop' />"
     "    </signal>"
+    "    <signal name='UpdatePropertyState'>"
+    "      <arg type='s' name='key' />"
+    "      <arg type='u' name='state' />"
+    "      <arg type='b' name='visible' />"
+    "      <arg type='b' name='sensitive' />"
+    "    </signal>"
+    "    <signal name='UpdateKeyFilter'>"
+    "      <arg type='a(uuu)' name='ranges' />"
+    "    </signal>"
+    "    <signal name='DirectChannelClosed'/>"
     "  </interface>"
     "</node>";
 
@@ -519,6 +613,20 @@ bus_input_context_class_init (BusInputContextClass *class)
             1,
             IBUS_TYPE_PROPERTY);
 
+    context_signals[UPDATE_PROPERTY_STATE] =
+        g_signal_new (I_("update-property-state"),
+            G_TYPE_FROM_CLASS (class),
+            G_SIGNAL_RUN_LAST,
+            0,
+            NULL, NULL,
+            bus_marshal_VOID__STRING_UINT_BOOLEAN_BOOLEAN,
+            G_TYPE_NONE,
+            4,
+            G_TYPE_STRING,
+            G_TYPE_UINT,
+            G_TYPE_BOOLEAN,
+            G_TYPE_BOOLEAN);
+
     context_signals[ENGINE_CHANGED] =
         g_signal_new (I_("engine-changed"),
             G_TYPE_FROM_CLASS (class),
@@ -556,6 +664,8 @@ bus_input_context_init (BusInputContext *context)
     context->prev_keyval = IBUS_KEY_VoidSymbol;
     g_object_ref_sink (text_empty);
     context->preedit_text = text_empty;
+    g_object_ref_sink (text_empty);
+    context->surrounding_text = text_empty;
     context->preedit_mode = IBUS_ENGINE_PREEDIT_CLEAR;
     g_object_ref_sink (text_empty);
     context->auxiliary_text = text_empty;
@@ -572,6 +682,19 @@ bus_input_context_destroy (BusInputContext *context)
         context->has_focus = FALSE;
     }
 
+    if (context->engine_idle_id != 0) {
+        g_source_remove (context->engine_idle_id);
+        context->engine_idle_id = 0;
+    }
+
+    /* The engine being created must not be set to the destroyed context. */
+    if (context->data != NULL) {
+        cancel_set_engine_by_desc (context->data);
+    }
+    bus_input_context_drop_reattach_key_events (context);
+
+    bus_input_context_clear_idle_engine (context);
+
     if (context->engine) {
         bus_input_context_unset_engine (context);
     }
@@ -586,6 +709,11 @@ bus_input_context_destroy (BusInputContext *context)
         context->auxiliary_text = NULL;
     }
 
+    if (context->surrounding_text) {
+        g_object_unref (context->surrounding_text);
+        context->surrounding_text = NULL;
+    }
+
     if (context->lookup_table) {
         g_object_unref (context->lookup_table);
         context->lookup_table = NULL;
@@ -638,6 +766,19 @@ bus_input_context_emit_signal (BusInputContext *context,
     return retval;
 }
 
+typedef struct {
+    BusInputContext *context;
+    GDBusMethodInvocation *invocation;
+    guint keyval;
+    guint modifiers;
+    guint64 start;
+} ProcessKeyEventData;
+
+typedef struct {
+    GVariant *parameters;
+    GDBusMethodInvocation *invocation;
+} QueuedKeyEvent;
+
 /**
  * _ic_process_key_event_reply_cb:
  *
@@ -646,20 +787,32 @@ bus_input_context_emit_signal (BusInputContext *context,
 static void
 _ic_process_key_event_reply_cb (GObject               *source,
                                 GAsyncResult          *res,
-                                GDBusMethodInvocation *invocation)
+                                ProcessKeyEventData   *data)
 {
+    BusInputContext *context = data->context;
     GError *error = NULL;
-    GVariant *value = g_dbus_proxy_call_finish ((GDBusProxy *)source,
-                                                 res,
-                                                 &error);
+    GVariant *value = bus_engine_proxy_process_key_event_finish ((BusEngineProxy *)source,
+                                                                 res,
+                                                                 &error);
     if (value != NULL) {
-        g_dbus_method_invocation_return_value (invocation, value);
+        g_dbus_method_invocation_return_value (data->invocation, value);
         g_variant_unref (value);
     }
     else {
-        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_dbus_method_invocation_return_gerror (data->invocation, error);
         g_error_free (error);
     }
+
+    bus_recorder_record (BUS_RECORD_KEY_REPLY,
+                         context->id,
+                         data->keyval,
+                         data->modifiers,
+                         (guint) (bus_recorder_get_time () - data->start),
+                         context->pending_key_events);
+    context->pending_key_events--;
+
+    g_object_unref (context);
+    g_slice_free (ProcessKeyEventData, data);
 }
 
 /**
@@ -688,14 +841,51 @@ _ic_process_key_event  (BusInputContext       *context,
         }
     }
 
+    /* the global engine may not be moved to the context yet, if the focus
+     * changed just before the key event. */
+    if (context->has_focus && (context->capabilities & IBUS_CAP_FOCUS))
+        bus_ibus_impl_flush_focus_change (BUS_DEFAULT_IBUS);
+
+    /* The engine detached from the idle context is created again, and the
+     * key events are processed in order when it is set. */
+    if (context->reattach_key_events == NULL &&
+        context->engine == NULL &&
+        context->idle_engine_desc != NULL &&
+        context->data == NULL &&
+        context->fake == FALSE) {
+        bus_input_context_reattach_idle_engine (context);
+    }
+    if (context->reattach_key_events != NULL) {
+        QueuedKeyEvent *event = g_slice_new (QueuedKeyEvent);
+        event->parameters = g_variant_ref (parameters);
+        event->invocation = invocation;
+        g_queue_push_tail (context->reattach_key_events, event);
+        return;
+    }
+
     /* ignore key events, if it is a fake input context */
     if (context->has_focus && context->engine && context->fake == FALSE) {
+        ProcessKeyEventData *data = g_slice_new (ProcessKeyEventData);
+        data->context = (BusInputContext *) g_object_ref (context);
+        data->invocation = invocation;
+        data->keyval = keyval;
+        data->modifiers = modifiers;
+        data->start = bus_recorder_get_time ();
+        context->pending_key_events++;
+        /* Record the key event before the engine replies, so a key event
+         * the engine never replies to is in the dump as well. */
+        bus_recorder_record (BUS_RECORD_KEY_EVENT,
+                             context->id,
+                             keyval,
+                             modifiers,
+                             0,
+                             context->pending_key_events);
         bus_engine_proxy_process_key_event (context->engine,
                                             keyval,
                                             keycode,
                                             modifiers,
                                             (GAsyncReadyCallback) _ic_process_key_event_reply_cb,
-                                            invocation);
+                                            data);
     }
     else {
         g_dbus_method_invocation_return_value (invocation, g_variant_new ("(b)", FALSE));
@@ -941,18 +1131,151 @@ _ic_get_engine (BusInputContext       *context,
 {
     IBusEngineDesc *desc = context->engine ?
             bus_engine_proxy_get_desc (context->engine) :
-            BUS_INPUT_CONTEXT_GET_CLASS (context)->default_engine_desc;
+            context->idle_engine_desc;
 
+    if (desc == NULL)
+        desc = BUS_INPUT_CONTEXT_GET_CLASS (context)->default_engine_desc;
 
     g_dbus_method_invocation_return_value (invocation,
             g_variant_new ("(v)", ibus_serializable_serialize ((IBusSerializable *)desc)));
 }
 
+typedef struct {
+    BusInputContext *context;
+    BusEngineProxy *engine;
+    guint serial;
+    GDBusMethodInvocation *invocation;
+} OpenDirectChannelData;
+
 /**
- * bus_input_context_service_method_call:
+ * _ic_open_direct_channel_reply_cb:
  *
- * Handle a D-Bus method call whose destination and interface name are both "org.freedesktop.IBus.InputContext"
+ * A GAsyncReadyCallback function to be called when bus_engine_proxy_open_direct_channel() is finished.
+ */
+static void
+_ic_open_direct_channel_reply_cb (GObject               *source,
+                                  GAsyncResult          *res,
+                                  OpenDirectChannelData *data)
+{
+    GError *error = NULL;
+    gchar *address = bus_engine_proxy_open_direct_channel_finish (
+            (BusEngineProxy *)source, res, &error);
+
+    if (address == NULL) {
+        g_dbus_method_invocation_return_gerror (data->invocation, error);
+        g_error_free (error);
+    }
+    else if (data->context->engine != data->engine ||
+             data->context->direct_channel_serial != data->serial) {
+        /* the engine is changed or the channel is closed while the engine
+         * was starting its server. */
+        g_dbus_method_invocation_return_error (data->invocation,
+                G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                "Direct channel is closed.");
+    }
+    else {
+        /* the signals are relayed until the engine emits
+         * "DirectChannelConnected". */
+        data->context->direct_channel_requested = TRUE;
+        g_dbus_method_invocation_return_value (data->invocation,
+                g_variant_new ("(so)",
+                               address,
+                               g_dbus_proxy_get_object_path ((GDBusProxy *)data->engine)));
+    }
+
+    g_free (address);
+    g_object_unref (data->context);
+    g_object_unref (data->engine);
+    g_slice_free (OpenDirectChannelData, data);
+}
+
+/**
+ * _ic_open_direct_channel:
+ *
+ * Implement the "OpenDirectChannel" method call of the org.freedesktop.IBus.InputContext interface.
+ * The client gets the address of a private D-Bus server of the current engine,
+ * and sends key events to the engine without going through ibus-daemon.
+ * When the engine confirms the connection of the client, "CommitText",
+ * "ForwardKeyEvent" and "DeleteSurroundingText" of the engine are not relayed
+ * to the client any more. If the client can not connect, it calls
+ * "CloseDirectChannel".
  */
+static void
+_ic_open_direct_channel (BusInputContext       *context,
+                         GVariant              *parameters,
+                         GDBusMethodInvocation *invocation)
+{
+    /* the key events have to be converted with the keymap of the engine in
+     * ibus-daemon, if use_sys_layout is disabled. */
+    if (!g_direct_channel ||
+        context->engine == NULL ||
+        context->fake ||
+        !bus_ibus_impl_is_use_sys_layout (BUS_DEFAULT_IBUS)) {
+        g_dbus_method_invocation_return_error (invocation,
+                G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED,
+                "Direct channel is not available.");
+        return;
+    }
+
+    OpenDirectChannelData *data = g_slice_new (OpenDirectChannelData);
+    data->context = (BusInputContext *) g_object_ref (context);
+    data->engine = (BusEngineProxy *) g_object_ref (context->engine);
+    data->serial = context->direct_channel_serial;
+    data->invocation = invocation;
+    bus_engine_proxy_open_direct_channel (context->engine,
+            NULL,
+            (GAsyncReadyCallback)_ic_open_direct_channel_reply_cb,
+            data);
+}
+
+/**
+ * _ic_close_direct_channel:
+ *
+ * Implement the "CloseDirectChannel" method call of the org.freedesktop.IBus.InputContext interface.
+ * The client stops using the direct channel, so the signals of the engine are relayed again.
+ */
+static void
+_ic_close_direct_channel (BusInputContext       *context,
+                          GVariant              *parameters,
+                          GDBusMethodInvocation *invocation)
+{
+    context->direct_channel = FALSE;
+    context->direct_channel_requested = FALSE;
+    context->direct_channel_serial++;
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+/**
+ * bus_input_context_set_surrounding_text:
+ *
+ * Keep the surrounding text of the client, which the next edits apply to, and pass it to the engine.
+ */
+static void
+bus_input_context_set_surrounding_text (BusInputContext *context,
+                                        IBusText        *text,
+                                        guint            cursor_pos,
+                                        guint            anchor_pos)
+{
+    g_object_ref_sink (text);
+    g_object_unref (context->surrounding_text);
+    context->surrounding_text = text;
+    context->surrounding_cursor_pos = cursor_pos;
+    context->selection_anchor_pos = anchor_pos;
+
+    /* the global engine may not be moved to the context yet, if the focus
+     * changed just before the surrounding text. */
+    if (context->has_focus && (context->capabilities & IBUS_CAP_FOCUS))
+        bus_ibus_impl_flush_focus_change (BUS_DEFAULT_IBUS);
+
+    if ((context->capabilities & IBUS_CAP_SURROUNDING_TEXT) &&
+         context->has_focus && context->engine) {
+        bus_engine_proxy_set_surrounding_text (context->engine,
+                                               text,
+                                               cursor_pos,
+                                               anchor_pos);
+    }
+}
+
 static void
 _ic_set_surrounding_text (BusInputContext       *context,
                           GVariant              *parameters,
@@ -971,20 +1294,75 @@ _ic_set_surrounding_text (BusInputContext       *context,
     text = IBUS_TEXT (ibus_serializable_deserialize (variant));
     g_variant_unref (variant);
 
-    if ((context->capabilities & IBUS_CAP_SURROUNDING_TEXT) &&
-         context->has_focus && context->engine) {
-        bus_engine_proxy_set_surrounding_text (context->engine,
-                                               text,
-                                               cursor_pos,
-                                               anchor_pos);
+    context->surrounding_text_stale = FALSE;
+    bus_input_context_set_surrounding_text (context, text, cursor_pos, anchor_pos);
+
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+/**
+ * _ic_update_surrounding_text:
+ *
+ * Implement the "UpdateSurroundingText" method call of the org.freedesktop.IBus.InputContext interface.
+ * The client sends only the edited part of its surrounding text, which replaces the
+ * characters from start to end of the text it sent last time.
+ */
+static void
+_ic_update_surrounding_text (BusInputContext       *context,
+                             GVariant              *parameters,
+                             GDBusMethodInvocation *invocation)
+{
+    IBusText *text;
+    guint start = 0;
+    guint end = 0;
+    const gchar *replacement = NULL;
+    guint cursor_pos = 0;
+    guint anchor_pos = 0;
+
+    g_variant_get (parameters,
+                   "(uu&suu)",
+                   &start,
+                   &end,
+                   &replacement,
+                   &cursor_pos,
+                   &anchor_pos);
+    /* The edits following a failed one are made from a text ibus-daemon
+     * does not have either, so they are dropped until the whole text is
+     * sent again. */
+    text = NULL;
+    if (!context->surrounding_text_stale) {
+        text = ibus_text_new_from_edit (context->surrounding_text,
+                                        start,
+                                        end,
+                                        replacement);
+    }
+    if (text == NULL) {
+        if (!context->surrounding_text_stale) {
+            context->surrounding_text_stale = TRUE;
+            /* ask the client to send the whole text */
+            bus_input_context_emit_signal (context,
+                                           "RequireSurroundingText",
+                                           NULL,
+                                           NULL);
+        }
+        g_dbus_method_invocation_return_error (invocation,
+                                               G_DBUS_ERROR,
+                                               G_DBUS_ERROR_INVALID_ARGS,
+                                               "Invalid surrounding text range %u-%u",
+                                               start, end);
+        return;
     }
 
-    if (g_object_is_floating (text))
-        g_object_unref (text);
+    bus_input_context_set_surrounding_text (context, text, cursor_pos, anchor_pos);
 
     g_dbus_method_invocation_return_value (invocation, NULL);
 }
 
+/**
+ * bus_input_context_service_method_call:
+ *
+ * Handle a D-Bus method call whose destination and interface name are both "org.freedesktop.IBus.InputContext"
+ */
 static void
 bus_input_context_service_method_call (IBusService            *service,
                                        GDBusConnection        *connection,
@@ -1025,16 +1403,33 @@ bus_input_context_service_method_call (IBusService            *service,
         { "SetEngine",         _ic_set_engine },
         { "GetEngine",         _ic_get_engine },
         { "SetSurroundingText", _ic_set_surrounding_text},
+        { "UpdateSurroundingText",
+                               _ic_update_surrounding_text },
+        { "OpenDirectChannel", _ic_open_direct_channel },
+        { "CloseDirectChannel", _ic_close_direct_channel },
     };
 
+    /* A map from a method name to its index + 1 in methods. */
+    static GHashTable *methods_table = NULL;
+
     gint i;
-    for (i = 0; i < G_N_ELEMENTS (methods); i++) {
-        if (g_strcmp0 (method_name, methods[i].method_name) == 0) {
-            methods[i].method_callback ((BusInputContext *)service, parameters, invocation);
-            return;
+    if (methods_table == NULL) {
+        methods_table = g_hash_table_new (g_str_hash, g_str_equal);
+        for (i = 0; i < G_N_ELEMENTS (methods); i++) {
+            g_hash_table_insert (methods_table,
+                                 (gpointer) methods[i].method_name,
+                                 GINT_TO_POINTER (i + 1));
         }
     }
 
+    ((BusInputContext *)service)->engine_active = TRUE;
+
+    i = GPOINTER_TO_INT (g_hash_table_lookup (methods_table, method_name)) - 1;
+    if (i >= 0) {
+        methods[i].method_callback ((BusInputContext *)service, parameters, invocation);
+        return;
+    }
+
     g_return_if_reached ();
 }
 
@@ -1046,6 +1441,165 @@ bus_input_context_has_focus (BusInputContext *context)
     return context->has_focus;
 }
 
+/**
+ * bus_input_context_clear_idle_engine:
+ *
+ * Forget the engine detached from the idle context.
+ */
+static void
+bus_input_context_clear_idle_engine (BusInputContext *context)
+{
+    if (context->idle_engine_desc != NULL) {
+        g_object_unref (context->idle_engine_desc);
+        context->idle_engine_desc = NULL;
+        n_idle_engines--;
+    }
+}
+
+/**
+ * _ic_engine_idle_timeout_cb:
+ *
+ * A function to be called every g_engine_idle_timeout seconds while a context without IBUS_CAP_FOCUS has an engine.
+ * If the client has not called any method since the last call, detach the engine, so the engine process can free
+ * it, and remember its desc to create it again on the next key event.
+ */
+static gboolean
+_ic_engine_idle_timeout_cb (BusInputContext *context)
+{
+    IBusEngineDesc *desc;
+
+    /* The engines of the contexts with IBUS_CAP_FOCUS are moved between them
+     * by BusIBusImpl, and the last focused one keeps the global engine. */
+    if (context->engine == NULL ||
+        context->fake ||
+        (context->capabilities & IBUS_CAP_FOCUS) != 0) {
+        context->engine_idle_id = 0;
+        return FALSE;
+    }
+
+    /* The key events sent through the direct channel do not go through
+     * ibus-daemon, so the engine of the channel is never detached. */
+    if (context->engine_active ||
+        context->pending_key_events > 0 ||
+        context->data != NULL ||
+        context->direct_channel ||
+        context->direct_channel_requested) {
+        context->engine_active = FALSE;
+        return TRUE;
+    }
+
+    context->engine_idle_id = 0;
+
+    desc = bus_engine_proxy_get_desc (context->engine);
+    g_object_ref (desc);
+
+    /* The engine proxy is destroyed with the last reference, and it asks
+     * the engine process to destroy the engine. */
+    bus_input_context_unset_engine (context);
+
+    context->idle_engine_desc = desc;
+    n_idle_engines++;
+
+    g_debug ("Detached engine %s from idle input context %s, %u engines detached",
+             ibus_engine_desc_get_name (desc),
+             ibus_service_get_object_path ((IBusService *) context),
+             n_idle_engines);
+    return FALSE;
+}
+
+/**
+ * bus_input_context_start_engine_idle_timer:
+ *
+ * Start checking whether the engine of a context without IBUS_CAP_FOCUS is idle. The contexts without
+ * IBUS_CAP_FOCUS are always focused, so the engine is detached when the client stops calling methods.
+ */
+static void
+bus_input_context_start_engine_idle_timer (BusInputContext *context)
+{
+    if (g_engine_idle_timeout <= 0 ||
+        context->engine_idle_id != 0 ||
+        context->engine == NULL ||
+        context->fake ||
+        (context->capabilities & IBUS_CAP_FOCUS) != 0) {
+        return;
+    }
+
+    context->engine_active = FALSE;
+    context->engine_idle_id =
+            g_timeout_add_seconds (g_engine_idle_timeout,
+                                   (GSourceFunc) _ic_engine_idle_timeout_cb,
+                                   context);
+}
+
+/**
+ * bus_input_context_reattach_idle_engine:
+ *
+ * Create the engine detached by _ic_engine_idle_timeout_cb again. The key events received meanwhile are queued,
+ * and processed by bus_input_context_process_reattach_key_events when the engine is set.
+ */
+static void
+bus_input_context_reattach_idle_engine (BusInputContext *context)
+{
+    g_assert (context->engine == NULL && context->data == NULL);
+
+    context->reattach_key_events = g_queue_new ();
+    bus_input_context_set_engine_by_desc (context,
+                    context->idle_engine_desc,
+                    g_gdbus_timeout, /* timeout in msec. */
+                    NULL, /* we do not cancel the call. */
+                    NULL, /* use the default callback function. */
+                    NULL);
+    context->data->reattach = TRUE;
+}
+
+/**
+ * bus_input_context_process_reattach_key_events:
+ *
+ * Process the key events queued while the detached engine is created again. If the engine could not be created,
+ * they are not handled.
+ */
+static void
+bus_input_context_process_reattach_key_events (BusInputContext *context)
+{
+    GQueue *queue = context->reattach_key_events;
+    QueuedKeyEvent *event;
+
+    if (queue == NULL)
+        return;
+
+    context->reattach_key_events = NULL;
+    while ((event = g_queue_pop_head (queue)) != NULL) {
+        _ic_process_key_event (context, event->parameters, event->invocation);
+        g_variant_unref (event->parameters);
+        g_slice_free (QueuedKeyEvent, event);
+    }
+    g_queue_free (queue);
+}
+
+/**
+ * bus_input_context_drop_reattach_key_events:
+ *
+ * Reply to the key events queued while the detached engine is created again that they are not handled.
+ */
+static void
+bus_input_context_drop_reattach_key_events (BusInputContext *context)
+{
+    GQueue *queue = context->reattach_key_events;
+    QueuedKeyEvent *event;
+
+    if (queue == NULL)
+        return;
+
+    context->reattach_key_events = NULL;
+    while ((event = g_queue_pop_head (queue)) != NULL) {
+        g_dbus_method_invocation_return_value (event->invocation,
+                                               g_variant_new ("(b)", FALSE));
+        g_variant_unref (event->parameters);
+        g_slice_free (QueuedKeyEvent, event);
+    }
+    g_queue_free (queue);
+}
+
 void
 bus_input_context_focus_in (BusInputContext *context)
 {
@@ -1055,6 +1609,8 @@ bus_input_context_focus_in (BusInputContext *context)
         return;
 
     context->has_focus = TRUE;
+    bus_recorder_record (BUS_RECORD_FOCUS_IN, context->id, 0, 0, 0,
+                         context->pending_key_events);
 
     /* To make sure that we won't use an old value left before we losing focus
      * last time. */
@@ -1130,13 +1686,21 @@ bus_input_context_focus_out (BusInputContext *context)
     bus_input_context_clear_preedit_text (context);
     bus_input_context_update_auxiliary_text (context, text_empty, FALSE);
     bus_input_context_update_lookup_table (context, lookup_table_empty, FALSE);
-    bus_input_context_register_properties (context, props_empty);
+    /* The panel clears the properties itself when the focus is not moved to
+     * another context (see bus_panel_proxy_focus_out), so switching between
+     * contexts with the same engine does not make the panel rebuild its
+     * menus. */
+    if (context->capabilities & IBUS_CAP_PROPERTY) {
+        bus_input_context_register_properties (context, props_empty);
+    }
 
     if (context->engine) {
         bus_engine_proxy_focus_out (context->engine);
     }
 
     context->has_focus = FALSE;
+    bus_recorder_record (BUS_RECORD_FOCUS_OUT, context->id, 0, 0, 0,
+                         context->pending_key_events);
 
     if (context->capabilities & IBUS_CAP_FOCUS) {
         g_signal_emit (context, context_signals[FOCUS_OUT], 0);
@@ -1219,17 +1783,24 @@ bus_input_context_update_preedit_text (BusInputContext *context,
 {
     g_assert (BUS_IS_INPUT_CONTEXT (context));
 
+    if (text == NULL)
+        text = text_empty;
+    g_object_ref_sink (text);
+
     if (context->preedit_text) {
         g_object_unref (context->preedit_text);
     }
 
-    context->preedit_text = (IBusText *) g_object_ref_sink (text ? text : text_empty);
+    /* The text is needed again only to commit it on focus out, or by the
+     * panel on the next focus in. */
+    context->preedit_text = (IBusText *) g_object_ref (
+            (mode == IBUS_ENGINE_PREEDIT_COMMIT || !PREEDIT_CONDITION) ? text : text_empty);
     context->preedit_cursor_pos = cursor_pos;
-    context->preedit_visible = visible;
+    context->preedit_visible = (visible != FALSE);
     context->preedit_mode = mode;
 
     if (PREEDIT_CONDITION) {
-        GVariant *variant = ibus_serializable_serialize ((IBusSerializable *)context->preedit_text);
+        GVariant *variant = ibus_serializable_serialize ((IBusSerializable *)text);
         bus_input_context_emit_signal (context,
                                        "UpdatePreeditText",
                                        g_variant_new ("(vub)", variant, context->preedit_cursor_pos, context->preedit_visible),
@@ -1243,6 +1814,8 @@ bus_input_context_update_preedit_text (BusInputContext *context,
                        context->preedit_cursor_pos,
                        context->preedit_visible);
     }
+
+    g_object_unref (text);
 }
 
 /**
@@ -1315,12 +1888,19 @@ bus_input_context_update_auxiliary_text (BusInputContext *context,
 {
     g_assert (BUS_IS_INPUT_CONTEXT (context));
 
+    if (text == NULL)
+        text = text_empty;
+    g_object_ref_sink (text);
+
     if (context->auxiliary_text) {
         g_object_unref (context->auxiliary_text);
     }
 
-    context->auxiliary_text = (IBusText *) g_object_ref_sink (text ? text : text_empty);
-    context->auxiliary_visible = visible;
+    /* Only the panel needs the text again on the next focus in. A client
+     * showing the text itself keeps its own copy. */
+    context->auxiliary_text = (IBusText *) g_object_ref (
+            (context->capabilities & IBUS_CAP_AUXILIARY_TEXT) ? text_empty : text);
+    context->auxiliary_visible = (visible != FALSE);
 
     if (context->capabilities & IBUS_CAP_AUXILIARY_TEXT) {
         GVariant *variant = ibus_serializable_serialize ((IBusSerializable *)text);
@@ -1336,6 +1916,8 @@ bus_input_context_update_auxiliary_text (BusInputContext *context,
                        context->auxiliary_text,
                        context->auxiliary_visible);
     }
+
+    g_object_unref (text);
 }
 
 /**
@@ -1409,12 +1991,19 @@ bus_input_context_update_lookup_table (BusInputContext *context,
 {
     g_assert (BUS_IS_INPUT_CONTEXT (context));
 
+    if (table == NULL)
+        table = lookup_table_empty;
+    g_object_ref_sink (table);
+
     if (context->lookup_table) {
         g_object_unref (context->lookup_table);
     }
 
-    context->lookup_table = (IBusLookupTable *) g_object_ref_sink (table ? table : lookup_table_empty);
-    context->lookup_table_visible = visible;
+    /* Only the panel needs the table again on the next focus in and to move
+     * its cursor. A client showing the table itself keeps its own copy. */
+    context->lookup_table = (IBusLookupTable *) g_object_ref (
+            (context->capabilities & IBUS_CAP_LOOKUP_TABLE) ? lookup_table_empty : table);
+    context->lookup_table_visible = (visible != FALSE);
 
     if (context->capabilities & IBUS_CAP_LOOKUP_TABLE) {
         GVariant *variant = ibus_serializable_serialize ((IBusSerializable *)table);
@@ -1430,6 +2019,8 @@ bus_input_context_update_lookup_table (BusInputContext *context,
                        context->lookup_table,
                        context->lookup_table_visible);
     }
+
+    g_object_unref (table);
 }
 
 /**
@@ -1500,17 +2091,14 @@ bus_input_context_page_up_lookup_table (BusInputContext *context)
 {
     g_assert (BUS_IS_INPUT_CONTEXT (context));
 
-    if (!ibus_lookup_table_page_up (context->lookup_table)) {
-        return;
-    }
-
+    /* The client moves the cursor of its own lookup table. */
     if ((context->capabilities & IBUS_CAP_LOOKUP_TABLE) == IBUS_CAP_LOOKUP_TABLE) {
         bus_input_context_emit_signal (context,
                                        "PageUpLookupTable",
                                        NULL,
                                        NULL);
     }
-    else {
+    else if (ibus_lookup_table_page_up (context->lookup_table)) {
         g_signal_emit (context,
                        context_signals[PAGE_UP_LOOKUP_TABLE],
                        0);
@@ -1527,17 +2115,14 @@ bus_input_context_page_down_lookup_table (BusInputContext *context)
 {
     g_assert (BUS_IS_INPUT_CONTEXT (context));
 
-    if (!ibus_lookup_table_page_down (context->lookup_table)) {
-        return;
-    }
-
+    /* The client moves the cursor of its own lookup table. */
     if ((context->capabilities & IBUS_CAP_LOOKUP_TABLE) == IBUS_CAP_LOOKUP_TABLE) {
         bus_input_context_emit_signal (context,
                                        "PageDownLookupTable",
                                        NULL,
                                        NULL);
     }
-    else {
+    else if (ibus_lookup_table_page_down (context->lookup_table)) {
         g_signal_emit (context,
                        context_signals[PAGE_DOWN_LOOKUP_TABLE],
                        0);
@@ -1554,17 +2139,14 @@ bus_input_context_cursor_up_lookup_table (BusInputContext *context)
 {
     g_assert (BUS_IS_INPUT_CONTEXT (context));
 
-    if (!ibus_lookup_table_cursor_up (context->lookup_table)) {
-        return;
-    }
-
+    /* The client moves the cursor of its own lookup table. */
     if ((context->capabilities & IBUS_CAP_LOOKUP_TABLE) == IBUS_CAP_LOOKUP_TABLE) {
         bus_input_context_emit_signal (context,
                                        "CursorUpLookupTable",
                                        NULL,
                                        NULL);
     }
-    else {
+    else if (ibus_lookup_table_cursor_up (context->lookup_table)) {
         g_signal_emit (context,
                        context_signals[CURSOR_UP_LOOKUP_TABLE],
                        0);
@@ -1581,17 +2163,14 @@ bus_input_context_cursor_down_lookup_table (BusInputContext *context)
 {
     g_assert (BUS_IS_INPUT_CONTEXT (context));
 
-    if (!ibus_lookup_table_cursor_down (context->lookup_table)) {
-        return;
-    }
-
+    /* The client moves the cursor of its own lookup table. */
     if ((context->capabilities & IBUS_CAP_LOOKUP_TABLE) == IBUS_CAP_LOOKUP_TABLE) {
         bus_input_context_emit_signal (context,
                                        "CursorDownLookupTable",
                                        NULL,
                                        NULL);
     }
-    else {
+    else if (ibus_lookup_table_cursor_down (context->lookup_table)) {
         g_signal_emit (context,
                        context_signals[CURSOR_DOWN_LOOKUP_TABLE],
                        0);
@@ -1652,6 +2231,46 @@ bus_input_context_update_property (BusInputContext *context,
     }
 }
 
+/**
+ * bus_input_context_update_property_state:
+ *
+ * Update the state, visibility and sensitivity of a property. Send D-Bus signal to update status of client or send glib signal to the panel, depending on capabilities of the client.
+ * The client is sent the whole property with "UpdateProperty", since a client using an older libibus ignores the
+ * "UpdatePropertyState" signal.
+ */
+static void
+bus_input_context_update_property_state (BusInputContext *context,
+                                         const gchar     *key,
+                                         guint            state,
+                                         gboolean         visible,
+                                         gboolean         sensitive)
+{
+    g_assert (BUS_IS_INPUT_CONTEXT (context));
+    g_assert (key != NULL);
+
+    if (context->capabilities & IBUS_CAP_PROPERTY) {
+        /* The properties of the engine already have the new state. */
+        IBusPropList *props = NULL;
+        IBusProperty *prop = NULL;
+
+        if (context->engine)
+            props = bus_engine_proxy_get_properties (context->engine);
+        if (props)
+            prop = ibus_prop_list_lookup (props, key);
+        if (prop)
+            bus_input_context_update_property (context, prop);
+    }
+    else {
+        g_signal_emit (context,
+                       context_signals[UPDATE_PROPERTY_STATE],
+                       0,
+                       key,
+                       state,
+                       visible,
+                       sensitive);
+    }
+}
+
 /**
  * _engine_destroy_cb:
  *
@@ -1686,6 +2305,10 @@ _engine_commit_text_cb (BusEngineProxy  *engine,
 
     g_assert (context->engine == engine);
 
+    /* the client receives the text from the engine directly. */
+    if (context->direct_channel)
+        return;
+
     bus_input_context_commit_text (context, text);
 }
 
@@ -1706,12 +2329,52 @@ _engine_forward_key_event_cb (BusEngineProxy    *engine,
 
     g_assert (context->engine == engine);
 
+    if (context->direct_channel)
+        return;
+
     bus_input_context_emit_signal (context,
                                    "ForwardKeyEvent",
                                    g_variant_new ("(uuu)", keyval, keycode, state),
                                    NULL);
 }
 
+/**
+ * bus_input_context_update_surrounding_text_window:
+ *
+ * Send the window of surrounding text the engine wants to the client, so
+ * the client sends only that part of its text, and sends the edits of it
+ * with "UpdateSurroundingText". Without an engine, the client is told to
+ * send the whole text again, as old engines expect.
+ */
+static void
+bus_input_context_update_surrounding_text_window (BusInputContext *context)
+{
+    guint chars_before = G_MAXUINT;
+    guint chars_after = G_MAXUINT;
+
+    if (context->engine != NULL) {
+        if (context->surrounding_window_published)
+            return;
+        if (!bus_engine_proxy_get_surrounding_text_window (context->engine,
+                                                           &chars_before,
+                                                           &chars_after))
+            return;
+        context->surrounding_window_published = TRUE;
+    }
+    else {
+        if (!context->surrounding_window_published)
+            return;
+        context->surrounding_window_published = FALSE;
+    }
+
+    bus_input_context_emit_signal (context,
+                                   "SurroundingTextWindow",
+                                   g_variant_new ("(uu)",
+                                                  chars_before,
+                                                  chars_after),
+                                   NULL);
+}
+
 /**
  * _engine_delete_surrounding_text_cb:
  *
@@ -1728,6 +2391,9 @@ _engine_delete_surrounding_text_cb (BusEngineProxy    *engine,
 
     g_assert (context->engine == engine);
 
+    if (context->direct_channel)
+        return;
+
     bus_input_context_emit_signal (context,
                                    "DeleteSurroundingText",
                                    g_variant_new ("(iu)", offset_from_cursor, nchars),
@@ -1752,6 +2418,112 @@ _engine_require_surrounding_text_cb (BusEngineProxy    *engine,
                                    "RequireSurroundingText",
                                    NULL,
                                    NULL);
+    bus_input_context_update_surrounding_text_window (context);
+}
+
+/**
+ * _engine_surrounding_text_window_cb:
+ *
+ * A function to be called when "surrounding-text-window" glib signal is sent to the engine object.
+ */
+static void
+_engine_surrounding_text_window_cb (BusEngineProxy    *engine,
+                                    BusInputContext   *context)
+{
+    g_assert (BUS_IS_ENGINE_PROXY (engine));
+    g_assert (BUS_IS_INPUT_CONTEXT (context));
+
+    g_assert (context->engine == engine);
+
+    context->surrounding_window_published = FALSE;
+    bus_input_context_update_surrounding_text_window (context);
+}
+
+/**
+ * bus_input_context_update_key_filter:
+ *
+ * Send the key filter of the engine to the client, so the client does not
+ * send the key events the engine does not want. The filter is not sent when
+ * use_sys_layout is disabled, because then the key symbols of the client are
+ * converted with the keymap of the engine in bus_engine_proxy_process_key_event().
+ */
+static void
+bus_input_context_update_key_filter (BusInputContext *context)
+{
+    GVariant *key_filter = NULL;
+
+    if (context->engine != NULL &&
+        bus_ibus_impl_is_use_sys_layout (BUS_DEFAULT_IBUS)) {
+        key_filter = bus_engine_proxy_get_key_filter (context->engine);
+    }
+
+    if (key_filter == NULL && !context->key_filter_published)
+        return;
+
+    context->key_filter_published = (key_filter != NULL);
+    if (key_filter == NULL)
+        key_filter = g_variant_new_array (G_VARIANT_TYPE ("(uuu)"), NULL, 0);
+    bus_input_context_emit_signal (context,
+                                   "UpdateKeyFilter",
+                                   g_variant_new_tuple (&key_filter, 1),
+                                   NULL);
+}
+
+/**
+ * _engine_update_key_filter_cb:
+ *
+ * A function to be called when "update-key-filter" glib signal is sent to the engine object.
+ */
+static void
+_engine_update_key_filter_cb (BusEngineProxy  *engine,
+                              BusInputContext *context)
+{
+    g_assert (BUS_IS_ENGINE_PROXY (engine));
+    g_assert (BUS_IS_INPUT_CONTEXT (context));
+
+    g_assert (context->engine == engine);
+
+    bus_input_context_update_key_filter (context);
+}
+
+/**
+ * _engine_direct_channel_connected_cb:
+ *
+ * A function to be called when "direct-channel-connected" glib signal is sent to the engine object.
+ * The client is connected to the engine, so the signals of the engine are not relayed any more.
+ */
+static void
+_engine_direct_channel_connected_cb (BusEngineProxy  *engine,
+                                     BusInputContext *context)
+{
+    g_assert (BUS_IS_ENGINE_PROXY (engine));
+    g_assert (BUS_IS_INPUT_CONTEXT (context));
+
+    g_assert (context->engine == engine);
+
+    /* the client has closed the channel it asked for. */
+    if (!context->direct_channel_requested)
+        return;
+
+    context->direct_channel_requested = FALSE;
+    context->direct_channel = TRUE;
+}
+
+/**
+ * _engine_direct_channel_disconnected_cb:
+ *
+ * A function to be called when "direct-channel-disconnected" glib signal is sent to the engine object.
+ */
+static void
+_engine_direct_channel_disconnected_cb (BusEngineProxy  *engine,
+                                        BusInputContext *context)
+{
+    g_assert (BUS_IS_ENGINE_PROXY (engine));
+    g_assert (BUS_IS_INPUT_CONTEXT (context));
+
+    g_assert (context->engine == engine);
+
+    context->direct_channel = FALSE;
 }
 
 /**
@@ -1854,6 +2626,31 @@ _engine_update_property_cb (BusEngineProxy  *engine,
     bus_input_context_update_property (context, prop);
 }
 
+/**
+ * _engine_update_property_state_cb:
+ *
+ * A function to be called when "update-property-state" glib signal is sent to the engine object.
+ */
+static void
+_engine_update_property_state_cb (BusEngineProxy  *engine,
+                                  const gchar     *key,
+                                  guint            state,
+                                  gboolean         visible,
+                                  gboolean         sensitive,
+                                  BusInputContext *context)
+{
+    g_assert (BUS_IS_ENGINE_PROXY (engine));
+    g_assert (BUS_IS_INPUT_CONTEXT (context));
+
+    g_assert (context->engine == engine);
+
+    bus_input_context_update_property_state (context,
+                                             key,
+                                             state,
+                                             visible,
+                                             sensitive);
+}
+
 #define DEFINE_FUNCTION(name)                                   \
     static void                                                 \
     _engine_##name##_cb (BusEngineProxy   *engine,              \
@@ -1904,6 +2701,7 @@ bus_input_context_new (BusConnection    *connection,
     }
     g_free (path);
 
+    context->id = id;
     context->client = g_strdup (client);
 
     /* it is a fake input context, just need process hotkey */
@@ -1931,11 +2729,14 @@ bus_input_context_enable (BusInputContext *context)
     }
 
     if (context->engine == NULL) {
-        IBusEngineDesc *desc = NULL;
-        g_signal_emit (context,
-                       context_signals[REQUEST_ENGINE], 0,
-                       NULL,
-                       &desc);
+        /* Prefer the engine detached from the idle context. */
+        IBusEngineDesc *desc = context->idle_engine_desc;
+        if (desc == NULL) {
+            g_signal_emit (context,
+                           context_signals[REQUEST_ENGINE], 0,
+                           NULL,
+                           &desc);
+        }
         if (desc != NULL) {
             bus_input_context_set_engine_by_desc (context,
                             desc,
@@ -1980,6 +2781,7 @@ const static struct {
     { "forward-key-event",        G_CALLBACK (_engine_forward_key_event_cb) },
     { "delete-surrounding-text",  G_CALLBACK (_engine_delete_surrounding_text_cb) },
     { "require-surrounding-text", G_CALLBACK (_engine_require_surrounding_text_cb) },
+    { "surrounding-text-window",  G_CALLBACK (_engine_surrounding_text_window_cb) },
     { "update-preedit-text",      G_CALLBACK (_engine_update_preedit_text_cb) },
     { "show-preedit-text",        G_CALLBACK (_engine_show_preedit_text_cb) },
     { "hide-preedit-text",        G_CALLBACK (_engine_hide_preedit_text_cb) },
@@ -1995,6 +2797,11 @@ const static struct {
     { "cursor-down-lookup-table", G_CALLBACK (_engine_cursor_down_lookup_table_cb) },
     { "register-properties",      G_CALLBACK (_engine_register_properties_cb) },
     { "update-property",          G_CALLBACK (_engine_update_property_cb) },
+    { "update-property-state",    G_CALLBACK (_engine_update_property_state_cb) },
+    { "update-key-filter",        G_CALLBACK (_engine_update_key_filter_cb) },
+    { "direct-channel-connected", G_CALLBACK (_engine_direct_channel_connected_cb) },
+    { "direct-channel-disconnected",
+                                  G_CALLBACK (_engine_direct_channel_disconnected_cb) },
     { "destroy",                  G_CALLBACK (_engine_destroy_cb) },
 };
 
@@ -2018,6 +2825,19 @@ bus_input_context_unset_engine (BusInputContext *context)
         g_object_unref (context->engine);
         context->engine = NULL;
     }
+
+    context->direct_channel_serial++;
+    if (context->direct_channel || context->direct_channel_requested) {
+        context->direct_channel = FALSE;
+        context->direct_channel_requested = FALSE;
+        bus_input_context_emit_signal (context,
+                                       "DirectChannelClosed",
+                                       NULL,
+                                       NULL);
+    }
+
+    bus_input_context_update_key_filter (context);
+    bus_input_context_update_surrounding_text_window (context);
 }
 
 void
@@ -2029,6 +2849,9 @@ bus_input_context_set_engine (BusInputContext *context,
     if (context->engine == engine)
         return;
 
+    /* A new engine replaces the detached one. */
+    bus_input_context_clear_idle_engine (context);
+
     if (context->engine != NULL) {
         bus_input_context_unset_engine (context);
     }
@@ -2054,7 +2877,11 @@ bus_input_context_set_engine (BusInputContext *context,
             bus_engine_proxy_set_capabilities (context->engine, context->capabilities);
             bus_engine_proxy_set_cursor_location (context->engine, context->x, context->y, context->w, context->h);
         }
+        bus_input_context_update_key_filter (context);
+        bus_input_context_start_engine_idle_timer (context);
     }
+    bus_recorder_record (BUS_RECORD_ENGINE_CHANGED, context->id, 0, 0, 0,
+                         context->pending_key_events);
     g_signal_emit (context,
                    context_signals[ENGINE_CHANGED],
                    0);
@@ -2111,6 +2938,14 @@ new_engine_cb (GObject             *obj,
                                              G_IO_ERROR_CANCELLED,
                                              "Opertation was cancelled");
         }
+        else if (data->reattach) {
+            /* The client did not switch the engine off, so the engine is
+             * only focused in and enabled by bus_input_context_set_engine,
+             * without a disable and enable. */
+            bus_input_context_set_engine (data->context, engine);
+            g_object_unref (engine);
+            g_simple_async_result_set_op_res_gboolean (data->simple, TRUE);
+        }
         else {
             /* Let BusEngineProxy call a Disable signal. */
             bus_input_context_disable (data->context);
@@ -2121,6 +2956,15 @@ new_engine_cb (GObject             *obj,
         }
     }
 
+    if (data->reattach) {
+        /* The request is cancelled when the context is destroyed or another
+         * engine is set, and then the queued key events are not handled. */
+        if (data->context->data == data)
+            bus_input_context_process_reattach_key_events (data->context);
+        else
+            bus_input_context_drop_reattach_key_events (data->context);
+    }
+
     /* Call the callback function for bus_input_context_set_engine_by_desc(). */
     g_simple_async_result_complete_in_idle (data->simple);
 
@@ -2281,6 +3125,19 @@ bus_input_context_get_engine_desc (BusInputContext *context)
     return NULL;
 }
 
+IBusPropList *
+bus_input_context_get_properties (BusInputContext *context)
+{
+    g_assert (BUS_IS_INPUT_CONTEXT (context));
+
+    IBusPropList *props = NULL;
+
+    /* The client shows the properties itself. */
+    if (context->engine && (context->capabilities & IBUS_CAP_PROPERTY) == 0)
+        props = bus_engine_proxy_get_properties (context->engine);
+    return props != NULL ? props : props_empty;
+}
+
 guint
 bus_input_context_get_capabilities (BusInputContext *context)
 {
@@ -2312,6 +3169,7 @@ bus_input_context_set_capabilities (BusInputContext    *context,
         if (context->engine) {
             bus_engine_proxy_set_capabilities (context->engine, capabilities);
         }
+        bus_input_context_start_engine_idle_timer (context);
     }
 
     context->capabilities = capabilities;
@@ -2324,3 +3182,58 @@ bus_input_context_get_client (BusInputContext *context)
     g_assert (BUS_IS_INPUT_CONTEXT (context));
     return context->client;
 }
+
+/* Return the bytes used by text, or 0 for the shared empty text. */
+static gsize
+_text_get_memory_size (IBusText *text)
+{
+    gsize size;
+
+    if (text == NULL || text == text_empty)
+        return 0;
+
+    size = sizeof (IBusText);
+    if (text->text != NULL && !text->is_static)
+        size += strlen (text->text) + 1;
+    if (text->attrs != NULL) {
+        size += sizeof (IBusAttrList) + sizeof (GArray);
+        size += text->attrs->attributes->len *
+                (sizeof (IBusAttribute *) + sizeof (IBusAttribute));
+    }
+    return size;
+}
+
+gsize
+bus_input_context_get_memory_size (BusInputContext *context)
+{
+    gsize size;
+    guint i;
+
+    g_assert (BUS_IS_INPUT_CONTEXT (context));
+
+    size = sizeof (BusInputContext);
+    if (context->client != NULL)
+        size += strlen (context->client) + 1;
+
+    size += _text_get_memory_size (context->preedit_text);
+    size += _text_get_memory_size (context->auxiliary_text);
+    size += _text_get_memory_size (context->surrounding_text);
+
+    if (context->lookup_table != lookup_table_empty) {
+        IBusLookupTable *table = context->lookup_table;
+        size += sizeof (IBusLookupTable) + 2 * sizeof (GArray);
+        for (i = 0; i < table->candidates->len; i++) {
+            size += sizeof (IBusText *) +
+                    _text_get_memory_size (ibus_lookup_table_get_candidate (table, i));
+        }
+        for (i = 0; i < table->labels->len; i++) {
+            size += sizeof (IBusText *) +
+                    _text_get_memory_size (ibus_lookup_table_get_label (table, i));
+        }
+    }
+
+    if (context->data != NULL)
+        size += sizeof (SetEngineByDescData);
+
+    return size;
+}
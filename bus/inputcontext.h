@@ -179,6 +179,14 @@ BusEngineProxy      *bus_input_context_get_engine       (BusInputContext    *con
  */
 IBusEngineDesc      *bus_input_context_get_engine_desc  (BusInputContext    *context);
 
+/**
+ * bus_input_context_get_properties:
+ *
+ * Get the properties of the current engine to be shown by the panel, or an empty IBusPropList if there is no engine or the client
+ * shows the properties itself.
+ */
+IBusPropList        *bus_input_context_get_properties   (BusInputContext    *context);
+
 /**
  * bus_input_context_property_activate:
  *
@@ -208,5 +216,12 @@ void                 bus_input_context_set_capabilities (BusInputContext    *con
  */
 const gchar         *bus_input_context_get_client       (BusInputContext    *context);
 
+/**
+ * bus_input_context_get_memory_size:
+ * @returns: The bytes used by the context and the preedit text, auxiliary text, lookup table and surrounding text
+ *           it keeps. The shared empty ones are not counted.
+ */
+gsize                bus_input_context_get_memory_size  (BusInputContext    *context);
+
 G_END_DECLS
 #endif
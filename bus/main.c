@@ -20,6 +20,7 @@
  * Boston, MA 02111-1307, USA.
  */
 #include <config.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <glib.h>
 #include <gio/gio.h>
@@ -34,6 +35,7 @@
 
 #include "global.h"
 #include "ibusimpl.h"
+#include "recorder.h"
 #include "server.h"
 
 static gboolean daemonize = FALSE;
@@ -65,9 +67,13 @@ static const GOptionEntry entries[] =
     { "replace",   'r', 0, G_OPTION_ARG_NONE,   &replace,   "if there is an old ibus-daemon is running, it will be replaced.", NULL },
     { "cache",     't', 0, G_OPTION_ARG_STRING, &g_cache,   "specify the cache mode. [auto/refresh/none]", NULL },
     { "timeout",   'o', 0, G_OPTION_ARG_INT,    &g_gdbus_timeout, "gdbus reply timeout in milliseconds. pass -1 to use the default timeout of gdbus.", "timeout [default is 5000]" },
+    { "key-event-timeout", 'k', 0, G_OPTION_ARG_INT, &g_key_event_timeout, "timeout of engines processing a key event in milliseconds. the key is passed through to the application if the engine does not reply in time. 0 to disable it.", "timeout [default is 0]" },
+    { "engine-idle-timeout", 'i', 0, G_OPTION_ARG_INT, &g_engine_idle_timeout, "detach the engine from an input context without focus support, whose client has not called any method for this number of seconds, and create it again on the next key event. 0 to disable it.", "timeout [default is 0]" },
+    { "focus-change-delay", 'f', 0, G_OPTION_ARG_INT, &g_focus_change_delay, "coalesce the focus changes of input contexts within this number of milliseconds, so only the last one is passed to the panel and the global engine. 0 to disable it.", "delay [default is 0]" },
 #ifdef G_THREADS_ENABLED
     { "monitor-timeout", 'j', 0, G_OPTION_ARG_INT,    &g_monitor_timeout, "timeout of poll changes of engines in seconds. 0 to disable it. ", "timeout [default is 0]" },
 #endif
+    { "direct-channel", 'D', 0, G_OPTION_ARG_NONE, &g_direct_channel, "allow clients to send key events to engines through a direct channel.", NULL },
     { "mem-profile", 'm', 0, G_OPTION_ARG_NONE,   &g_mempro,   "enable memory profile, send SIGUSR2 to print out the memory profile.", NULL },
     { "restart",     'R', 0, G_OPTION_ARG_NONE,   &restart,    "restart panel and config processes when they die.", NULL },
     { "verbose",   'v', 0, G_OPTION_ARG_NONE,   &g_verbose,   "verbose.", NULL },
@@ -167,6 +173,22 @@ _sig_usr2_handler (int sig)
     g_mem_profile ();
 }
 
+/*
+ * _sig_usr1_handler:
+ * @sig: the signal number, which is usually SIGUSR1.
+ *
+ * A signal handler for SIGUSR1 signal. Dump the flight recorder into the default file.
+ */
+static void
+_sig_usr1_handler (int sig)
+{
+    /* The interrupted code may check errno after the handler returns. */
+    int saved_errno = errno;
+
+    bus_recorder_dump ();
+    errno = saved_errno;
+}
+
 gint
 main (gint argc, gchar **argv)
 {
@@ -192,6 +214,9 @@ main (gint argc, gchar **argv)
         signal (SIGUSR2, _sig_usr2_handler);
     }
 
+    bus_recorder_init ();
+    signal (SIGUSR1, _sig_usr1_handler);
+
     /* check uid */
     {
         const gchar *username = ibus_get_user_name ();
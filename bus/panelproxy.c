@@ -57,6 +57,19 @@ struct _BusPanelProxy {
 
     /* instance members */
     BusInputContext *focused_context;
+
+    /* the serialized properties the panel is showing, or NULL if they are
+     * unknown because a property was updated after they were sent. */
+    GVariant *prop_list_variant;
+
+    /* TRUE if the panel does not implement "UpdatePropertyState", e.g. it
+     * is written with an older libibus, so whole properties are sent with
+     * "UpdateProperty". */
+    gboolean update_property_state_unsupported;
+
+    /* the idle source clearing the properties after the focused context
+     * lost the focus, unless another context takes the focus first. */
+    guint clear_properties_id;
 };
 
 struct _BusPanelProxyClass {
@@ -232,9 +245,58 @@ bus_panel_proxy_real_destroy (IBusProxy *proxy)
         panel->focused_context = NULL;
     }
 
+    if (panel->clear_properties_id != 0) {
+        g_source_remove (panel->clear_properties_id);
+        panel->clear_properties_id = 0;
+    }
+
+    if (panel->prop_list_variant) {
+        g_variant_unref (panel->prop_list_variant);
+        panel->prop_list_variant = NULL;
+    }
+
     IBUS_PROXY_CLASS(bus_panel_proxy_parent_class)->destroy ((IBusProxy *)panel);
 }
 
+static void
+_panel_candidate_clicked (BusPanelProxy *panel,
+                          GVariant      *parameters)
+{
+    guint index = 0;
+    guint button = 0;
+    guint state = 0;
+    g_variant_get (parameters, "(uuu)", &index, &button, &state);
+    g_signal_emit (panel, panel_signals[CANDIDATE_CLICKED], 0, index, button, state);
+}
+
+static void
+_panel_property_activate (BusPanelProxy *panel,
+                          GVariant      *parameters)
+{
+    gchar *prop_name = NULL;
+    gint prop_state = 0;
+    g_variant_get (parameters, "(&su)", &prop_name, &prop_state);
+    g_signal_emit (panel, panel_signals[PROPERTY_ACTIVATE], 0, prop_name, prop_state);
+}
+
+static void
+_panel_property_show (BusPanelProxy *panel,
+                      GVariant      *parameters)
+{
+    gchar *prop_name = NULL;
+    g_variant_get (parameters, "(&s)", &prop_name);
+    g_signal_emit (panel, panel_signals[PROPERTY_SHOW], 0, prop_name);
+}
+
+static void
+_panel_property_hide (BusPanelProxy *panel,
+                      GVariant      *parameters)
+{
+    gchar *prop_name = NULL;
+    g_variant_get (parameters, "(&s)", &prop_name);
+    g_signal_emit (panel, panel_signals[PROPERTY_HIDE], 0, prop_name);
+}
+
 /**
  * bus_panel_proxy_g_signal:
  *
@@ -248,61 +310,45 @@ bus_panel_proxy_g_signal (GDBusProxy  *proxy,
 {
     BusPanelProxy *panel = (BusPanelProxy *)proxy;
 
-    /* The list of nullary D-Bus signals. */
+    /* The list of D-Bus signals. Nullary signals just emit the glib signal
+     * signal_id, the others are deserialized by signal_callback. */
     static const struct {
         const gchar *signal_name;
         const guint  signal_id;
+        void (* signal_callback) (BusPanelProxy *, GVariant *);
     } signals [] = {
-        { "PageUp",         PAGE_UP },
-        { "PageDown",       PAGE_DOWN },
-        { "CursorUp",       CURSOR_UP },
-        { "CursorDown",     CURSOR_DOWN },
+        { "PageUp",             PAGE_UP,            NULL },
+        { "PageDown",           PAGE_DOWN,          NULL },
+        { "CursorUp",           CURSOR_UP,          NULL },
+        { "CursorDown",         CURSOR_DOWN,        NULL },
+        { "CandidateClicked",   CANDIDATE_CLICKED,  _panel_candidate_clicked },
+        { "PropertyActivate",   PROPERTY_ACTIVATE,  _panel_property_activate },
+        { "PropertyShow",       PROPERTY_SHOW,      _panel_property_show },
+        { "PropertyHide",       PROPERTY_HIDE,      _panel_property_hide },
     };
 
+    /* A map from a signal name to its index + 1 in signals. */
+    static GHashTable *signals_table = NULL;
+
     gint i;
-    for (i = 0; i < G_N_ELEMENTS (signals); i++) {
-        if (g_strcmp0 (signal_name, signals[i].signal_name) == 0) {
-            g_signal_emit (panel, panel_signals[signals[i].signal_id], 0);
-            return;
+    if (signals_table == NULL) {
+        signals_table = g_hash_table_new (g_str_hash, g_str_equal);
+        for (i = 0; i < G_N_ELEMENTS (signals); i++) {
+            g_hash_table_insert (signals_table,
+                                 (gpointer) signals[i].signal_name,
+                                 GINT_TO_POINTER (i + 1));
         }
     }
 
-    /* Handle D-Bus signals with parameters. Deserialize them and emit a glib signal. */
-    if (g_strcmp0 ("CandidateClicked", signal_name) == 0) {
-        guint index = 0;
-        guint button = 0;
-        guint state = 0;
-        g_variant_get (parameters, "(uuu)", &index, &button, &state);
-        g_signal_emit (panel, panel_signals[CANDIDATE_CLICKED], 0, index, button, state);
-        return;
-    }
-
-    if (g_strcmp0 ("PropertyActivate", signal_name) == 0) {
-        gchar *prop_name = NULL;
-        gint prop_state = 0;
-        g_variant_get (parameters, "(&su)", &prop_name, &prop_state);
-        g_signal_emit (panel, panel_signals[PROPERTY_ACTIVATE], 0, prop_name, prop_state);
-        return;
-    }
-
-    if (g_strcmp0 ("PropertyShow", signal_name) == 0) {
-        gchar *prop_name = NULL;
-        g_variant_get (parameters, "(&s)", &prop_name);
-        g_signal_emit (panel, panel_signals[PROPERTY_SHOW], 0, prop_name);
-        return;
-    }
-
-    if (g_strcmp0 ("PropertyHide", signal_name) == 0) {
-        gchar *prop_name = NULL;
-        g_variant_get (parameters, "(&s)", &prop_name);
-        g_signal_emit (panel, panel_signals[PROPERTY_HIDE], 0, prop_name);
-        return;
-    }
-
+    i = GPOINTER_TO_INT (g_hash_table_lookup (signals_table, signal_name)) - 1;
     /* shound not be reached */
-    g_return_if_reached ();
-}
+    g_return_if_fail (i >= 0);
 
+    if (signals[i].signal_callback != NULL)
+        signals[i].signal_callback (panel, parameters);
+    else
+        g_signal_emit (panel, panel_signals[signals[i].signal_id], 0);
+}
 
 void
 bus_panel_proxy_set_cursor_location (BusPanelProxy *panel,
@@ -376,6 +422,21 @@ bus_panel_proxy_register_properties (BusPanelProxy  *panel,
     g_assert (IBUS_IS_PROP_LIST (prop_list));
 
     GVariant *variant = ibus_serializable_serialize ((IBusSerializable *)prop_list);
+    g_variant_ref_sink (variant);
+
+    /* The panel keeps the registered properties, so there is nothing to send
+     * if they are not changed, e.g. when the focus moves between contexts
+     * using the same engine. */
+    if (panel->prop_list_variant != NULL &&
+        g_variant_equal (panel->prop_list_variant, variant)) {
+        g_variant_unref (variant);
+        return;
+    }
+
+    if (panel->prop_list_variant)
+        g_variant_unref (panel->prop_list_variant);
+    panel->prop_list_variant = variant;
+
     g_dbus_proxy_call ((GDBusProxy *)panel,
                        "RegisterProperties",
                        g_variant_new ("(v)", variant),
@@ -383,6 +444,93 @@ bus_panel_proxy_register_properties (BusPanelProxy  *panel,
                        -1, NULL, NULL, NULL);
 }
 
+typedef struct {
+    BusPanelProxy *panel;
+    gchar *key;
+} UpdatePropertyStateData;
+
+/**
+ * bus_panel_proxy_update_property_fallback:
+ *
+ * Send the property of the focused context with the key with "UpdateProperty", for the panels which do not
+ * implement "UpdatePropertyState". The properties of the engine already have the new state.
+ */
+static void
+bus_panel_proxy_update_property_fallback (BusPanelProxy *panel,
+                                          const gchar   *key)
+{
+    IBusProperty *prop;
+
+    if (panel->focused_context == NULL)
+        return;
+
+    prop = ibus_prop_list_lookup (
+            bus_input_context_get_properties (panel->focused_context), key);
+    if (prop != NULL)
+        bus_panel_proxy_update_property (panel, prop);
+}
+
+/**
+ * _update_property_state_reply_cb:
+ *
+ * A GAsyncReadyCallback function to be called when the "UpdatePropertyState" call of the panel is finished.
+ */
+static void
+_update_property_state_reply_cb (GDBusProxy              *proxy,
+                                 GAsyncResult            *res,
+                                 UpdatePropertyStateData *data)
+{
+    GError *error = NULL;
+    GVariant *retval = g_dbus_proxy_call_finish (proxy, res, &error);
+
+    if (retval != NULL) {
+        g_variant_unref (retval);
+    }
+    else {
+        if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD)) {
+            data->panel->update_property_state_unsupported = TRUE;
+            bus_panel_proxy_update_property_fallback (data->panel, data->key);
+        }
+        g_error_free (error);
+    }
+
+    g_object_unref (data->panel);
+    g_free (data->key);
+    g_slice_free (UpdatePropertyStateData, data);
+}
+
+void
+bus_panel_proxy_update_property_state (BusPanelProxy  *panel,
+                                       const gchar    *key,
+                                       guint           state,
+                                       gboolean        visible,
+                                       gboolean        sensitive)
+{
+    g_assert (BUS_IS_PANEL_PROXY (panel));
+    g_assert (key != NULL);
+
+    if (panel->update_property_state_unsupported) {
+        bus_panel_proxy_update_property_fallback (panel, key);
+        return;
+    }
+
+    if (panel->prop_list_variant) {
+        g_variant_unref (panel->prop_list_variant);
+        panel->prop_list_variant = NULL;
+    }
+
+    UpdatePropertyStateData *data = g_slice_new (UpdatePropertyStateData);
+    data->panel = (BusPanelProxy *) g_object_ref (panel);
+    data->key = g_strdup (key);
+    g_dbus_proxy_call ((GDBusProxy *)panel,
+                       "UpdatePropertyState",
+                       g_variant_new ("(subb)", key, state, visible, sensitive),
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1, NULL,
+                       (GAsyncReadyCallback) _update_property_state_reply_cb,
+                       data);
+}
+
 void
 bus_panel_proxy_update_property (BusPanelProxy  *panel,
                                  IBusProperty   *prop)
@@ -390,6 +538,11 @@ bus_panel_proxy_update_property (BusPanelProxy  *panel,
     g_assert (BUS_IS_PANEL_PROXY (panel));
     g_assert (IBUS_IS_PROPERTY (prop));
 
+    if (panel->prop_list_variant) {
+        g_variant_unref (panel->prop_list_variant);
+        panel->prop_list_variant = NULL;
+    }
+
     GVariant *variant = ibus_serializable_serialize ((IBusSerializable *)prop);
     g_dbus_proxy_call ((GDBusProxy *)panel,
                        "UpdateProperty",
@@ -563,6 +716,72 @@ _context_update_property_cb (BusInputContext *context,
                                      prop);
 }
 
+static void
+_context_update_property_state_cb (BusInputContext *context,
+                                   const gchar     *key,
+                                   guint            state,
+                                   gboolean         visible,
+                                   gboolean         sensitive,
+                                   BusPanelProxy   *panel)
+{
+    g_assert (BUS_IS_INPUT_CONTEXT (context));
+    g_assert (BUS_IS_PANEL_PROXY (panel));
+
+    g_return_if_fail (panel->focused_context == context);
+
+    bus_panel_proxy_update_property_state (panel,
+                                           key,
+                                           state,
+                                           visible,
+                                           sensitive);
+}
+
+static gboolean
+_clear_properties_cb (BusPanelProxy *panel)
+{
+    panel->clear_properties_id = 0;
+
+    /* The context focused out may take the focus again, e.g. A -> B -> A. */
+    if (panel->focused_context != NULL &&
+        bus_input_context_has_focus (panel->focused_context))
+        return FALSE;
+
+    IBusPropList *prop_list = ibus_prop_list_new ();
+    g_object_ref_sink (prop_list);
+    bus_panel_proxy_register_properties (panel, prop_list);
+    g_object_unref (prop_list);
+    return FALSE;
+}
+
+/**
+ * bus_panel_proxy_clear_properties_later:
+ *
+ * Clear the properties the panel shows for the context which lost the focus.
+ * It is done in idle, so it is skipped if another context takes the focus in
+ * the same transition, as its properties replace them anyway.
+ */
+static void
+bus_panel_proxy_clear_properties_later (BusPanelProxy *panel)
+{
+    if (panel->clear_properties_id == 0) {
+        panel->clear_properties_id =
+                g_idle_add ((GSourceFunc) _clear_properties_cb, panel);
+    }
+}
+
+static void
+_context_focus_out_cb (BusInputContext *context,
+                       BusPanelProxy   *panel)
+{
+    g_assert (BUS_IS_INPUT_CONTEXT (context));
+    g_assert (BUS_IS_PANEL_PROXY (panel));
+
+    g_return_if_fail (panel->focused_context == context);
+
+    /* The panel keeps the focused context while the global engine is used. */
+    bus_panel_proxy_clear_properties_later (panel);
+}
+
 static void
 _context_destroy_cb (BusInputContext *context,
                      BusPanelProxy   *panel)
@@ -625,9 +844,12 @@ static const struct {
 
     { "register-properties",        G_CALLBACK (_context_register_properties_cb) },
     { "update-property",            G_CALLBACK (_context_update_property_cb) },
+    { "update-property-state",      G_CALLBACK (_context_update_property_state_cb) },
 
     { "engine-changed",             G_CALLBACK (_context_state_changed_cb) },
 
+    { "focus-out",                  G_CALLBACK (_context_focus_out_cb) },
+
     { "destroy",                    G_CALLBACK (_context_destroy_cb) },
 };
 
@@ -644,6 +866,13 @@ bus_panel_proxy_focus_in (BusPanelProxy     *panel,
     if (panel->focused_context != NULL)
         bus_panel_proxy_focus_out (panel, panel->focused_context);
 
+    /* The properties of the context replace the ones of the context focused
+     * out, so they are not cleared in between. */
+    if (panel->clear_properties_id != 0) {
+        g_source_remove (panel->clear_properties_id);
+        panel->clear_properties_id = 0;
+    }
+
     g_object_ref_sink (context);
     panel->focused_context = context;
 
@@ -655,6 +884,11 @@ bus_panel_proxy_focus_in (BusPanelProxy     *panel,
                        G_DBUS_CALL_FLAGS_NONE,
                        -1, NULL, NULL, NULL);
 
+    /* Show the cached properties of the engine, which the engine usually
+     * registers again on focus in. */
+    bus_panel_proxy_register_properties (panel,
+            bus_input_context_get_properties (context));
+
     /* install signal handlers */
     gint i;
     for (i = 0; i < G_N_ELEMENTS (input_context_signals); i++) {
@@ -692,5 +926,7 @@ bus_panel_proxy_focus_out (BusPanelProxy    *panel,
 
     g_object_unref (panel->focused_context);
     panel->focused_context = NULL;
+
+    bus_panel_proxy_clear_properties_later (panel);
 }
 
@@ -92,6 +92,12 @@ void             bus_panel_proxy_register_properties(BusPanelProxy      *panel,
                                                      IBusPropList       *prop_list);
 void             bus_panel_proxy_update_property    (BusPanelProxy      *panel,
                                                      IBusProperty       *prop);
+void             bus_panel_proxy_update_property_state
+                                                    (BusPanelProxy      *panel,
+                                                     const gchar        *key,
+                                                     guint               state,
+                                                     gboolean            visible,
+                                                     gboolean            sensitive);
 G_END_DECLS
 #endif
 
@@ -0,0 +1,164 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/* vim:set et sts=4: */
+/* bus - The Input Bus
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "recorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+typedef struct _BusRecord BusRecord;
+struct _BusRecord {
+    guint64 time;
+    guint32 context_id;
+    guint16 type;
+    guint16 queue_depth;
+    guint32 keyval;
+    guint32 modifiers;
+    guint32 latency;
+    /* The serial number of the event, or 0 while the record is written. A
+     * dump skips the records whose serial numbers are not the expected
+     * ones, as they are overwritten by newer events. */
+    gint    serial;
+};
+
+G_STATIC_ASSERT (sizeof (BusRecord) == 32);
+G_STATIC_ASSERT ((BUS_RECORDER_SIZE & (BUS_RECORDER_SIZE - 1)) == 0);
+
+static BusRecord records[BUS_RECORDER_SIZE];
+/* The serial number of the last recorded event. */
+static volatile gint last_serial = 0;
+
+static gchar *default_path = NULL;
+
+void
+bus_recorder_init (void)
+{
+    gchar *dir;
+
+    if (default_path != NULL)
+        return;
+
+    dir = g_build_filename (g_get_user_cache_dir (), "ibus", NULL);
+    g_mkdir_with_parents (dir, 0700);
+    default_path = g_build_filename (dir, "flight-recorder", NULL);
+    g_free (dir);
+}
+
+guint64
+bus_recorder_get_time (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (guint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+void
+bus_recorder_record (BusRecordType type,
+                     guint         context_id,
+                     guint         keyval,
+                     guint         modifiers,
+                     guint         latency,
+                     guint         queue_depth)
+{
+    gint serial = g_atomic_int_exchange_and_add (&last_serial, 1) + 1;
+    BusRecord *record = &records[serial & (BUS_RECORDER_SIZE - 1)];
+
+    g_atomic_int_set (&record->serial, 0);
+    record->time = bus_recorder_get_time ();
+    record->context_id = context_id;
+    record->type = type;
+    record->queue_depth = MIN (queue_depth, G_MAXUINT16);
+    record->keyval = keyval;
+    record->modifiers = modifiers;
+    record->latency = latency;
+    g_atomic_int_set (&record->serial, serial);
+}
+
+static gboolean
+_write_all (gint          fd,
+            gconstpointer data,
+            gsize         size)
+{
+    const gchar *p = (const gchar *) data;
+
+    while (size > 0) {
+        gssize n = write (fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        p += n;
+        size -= n;
+    }
+    return TRUE;
+}
+
+const gchar *
+bus_recorder_dump (void)
+{
+    /* Copy the records in chunks, so a record being written is not dumped
+     * half updated. */
+    BusRecord chunk[64];
+    guint8 header[16];
+    guint16 record_size = sizeof (BusRecord);
+    guint32 size = BUS_RECORDER_SIZE;
+    gint last, serial;
+    guint n = 0;
+    gboolean retval = TRUE;
+    gint fd;
+
+    if (default_path == NULL)
+        return NULL;
+
+    fd = open (default_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        return NULL;
+
+    memcpy (header, "IBUSFREC", 8);
+    header[8] = G_BYTE_ORDER == G_LITTLE_ENDIAN ? 'l' : 'B';
+    header[9] = BUS_RECORDER_VERSION;
+    memcpy (header + 10, &record_size, 2);
+    memcpy (header + 12, &size, 4);
+    retval = _write_all (fd, header, sizeof (header));
+
+    last = g_atomic_int_get (&last_serial);
+    serial = last > BUS_RECORDER_SIZE ? last - BUS_RECORDER_SIZE + 1 : 1;
+    for (; retval && serial <= last; serial++) {
+        BusRecord *record = &records[serial & (BUS_RECORDER_SIZE - 1)];
+        chunk[n] = *record;
+        if (chunk[n].serial == serial &&
+            g_atomic_int_get (&record->serial) == serial) {
+            n++;
+        }
+        if (n == G_N_ELEMENTS (chunk) || (serial == last && n > 0)) {
+            retval = _write_all (fd, chunk, n * sizeof (BusRecord));
+            n = 0;
+        }
+    }
+
+    if (close (fd) != 0)
+        retval = FALSE;
+    return retval ? default_path : NULL;
+}
@@ -0,0 +1,109 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/* vim:set et sts=4: */
+/* bus - The Input Bus
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef __BUS_RECORDER_H_
+#define __BUS_RECORDER_H_
+
+#include <glib.h>
+
+/*
+ * The flight recorder keeps the last BUS_RECORDER_SIZE events of the daemon
+ * in a fixed-size ring buffer, so they can be dumped into a file after a
+ * problem like a stalled engine happened.
+ *
+ * A dump file starts with a header of 16 bytes:
+ *   8 bytes   magic "IBUSFREC"
+ *   1 byte    byte order of the following integers, 'l' or 'B'
+ *   1 byte    version, BUS_RECORDER_VERSION
+ *   2 bytes   size of a record
+ *   4 bytes   BUS_RECORDER_SIZE
+ * and is followed by the records from the oldest one, each of which is
+ *   8 bytes   monotonic time in microseconds
+ *   4 bytes   input context id, as in the object path of the context
+ *   2 bytes   event type, one of BusRecordType
+ *   2 bytes   queue depth, the key events of the context waiting for the
+ *             engine
+ *   4 bytes   keyval
+ *   4 bytes   modifiers
+ *   4 bytes   engine reply latency in microseconds, for key-reply records
+ *   4 bytes   serial number of the record
+ */
+
+G_BEGIN_DECLS
+
+#define BUS_RECORDER_SIZE       4096
+#define BUS_RECORDER_VERSION    1
+
+/*
+ * A key event is recorded when it is sent to the engine, and again with
+ * BUS_RECORD_KEY_REPLY when the engine replies.
+ */
+typedef enum {
+    BUS_RECORD_KEY_EVENT = 1,
+    BUS_RECORD_FOCUS_IN,
+    BUS_RECORD_FOCUS_OUT,
+    BUS_RECORD_ENGINE_CHANGED,
+    BUS_RECORD_KEY_REPLY,
+} BusRecordType;
+
+/**
+ * bus_recorder_init:
+ *
+ * Set up the default dump file path, which is "flight-recorder" in the ibus
+ * cache directory of the user.
+ */
+void             bus_recorder_init          (void);
+
+/**
+ * bus_recorder_record:
+ * @type: the event type.
+ * @context_id: the id of the input context.
+ * @keyval: the keyval of a key event, or 0.
+ * @modifiers: the modifiers of a key event, or 0.
+ * @latency: the engine reply latency in microseconds, or 0.
+ * @queue_depth: the number of key events of the context waiting for the engine.
+ *
+ * Record an event. It does not take a lock nor allocate memory, and it is
+ * safe to call from any thread.
+ */
+void             bus_recorder_record        (BusRecordType   type,
+                                             guint           context_id,
+                                             guint           keyval,
+                                             guint           modifiers,
+                                             guint           latency,
+                                             guint           queue_depth);
+
+/**
+ * bus_recorder_get_time:
+ * @returns: The monotonic time in microseconds, which is used for the records.
+ */
+guint64          bus_recorder_get_time      (void);
+
+/**
+ * bus_recorder_dump:
+ * @returns: The path written, which is owned by the recorder, or NULL on
+ * error.
+ *
+ * Write the recorded events into the default file. It only uses
+ * async-signal-safe functions, so it can be called from a signal handler.
+ */
+const gchar     *bus_recorder_dump          (void);
+
+G_END_DECLS
+#endif
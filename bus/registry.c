@@ -49,6 +49,11 @@ struct _BusRegistry {
     GList *components;
     /* a mapping from an engine name (e.g. 'pinyin') to the corresponding IBusEngineDesc object. */
     GHashTable *engine_table;
+    /* a mapping from an engine name to the serialized IBusEngineDesc object, and the
+     * serialized list of all engines. They are made when they are requested first, and
+     * dropped when the engines are removed from the registry. */
+    GHashTable *engine_variants;
+    GVariant *engines_variant;
 
 #ifdef G_THREADS_ENABLED
     GThread *thread;
@@ -103,6 +108,10 @@ bus_registry_init (BusRegistry *registry)
     registry->observed_paths = NULL;
     registry->components = NULL;
     registry->engine_table = g_hash_table_new (g_str_hash, g_str_equal);
+    registry->engine_variants = g_hash_table_new_full (g_str_hash,
+                                                       g_str_equal,
+                                                       NULL,
+                                                       (GDestroyNotify) g_variant_unref);
 
 #ifdef G_THREADS_ENABLED
     /* If glib supports thread, we'll create a thread to monitor changes in IME
@@ -165,6 +174,12 @@ bus_registry_remove_all (BusRegistry *registry)
     registry->components = NULL;
 
     g_hash_table_remove_all (registry->engine_table);
+
+    g_hash_table_remove_all (registry->engine_variants);
+    if (registry->engines_variant != NULL) {
+        g_variant_unref (registry->engines_variant);
+        registry->engines_variant = NULL;
+    }
 }
 
 static void
@@ -192,6 +207,9 @@ bus_registry_destroy (BusRegistry *registry)
     g_hash_table_destroy (registry->engine_table);
     registry->engine_table = NULL;
 
+    g_hash_table_destroy (registry->engine_variants);
+    registry->engine_variants = NULL;
+
 #ifdef G_THREADS_ENABLED
     g_cond_free (registry->cond);
     registry->cond = NULL;
@@ -248,64 +266,124 @@ bus_registry_load (BusRegistry *registry)
         }                                       \
     }
 
-static gboolean
-bus_registry_load_cache (BusRegistry *registry)
-{
-    g_assert (BUS_IS_REGISTRY (registry));
+enum {
+    REGISTRY_SECTION_NONE = 0,
+    REGISTRY_SECTION_OBSERVED_PATHS,
+    REGISTRY_SECTION_COMPONENTS,
+};
 
-    gchar *filename;
-    XMLNode *node;
-    GList *p;
+typedef struct {
+    BusRegistry *registry;
+    gint         depth;
+    gint         section;
+} RegistryCacheMarkupData;
 
-    filename = g_build_filename (g_get_user_cache_dir (), "ibus", "bus", "registry.xml", NULL);
-    node = ibus_xml_parse_file (filename);
-    g_free (filename);
+static void
+_registry_cache_start_element_cb (GMarkupParseContext *context,
+                                  const gchar         *element_name,
+                                  const gchar        **attribute_names,
+                                  const gchar        **attribute_values,
+                                  gpointer             user_data,
+                                  GError             **error)
+{
+    RegistryCacheMarkupData *data = (RegistryCacheMarkupData *) user_data;
 
-    if (node == NULL) {
-        return FALSE;
-    }
+    data->depth++;
 
-    if (g_strcmp0 (node->name, "ibus-registry") != 0) {
-        ibus_xml_free (node);
-        return FALSE;
+    switch (data->depth) {
+    case 1:
+        if (g_strcmp0 (element_name, "ibus-registry") != 0) {
+            g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                         "Root element <%s> is not <ibus-registry>", element_name);
+        }
+        break;
+    case 2:
+        data->section = REGISTRY_SECTION_NONE;
+        if (g_strcmp0 (element_name, "observed-paths") == 0)
+            data->section = REGISTRY_SECTION_OBSERVED_PATHS;
+        else if (g_strcmp0 (element_name, "components") == 0)
+            data->section = REGISTRY_SECTION_COMPONENTS;
+        else
+            g_warning ("Unknown element <%s>", element_name);
+        break;
+    case 3:
+        if (data->section == REGISTRY_SECTION_OBSERVED_PATHS &&
+            g_strcmp0 (element_name, "path") == 0) {
+            ibus_observed_path_start_markup (context,
+                                             attribute_names,
+                                             attribute_values);
+        }
+        else if (data->section == REGISTRY_SECTION_COMPONENTS &&
+                 g_strcmp0 (element_name, "component") == 0) {
+            ibus_component_start_markup (context, FALSE);
+        }
+        break;
     }
+}
 
-    for (p = node->sub_nodes; p != NULL; p = p->next) {
-        XMLNode *sub_node = (XMLNode *) p->data;
-
-        if (g_strcmp0 (sub_node->name, "observed-paths") == 0) {
-            GList *pp;
-            for (pp = sub_node->sub_nodes; pp != NULL; pp = pp->next) {
-                IBusObservedPath *path;
-                path = ibus_observed_path_new_from_xml_node (pp->data, FALSE);
-                if (path) {
-                    g_object_ref_sink (path);
-                    registry->observed_paths = g_list_append (registry->observed_paths, path);
-                }
+static void
+_registry_cache_end_element_cb (GMarkupParseContext *context,
+                                const gchar         *element_name,
+                                gpointer             user_data,
+                                GError             **error)
+{
+    RegistryCacheMarkupData *data = (RegistryCacheMarkupData *) user_data;
+    BusRegistry *registry = data->registry;
+
+    if (data->depth == 3) {
+        if (data->section == REGISTRY_SECTION_OBSERVED_PATHS &&
+            g_strcmp0 (element_name, "path") == 0) {
+            IBusObservedPath *path;
+            path = ibus_observed_path_end_markup (context, FALSE);
+            if (path) {
+                g_object_ref_sink (path);
+                registry->observed_paths = g_list_append (registry->observed_paths, path);
             }
-            continue;
         }
-        if (g_strcmp0 (sub_node->name, "components") == 0) {
-            GList *pp;
-            for (pp = sub_node->sub_nodes; pp != NULL; pp = pp->next) {
-                IBusComponent *component;
-                component = ibus_component_new_from_xml_node (pp->data);
-                if (component) {
-                    BusComponent *buscomp = bus_component_new (component,
-                                                               NULL /* factory */);
-                    g_object_ref_sink (buscomp);
-                    registry->components =
-                        g_list_append (registry->components, buscomp);
-                }
+        else if (data->section == REGISTRY_SECTION_COMPONENTS &&
+                 g_strcmp0 (element_name, "component") == 0) {
+            IBusComponent *component;
+            component = ibus_component_end_markup (context);
+            if (component) {
+                BusComponent *buscomp = bus_component_new (component,
+                                                           NULL /* factory */);
+                g_object_ref_sink (buscomp);
+                registry->components =
+                    g_list_append (registry->components, buscomp);
             }
-
-            continue;
         }
-        g_warning ("Unknown element <%s>", sub_node->name);
     }
 
-    ibus_xml_free (node);
-    return TRUE;
+    data->depth--;
+}
+
+static const GMarkupParser _registry_cache_markup_parser = {
+    _registry_cache_start_element_cb,
+    _registry_cache_end_element_cb,
+    0,
+    0,
+    0,
+};
+
+static gboolean
+bus_registry_load_cache (BusRegistry *registry)
+{
+    g_assert (BUS_IS_REGISTRY (registry));
+
+    gchar *filename;
+    gboolean retval;
+    RegistryCacheMarkupData data = { registry, 0, REGISTRY_SECTION_NONE };
+
+    /* Build the components directly from the parsing events, so a
+     * registry with hundreds of components does not need an XML tree.
+     */
+    filename = g_build_filename (g_get_user_cache_dir (), "ibus", "bus", "registry.xml", NULL);
+    retval = ibus_xml_parse_file_with_parser (filename,
+                                              &_registry_cache_markup_parser,
+                                              &data);
+    g_free (filename);
+
+    return retval;
 }
 
 static gboolean
@@ -386,10 +464,41 @@ bus_registry_save_cache (BusRegistry *registry)
     return (items == 1 ? TRUE : FALSE);
 }
 
+/* The maximum number of threads to parse component files. Parsing is mostly
+ * waiting for file system, so it is not bound to the number of CPUs.
+ */
+#define MAX_SCAN_THREADS 8
+
+typedef struct {
+    gchar         *path;
+    IBusComponent *component;
+} ComponentScanTask;
+
+/**
+ * _scan_component_file:
+ *
+ * Parse a component XML file and stat its observed paths. It may be called in
+ * a worker thread, so it must not touch the registry.
+ */
+static void
+_scan_component_file (ComponentScanTask *task,
+                      gpointer           user_data)
+{
+    task->component = ibus_component_new_from_file (task->path);
+}
+
+static gint
+_compare_component_filename (gconstpointer a,
+                             gconstpointer b)
+{
+    return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
 /**
  * bus_registry_load_in_dir:
  *
  * Read all XML files in dirname, create a BusComponent object for each file, and add the component objects to the registry.
+ * The files are parsed in a thread pool, and the components are added in the order of their file names.
  */
 static void
 bus_registry_load_in_dir (BusRegistry *registry,
@@ -401,6 +510,11 @@ bus_registry_load_in_dir (BusRegistry *registry,
     GError *error = NULL;
     GDir *dir;
     const gchar *filename;
+    GPtrArray *filenames;
+    ComponentScanTask *tasks;
+    GList *components = NULL;
+    GTimer *timer;
+    guint i;
 
     dir = g_dir_open (dirname, 0, &error);
 
@@ -410,31 +524,76 @@ bus_registry_load_in_dir (BusRegistry *registry,
         return;
     }
 
+    timer = g_timer_new ();
+
+    filenames = g_ptr_array_new ();
     while ((filename = g_dir_read_name (dir)) != NULL) {
         glong size;
-        gchar *path;
-        IBusComponent *component;
 
         size = g_utf8_strlen (filename, -1);
         if (g_strcmp0 (MAX (filename, filename + size - 4), ".xml") != 0)
             continue;
 
-        path = g_build_filename (dirname, filename, NULL);
-        component = ibus_component_new_from_file (path);
-        if (component != NULL) {
-            BusComponent *buscomp = bus_component_new (component,
+        g_ptr_array_add (filenames, g_strdup (filename));
+    }
+    g_dir_close (dir);
+
+    /* The order of g_dir_read_name () is undefined. Sort the file names, so
+     * the components are always loaded in the same order.
+     */
+    g_ptr_array_sort (filenames, _compare_component_filename);
+
+    tasks = g_new0 (ComponentScanTask, filenames->len);
+    for (i = 0; i < filenames->len; i++) {
+        tasks[i].path = g_build_filename (dirname,
+                                          g_ptr_array_index (filenames, i),
+                                          NULL);
+    }
+
+#ifdef G_THREADS_ENABLED
+    if (g_thread_supported () && filenames->len > 1) {
+        GThreadPool *pool;
+
+        pool = g_thread_pool_new ((GFunc) _scan_component_file,
+                                  NULL,
+                                  MIN (filenames->len, MAX_SCAN_THREADS),
+                                  FALSE,
+                                  NULL);
+        for (i = 0; i < filenames->len; i++) {
+            g_thread_pool_push (pool, &tasks[i], NULL);
+        }
+        /* Wait until all files are parsed. */
+        g_thread_pool_free (pool, FALSE, TRUE);
+    }
+    else
+#endif
+    {
+        for (i = 0; i < filenames->len; i++) {
+            _scan_component_file (&tasks[i], NULL);
+        }
+    }
+
+    /* BusComponent objects are created in the main thread only. */
+    for (i = 0; i < filenames->len; i++) {
+        if (tasks[i].component != NULL) {
+            BusComponent *buscomp = bus_component_new (tasks[i].component,
                                                        NULL /* factory */);
             g_object_ref_sink (buscomp);
-            registry->components =
-                g_list_append (registry->components, buscomp);
+            components = g_list_prepend (components, buscomp);
         }
-
-        g_free (path);
+        g_free (tasks[i].path);
     }
+    registry->components = g_list_concat (registry->components,
+                                          g_list_reverse (components));
 
-    g_dir_close (dir);
-}
+    g_debug ("Scanned %u component files in %s in %.3f ms",
+             filenames->len, dirname, g_timer_elapsed (timer, NULL) * 1000);
 
+    g_free (tasks);
+    g_ptr_array_foreach (filenames, (GFunc) g_free, NULL);
+    g_ptr_array_free (filenames, TRUE);
+    g_timer_destroy (timer);
+}
 
 BusRegistry *
 bus_registry_new (void)
@@ -526,6 +685,54 @@ bus_registry_find_engine_by_name (BusRegistry *registry,
     return (IBusEngineDesc *) g_hash_table_lookup (registry->engine_table, name);
 }
 
+GVariant *
+bus_registry_get_engine_variant (BusRegistry *registry,
+                                 const gchar *name)
+{
+    g_assert (BUS_IS_REGISTRY (registry));
+    g_assert (name);
+
+    IBusEngineDesc *desc;
+    GVariant *variant;
+
+    variant = (GVariant *) g_hash_table_lookup (registry->engine_variants, name);
+    if (variant != NULL)
+        return variant;
+
+    desc = (IBusEngineDesc *) g_hash_table_lookup (registry->engine_table, name);
+    if (desc == NULL)
+        return NULL;
+
+    variant = ibus_serializable_serialize ((IBusSerializable *) desc);
+    g_variant_ref_sink (variant);
+    g_hash_table_insert (registry->engine_variants,
+                         (gpointer) ibus_engine_desc_get_name (desc),
+                         variant);
+    return variant;
+}
+
+GVariant *
+bus_registry_get_engines_variant (BusRegistry *registry)
+{
+    g_assert (BUS_IS_REGISTRY (registry));
+
+    if (registry->engines_variant == NULL) {
+        GVariantBuilder builder;
+        GHashTableIter iter;
+        const gchar *name;
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("av"));
+        g_hash_table_iter_init (&iter, registry->engine_table);
+        while (g_hash_table_iter_next (&iter, (gpointer *) &name, NULL)) {
+            g_variant_builder_add (&builder, "v",
+                    bus_registry_get_engine_variant (registry, name));
+        }
+        registry->engines_variant = g_variant_builder_end (&builder);
+        g_variant_ref_sink (registry->engines_variant);
+    }
+    return registry->engines_variant;
+}
+
 void
 bus_registry_stop_all_components (BusRegistry *registry)
 {
@@ -98,6 +98,24 @@ IBusEngineDesc  *bus_registry_find_engine_by_name
                                                 (BusRegistry    *registry,
                                                  const gchar    *name);
 
+/**
+ * bus_registry_get_engine_variant:
+ * @name: an engine name like 'pinyin'
+ * @returns: the serialized IBusEngineDesc object, or NULL if not found. It is made once and
+ * owned by the registry, so the caller must not unref it.
+ */
+GVariant        *bus_registry_get_engine_variant
+                                                (BusRegistry    *registry,
+                                                 const gchar    *name);
+
+/**
+ * bus_registry_get_engines_variant:
+ * @returns: an "av" GVariant of all serialized IBusEngineDesc objects. It is made once and
+ * owned by the registry, so the caller must not unref it.
+ */
+GVariant        *bus_registry_get_engines_variant
+                                                (BusRegistry    *registry);
+
 /**
  * bus_registry_name_owner_changed:
  * @name: a unique or well-known name like ":1.1", "org.freedesktop.IBus.Config", "com.google.IBus.Mozc".
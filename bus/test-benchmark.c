@@ -0,0 +1,640 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/* vim:set et sts=4: */
+/* bus - The Input Bus
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* ibus benchmark
+   Start a private ibus-daemon, register an engine running in a thread of
+   this process, and send key events to it from several input contexts as
+   fast as the daemon replies. Each input context sends the next key event
+   when the previous one is replied.
+   The throughput and the latency percentiles are printed as a JSON object.
+   With IBUS_OBJECT_POOL=1, the hits and misses of the object recycling
+   pools of this process (the engine and the clients) are printed too.
+   No display is needed.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <ibus.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#define BUS_TYPE_TEST_ENGINE    (bus_test_engine_get_type ())
+
+#define BENCHMARK_ENGINE_NAME   "benchmark"
+#define BENCHMARK_COMPONENT     "org.freedesktop.IBus.Benchmark"
+
+typedef struct _BusTestEngine BusTestEngine;
+typedef struct _BusTestEngineClass BusTestEngineClass;
+
+/* An engine which shows the last typed characters as preedit text with a
+ * lookup table, and commits the preedit text when space is typed. */
+struct _BusTestEngine {
+    IBusEngine parent;
+
+    GString *preedit;
+    IBusLookupTable *table;
+};
+
+struct _BusTestEngineClass {
+    IBusEngineClass parent;
+};
+
+/* A client sending the key events with an input context. */
+typedef struct _BenchmarkClient BenchmarkClient;
+struct _BenchmarkClient {
+    IBusInputContext *context;
+    guint n_events;
+    gint64 start;
+};
+
+static gchar *daemon_path = IBUS_DAEMON_PATH;
+static gchar *config = MEMCONF_PATH;
+static gint n_clients = 4;
+static gint n_keys = 10000;
+static gint preedit_length = 8;
+static gint lookup_table_size = 10;
+static gint commit_interval = 8;
+static gint max_p99 = 0;
+static gint engine_idle_timeout = 0;
+
+static const GOptionEntry entries[] =
+{
+    { "daemon",            'd', 0, G_OPTION_ARG_STRING, &daemon_path,       "the ibus-daemon to benchmark.", "path" },
+    { "config",            'c', 0, G_OPTION_ARG_STRING, &config,            "the cmdline of config program. pass 'disable' not to start a config program.", "cmdline" },
+    { "clients",           'n', 0, G_OPTION_ARG_INT,    &n_clients,         "the number of input contexts sending key events concurrently.", "number [default is 4]" },
+    { "keys",              'k', 0, G_OPTION_ARG_INT,    &n_keys,            "the number of keys typed by each input context. a key is a press and a release event.", "number [default is 10000]" },
+    { "preedit-length",    'p', 0, G_OPTION_ARG_INT,    &preedit_length,    "the max length of the preedit text of the engine.", "length [default is 8]" },
+    { "lookup-table-size", 'l', 0, G_OPTION_ARG_INT,    &lookup_table_size, "the number of candidates of the engine. 0 not to show the lookup table.", "size [default is 10]" },
+    { "commit-interval",   'i', 0, G_OPTION_ARG_INT,    &commit_interval,   "type space to commit the preedit text every this number of keys.", "keys [default is 8]" },
+    { "max-p99",           'm', 0, G_OPTION_ARG_INT,    &max_p99,           "exit with failure if the 99th percentile latency is longer than this. 0 not to check it.", "usec [default is 0]" },
+    { "engine-idle-timeout", 'e', 0, G_OPTION_ARG_INT,  &engine_idle_timeout, "stop typing, and report the engines and the memory of this process before and after the daemon detaches the idle engines. exit with failure if no engine is detached. 0 not to test it.", "seconds [default is 0]" },
+    { NULL },
+};
+
+static gchar *tmpdir = NULL;
+static gchar *address = NULL;
+static GPid daemon_pid = 0;
+
+static BenchmarkClient *clients = NULL;
+static guint32 *latencies = NULL;
+static guint n_latencies = 0;
+static guint n_running_clients = 0;
+static GMainLoop *main_loop = NULL;
+/* The number of the engines alive in the engine thread. */
+static volatile gint n_engines = 0;
+
+GType bus_test_engine_get_type (void);
+
+G_DEFINE_TYPE (BusTestEngine, bus_test_engine, IBUS_TYPE_ENGINE)
+
+static gint64
+get_time_usec (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static void
+bus_test_engine_destroy (IBusObject *object)
+{
+    BusTestEngine *engine = (BusTestEngine *) object;
+
+    if (engine->preedit) {
+        g_string_free (engine->preedit, TRUE);
+        engine->preedit = NULL;
+    }
+
+    if (engine->table) {
+        g_object_unref (engine->table);
+        engine->table = NULL;
+    }
+
+    g_atomic_int_add (&n_engines, -1);
+
+    IBUS_OBJECT_CLASS (bus_test_engine_parent_class)->destroy (object);
+}
+
+static void
+bus_test_engine_update (BusTestEngine *engine)
+{
+    IBusText *text;
+    gint i;
+
+    text = ibus_text_new_from_string (engine->preedit->str);
+    ibus_engine_update_preedit_text ((IBusEngine *) engine,
+                                     text,
+                                     engine->preedit->len,
+                                     TRUE);
+
+    if (lookup_table_size <= 0)
+        return;
+
+    ibus_lookup_table_clear (engine->table);
+    for (i = 0; i < lookup_table_size; i++) {
+        gchar *candidate = g_strdup_printf ("%s%d", engine->preedit->str, i);
+        ibus_lookup_table_append_candidate (engine->table,
+                                            ibus_text_new_from_string (candidate));
+        g_free (candidate);
+    }
+    ibus_engine_update_lookup_table ((IBusEngine *) engine,
+                                     engine->table,
+                                     TRUE);
+}
+
+static gboolean
+bus_test_engine_process_key_event (IBusEngine *ibus_engine,
+                                   guint       keyval,
+                                   guint       keycode,
+                                   guint       modifiers)
+{
+    BusTestEngine *engine = (BusTestEngine *) ibus_engine;
+
+    if (modifiers & IBUS_RELEASE_MASK)
+        return FALSE;
+
+    if (keyval == IBUS_KEY_space) {
+        if (engine->preedit->len == 0)
+            return FALSE;
+        ibus_engine_commit_text (ibus_engine,
+                                 ibus_text_new_from_string (engine->preedit->str));
+        g_string_truncate (engine->preedit, 0);
+        ibus_engine_hide_preedit_text (ibus_engine);
+        if (lookup_table_size > 0)
+            ibus_engine_hide_lookup_table (ibus_engine);
+        return TRUE;
+    }
+
+    if (keyval < IBUS_KEY_a || keyval > IBUS_KEY_z)
+        return FALSE;
+
+    if (preedit_length <= 0)
+        return FALSE;
+
+    if (engine->preedit->len >= preedit_length)
+        g_string_erase (engine->preedit, 0, engine->preedit->len - preedit_length + 1);
+    g_string_append_c (engine->preedit, keyval);
+    bus_test_engine_update (engine);
+    return TRUE;
+}
+
+static void
+bus_test_engine_class_init (BusTestEngineClass *class)
+{
+    IBusObjectClass *ibus_object_class = IBUS_OBJECT_CLASS (class);
+    IBusEngineClass *engine_class = IBUS_ENGINE_CLASS (class);
+
+    ibus_object_class->destroy = bus_test_engine_destroy;
+    engine_class->process_key_event = bus_test_engine_process_key_event;
+}
+
+static void
+bus_test_engine_init (BusTestEngine *engine)
+{
+    engine->preedit = g_string_new ("");
+    engine->table = ibus_lookup_table_new (MAX (lookup_table_size, 1), 0, TRUE, TRUE);
+    g_object_ref_sink (engine->table);
+    g_atomic_int_inc (&n_engines);
+}
+
+static gboolean
+_engine_ready_cb (gpointer user_data)
+{
+    g_main_loop_quit (main_loop);
+    return FALSE;
+}
+
+/* Run the engine with its own connection and main context, so the engine
+ * does not delay the replies to the clients in the main thread. */
+static gpointer
+_engine_thread (gpointer user_data)
+{
+    GMainContext *context;
+    GMainLoop *loop;
+    GDBusConnection *connection;
+    IBusFactory *factory;
+    IBusComponent *component;
+    GVariant *result;
+    GError *error = NULL;
+
+    context = g_main_context_new ();
+    g_main_context_push_thread_default (context);
+
+    connection = g_dbus_connection_new_for_address_sync (address,
+                        G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                        G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                        NULL, NULL, &error);
+    if (connection == NULL) {
+        g_printerr ("Can not connect to ibus-daemon: %s\n", error->message);
+        exit (1);
+    }
+
+    factory = ibus_factory_new (connection);
+    ibus_factory_add_engine (factory, BENCHMARK_ENGINE_NAME, BUS_TYPE_TEST_ENGINE);
+
+    component = ibus_component_new (BENCHMARK_COMPONENT,
+                                    "Benchmark Component",
+                                    "0.0.0",
+                                    "LGPL2.1",
+                                    "",
+                                    "",
+                                    "",
+                                    "ibus");
+    ibus_component_add_engine (component,
+                               ibus_engine_desc_new (BENCHMARK_ENGINE_NAME,
+                                                     "Benchmark",
+                                                     "Benchmark Engine",
+                                                     "en",
+                                                     "LGPL2.1",
+                                                     "",
+                                                     "",
+                                                     "us"));
+    result = g_dbus_connection_call_sync (connection,
+                        IBUS_SERVICE_IBUS,
+                        IBUS_PATH_IBUS,
+                        IBUS_INTERFACE_IBUS,
+                        "RegisterComponent",
+                        g_variant_new ("(v)", ibus_serializable_serialize ((IBusSerializable *) component)),
+                        NULL,
+                        G_DBUS_CALL_FLAGS_NONE,
+                        -1, NULL, &error);
+    g_object_unref (component);
+    if (result == NULL) {
+        g_printerr ("Can not register the benchmark engine: %s\n", error->message);
+        exit (1);
+    }
+    g_variant_unref (result);
+
+    g_idle_add (_engine_ready_cb, NULL);
+
+    loop = g_main_loop_new (context, FALSE);
+    g_main_loop_run (loop);
+    return NULL;
+}
+
+static void
+_start_daemon (void)
+{
+    GError *error = NULL;
+    gchar *address_file;
+    gchar *socket_path;
+    gchar *address_option;
+    gchar *config_option;
+    gchar *idle_option;
+    gint i;
+
+    tmpdir = g_build_filename (g_get_tmp_dir (), "ibus-benchmark-XXXXXX", NULL);
+    if (mkdtemp (tmpdir) == NULL) {
+        g_printerr ("Can not create %s\n", tmpdir);
+        exit (1);
+    }
+
+    /* Keep the address file of the user's ibus-daemon. */
+    address_file = g_build_filename (tmpdir, "address", NULL);
+    g_setenv ("IBUS_ADDRESS_FILE", address_file, TRUE);
+    g_unsetenv ("IBUS_ADDRESS");
+    g_free (address_file);
+
+    socket_path = g_build_filename (tmpdir, "socket", NULL);
+    address = g_strdup_printf ("unix:path=%s", socket_path);
+
+    if (g_strcmp0 (config, "disable") != 0 &&
+        !g_file_test (config, G_FILE_TEST_IS_EXECUTABLE)) {
+        g_printerr ("%s is not found, the config program is disabled\n", config);
+        config = "disable";
+    }
+
+    address_option = g_strdup_printf ("--address=%s", address);
+    config_option = g_strdup_printf ("--config=%s", config);
+    idle_option = g_strdup_printf ("--engine-idle-timeout=%d", engine_idle_timeout);
+    gchar *argv[] = {
+        daemon_path,
+        "--panel=disable",
+        config_option,
+        address_option,
+        "--cache=none",
+        idle_option,
+        NULL,
+    };
+
+    if (!g_spawn_async (NULL, argv, NULL,
+                        G_SPAWN_DO_NOT_REAP_CHILD,
+                        NULL, NULL, &daemon_pid, &error)) {
+        g_printerr ("Can not execute %s: %s\n", daemon_path, error->message);
+        exit (1);
+    }
+    g_free (address_option);
+    g_free (config_option);
+    g_free (idle_option);
+
+    /* Wait for the daemon listening on the socket. */
+    for (i = 0; i < 100 && !g_file_test (socket_path, G_FILE_TEST_EXISTS); i++)
+        g_usleep (G_USEC_PER_SEC / 10);
+    if (!g_file_test (socket_path, G_FILE_TEST_EXISTS)) {
+        g_printerr ("ibus-daemon does not start\n");
+        kill (daemon_pid, SIGTERM);
+        exit (1);
+    }
+    g_free (socket_path);
+
+    g_setenv ("IBUS_ADDRESS", address, TRUE);
+}
+
+static void
+_stop_daemon (IBusBus *bus)
+{
+    const gchar *name;
+    GDir *dir;
+
+    ibus_bus_exit (bus, FALSE);
+    waitpid (daemon_pid, NULL, 0);
+    g_spawn_close_pid (daemon_pid);
+
+    dir = g_dir_open (tmpdir, 0, NULL);
+    while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+        gchar *path = g_build_filename (tmpdir, name, NULL);
+        g_unlink (path);
+        g_free (path);
+    }
+    if (dir != NULL)
+        g_dir_close (dir);
+    g_rmdir (tmpdir);
+}
+
+static void _send_key_event (BenchmarkClient *client);
+
+static void
+_process_key_event_cb (GObject      *source_object,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+    BenchmarkClient *client = (BenchmarkClient *) user_data;
+    GError *error = NULL;
+
+    latencies[n_latencies++] = get_time_usec () - client->start;
+
+    ibus_input_context_process_key_event_async_finish (client->context,
+                                                       res,
+                                                       &error);
+    if (error != NULL) {
+        g_printerr ("ProcessKeyEvent failed: %s\n", error->message);
+        exit (1);
+    }
+
+    client->n_events++;
+    if (client->n_events < n_keys * 2) {
+        _send_key_event (client);
+        return;
+    }
+
+    if (--n_running_clients == 0)
+        g_main_loop_quit (main_loop);
+}
+
+static void
+_send_key_event (BenchmarkClient *client)
+{
+    guint key = client->n_events / 2;
+    guint keyval;
+    guint modifiers = (client->n_events % 2) ? IBUS_RELEASE_MASK : 0;
+
+    if (commit_interval > 0 && key % commit_interval == commit_interval - 1)
+        keyval = IBUS_KEY_space;
+    else
+        keyval = IBUS_KEY_a + key % 26;
+
+    client->start = get_time_usec ();
+    ibus_input_context_process_key_event_async (client->context,
+                                                keyval,
+                                                0,
+                                                modifiers,
+                                                -1,
+                                                NULL,
+                                                _process_key_event_cb,
+                                                client);
+}
+
+static void
+_context_enabled_cb (IBusInputContext *context,
+                     gpointer          user_data)
+{
+    if (--n_running_clients == 0)
+        g_main_loop_quit (main_loop);
+}
+
+static gint
+_compare_latency (gconstpointer a,
+                  gconstpointer b)
+{
+    guint32 x = *(const guint32 *) a;
+    guint32 y = *(const guint32 *) b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Quit when the daemon has detached the engines of all clients, or when it
+ * should have done so, i.e. 2 idle timeouts after the last key event. */
+static gboolean
+_engines_detached_cb (gint *engines_before)
+{
+    static gint64 deadline = 0;
+    gint64 now = get_time_usec ();
+
+    if (deadline == 0)
+        deadline = now + (2 * engine_idle_timeout + 1) * G_USEC_PER_SEC;
+
+    if (g_atomic_int_get (&n_engines) <= *engines_before - n_clients ||
+        now >= deadline) {
+        g_main_loop_quit (main_loop);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Return the resident set size of this process in kB, or 0 if it is not
+ * available. */
+static gint
+_get_rss_kb (void)
+{
+    gchar *contents = NULL;
+    gchar *p;
+    gint rss = 0;
+
+    if (!g_file_get_contents ("/proc/self/status", &contents, NULL, NULL))
+        return 0;
+    p = strstr (contents, "VmRSS:");
+    if (p != NULL)
+        rss = atoi (p + strlen ("VmRSS:"));
+    g_free (contents);
+    return rss;
+}
+
+static guint32
+_get_percentile (gdouble percentile)
+{
+    guint i = (guint) (n_latencies * percentile / 100.0);
+    return latencies[MIN (i, n_latencies - 1)];
+}
+
+gint
+main (gint argc, gchar **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    IBusBus *bus;
+    gint64 start, elapsed;
+    gint engines_before = 0, engines_after = 0;
+    gint rss_before = 0, rss_after = 0;
+    gint i;
+
+    context = g_option_context_new ("- ibus benchmark");
+    g_option_context_add_main_entries (context, entries, "ibus-benchmark");
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("Option parsing failed: %s\n", error->message);
+        exit (1);
+    }
+    g_option_context_free (context);
+
+    if (n_clients <= 0 || n_keys <= 0) {
+        g_printerr ("The number of clients and keys must be positive\n");
+        exit (1);
+    }
+
+    if (engine_idle_timeout < 0) {
+        g_printerr ("The engine idle timeout must not be negative\n");
+        exit (1);
+    }
+
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+    ibus_init ();
+
+    _start_daemon ();
+
+    bus = ibus_bus_new ();
+    if (!ibus_bus_is_connected (bus)) {
+        g_printerr ("Can not connect to ibus-daemon\n");
+        exit (1);
+    }
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+
+    if (g_thread_create (_engine_thread, NULL, FALSE, &error) == NULL) {
+        g_printerr ("Can not create the engine thread: %s\n", error->message);
+        exit (1);
+    }
+    g_main_loop_run (main_loop);
+
+    clients = g_new0 (BenchmarkClient, n_clients);
+    for (i = 0; i < n_clients; i++) {
+        gchar *name = g_strdup_printf ("benchmark-%d", i);
+        clients[i].context = ibus_bus_create_input_context (bus, name);
+        g_free (name);
+        if (clients[i].context == NULL) {
+            g_printerr ("Can not create input context\n");
+            exit (1);
+        }
+        g_signal_connect (clients[i].context, "enabled",
+                          G_CALLBACK (_context_enabled_cb), NULL);
+        /* Without IBUS_CAP_FOCUS, the daemon does not move the global
+         * engine between the input contexts, so each of them gets its own
+         * engine and they can type concurrently. */
+        ibus_input_context_set_capabilities (clients[i].context,
+                                             IBUS_CAP_PREEDIT_TEXT |
+                                             IBUS_CAP_AUXILIARY_TEXT |
+                                             IBUS_CAP_LOOKUP_TABLE);
+        ibus_input_context_focus_in (clients[i].context);
+        ibus_input_context_set_engine (clients[i].context, BENCHMARK_ENGINE_NAME);
+    }
+
+    /* Wait for the engines of all input contexts. */
+    n_running_clients = n_clients;
+    g_main_loop_run (main_loop);
+
+    latencies = g_new (guint32, n_clients * n_keys * 2);
+    n_running_clients = n_clients;
+    start = get_time_usec ();
+    for (i = 0; i < n_clients; i++)
+        _send_key_event (&clients[i]);
+    g_main_loop_run (main_loop);
+    elapsed = get_time_usec () - start;
+
+    qsort (latencies, n_latencies, sizeof (guint32), _compare_latency);
+
+    if (engine_idle_timeout > 0) {
+        /* The engines run in this process, so its memory is the memory of
+         * the engine process. */
+        engines_before = g_atomic_int_get (&n_engines);
+        rss_before = _get_rss_kb ();
+        /* The clients do not support focus, so the daemon detaches their
+         * engines when they stop calling methods. */
+        g_timeout_add (100, (GSourceFunc) _engines_detached_cb, &engines_before);
+        g_main_loop_run (main_loop);
+        engines_after = g_atomic_int_get (&n_engines);
+        rss_after = _get_rss_kb ();
+    }
+
+    /* The engine and the clients deserialize the texts in this process. */
+    guint pool_hits = 0;
+    guint pool_misses = 0;
+    gboolean pool_enabled = ibus_serializable_get_pool_stats (&pool_hits,
+                                                              &pool_misses);
+
+    g_print ("{\"clients\": %d, \"keys\": %d, \"events\": %u, "
+             "\"preedit_length\": %d, \"lookup_table_size\": %d, "
+             "\"commit_interval\": %d, \"elapsed_usec\": %" G_GINT64_FORMAT ", "
+             "\"keys_per_second\": %.1f, \"events_per_second\": %.1f, "
+             "\"latency_usec\": {\"p50\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u}, "
+             "\"object_pool\": {\"enabled\": %s, \"hits\": %u, \"misses\": %u}, "
+             "\"engine_idle\": {\"timeout\": %d, \"engines_before\": %d, \"engines_after\": %d, "
+             "\"rss_kb_before\": %d, \"rss_kb_after\": %d}}\n",
+             n_clients, n_keys, n_latencies,
+             preedit_length, lookup_table_size,
+             commit_interval, elapsed,
+             n_clients * n_keys * (gdouble) G_USEC_PER_SEC / elapsed,
+             n_latencies * (gdouble) G_USEC_PER_SEC / elapsed,
+             _get_percentile (50), _get_percentile (99), _get_percentile (99.9),
+             latencies[n_latencies - 1],
+             pool_enabled ? "true" : "false", pool_hits, pool_misses,
+             engine_idle_timeout, engines_before, engines_after,
+             rss_before, rss_after);
+
+    for (i = 0; i < n_clients; i++)
+        g_object_unref (clients[i].context);
+    _stop_daemon (bus);
+
+    if (max_p99 > 0 && _get_percentile (99) > max_p99) {
+        g_printerr ("p99 latency %u usec is longer than %d usec\n",
+                    _get_percentile (99), max_p99);
+        return 1;
+    }
+    if (engine_idle_timeout > 0 && engines_after >= engines_before) {
+        g_printerr ("no engine is detached from the idle input contexts: "
+                    "%d engines before, %d after\n",
+                    engines_before, engines_after);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,288 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/* vim:set et sts=4: */
+/* bus - The Input Bus
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Test the coalescing of the focus changes. A private ibus-daemon is started
+   with --focus-change-delay, and this process is its panel, so the focus
+   changes passed to the panel are logged.
+*/
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <ibus.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+/* in milliseconds */
+#define FOCUS_CHANGE_DELAY  500
+
+static gchar *tmpdir = NULL;
+static GPid daemon_pid = 0;
+
+static IBusBus *bus = NULL;
+static GMainLoop *main_loop = NULL;
+static IBusInputContext *context_a = NULL;
+static IBusInputContext *context_b = NULL;
+/* the focus changes in the order the panel sees them */
+static GString *panel_log = NULL;
+
+static const gchar *
+_context_name (const gchar *path)
+{
+    if (g_strcmp0 (path, g_dbus_proxy_get_object_path ((GDBusProxy *) context_a)) == 0)
+        return "A";
+    if (g_strcmp0 (path, g_dbus_proxy_get_object_path ((GDBusProxy *) context_b)) == 0)
+        return "B";
+    return "fake";
+}
+
+static void
+_panel_focus_in_cb (IBusPanelService *panel,
+                    const gchar      *path,
+                    gpointer          user_data)
+{
+    g_string_append_printf (panel_log, "focus-in %s;", _context_name (path));
+}
+
+static void
+_panel_focus_out_cb (IBusPanelService *panel,
+                     const gchar      *path,
+                     gpointer          user_data)
+{
+    g_string_append_printf (panel_log, "focus-out %s;", _context_name (path));
+}
+
+static gboolean
+_quit_cb (gpointer user_data)
+{
+    g_main_loop_quit (main_loop);
+    return FALSE;
+}
+
+/* Run the main loop longer than the delay, so the pending focus change is
+ * applied and passed to the panel. */
+static void
+_wait_focus_change (void)
+{
+    /* The daemon has handled the calls sent before when it replies. */
+    g_assert (ibus_bus_name_has_owner (bus, IBUS_SERVICE_PANEL));
+    g_timeout_add (FOCUS_CHANGE_DELAY * 2, _quit_cb, NULL);
+    g_main_loop_run (main_loop);
+}
+
+static void
+test_coalesce (void)
+{
+    ibus_input_context_focus_in (context_a);
+    _wait_focus_change ();
+
+    /* A -> B -> A within the delay is not passed to the panel. */
+    g_string_truncate (panel_log, 0);
+    ibus_input_context_focus_out (context_a);
+    ibus_input_context_focus_in (context_b);
+    ibus_input_context_focus_out (context_b);
+    ibus_input_context_focus_in (context_a);
+    _wait_focus_change ();
+    g_assert_cmpstr (panel_log->str, ==, "");
+
+    /* A -> B is passed to the panel after the delay. */
+    ibus_input_context_focus_out (context_a);
+    ibus_input_context_focus_in (context_b);
+    _wait_focus_change ();
+    g_assert_cmpstr (panel_log->str, ==, "focus-out A;focus-in B;");
+}
+
+static void
+_process_key_event_cb (GObject      *source_object,
+                       GAsyncResult *res,
+                       gchar       **log)
+{
+    GError *error = NULL;
+
+    ibus_input_context_process_key_event_async_finish (
+            (IBusInputContext *) source_object, res, &error);
+    g_assert_no_error (error);
+
+    *log = g_strdup (panel_log->str);
+    g_main_loop_quit (main_loop);
+}
+
+static void
+test_flush_on_key (void)
+{
+    gchar *log = NULL;
+
+    ibus_input_context_focus_in (context_b);
+    _wait_focus_change ();
+
+    /* The key event is sent to the context focused last, so the pending
+     * focus change is applied before the key event is replied. */
+    g_string_truncate (panel_log, 0);
+    ibus_input_context_focus_out (context_b);
+    ibus_input_context_focus_in (context_a);
+    ibus_input_context_process_key_event_async (context_a,
+                                                IBUS_KEY_a, 0, 0,
+                                                -1, NULL,
+                                                (GAsyncReadyCallback) _process_key_event_cb,
+                                                &log);
+    g_main_loop_run (main_loop);
+    g_assert_cmpstr (log, ==, "focus-out B;focus-in A;");
+    g_free (log);
+
+    /* Nothing is left to the timer. */
+    _wait_focus_change ();
+    g_assert_cmpstr (panel_log->str, ==, "focus-out B;focus-in A;");
+}
+
+static void
+_start_daemon (void)
+{
+    GError *error = NULL;
+    gchar *address_file;
+    gchar *socket_path;
+    gchar *address;
+    gchar *address_option;
+    gchar *delay_option;
+    gint i;
+
+    tmpdir = g_build_filename (g_get_tmp_dir (), "ibus-test-XXXXXX", NULL);
+    if (mkdtemp (tmpdir) == NULL)
+        g_error ("Can not create %s", tmpdir);
+
+    /* Keep the address file of the user's ibus-daemon. */
+    address_file = g_build_filename (tmpdir, "address", NULL);
+    g_setenv ("IBUS_ADDRESS_FILE", address_file, TRUE);
+    g_free (address_file);
+
+    socket_path = g_build_filename (tmpdir, "socket", NULL);
+    address = g_strdup_printf ("unix:path=%s", socket_path);
+
+    address_option = g_strdup_printf ("--address=%s", address);
+    delay_option = g_strdup_printf ("--focus-change-delay=%d", FOCUS_CHANGE_DELAY);
+    gchar *argv[] = {
+        IBUS_DAEMON_PATH,
+        "--panel=disable",
+        "--config=disable",
+        address_option,
+        "--cache=none",
+        delay_option,
+        NULL,
+    };
+
+    if (!g_spawn_async (NULL, argv, NULL,
+                        G_SPAWN_DO_NOT_REAP_CHILD,
+                        NULL, NULL, &daemon_pid, &error)) {
+        g_error ("Can not execute %s: %s", IBUS_DAEMON_PATH, error->message);
+    }
+    g_free (address_option);
+    g_free (delay_option);
+
+    /* Wait for the daemon listening on the socket. */
+    for (i = 0; i < 100 && !g_file_test (socket_path, G_FILE_TEST_EXISTS); i++)
+        g_usleep (G_USEC_PER_SEC / 10);
+    if (!g_file_test (socket_path, G_FILE_TEST_EXISTS)) {
+        kill (daemon_pid, SIGTERM);
+        g_error ("ibus-daemon does not start");
+    }
+    g_free (socket_path);
+
+    g_setenv ("IBUS_ADDRESS", address, TRUE);
+    g_free (address);
+}
+
+static void
+_stop_daemon (void)
+{
+    const gchar *name;
+    GDir *dir;
+
+    ibus_bus_exit (bus, FALSE);
+    waitpid (daemon_pid, NULL, 0);
+    g_spawn_close_pid (daemon_pid);
+
+    dir = g_dir_open (tmpdir, 0, NULL);
+    while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+        gchar *path = g_build_filename (tmpdir, name, NULL);
+        g_unlink (path);
+        g_free (path);
+    }
+    if (dir != NULL)
+        g_dir_close (dir);
+    g_rmdir (tmpdir);
+    g_free (tmpdir);
+}
+
+static IBusInputContext *
+_create_input_context (const gchar *name)
+{
+    IBusInputContext *context = ibus_bus_create_input_context (bus, name);
+
+    g_assert (context != NULL);
+    ibus_input_context_set_capabilities (context, IBUS_CAP_FOCUS);
+    return context;
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+    IBusPanelService *panel;
+    gint retval;
+
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+    g_test_init (&argc, &argv, NULL);
+    ibus_init ();
+
+    _start_daemon ();
+
+    bus = ibus_bus_new ();
+    g_assert (ibus_bus_is_connected (bus));
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+    panel_log = g_string_new ("");
+
+    panel = ibus_panel_service_new (ibus_bus_get_connection (bus));
+    g_signal_connect (panel, "focus-in",
+                      G_CALLBACK (_panel_focus_in_cb), NULL);
+    g_signal_connect (panel, "focus-out",
+                      G_CALLBACK (_panel_focus_out_cb), NULL);
+    ibus_bus_request_name (bus, IBUS_SERVICE_PANEL, 0);
+
+    context_a = _create_input_context ("test-a");
+    context_b = _create_input_context ("test-b");
+
+    g_test_add_func ("/ibus/focus-change-coalesce", test_coalesce);
+    g_test_add_func ("/ibus/focus-change-flush-on-key", test_flush_on_key);
+
+    retval = g_test_run ();
+
+    ibus_proxy_destroy ((IBusProxy *) context_a);
+    ibus_proxy_destroy ((IBusProxy *) context_b);
+    ibus_object_destroy ((IBusObject *) panel);
+    _stop_daemon ();
+
+    g_object_unref (bus);
+    g_string_free (panel_log, TRUE);
+    g_main_loop_unref (main_loop);
+    return retval;
+}
@@ -5,6 +5,20 @@ int main()
 {
 	g_type_init ();
 	BusRegistry *registry = bus_registry_new ();
+
+	/* the serialized engines are made once and kept */
+	GList *engines = bus_registry_get_engines (registry);
+	GVariant *variant = bus_registry_get_engines_variant (registry);
+	g_assert_cmpuint (g_variant_n_children (variant), ==, g_list_length (engines));
+	g_assert (bus_registry_get_engines_variant (registry) == variant);
+	if (engines != NULL) {
+		const gchar *name = ibus_engine_desc_get_name ((IBusEngineDesc *) engines->data);
+		g_assert (bus_registry_get_engine_variant (registry, name) ==
+		          bus_registry_get_engine_variant (registry, name));
+	}
+	g_assert (bus_registry_get_engine_variant (registry, "no-such-engine") == NULL);
+	g_list_free (engines);
+
 	g_object_unref (registry);
 	return 0;
 }
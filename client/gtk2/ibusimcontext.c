@@ -1025,7 +1025,8 @@ ibus_im_context_set_surrounding (GtkIMContext  *context,
     g_return_if_fail (context != NULL);
     g_return_if_fail (IBUS_IS_IM_CONTEXT (context));
     g_return_if_fail (text != NULL);
-    g_return_if_fail (strlen (text) >= len);
+    gsize text_len = strlen (text);
+    g_return_if_fail (text_len >= len);
     g_return_if_fail (0 <= cursor_index && cursor_index <= len);
 
     IBusIMContext *ibusimcontext = IBUS_IM_CONTEXT (context);
@@ -1034,13 +1035,22 @@ ibus_im_context_set_surrounding (GtkIMContext  *context,
         IBusText *ibustext;
         guint cursor_pos;
         guint utf8_len;
-        gchar *p;
 
-        p = g_strndup (text, len);
-        cursor_pos = g_utf8_strlen (p, cursor_index);
-        utf8_len = g_utf8_strlen(p, len);
-        ibustext = ibus_text_new_from_string (p);
-        g_free (p);
+        cursor_pos = g_utf8_strlen (text, cursor_index);
+        utf8_len = cursor_pos + g_utf8_strlen (text + cursor_index,
+                                               len - cursor_index);
+        /* ibus_input_context_set_surrounding_text() copies only the part
+         * of the text around the cursor the engine wants, so the text of
+         * the application is not copied when it ends at len. The length is
+         * compared instead of reading the byte at len. */
+        if (text_len == len) {
+            ibustext = ibus_text_new_from_static_string (text);
+        }
+        else {
+            gchar *p = g_strndup (text, len);
+            ibustext = ibus_text_new_from_string (p);
+            g_free (p);
+        }
 
         guint anchor_pos = get_selection_anchor_point (ibusimcontext,
                                                        cursor_pos,
@@ -986,6 +986,40 @@ _init_ibus (void)
     _use_sync_mode = _get_boolean_env ("IBUS_ENABLE_SYNC_MODE", FALSE);
 }
 
+/* The XIM transport queues the messages to the clients, and they are sent
+ * here before the main loop polls, so the commit, preedit and forward event
+ * messages produced in one main loop iteration cost one X round. */
+static gboolean
+_xim_flush_source_prepare (GSource *source,
+                           gint    *timeout)
+{
+    if (_xims != NULL)
+        IMFlush (_xims);
+    *timeout = -1;
+    return FALSE;
+}
+
+static gboolean
+_xim_flush_source_check (GSource *source)
+{
+    return FALSE;
+}
+
+static gboolean
+_xim_flush_source_dispatch (GSource    *source,
+                            GSourceFunc callback,
+                            gpointer    user_data)
+{
+    return TRUE;
+}
+
+static GSourceFuncs _xim_flush_source_funcs = {
+    _xim_flush_source_prepare,
+    _xim_flush_source_check,
+    _xim_flush_source_dispatch,
+    NULL,
+};
+
 static void
 _xim_init_IMdkit ()
 {
@@ -1049,6 +1083,12 @@ _xim_init_IMdkit ()
         IMFilterEventMask, KeyPressMask | KeyReleaseMask,
         NULL);
 
+    GSource *source = g_source_new (&_xim_flush_source_funcs, sizeof (GSource));
+    /* a high priority source is prepared even if other sources are ready */
+    g_source_set_priority (source, G_PRIORITY_HIGH);
+    g_source_attach (source, NULL);
+    g_source_unref (source);
+
     _init_ibus ();
 
     if (!ibus_bus_is_connected (_bus)) {
@@ -0,0 +1,377 @@
+/* vim:set et sts=4 sw=4:
+ *
+ * ibus - The Input Bus
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ */
+
+/* A synthetic engine for load tests. It does not convert anything, but
+ * it updates the preedit text, the lookup table and the properties like a
+ * real engine, as described by a profile, so the daemon and the panel can
+ * be measured with a reproducible workload.
+ *
+ * It registers one engine "benchmark-<profile>" for each profile on the
+ * running ibus-daemon. The built-in profiles are "pinyin", "hangul" and
+ * "passthrough". More profiles can be defined, or the built-in ones changed,
+ * in a key file given by --profiles or $IBUS_BENCHMARK_PROFILES:
+ *
+ *   [pinyin]
+ *   delay=200               # microseconds spent in each key event
+ *   preedit-length=8        # max characters of the preedit text
+ *   lookup-table-size=9     # candidates per page, 0 for no lookup table
+ *   lookup-table-pages=4    # pages of the lookup table
+ *   properties=4            # number of properties to register
+ *   commit-interval=8       # commit after so many keys, 0 for never
+ *   forward-ratio=0.1       # ratio of key presses forwarded to the client
+ *
+ * The same keys can be set for all profiles in the environment, e.g.
+ * IBUS_BENCHMARK_DELAY=1000 or IBUS_BENCHMARK_FORWARD_RATIO=0.5.
+ */
+
+using GLib;
+using IBus;
+
+string? profiles_file = null;
+
+class BenchmarkProfile {
+    public string name;
+    public int delay = 0;
+    public int preedit_length = 0;
+    public int lookup_table_size = 0;
+    public int lookup_table_pages = 1;
+    public int properties = 0;
+    public int commit_interval = 0;
+    public double forward_ratio = 0.0;
+
+    public BenchmarkProfile(string name) {
+        this.name = name;
+    }
+
+    public void load(KeyFile keyfile) throws KeyFileError {
+        if (keyfile.has_key(name, "delay"))
+            delay = keyfile.get_integer(name, "delay");
+        if (keyfile.has_key(name, "preedit-length"))
+            preedit_length = keyfile.get_integer(name, "preedit-length");
+        if (keyfile.has_key(name, "lookup-table-size"))
+            lookup_table_size = keyfile.get_integer(name, "lookup-table-size");
+        if (keyfile.has_key(name, "lookup-table-pages"))
+            lookup_table_pages = keyfile.get_integer(name, "lookup-table-pages");
+        if (keyfile.has_key(name, "properties"))
+            properties = keyfile.get_integer(name, "properties");
+        if (keyfile.has_key(name, "commit-interval"))
+            commit_interval = keyfile.get_integer(name, "commit-interval");
+        if (keyfile.has_key(name, "forward-ratio"))
+            forward_ratio = keyfile.get_double(name, "forward-ratio");
+    }
+
+    private static int get_env_integer(string key, int value) {
+        string s = Environment.get_variable("IBUS_BENCHMARK_" + key);
+        return s != null ? int.parse(s) : value;
+    }
+
+    public void load_environment() {
+        delay = get_env_integer("DELAY", delay);
+        preedit_length = get_env_integer("PREEDIT_LENGTH", preedit_length);
+        lookup_table_size =
+            get_env_integer("LOOKUP_TABLE_SIZE", lookup_table_size);
+        lookup_table_pages =
+            get_env_integer("LOOKUP_TABLE_PAGES", lookup_table_pages);
+        properties = get_env_integer("PROPERTIES", properties);
+        commit_interval = get_env_integer("COMMIT_INTERVAL", commit_interval);
+        string s = Environment.get_variable("IBUS_BENCHMARK_FORWARD_RATIO");
+        if (s != null)
+            forward_ratio = double.parse(s);
+    }
+}
+
+class BenchmarkEngine : IBus.Engine {
+    private BenchmarkProfile m_profile;
+
+    private StringBuilder m_preedit = new StringBuilder();
+    private LookupTable m_table = null;
+    private PropList m_props = null;
+    private int m_keys = 0;
+    private double m_forward = 0.0;
+
+    private void commit() {
+        if (m_preedit.len > 0) {
+            Text text;
+            if (m_table != null && m_table.get_number_of_candidates() > 0)
+                text = m_table.get_candidate(m_table.get_cursor_pos());
+            else
+                text = new Text.from_string(m_preedit.str);
+            commit_text(text);
+        }
+        reset();
+    }
+
+    private void update() {
+        if (m_preedit.len == 0) {
+            hide_preedit_text();
+            hide_lookup_table();
+            return;
+        }
+
+        var text = new Text.from_string(m_preedit.str);
+        text.append_attribute(AttrType.UNDERLINE, AttrUnderline.SINGLE, 0, -1);
+        update_preedit_text(text, (uint) m_preedit.len, true);
+
+        if (m_table == null)
+            return;
+
+        /* build all candidates again, like an engine converting the new
+         * input would. */
+        m_table.clear();
+        int n = m_profile.lookup_table_size * m_profile.lookup_table_pages;
+        for (int i = 0; i < n; i++)
+            m_table.append_candidate(
+                new Text.from_string("%s%d".printf(m_preedit.str, i)));
+        update_lookup_table(m_table, true);
+    }
+
+    public override bool process_key_event(uint keyval,
+                                           uint keycode,
+                                           uint state) {
+        if (m_profile.delay > 0)
+            Thread.usleep(m_profile.delay);
+
+        if ((state & ModifierType.RELEASE_MASK) != 0)
+            return false;
+
+        if (m_profile.forward_ratio > 0.0) {
+            m_forward += m_profile.forward_ratio;
+            if (m_forward >= 1.0) {
+                m_forward -= 1.0;
+                forward_key_event(keyval, keycode, state);
+                return true;
+            }
+        }
+
+        if (m_profile.preedit_length <= 0)
+            return false;
+
+        if (keyval == IBus.space || keyval == IBus.Return) {
+            if (m_preedit.len == 0)
+                return false;
+            commit();
+            return true;
+        }
+
+        if (m_preedit.len > 0 && m_table != null) {
+            if (keyval == IBus.Page_Down) {
+                if (m_table.page_down())
+                    update_lookup_table(m_table, true);
+                return true;
+            }
+            if (keyval == IBus.Page_Up) {
+                if (m_table.page_up())
+                    update_lookup_table(m_table, true);
+                return true;
+            }
+        }
+
+        if (keyval < IBus.a || keyval > IBus.z)
+            return false;
+
+        if (m_preedit.len >= m_profile.preedit_length)
+            m_preedit.erase(0, 1);
+        m_preedit.append_c((char) keyval);
+
+        if (m_profile.commit_interval > 0 &&
+            ++m_keys >= m_profile.commit_interval) {
+            commit();
+            return true;
+        }
+
+        update();
+        return true;
+    }
+
+    public override void reset() {
+        m_preedit.erase();
+        m_keys = 0;
+        update();
+    }
+
+    public override void focus_in() {
+        if (m_props == null && m_profile.properties > 0) {
+            m_props = new PropList();
+            for (int i = 0; i < m_profile.properties; i++) {
+                string key = "benchmark.%d".printf(i);
+                m_props.append(new Property(key,
+                                            PropType.TOGGLE,
+                                            new Text.from_string(key),
+                                            null,
+                                            new Text.from_string(key),
+                                            true,
+                                            true,
+                                            PropState.UNCHECKED,
+                                            null));
+            }
+        }
+        if (m_props != null)
+            register_properties(m_props);
+    }
+
+    public override void focus_out() {
+        reset();
+    }
+
+    public override void property_activate(string key, uint state) {
+        for (uint i = 0; m_props != null; i++) {
+            var prop = m_props.get(i);
+            if (prop == null)
+                break;
+            if (prop.get_key() == key) {
+                prop.set_state((PropState) state);
+                update_property(prop);
+                break;
+            }
+        }
+    }
+
+    public void set_profile(BenchmarkProfile profile) {
+        m_profile = profile;
+        if (profile.lookup_table_size > 0)
+            m_table = new LookupTable(profile.lookup_table_size,
+                                      0, true, false);
+    }
+}
+
+HashTable<string, BenchmarkProfile> load_profiles() {
+    var profiles = new HashTable<string, BenchmarkProfile>(str_hash, str_equal);
+
+    var profile = new BenchmarkProfile("pinyin");
+    profile.delay = 200;
+    profile.preedit_length = 8;
+    profile.lookup_table_size = 9;
+    profile.lookup_table_pages = 4;
+    profile.properties = 4;
+    profile.commit_interval = 8;
+    profiles.insert(profile.name, profile);
+
+    profile = new BenchmarkProfile("hangul");
+    profile.delay = 50;
+    profile.preedit_length = 1;
+    profile.properties = 1;
+    profile.commit_interval = 2;
+    profiles.insert(profile.name, profile);
+
+    profile = new BenchmarkProfile("passthrough");
+    profiles.insert(profile.name, profile);
+
+    if (profiles_file == null)
+        profiles_file = Environment.get_variable("IBUS_BENCHMARK_PROFILES");
+
+    if (profiles_file != null) {
+        var keyfile = new KeyFile();
+        try {
+            keyfile.load_from_file(profiles_file, KeyFileFlags.NONE);
+            foreach (var name in keyfile.get_groups()) {
+                profile = profiles.get(name);
+                if (profile == null) {
+                    profile = new BenchmarkProfile(name);
+                    profiles.insert(name, profile);
+                }
+                profile.load(keyfile);
+            }
+        } catch (Error e) {
+            warning("Can not load profiles %s: %s", profiles_file, e.message);
+        }
+    }
+
+    foreach (var p in profiles.get_values())
+        p.load_environment();
+
+    return profiles;
+}
+
+public int main(string[] args) {
+    const OptionEntry[] options = {
+        { "profiles", 'p', 0, OptionArg.FILENAME, out profiles_file,
+          "load profiles from file", "file" },
+        { null }
+    };
+
+    var option = new OptionContext("- ibus benchmark engine");
+    option.add_main_entries(options, "ibus");
+
+    try {
+        option.parse(ref args);
+    } catch (OptionError e) {
+        warning("%s", e.message);
+        return 1;
+    }
+
+    IBus.init();
+
+    IBus.Bus bus = new IBus.Bus();
+    if (!bus.is_connected()) {
+        warning("ibus-daemon does not exist.");
+        return 1;
+    }
+
+    bus.disconnected.connect((bus) => {
+        debug("bus disconnected");
+        IBus.quit();
+    });
+
+    var profiles = load_profiles();
+
+    var component = new IBus.Component("org.freedesktop.IBus.Benchmark",
+                                       "Benchmark Engine",
+                                       "0.0.0",
+                                       "LGPL2.1",
+                                       "",
+                                       "",
+                                       "",
+                                       "ibus");
+    foreach (var profile in profiles.get_values()) {
+        component.add_engine(new IBus.EngineDesc(
+                                 "benchmark-" + profile.name,
+                                 "Benchmark (%s)".printf(profile.name),
+                                 "Synthetic engine for load tests",
+                                 "other",
+                                 "LGPL2.1",
+                                 "",
+                                 "",
+                                 "us"));
+    }
+
+    IBus.Factory factory = new IBus.Factory(bus.get_connection());
+
+    int id = 0;
+
+    factory.create_engine.connect((factory, name) => {
+        const string path = "/org/freedesktop/IBus/engine/benchmark/%d";
+        if (!name.has_prefix("benchmark-"))
+            return null;
+        var profile = profiles.get(name.substring("benchmark-".length));
+        if (profile == null)
+            return null;
+        var engine = new IBus.Engine.with_type(
+            typeof(BenchmarkEngine), name,
+            path.printf(++id), bus.get_connection()) as BenchmarkEngine;
+        engine.set_profile(profile);
+        return engine;
+    });
+
+    bus.register_component(component);
+
+    IBus.main();
+
+    return 0;
+}
@@ -171,6 +171,10 @@ class EngineBase(object.Object):
         dbus_values = serializable.serialize_object(prop)
         return self.__proxy.UpdateProperty(dbus_values)
 
+    def update_property_state(self, prop):
+        return self.__proxy.UpdatePropertyState(prop.key, prop.state,
+                                                prop.visible, prop.sensitive)
+
     def get_dbus_object(self):
         return self.__proxy
 
@@ -152,6 +152,9 @@ class IEngine(dbus.service.Object):
     @signal(signature="v")
     def UpdateProperty(self, prop): pass
 
+    @signal(signature="subb")
+    def UpdatePropertyState(self, key, state, visible, sensitive): pass
+
     @signal(signature="iu")
     def DeleteSurroundingText(self, offset_from_cursor, nchars): pass
 
@@ -90,6 +90,9 @@ class IPanel(dbus.service.Object):
     @method(in_signature="v")
     def UpdateProperty(self, prop): pass
 
+    @method(in_signature="subb")
+    def UpdatePropertyState(self, key, state, visible, sensitive): pass
+
     @method()
     def ShowLanguageBar(self): pass
 
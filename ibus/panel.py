@@ -166,6 +166,7 @@ class PanelProxy(interface.IPanel):
         self.__bus = bus
         self.__panel = panel
         self.__focus_ic = None
+        self.__props = {}
 
     def SetCursorLocation(self, x, y, w, h):
         self.__panel.set_cursor_location(x, y, w, h)
@@ -226,12 +227,28 @@ class PanelProxy(interface.IPanel):
 
     def RegisterProperties(self, props):
         props = deserialize_object(props)
+        self.__props = {}
+        self.__index_props(props)
         self.__panel.register_properties(props)
 
     def UpdateProperty(self, prop):
         prop = deserialize_object(prop)
         self.__panel.update_property(prop)
 
+    def UpdatePropertyState(self, key, state, visible, sensitive):
+        prop = self.__props.get(key)
+        if prop == None:
+            return
+        prop.state = state
+        prop.visible = visible
+        prop.sensitive = sensitive
+        self.__panel.update_property(prop)
+
+    def __index_props(self, props):
+        for prop in props:
+            self.__props.setdefault(prop.key, prop)
+            self.__index_props(prop.sub_props)
+
     def FocusIn(self, ic):
         self.__panel.focus_in(ic)
 
@@ -19,10 +19,12 @@
  * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
  * Boston, MA 02111-1307, USA.
  */
+#include "ibusinternal.h"
 #include "ibusattribute.h"
 
 /* functions prototype */
 // static void         ibus_attribute_destroy      (IBusAttribute          *attr);
+static void         ibus_attribute_dispose      (GObject                *object);
 static gboolean     ibus_attribute_serialize    (IBusAttribute          *attr,
                                                  GVariantBuilder        *builder);
 static gint         ibus_attribute_deserialize  (IBusAttribute          *attr,
@@ -35,8 +37,11 @@ G_DEFINE_TYPE (IBusAttribute, ibus_attribute, IBUS_TYPE_SERIALIZABLE)
 static void
 ibus_attribute_class_init (IBusAttributeClass *class)
 {
+    GObjectClass *gobject_class = G_OBJECT_CLASS (class);
     IBusSerializableClass *serializable_class = IBUS_SERIALIZABLE_CLASS (class);
 
+    gobject_class->dispose = ibus_attribute_dispose;
+
     serializable_class->serialize   = (IBusSerializableSerializeFunc) ibus_attribute_serialize;
     serializable_class->deserialize = (IBusSerializableDeserializeFunc) ibus_attribute_deserialize;
     serializable_class->copy        = (IBusSerializableCopyFunc) ibus_attribute_copy;
@@ -47,6 +52,13 @@ ibus_attribute_init (IBusAttribute *attr)
 {
 }
 
+static void
+ibus_attribute_dispose (GObject *object)
+{
+    G_OBJECT_CLASS (ibus_attribute_parent_class)->dispose (object);
+    _ibus_serializable_recycle (object);
+}
+
 static gboolean
 ibus_attribute_serialize (IBusAttribute   *attr,
                           GVariantBuilder *builder)
@@ -114,7 +126,7 @@ ibus_attribute_new (guint type,
         type == IBUS_ATTR_TYPE_FOREGROUND ||
         type == IBUS_ATTR_TYPE_BACKGROUND, NULL);
 
-    IBusAttribute *attr = IBUS_ATTRIBUTE (g_object_new (IBUS_TYPE_ATTRIBUTE, NULL));
+    IBusAttribute *attr = IBUS_ATTRIBUTE (_ibus_serializable_new (IBUS_TYPE_ATTRIBUTE));
 
     attr->type = type;
     attr->value = value;
@@ -19,9 +19,12 @@
  * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
  * Boston, MA 02111-1307, USA.
  */
+#include "ibusinternal.h"
 #include "ibusattrlist.h"
 
 /* functions prototype */
+static void         ibus_attr_list_dispose      (GObject                *object);
+static void         ibus_attr_list_finalize     (GObject                *object);
 static void         ibus_attr_list_destroy      (IBusAttrList           *attr_list);
 static gboolean     ibus_attr_list_serialize    (IBusAttrList           *attr_list,
                                                  GVariantBuilder        *builder);
@@ -35,9 +38,13 @@ G_DEFINE_TYPE (IBusAttrList, ibus_attr_list, IBUS_TYPE_SERIALIZABLE)
 static void
 ibus_attr_list_class_init (IBusAttrListClass *class)
 {
+    GObjectClass *gobject_class = G_OBJECT_CLASS (class);
     IBusObjectClass *object_class = IBUS_OBJECT_CLASS (class);
     IBusSerializableClass *serializable_class = IBUS_SERIALIZABLE_CLASS (class);
 
+    gobject_class->dispose = ibus_attr_list_dispose;
+    gobject_class->finalize = ibus_attr_list_finalize;
+
     object_class->destroy = (IBusObjectDestroyFunc) ibus_attr_list_destroy;
 
     serializable_class->serialize   = (IBusSerializableSerializeFunc) ibus_attr_list_serialize;
@@ -51,6 +58,20 @@ ibus_attr_list_init (IBusAttrList *attr_list)
     attr_list->attributes = g_array_new (TRUE, TRUE, sizeof (IBusAttribute *));
 }
 
+static void
+ibus_attr_list_dispose (GObject *object)
+{
+    G_OBJECT_CLASS (ibus_attr_list_parent_class)->dispose (object);
+    _ibus_serializable_recycle (object);
+}
+
+static void
+ibus_attr_list_finalize (GObject *object)
+{
+    g_array_free (((IBusAttrList *) object)->attributes, TRUE);
+    G_OBJECT_CLASS (ibus_attr_list_parent_class)->finalize (object);
+}
+
 static void
 ibus_attr_list_destroy (IBusAttrList *attr_list)
 {
@@ -67,7 +88,8 @@ ibus_attr_list_destroy (IBusAttrList *attr_list)
         g_object_unref (attr);
     }
 
-    g_array_free (attr_list->attributes, TRUE);
+    /* keep the array, so it can be reused if the list is recycled. */
+    g_array_set_size (attr_list->attributes, 0);
 
     IBUS_OBJECT_CLASS (ibus_attr_list_parent_class)->destroy ((IBusObject *)attr_list);
 }
@@ -106,14 +128,16 @@ ibus_attr_list_deserialize (IBusAttrList    *attr_list,
     gint retval = IBUS_SERIALIZABLE_CLASS (ibus_attr_list_parent_class)->deserialize ((IBusSerializable *)attr_list, variant);
     g_return_val_if_fail (retval, 0);
 
-    GVariantIter *iter = NULL;
-    g_variant_get_child (variant, retval++, "av", &iter);
+    GVariantIter iter;
+    GVariant *array = g_variant_get_child_value (variant, retval++);
     GVariant *var;
-    while (g_variant_iter_loop (iter, "v", &var)) {
+    g_variant_iter_init (&iter, array);
+    while ((var = g_variant_iter_next_value (&iter)) != NULL) {
         IBusAttribute *attr = IBUS_ATTRIBUTE (ibus_serializable_deserialize (var));
         ibus_attr_list_append (attr_list, attr);
+        g_variant_unref (var);
     }
-    g_variant_iter_free (iter);
+    g_variant_unref (array);
 
     return retval;
 }
@@ -155,7 +179,7 @@ IBusAttrList *
 ibus_attr_list_new ()
 {
     IBusAttrList *attr_list;
-    attr_list = g_object_new (IBUS_TYPE_ATTR_LIST, NULL);
+    attr_list = _ibus_serializable_new (IBUS_TYPE_ATTR_LIST);
     return attr_list;
 }
 
@@ -45,6 +45,7 @@ enum {
     DISCONNECTED,
     GLOBAL_ENGINE_CHANGED,
     NAME_OWNER_CHANGED,
+    ENGINES_CHANGED,
     LAST_SIGNAL,
 };
 
@@ -59,6 +60,15 @@ struct _IBusBusPrivate {
     guint watch_ibus_signal_id;
     IBusConfig *config;
     gchar *unique_name;
+
+    /* The engine descriptions fetched from ibus-daemon. They are fetched
+     * once and kept up to date with the EnginesChanged signal. */
+    guint watch_engines_signal_id;
+    GHashTable *engines;
+    GList *engine_list;
+    gboolean active_engines_cached;
+    GList *active_engine_list;
+    GHashTable *pending_engines;
 };
 
 static guint    bus_signals[LAST_SIGNAL] = { 0 };
@@ -74,6 +84,7 @@ static void      ibus_bus_watch_dbus_signal     (IBusBus                *bus);
 static void      ibus_bus_unwatch_dbus_signal   (IBusBus                *bus);
 static void      ibus_bus_watch_ibus_signal     (IBusBus                *bus);
 static void      ibus_bus_unwatch_ibus_signal   (IBusBus                *bus);
+static void      ibus_bus_clear_engine_cache    (IBusBus                *bus);
 static GVariant *ibus_bus_call_sync             (IBusBus                *bus,
                                                  const gchar            *service,
                                                  const gchar            *path,
@@ -180,6 +191,29 @@ ibus_bus_class_init (IBusBusClass *class)
             3,
             G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
 
+    /**
+     * IBusBus::engines-changed:
+     * @bus: The #IBusBus object which recevied the signal
+     * @added: The names of the engines which are newly available.
+     * @removed: The names of the engines which are not available anymore.
+     * @updated: The names of the engines whose descriptions are changed.
+     *
+     * Emitted when engines are registered or unregistered in ibus-daemon,
+     * after the engine list of @bus is updated. It is emitted only after
+     * engines were listed with @bus.
+     *
+     */
+    bus_signals[ENGINES_CHANGED] =
+        g_signal_new (I_("engines-changed"),
+            G_TYPE_FROM_CLASS (class),
+            G_SIGNAL_RUN_LAST,
+            0,
+            NULL, NULL,
+            _ibus_marshal_VOID__BOXED_BOXED_BOXED,
+            G_TYPE_NONE,
+            3,
+            G_TYPE_STRV, G_TYPE_STRV, G_TYPE_STRV);
+
     g_type_class_add_private (class, sizeof (IBusBusPrivate));
 }
 
@@ -229,6 +263,68 @@ _connection_ibus_signal_cb (GDBusConnection *connection,
     /* FIXME handle org.freedesktop.IBus.RegistryChanged signal if needed */
 }
 
+static void
+_remove_engine_by_name (GList      **list,
+                        const gchar *name)
+{
+    GList *p;
+    for (p = *list; p != NULL; p = p->next) {
+        IBusEngineDesc *desc = (IBusEngineDesc *) p->data;
+        if (g_strcmp0 (ibus_engine_desc_get_name (desc), name) == 0) {
+            *list = g_list_delete_link (*list, p);
+            g_object_unref (desc);
+            return;
+        }
+    }
+}
+
+static void
+_connection_engines_changed_cb (GDBusConnection *connection,
+                                const gchar *sender_name,
+                                const gchar *object_path,
+                                const gchar *interface_name,
+                                const gchar *signal_name,
+                                GVariant *parameters,
+                                gpointer user_data)
+{
+    g_return_if_fail (user_data != NULL);
+    g_return_if_fail (IBUS_IS_BUS (user_data));
+
+    IBusBus *bus = IBUS_BUS (user_data);
+    gchar **added = NULL;
+    gchar **removed = NULL;
+    gchar **updated = NULL;
+    gint i;
+
+    g_variant_get (parameters, "(^as^as^as)", &added, &removed, &updated);
+
+    /* The engines in the registry are not changed while ibus-daemon is
+     * running, so only the active engines need to be updated. The new
+     * descriptions are fetched when the active engines are listed. */
+    if (bus->priv->active_engines_cached) {
+        for (i = 0; removed[i] != NULL; i++) {
+            _remove_engine_by_name (&bus->priv->active_engine_list, removed[i]);
+            g_hash_table_remove (bus->priv->pending_engines, removed[i]);
+        }
+        for (i = 0; updated[i] != NULL; i++) {
+            _remove_engine_by_name (&bus->priv->active_engine_list, updated[i]);
+            g_hash_table_insert (bus->priv->pending_engines,
+                                 g_strdup (updated[i]), NULL);
+        }
+        for (i = 0; added[i] != NULL; i++) {
+            g_hash_table_insert (bus->priv->pending_engines,
+                                 g_strdup (added[i]), NULL);
+        }
+    }
+
+    g_signal_emit (bus, bus_signals[ENGINES_CHANGED], 0,
+                   added, removed, updated);
+
+    g_strfreev (added);
+    g_strfreev (removed);
+    g_strfreev (updated);
+}
+
 static void
 _connection_closed_cb (GDBusConnection  *connection,
                        gboolean          remote_peer_vanished,
@@ -258,6 +354,10 @@ _connection_closed_cb (GDBusConnection  *connection,
     bus->priv->watch_dbus_signal_id = 0;
     bus->priv->watch_ibus_signal_id = 0;
 
+    /* the engines may be changed when ibus-daemon restarts */
+    bus->priv->watch_engines_signal_id = 0;
+    ibus_bus_clear_engine_cache (bus);
+
     g_signal_emit (bus, bus_signals[DISCONNECTED], 0);
 }
 
@@ -266,6 +366,7 @@ ibus_bus_connect (IBusBus *bus)
 {
     /* unref the old connection at first */
     if (bus->priv->connection != NULL) {
+        ibus_bus_clear_engine_cache (bus);
         g_signal_handlers_disconnect_by_func (bus->priv->connection,
                                               G_CALLBACK (_connection_closed_cb),
                                               bus);
@@ -334,6 +435,12 @@ ibus_bus_init (IBusBus *bus)
     bus->priv->watch_ibus_signal = FALSE;
     bus->priv->watch_ibus_signal_id = 0;
     bus->priv->unique_name = NULL;
+    bus->priv->watch_engines_signal_id = 0;
+    bus->priv->engines = NULL;
+    bus->priv->engine_list = NULL;
+    bus->priv->active_engines_cached = FALSE;
+    bus->priv->active_engine_list = NULL;
+    bus->priv->pending_engines = NULL;
 
     path = g_path_get_dirname (ibus_get_socket_path ());
 
@@ -397,6 +504,8 @@ ibus_bus_destroy (IBusObject *object)
         bus->priv->config = NULL;
     }
 
+    ibus_bus_clear_engine_cache (bus);
+
     if (bus->priv->connection) {
         g_signal_handlers_disconnect_by_func (bus->priv->connection,
                                               G_CALLBACK (_connection_closed_cb),
@@ -1361,34 +1470,175 @@ ibus_bus_register_component_async_finish (IBusBus      *bus,
     return _async_finish_void (res, error);
 }
 
+static void
+ibus_bus_clear_engine_cache (IBusBus *bus)
+{
+    if (bus->priv->watch_engines_signal_id != 0) {
+        g_dbus_connection_signal_unsubscribe (bus->priv->connection,
+                                              bus->priv->watch_engines_signal_id);
+        bus->priv->watch_engines_signal_id = 0;
+    }
+
+    if (bus->priv->engines != NULL) {
+        g_hash_table_destroy (bus->priv->engines);
+        bus->priv->engines = NULL;
+    }
+    g_list_free_full (bus->priv->engine_list, g_object_unref);
+    bus->priv->engine_list = NULL;
+
+    bus->priv->active_engines_cached = FALSE;
+    g_list_free_full (bus->priv->active_engine_list, g_object_unref);
+    bus->priv->active_engine_list = NULL;
+    if (bus->priv->pending_engines != NULL) {
+        g_hash_table_destroy (bus->priv->pending_engines);
+        bus->priv->pending_engines = NULL;
+    }
+}
+
 static GList *
-ibus_bus_do_list_engines (IBusBus *bus, gboolean active_engines_only)
+_deserialize_engines (GVariant *variant)
 {
-    g_return_val_if_fail (IBUS_IS_BUS (bus), NULL);
+    GList *retval = NULL;
+    GVariantIter *iter = NULL;
+    g_variant_get (variant, "(av)", &iter);
+    GVariant *var;
+    while (g_variant_iter_loop (iter, "v", &var)) {
+        IBusSerializable *serializable = ibus_serializable_deserialize (var);
+        g_object_ref_sink (serializable);
+        retval = g_list_prepend (retval, serializable);
+    }
+    g_variant_iter_free (iter);
+    return g_list_reverse (retval);
+}
 
+static GList *
+ibus_bus_fetch_engines (IBusBus     *bus,
+                        const gchar *member,
+                        GVariant    *parameters,
+                        gboolean    *succeeded)
+{
     GList *retval = NULL;
     GVariant *result;
     result = ibus_bus_call_sync (bus,
                                  IBUS_SERVICE_IBUS,
                                  IBUS_PATH_IBUS,
                                  IBUS_INTERFACE_IBUS,
-                                 active_engines_only ? "ListActiveEngines" : "ListEngines",
-                                 NULL,
+                                 member,
+                                 parameters,
                                  G_VARIANT_TYPE ("(av)"));
-
+    *succeeded = (result != NULL);
     if (result) {
-        GVariantIter *iter = NULL;
-        g_variant_get (result, "(av)", &iter);
-        GVariant *var;
-        while (g_variant_iter_loop (iter, "v", &var)) {
-            IBusSerializable *serializable = ibus_serializable_deserialize (var);
-            g_object_ref_sink (serializable);
-            retval = g_list_append (retval, serializable);
-        }
-        g_variant_iter_free (iter);
+        retval = _deserialize_engines (result);
         g_variant_unref (result);
     }
+    return retval;
+}
+
+/**
+ * ibus_bus_update_engine_cache:
+ * @active_engines_only: %TRUE to update the active engine list, %FALSE to
+ * update the list of all engines.
+ * @returns: %TRUE if the cached list is up to date.
+ *
+ * Fetch the engine list from ibus-daemon if it is not fetched yet, or fetch
+ * only the engines which were added or updated since the last call.
+ */
+static gboolean
+ibus_bus_update_engine_cache (IBusBus *bus,
+                              gboolean active_engines_only)
+{
+    IBusBusPrivate *priv = bus->priv;
+    gboolean succeeded;
+    GList *p;
+
+    g_return_val_if_fail (ibus_bus_is_connected (bus), FALSE);
+
+    /* Watch the changes before fetching the engines, so no change is
+     * missed between fetching and watching. */
+    if (priv->watch_engines_signal_id == 0) {
+        priv->watch_engines_signal_id =
+            g_dbus_connection_signal_subscribe (priv->connection,
+                                                "org.freedesktop.IBus",
+                                                IBUS_INTERFACE_IBUS,
+                                                "EnginesChanged",
+                                                IBUS_PATH_IBUS,
+                                                NULL /* arg0 */,
+                                                (GDBusSignalFlags) 0,
+                                                _connection_engines_changed_cb,
+                                                bus,
+                                                NULL /* user_data_free_func */);
+    }
+
+    if (!active_engines_only) {
+        if (priv->engines != NULL)
+            return TRUE;
+        priv->engine_list = ibus_bus_fetch_engines (bus, "ListEngines",
+                                                    NULL, &succeeded);
+        if (!succeeded)
+            return FALSE;
+        priv->engines = g_hash_table_new (g_str_hash, g_str_equal);
+        for (p = priv->engine_list; p != NULL; p = p->next) {
+            g_hash_table_insert (priv->engines,
+                (gpointer) ibus_engine_desc_get_name ((IBusEngineDesc *) p->data),
+                p->data);
+        }
+        return TRUE;
+    }
+
+    if (!priv->active_engines_cached) {
+        priv->active_engine_list =
+            ibus_bus_fetch_engines (bus, "ListActiveEngines", NULL, &succeeded);
+        if (!succeeded)
+            return FALSE;
+        priv->active_engines_cached = TRUE;
+        priv->pending_engines = g_hash_table_new_full (g_str_hash,
+                                                       g_str_equal,
+                                                       g_free,
+                                                       NULL);
+        return TRUE;
+    }
+
+    if (g_hash_table_size (priv->pending_engines) != 0) {
+        GPtrArray *names = g_ptr_array_new ();
+        GHashTableIter iter;
+        gpointer name;
+        g_hash_table_iter_init (&iter, priv->pending_engines);
+        while (g_hash_table_iter_next (&iter, &name, NULL))
+            g_ptr_array_add (names, name);
+        g_ptr_array_add (names, NULL);
+
+        GList *engines = ibus_bus_fetch_engines (bus,
+                "GetEnginesByNames",
+                g_variant_new ("(^as)", (gchar **) names->pdata),
+                &succeeded);
+        g_ptr_array_free (names, TRUE);
+        if (!succeeded)
+            return FALSE;
+        /* An engine added before the active engines were listed is already
+         * in the list, so replace it instead of adding a duplicate. */
+        for (p = engines; p != NULL; p = p->next) {
+            _remove_engine_by_name (&priv->active_engine_list,
+                    ibus_engine_desc_get_name ((IBusEngineDesc *) p->data));
+        }
+        priv->active_engine_list = g_list_concat (priv->active_engine_list,
+                                                  engines);
+        g_hash_table_remove_all (priv->pending_engines);
+    }
+    return TRUE;
+}
+
+static GList *
+ibus_bus_do_list_engines (IBusBus *bus, gboolean active_engines_only)
+{
+    g_return_val_if_fail (IBUS_IS_BUS (bus), NULL);
+
+    if (!ibus_bus_update_engine_cache (bus, active_engines_only))
+        return NULL;
 
+    GList *retval;
+    retval = g_list_copy (active_engines_only ? bus->priv->active_engine_list :
+                                                bus->priv->engine_list);
+    g_list_foreach (retval, (GFunc) g_object_ref, NULL);
     return retval;
 }
 
@@ -1432,17 +1682,7 @@ ibus_bus_list_engines_async_finish (IBusBus      *bus,
     GVariant *variant = g_simple_async_result_get_op_res_gpointer (simple);
     g_return_val_if_fail (variant != NULL, NULL);
 
-    GList *retval = NULL;
-    GVariantIter *iter = NULL;
-    g_variant_get (variant, "(av)", &iter);
-    GVariant *var;
-    while (g_variant_iter_loop (iter, "v", &var)) {
-        IBusSerializable *serializable = ibus_serializable_deserialize (var);
-        g_object_ref_sink (serializable);
-        retval = g_list_append (retval, serializable);
-    }
-    g_variant_iter_free (iter);
-    return retval;
+    return _deserialize_engines (variant);
 }
 
 GList *
@@ -1488,28 +1728,37 @@ ibus_bus_get_engines_by_names (IBusBus             *bus,
 {
     g_return_val_if_fail (IBUS_IS_BUS (bus), NULL);
 
-    GVariant *result;
-    result = ibus_bus_call_sync (bus,
-                                 IBUS_SERVICE_IBUS,
-                                 IBUS_PATH_IBUS,
-                                 IBUS_INTERFACE_IBUS,
-                                 "GetEnginesByNames",
-                                 g_variant_new("(^as)", names),
-                                 G_VARIANT_TYPE ("(av)"));
-    if (result == NULL)
+    if (!ibus_bus_update_engine_cache (bus, FALSE))
         return NULL;
-    
+
     GArray *array = g_array_new (TRUE, TRUE, sizeof (IBusEngineDesc *));
-    GVariantIter *iter = NULL;
-    g_variant_get (result, "(av)", &iter);
-    GVariant *var;
-    while (g_variant_iter_loop (iter, "v", &var)) {
-        IBusEngineDesc *desc = (IBusEngineDesc *) ibus_serializable_deserialize (var);
-        g_object_ref_sink (desc);
+    gboolean active_engines_updated = FALSE;
+    gint i;
+    for (i = 0; names[i] != NULL; i++) {
+        IBusEngineDesc *desc = (IBusEngineDesc *)
+                g_hash_table_lookup (bus->priv->engines, names[i]);
+
+        /* engines of registered components may not be in the registry */
+        if (desc == NULL) {
+            if (!active_engines_updated) {
+                ibus_bus_update_engine_cache (bus, TRUE);
+                active_engines_updated = TRUE;
+            }
+            GList *p;
+            for (p = bus->priv->active_engine_list; p != NULL; p = p->next) {
+                if (g_strcmp0 (ibus_engine_desc_get_name (
+                        (IBusEngineDesc *) p->data), names[i]) == 0) {
+                    desc = (IBusEngineDesc *) p->data;
+                    break;
+                }
+            }
+        }
+
+        if (desc == NULL)
+            continue;
+        g_object_ref (desc);
         g_array_append_val (array, desc);
     }
-    g_variant_iter_free (iter);
-    g_variant_unref (result);
 
     return (IBusEngineDesc **)g_array_free (array, FALSE);
 }
@@ -628,7 +628,8 @@ gboolean     ibus_bus_register_component_async_finish
  * @bus: An #IBusBus.
  * @returns: (transfer container) (element-type IBusEngineDesc): A List of engines.
  *
- * List engines synchronously.
+ * List engines synchronously. The engines are fetched from ibus-daemon on
+ * the first call only, later calls return the engines cached in @bus.
  */
 GList       *ibus_bus_list_engines      (IBusBus        *bus);
 
@@ -671,7 +672,9 @@ GList       *ibus_bus_list_engines_async_finish
  * @bus: An #IBusBus.
  * @returns: (transfer container) (element-type IBusEngineDesc): A List of active engines.
  *
- * List active engines synchronously.
+ * List active engines synchronously. The list is cached in @bus and kept up
+ * to date with the changes notified by ibus-daemon, so only the engines
+ * registered since the last call are fetched.
  */
 GList       *ibus_bus_list_active_engines
                                         (IBusBus        *bus);
@@ -716,7 +719,8 @@ GList       *ibus_bus_list_active_engines_async_finish
  * @names: (array zero-terminated=1): A %NULL-terminated array of names.
  * @returns: (array zero-terminated=1) (transfer full): A %NULL-terminated array of engines.
  *
- * Get engines by given names synchronously.
+ * Get engines by given names synchronously. The engines are looked up in
+ * the engine list cached in @bus, see ibus_bus_list_engines().
  * TODO(penghuang): add asynchronous version
  */
 IBusEngineDesc **
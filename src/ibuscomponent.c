@@ -21,6 +21,7 @@
  */
 #include <glib/gstdio.h>
 #include "ibuscomponent.h"
+#include "ibusinternal.h"
 
 enum {
     LAST_SIGNAL,
@@ -88,6 +89,10 @@ static void         ibus_component_parse_observed_paths
                                                 (IBusComponent          *component,
                                                  XMLNode                *node,
                                                  gboolean                access_fs);
+static void         ibus_component_append_observed_path
+                                                (IBusComponent          *component,
+                                                 IBusObservedPath       *path,
+                                                 gboolean                access_fs);
 
 G_DEFINE_TYPE (IBusComponent, ibus_component, IBUS_TYPE_SERIALIZABLE)
 
@@ -541,6 +546,33 @@ ibus_component_output_engines (IBusComponent  *component,
     g_string_append (output, "</engines>\n");
 }
 
+static gboolean
+ibus_component_set_xml_field (IBusComponent *component,
+                              const gchar   *element_name,
+                              const gchar   *text)
+{
+#define PARSE_ENTRY(field_name, element)                                \
+    if (g_strcmp0 (element_name, element) == 0) {                       \
+        if (component->priv->field_name != NULL) {                      \
+            g_free (component->priv->field_name);                       \
+        }                                                               \
+        component->priv->field_name = g_strdup (text);                  \
+        return TRUE;                                                    \
+    }
+#define PARSE_ENTRY_1(name) PARSE_ENTRY (name, #name)
+    PARSE_ENTRY_1 (name);
+    PARSE_ENTRY_1 (description);
+    PARSE_ENTRY_1 (version);
+    PARSE_ENTRY_1 (license);
+    PARSE_ENTRY_1 (author);
+    PARSE_ENTRY_1 (homepage);
+    PARSE_ENTRY_1 (exec);
+    PARSE_ENTRY_1 (textdomain);
+#undef PARSE_ENTRY
+#undef PARSE_ENTRY_1
+    return FALSE;
+}
+
 static gboolean
 ibus_component_parse_xml_node (IBusComponent   *component,
                               XMLNode          *node,
@@ -557,25 +589,9 @@ ibus_component_parse_xml_node (IBusComponent   *component,
     for (p = node->sub_nodes; p != NULL; p = p->next) {
         XMLNode *sub_node = (XMLNode *)p->data;
 
-#define PARSE_ENTRY(field_name, element_name)                           \
-        if (g_strcmp0 (sub_node->name, element_name) == 0) {            \
-            if (component->priv->field_name != NULL) {                  \
-                g_free (component->priv->field_name);                   \
-            }                                                           \
-            component->priv->field_name = g_strdup (sub_node->text);    \
-            continue;                                                   \
+        if (ibus_component_set_xml_field (component, sub_node->name, sub_node->text)) {
+            continue;
         }
-#define PARSE_ENTRY_1(name) PARSE_ENTRY (name, #name)
-        PARSE_ENTRY_1 (name);
-        PARSE_ENTRY_1 (description);
-        PARSE_ENTRY_1 (version);
-        PARSE_ENTRY_1 (license);
-        PARSE_ENTRY_1 (author);
-        PARSE_ENTRY_1 (homepage);
-        PARSE_ENTRY_1 (exec);
-        PARSE_ENTRY_1 (textdomain);
-#undef PARSE_ENTRY
-#undef PARSE_ENTRY_1
 
         if (g_strcmp0 (sub_node->name, "engines") == 0) {
             ibus_component_parse_engines (component, sub_node);
@@ -593,7 +609,6 @@ ibus_component_parse_xml_node (IBusComponent   *component,
     return TRUE;
 }
 
-
 static void
 ibus_component_parse_engines (IBusComponent *component,
                               XMLNode       *node)
@@ -662,17 +677,337 @@ ibus_component_parse_observed_paths (IBusComponent    *component,
         IBusObservedPath *path;
 
         path = ibus_observed_path_new_from_xml_node ((XMLNode *)p->data, access_fs);
-        g_object_ref_sink (path);
-        component->priv->observed_paths = g_list_append (component->priv->observed_paths, path);
+        if (path == NULL)
+            continue;
+        ibus_component_append_observed_path (component, path, access_fs);
+    }
+}
+
+static void
+ibus_component_append_observed_path (IBusComponent    *component,
+                                     IBusObservedPath *path,
+                                     gboolean          access_fs)
+{
+    g_object_ref_sink (path);
+    component->priv->observed_paths = g_list_append (component->priv->observed_paths, path);
+
+    if (access_fs && path->is_dir && path->is_exist) {
+        component->priv->observed_paths =
+                g_list_concat(component->priv->observed_paths,
+                              ibus_observed_path_traverse(path));
+    }
+}
+
+typedef struct {
+    /* the engines parsed so far, in the reversed order */
+    GList         *engines;
+    gint           depth;
+} EnginesMarkupData;
+
+static void
+_engines_start_element_cb (GMarkupParseContext *context,
+                           const gchar         *element_name,
+                           const gchar        **attribute_names,
+                           const gchar        **attribute_values,
+                           gpointer             user_data,
+                           GError             **error)
+{
+    EnginesMarkupData *data = (EnginesMarkupData *) user_data;
+
+    data->depth++;
+    if (data->depth == 1 && g_strcmp0 (element_name, "engines") != 0) {
+        g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                     "Root element <%s> is not <engines>", element_name);
+        return;
+    }
+    if (data->depth == 2 && g_strcmp0 (element_name, "engine") == 0) {
+        ibus_engine_desc_start_markup (context);
+    }
+}
+
+static void
+_engines_end_element_cb (GMarkupParseContext *context,
+                         const gchar         *element_name,
+                         gpointer             user_data,
+                         GError             **error)
+{
+    EnginesMarkupData *data = (EnginesMarkupData *) user_data;
+
+    if (data->depth == 2 && g_strcmp0 (element_name, "engine") == 0) {
+        IBusEngineDesc *desc = ibus_engine_desc_end_markup (context);
+        data->engines = g_list_prepend (data->engines, desc);
+    }
+    data->depth--;
+}
+
+static const GMarkupParser _engines_markup_parser = {
+    _engines_start_element_cb,
+    _engines_end_element_cb,
+    0,
+    0,
+    0,
+};
+
+/**
+ * ibus_component_load_engines_from_exec:
+ *
+ * Run the command in &lt;engines exec="..."&gt; and load the engines
+ * from its output. Returns FALSE if the output is not an &lt;engines&gt;
+ * element, then the engines in the component file should be used.
+ */
+static gboolean
+ibus_component_load_engines_from_exec (IBusComponent *component,
+                                       const gchar   *exec)
+{
+    gchar *output = NULL;
+    gboolean retval;
+    GList *p;
+    EnginesMarkupData data = { NULL, 0 };
+
+    if (!g_spawn_command_line_sync (exec, &output, NULL, NULL, NULL)) {
+        return FALSE;
+    }
+
+    retval = ibus_xml_parse_buffer_with_parser (output,
+                                                &_engines_markup_parser,
+                                                &data);
+    g_free (output);
+
+    /* Add the engines only if the whole output is parsed, like the
+     * engines in the component file are used all or none. */
+    data.engines = g_list_reverse (data.engines);
+    for (p = data.engines; p != NULL; p = p->next) {
+        if (retval)
+            ibus_component_add_engine (component, (IBusEngineDesc *) p->data);
+        else
+            g_object_unref (p->data);
+    }
+    g_list_free (data.engines);
+
+    return retval;
+}
+
+enum {
+    COMPONENT_SECTION_NONE = 0,
+    COMPONENT_SECTION_ENGINES,
+    COMPONENT_SECTION_OBSERVED_PATHS,
+};
+
+typedef struct {
+    IBusComponent *component;
+    gboolean       access_fs;
+    /* text of the current child element of <component> */
+    GString       *text;
+    gint           depth;
+    gint           section;
+    /* TRUE if the engines were loaded from <engines exec="..."> */
+    gboolean       skip_engines;
+} ComponentMarkupData;
+
+static void
+_component_start_element_cb (GMarkupParseContext *context,
+                             const gchar         *element_name,
+                             const gchar        **attribute_names,
+                             const gchar        **attribute_values,
+                             gpointer             user_data,
+                             GError             **error)
+{
+    ComponentMarkupData *data = (ComponentMarkupData *) user_data;
+
+    data->depth++;
+
+    if (data->depth == 1) {
+        g_string_truncate (data->text, 0);
+        data->section = COMPONENT_SECTION_NONE;
+
+        if (g_strcmp0 (element_name, "engines") == 0) {
+            const gchar *exec = NULL;
+            gint i;
 
-        if (access_fs && path->is_dir && path->is_exist) {
-            component->priv->observed_paths =
-                    g_list_concat(component->priv->observed_paths,
-                                  ibus_observed_path_traverse(path));
+            data->section = COMPONENT_SECTION_ENGINES;
+            for (i = 0; attribute_names[i] != NULL; i++) {
+                if (g_strcmp0 (attribute_names[i], "exec") == 0) {
+                    exec = attribute_values[i];
+                    break;
+                }
+            }
+            if (exec != NULL) {
+                data->skip_engines =
+                    ibus_component_load_engines_from_exec (data->component,
+                                                           exec);
+            }
+        }
+        else if (g_strcmp0 (element_name, "observed-paths") == 0) {
+            data->section = COMPONENT_SECTION_OBSERVED_PATHS;
+        }
+        return;
+    }
+
+    if (data->depth == 2) {
+        if (data->section == COMPONENT_SECTION_ENGINES &&
+            !data->skip_engines &&
+            g_strcmp0 (element_name, "engine") == 0) {
+            ibus_engine_desc_start_markup (context);
+        }
+        else if (data->section == COMPONENT_SECTION_OBSERVED_PATHS &&
+                 g_strcmp0 (element_name, "path") == 0) {
+            ibus_observed_path_start_markup (context,
+                                             attribute_names,
+                                             attribute_values);
         }
     }
 }
 
+static void
+_component_end_element_cb (GMarkupParseContext *context,
+                           const gchar         *element_name,
+                           gpointer             user_data,
+                           GError             **error)
+{
+    ComponentMarkupData *data = (ComponentMarkupData *) user_data;
+
+    if (data->depth == 1 && data->section == COMPONENT_SECTION_NONE) {
+        const gchar *text = data->text->str;
+        if (ibus_xml_text_is_space (data->text->str, data->text->len))
+            text = "";
+        if (!ibus_component_set_xml_field (data->component, element_name, text))
+            g_warning ("<component> element contains invalidate element <%s>", element_name);
+    }
+    else if (data->depth == 2) {
+        if (data->section == COMPONENT_SECTION_ENGINES &&
+            !data->skip_engines &&
+            g_strcmp0 (element_name, "engine") == 0) {
+            ibus_component_add_engine (data->component,
+                                       ibus_engine_desc_end_markup (context));
+        }
+        else if (data->section == COMPONENT_SECTION_OBSERVED_PATHS &&
+                 g_strcmp0 (element_name, "path") == 0) {
+            IBusObservedPath *path;
+            path = ibus_observed_path_end_markup (context, data->access_fs);
+            if (path != NULL)
+                ibus_component_append_observed_path (data->component,
+                                                     path,
+                                                     data->access_fs);
+        }
+    }
+
+    data->depth--;
+}
+
+static void
+_component_text_cb (GMarkupParseContext *context,
+                    const gchar         *text,
+                    gsize                text_len,
+                    gpointer             user_data,
+                    GError             **error)
+{
+    ComponentMarkupData *data = (ComponentMarkupData *) user_data;
+
+    if (data->depth == 1 && data->section == COMPONENT_SECTION_NONE)
+        g_string_append_len (data->text, text, text_len);
+}
+
+static void
+_component_markup_data_free (ComponentMarkupData *data)
+{
+    g_string_free (data->text, TRUE);
+    g_slice_free (ComponentMarkupData, data);
+}
+
+static void
+_component_error_cb (GMarkupParseContext *context,
+                     GError              *error,
+                     gpointer             user_data)
+{
+    ComponentMarkupData *data = (ComponentMarkupData *) user_data;
+
+    g_object_unref (data->component);
+    _component_markup_data_free (data);
+
+    _ibus_xml_markup_error (context, error);
+}
+
+static const GMarkupParser _component_markup_parser = {
+    _component_start_element_cb,
+    _component_end_element_cb,
+    _component_text_cb,
+    0,
+    _component_error_cb,
+};
+
+void
+ibus_component_start_markup (GMarkupParseContext *context,
+                             gboolean             access_fs)
+{
+    g_assert (context);
+
+    ComponentMarkupData *data = g_slice_new0 (ComponentMarkupData);
+
+    data->component = (IBusComponent *) g_object_new (IBUS_TYPE_COMPONENT, NULL);
+    data->access_fs = access_fs;
+    data->text = g_string_new ("");
+
+    _ibus_xml_markup_push (context, &_component_markup_parser, data);
+}
+
+IBusComponent *
+ibus_component_end_markup (GMarkupParseContext *context)
+{
+    g_assert (context);
+
+    ComponentMarkupData *data;
+    IBusComponent *component;
+
+    data = (ComponentMarkupData *) _ibus_xml_markup_pop (context);
+    component = data->component;
+
+    _component_markup_data_free (data);
+
+    return component;
+}
+
+typedef struct {
+    IBusComponent *component;
+    gboolean       access_fs;
+    gint           depth;
+} ComponentFileMarkupData;
+
+static void
+_component_file_start_element_cb (GMarkupParseContext *context,
+                                  const gchar         *element_name,
+                                  const gchar        **attribute_names,
+                                  const gchar        **attribute_values,
+                                  gpointer             user_data,
+                                  GError             **error)
+{
+    ComponentFileMarkupData *data = (ComponentFileMarkupData *) user_data;
+
+    if (data->depth++ == 0 && g_strcmp0 (element_name, "component") == 0) {
+        ibus_component_start_markup (context, data->access_fs);
+    }
+}
+
+static void
+_component_file_end_element_cb (GMarkupParseContext *context,
+                                const gchar         *element_name,
+                                gpointer             user_data,
+                                GError             **error)
+{
+    ComponentFileMarkupData *data = (ComponentFileMarkupData *) user_data;
+
+    if (--data->depth == 0 && g_strcmp0 (element_name, "component") == 0) {
+        data->component = ibus_component_end_markup (context);
+    }
+}
+
+static const GMarkupParser _component_file_markup_parser = {
+    _component_file_start_element_cb,
+    _component_file_end_element_cb,
+    0,
+    0,
+    0,
+};
+
 #define IBUS_COMPONENT_GET_PROPERTY(property, return_type)  \
 return_type                                                 \
 ibus_component_get_ ## property (IBusComponent *component)  \
@@ -757,26 +1092,25 @@ ibus_component_new_from_file (const gchar *filename)
 {
     g_assert (filename);
 
-    XMLNode *node;
     struct stat buf;
     IBusComponent *component;
     gboolean retval;
+    ComponentFileMarkupData data = { NULL, TRUE, 0 };
 
     if (g_stat (filename, &buf) != 0) {
         g_warning ("Can not get stat of file %s", filename);
         return NULL;
     }
 
-    node = ibus_xml_parse_file (filename);
+    retval = ibus_xml_parse_file_with_parser (filename,
+                                              &_component_file_markup_parser,
+                                              &data);
+    component = data.component;
 
-    if (!node) {
+    if (component == NULL) {
         return NULL;
     }
 
-    component = (IBusComponent *)g_object_new (IBUS_TYPE_COMPONENT, NULL);
-    retval = ibus_component_parse_xml_node (component, node, TRUE);
-    ibus_xml_free (node);
-
     if (!retval) {
         g_object_unref (component);
         component = NULL;
@@ -155,6 +155,33 @@ IBusComponent   *ibus_component_new_varargs     (const gchar    *first_property_
 IBusComponent   *ibus_component_new_from_xml_node
                                                 (XMLNode        *node);
 
+/**
+ * ibus_component_start_markup:
+ * @context: A GMarkupParseContext.
+ * @access_fs: Fill the status of observed paths from the file system.
+ *
+ * Push a sub parser which builds an IBusComponent from the content of
+ * a &lt;component&gt; element directly, without building an XML tree.
+ * It should be called from the start_element callback of the parent
+ * parser for the &lt;component&gt; element, and must be paired with
+ * ibus_component_end_markup() in the end_element callback of the same
+ * element.
+ */
+void             ibus_component_start_markup    (GMarkupParseContext
+                                                                *context,
+                                                 gboolean        access_fs);
+
+/**
+ * ibus_component_end_markup:
+ * @context: A GMarkupParseContext.
+ * @returns: A newly allocated IBusComponent.
+ *
+ * Pop the sub parser pushed by ibus_component_start_markup(), and
+ * return the IBusComponent it built.
+ */
+IBusComponent   *ibus_component_end_markup      (GMarkupParseContext
+                                                                *context);
+
 /**
  * ibus_component_new_from_file:
  * @filename: An XML file that contains component information.
@@ -162,8 +189,7 @@ IBusComponent   *ibus_component_new_from_xml_node
  *
  * New an IBusComponent from an XML file.
  * Note that a component file usually contains engine descriptions,
- * if it does, ibus_engine_desc_new_from_xml_node() will be called
- * to load the engine descriptions.
+ * if it does, they are loaded with ibus_engine_desc_start_markup().
  */
 IBusComponent   *ibus_component_new_from_file   (const gchar    *filename);
 
@@ -20,8 +20,10 @@
  * Boston, MA 02111-1307, USA.
  */
 #include "ibusengine.h"
+#include <glib/gstdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <unistd.h>
 #include "ibusmarshalers.h"
 #include "ibusinternal.h"
 #include "ibusshare.h"
@@ -68,8 +70,44 @@ struct _IBusEnginePrivate {
     IBusText *surrounding_text;
     guint surrounding_cursor_pos;
     guint selection_anchor_pos;
+
+    /* the surrounding text last received from ibus-daemon, which the
+       UpdateSurroundingText edits apply to. Unlike surrounding_text, it is
+       not changed by ibus_engine_delete_surrounding_text. */
+    IBusText *surrounding_base;
+
+    /* the characters of surrounding text wanted before and after the
+       cursor, and whether they are announced to ibus-daemon (see
+       ibus_engine_set_surrounding_text_window) */
+    guint surrounding_chars_before;
+    guint surrounding_chars_after;
+    gboolean surrounding_window_sent;
+
+    /* TRUE while a key event is processed by process_key_event_async.
+     * The method calls received meanwhile are queued in pending_calls. */
+    gboolean key_event_pending;
+    GQueue *pending_calls;
+
+    /* A private server for the direct channel of the input context, its
+     * socket file, and the connection from the client (see
+     * OpenDirectChannel). The server accepts only one connection. */
+    GDBusServer *direct_server;
+    gchar *direct_socket_path;
+    GDBusConnection *direct_connection;
+    /* the registration of the engine on direct_connection */
+    guint direct_registration_id;
+};
+
+struct _IBusKeyEventReply {
+    IBusEngine *engine;
+    GDBusMethodInvocation *invocation;
+    GMainContext *context;
 };
 
+/* the default window of surrounding text around the cursor */
+#define SURROUNDING_CHARS_BEFORE    512
+#define SURROUNDING_CHARS_AFTER     128
+
 static guint            engine_signals[LAST_SIGNAL] = { 0 };
 
 static IBusText *text_empty = NULL;
@@ -159,6 +197,19 @@ static void      ibus_engine_process_hand_writing_event
 static void      ibus_engine_cancel_hand_writing
                                              (IBusEngine         *engine,
                                               guint               n_strokes);
+static void      ibus_engine_close_direct_channel
+                                             (IBusEngine         *engine);
+static void      ibus_engine_free_direct_server
+                                             (IBusEngine         *engine);
+static gboolean  _direct_server_new_connection_cb
+                                             (GDBusServer        *server,
+                                              GDBusConnection    *connection,
+                                              IBusEngine         *engine);
+static void      _direct_connection_closed_cb
+                                             (GDBusConnection    *connection,
+                                              gboolean            remote_peer_vanished,
+                                              GError             *error,
+                                              IBusEngine         *engine);
 static void      ibus_engine_emit_signal     (IBusEngine         *engine,
                                               const gchar        *signal_name,
                                               GVariant           *parameters);
@@ -176,6 +227,9 @@ static const gchar introspection_xml[] =
     "      <arg direction='in'  type='u' name='state' />"
     "      <arg direction='out' type='b' />"
     "    </method>"
+    "    <method name='OpenDirectChannel'>"
+    "      <arg direction='out' type='s' name='address' />"
+    "    </method>"
     "    <method name='SetCursorLocation'>"
     "      <arg direction='in'  type='i' name='x' />"
     "      <arg direction='in'  type='i' name='y' />"
@@ -220,6 +274,13 @@ static const gchar introspection_xml[] =
     "      <arg direction='in'  type='u' name='cursor_pos' />"
     "      <arg direction='in'  type='u' name='anchor_pos' />"
     "    </method>"
+    "    <method name='UpdateSurroundingText'>"
+    "      <arg direction='in'  type='u' name='start' />"
+    "      <arg direction='in'  type='u' name='end' />"
+    "      <arg direction='in'  type='s' name='text' />"
+    "      <arg direction='in'  type='u' name='cursor_pos' />"
+    "      <arg direction='in'  type='u' name='anchor_pos' />"
+    "    </method>"
     /* FIXME signals */
     "    <signal name='CommitText'>"
     "      <arg type='v' name='text' />"
@@ -244,14 +305,60 @@ static const gchar introspection_xml[] =
     "    <signal name='UpdateProperty'>"
     "      <arg type='v' name='prop' />"
     "    </signal>"
+    "    <signal name='UpdatePropertyState'>"
+    "      <arg type='s' name='key' />"
+    "      <arg type='u' name='state' />"
+    "      <arg type='b' name='visible' />"
+    "      <arg type='b' name='sensitive' />"
+    "    </signal>"
     "    <signal name='ForwardKeyEvent'>"
     "      <arg type='u' name='keyval' />"
     "      <arg type='u' name='keycode' />"
     "      <arg type='u' name='state' />"
     "    </signal>"
+    "    <signal name='UpdateKeyFilter'>"
+    "      <arg type='a(uuu)' name='ranges' />"
+    "    </signal>"
+    "    <signal name='SurroundingTextWindow'>"
+    "      <arg type='u' name='chars_before' />"
+    "      <arg type='u' name='chars_after' />"
+    "    </signal>"
+    "    <signal name='DirectChannelConnected' />"
+    "    <signal name='DirectChannelDisconnected' />"
+    "  </interface>"
+    "</node>";
+
+/* Only the key events are sent through the direct channel. The other
+ * methods still go through ibus-daemon. */
+static const gchar direct_introspection_xml[] =
+    "<node>"
+    "  <interface name='org.freedesktop.IBus.Engine'>"
+    "    <method name='ProcessKeyEvent'>"
+    "      <arg direction='in'  type='u' name='keyval' />"
+    "      <arg direction='in'  type='u' name='keycode' />"
+    "      <arg direction='in'  type='u' name='state' />"
+    "      <arg direction='out' type='b' />"
+    "    </method>"
     "  </interface>"
     "</node>";
 
+static GDBusInterfaceInfo *direct_interface_info = NULL;
+
+static void      _direct_channel_method_call (GDBusConnection       *connection,
+                                              const gchar           *sender,
+                                              const gchar           *object_path,
+                                              const gchar           *interface_name,
+                                              const gchar           *method_name,
+                                              GVariant              *parameters,
+                                              GDBusMethodInvocation *invocation,
+                                              IBusEngine            *engine);
+
+static const GDBusInterfaceVTable direct_interface_vtable = {
+    (GDBusInterfaceMethodCallFunc) _direct_channel_method_call,
+    NULL,
+    NULL,
+};
+
 static void
 ibus_engine_class_init (IBusEngineClass *class)
 {
@@ -269,6 +376,12 @@ ibus_engine_class_init (IBusEngineClass *class)
 
     ibus_service_class_add_interfaces (IBUS_SERVICE_CLASS (class), introspection_xml);
 
+    GDBusNodeInfo *direct_node_info =
+            g_dbus_node_info_new_for_xml (direct_introspection_xml, NULL);
+    direct_interface_info =
+            g_dbus_interface_info_ref (direct_node_info->interfaces[0]);
+    g_dbus_node_info_unref (direct_node_info);
+
     class->process_key_event = ibus_engine_process_key_event;
     class->focus_in     = ibus_engine_focus_in;
     class->focus_out    = ibus_engine_focus_out;
@@ -737,6 +850,10 @@ ibus_engine_init (IBusEngine *engine)
     engine->priv = IBUS_ENGINE_GET_PRIVATE (engine);
 
     engine->priv->surrounding_text = g_object_ref_sink (text_empty);
+    engine->priv->surrounding_base = g_object_ref_sink (text_empty);
+    engine->priv->surrounding_chars_before = SURROUNDING_CHARS_BEFORE;
+    engine->priv->surrounding_chars_after = SURROUNDING_CHARS_AFTER;
+    engine->priv->pending_calls = g_queue_new ();
 }
 
 static void
@@ -750,6 +867,26 @@ ibus_engine_destroy (IBusEngine *engine)
         engine->priv->surrounding_text = NULL;
     }
 
+    if (engine->priv->surrounding_base) {
+        g_object_unref (engine->priv->surrounding_base);
+        engine->priv->surrounding_base = NULL;
+    }
+
+    ibus_engine_close_direct_channel (engine);
+    ibus_engine_free_direct_server (engine);
+
+    if (engine->priv->pending_calls) {
+        GDBusMethodInvocation *invocation;
+        while ((invocation = g_queue_pop_head (engine->priv->pending_calls)) != NULL) {
+            g_dbus_method_invocation_return_error (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   "The engine is destroyed.");
+        }
+        g_queue_free (engine->priv->pending_calls);
+        engine->priv->pending_calls = NULL;
+    }
+
     IBUS_OBJECT_CLASS(ibus_engine_parent_class)->destroy (IBUS_OBJECT (engine));
 }
 
@@ -785,20 +922,140 @@ ibus_engine_get_property (IBusEngine *engine,
 }
 
 static void
-ibus_engine_service_method_call (IBusService           *service,
-                                 GDBusConnection       *connection,
-                                 const gchar           *sender,
-                                 const gchar           *object_path,
-                                 const gchar           *interface_name,
-                                 const gchar           *method_name,
-                                 GVariant              *parameters,
-                                 GDBusMethodInvocation *invocation)
+ibus_engine_close_direct_channel (IBusEngine *engine)
 {
-    IBusEngine *engine = IBUS_ENGINE (service);
+    GDBusConnection *connection = engine->priv->direct_connection;
 
-    if (g_strcmp0 (interface_name, IBUS_INTERFACE_ENGINE) != 0) {
-        IBUS_SERVICE_CLASS (ibus_engine_parent_class)->
-                service_method_call (service,
+    if (connection == NULL)
+        return;
+
+    engine->priv->direct_connection = NULL;
+    g_signal_handlers_disconnect_by_func (connection,
+                                          G_CALLBACK (_direct_connection_closed_cb),
+                                          engine);
+    g_dbus_connection_unregister_object (connection,
+                                         engine->priv->direct_registration_id);
+    engine->priv->direct_registration_id = 0;
+    if (!g_dbus_connection_is_closed (connection))
+        g_dbus_connection_close (connection, NULL, NULL, NULL);
+    g_object_unref (connection);
+}
+
+static void
+_direct_connection_closed_cb (GDBusConnection *connection,
+                              gboolean         remote_peer_vanished,
+                              GError          *error,
+                              IBusEngine      *engine)
+{
+    g_assert (engine->priv->direct_connection == connection);
+    g_signal_handlers_disconnect_by_func (connection,
+                                          G_CALLBACK (_direct_connection_closed_cb),
+                                          engine);
+    g_dbus_connection_unregister_object (connection,
+                                         engine->priv->direct_registration_id);
+    engine->priv->direct_registration_id = 0;
+    engine->priv->direct_connection = NULL;
+    g_object_unref (connection);
+
+    /* ibus-daemon relays the signals to the client again. */
+    ibus_service_emit_signal ((IBusService *) engine,
+                              NULL,
+                              IBUS_INTERFACE_ENGINE,
+                              "DirectChannelDisconnected",
+                              NULL,
+                              NULL);
+}
+
+/* Stop listening for the direct channel, so no more client can connect. */
+static void
+ibus_engine_stop_direct_server (IBusEngine *engine)
+{
+    if (engine->priv->direct_socket_path == NULL)
+        return;
+
+    g_dbus_server_stop (engine->priv->direct_server);
+    g_unlink (engine->priv->direct_socket_path);
+    g_free (engine->priv->direct_socket_path);
+    engine->priv->direct_socket_path = NULL;
+}
+
+static void
+ibus_engine_free_direct_server (IBusEngine *engine)
+{
+    if (engine->priv->direct_server == NULL)
+        return;
+
+    ibus_engine_stop_direct_server (engine);
+    g_signal_handlers_disconnect_by_func (engine->priv->direct_server,
+                                          G_CALLBACK (_direct_server_new_connection_cb),
+                                          engine);
+    g_object_unref (engine->priv->direct_server);
+    engine->priv->direct_server = NULL;
+}
+
+static gboolean
+_direct_server_new_connection_cb (GDBusServer     *server,
+                                  GDBusConnection *connection,
+                                  IBusEngine      *engine)
+{
+    GError *error = NULL;
+
+    /* Only the client the channel is brokered for may connect. Reject the
+     * other connections instead of replacing the channel. */
+    if (engine->priv->direct_connection != NULL ||
+        engine->priv->direct_server != server) {
+        return FALSE;
+    }
+
+    /* Only the key event path is exported on the direct channel, not all
+     * the methods of the engine. */
+    engine->priv->direct_registration_id =
+            g_dbus_connection_register_object (connection,
+                    ibus_service_get_object_path ((IBusService *) engine),
+                    direct_interface_info,
+                    &direct_interface_vtable,
+                    g_object_ref (engine),
+                    (GDestroyNotify) g_object_unref,
+                    &error);
+    if (engine->priv->direct_registration_id == 0) {
+        g_warning ("Can not register engine on direct channel: %s",
+                   error->message);
+        g_error_free (error);
+        return FALSE;
+    }
+
+    engine->priv->direct_connection = g_object_ref (connection);
+    g_signal_connect (connection, "closed",
+                      G_CALLBACK (_direct_connection_closed_cb), engine);
+
+    /* The server is not unreferenced in its own signal handler. It is freed
+     * when the next channel is opened or the engine is destroyed. */
+    ibus_engine_stop_direct_server (engine);
+
+    /* The signals emitted from now on are also sent to the client, so
+     * ibus-daemon stops relaying them when it receives this signal. */
+    ibus_service_emit_signal ((IBusService *) engine,
+                              NULL,
+                              IBUS_INTERFACE_ENGINE,
+                              "DirectChannelConnected",
+                              NULL,
+                              NULL);
+    return TRUE;
+}
+
+/* Handle the key events received through the direct channel like the ones
+ * relayed by ibus-daemon, so they are ordered with the other method calls. */
+static void
+_direct_channel_method_call (GDBusConnection       *connection,
+                             const gchar           *sender,
+                             const gchar           *object_path,
+                             const gchar           *interface_name,
+                             const gchar           *method_name,
+                             GVariant              *parameters,
+                             GDBusMethodInvocation *invocation,
+                             IBusEngine            *engine)
+{
+    ibus_engine_service_method_call ((IBusService *) engine,
                                      connection,
                                      sender,
                                      object_path,
@@ -806,173 +1063,449 @@ ibus_engine_service_method_call (IBusService           *service,
                                      method_name,
                                      parameters,
                                      invocation);
-        return;
-    }
+}
 
-    if (g_strcmp0 (method_name, "ProcessKeyEvent") == 0) {
-        guint keyval, keycode, state;
-        gboolean retval = FALSE;
-        g_variant_get (parameters, "(uuu)", &keyval, &keycode, &state);
-        g_signal_emit (engine,
-                       engine_signals[PROCESS_KEY_EVENT],
-                       0,
-                       keyval,
-                       keycode,
-                       state,
-                       &retval);
-        g_dbus_method_invocation_return_value (invocation, g_variant_new ("(b)", retval));
-        return;
-    }
+/* Only allow the processes of the user to connect to the direct channel. */
+static gboolean
+_direct_server_authorize_cb (GDBusAuthObserver *observer,
+                             GIOStream         *stream,
+                             GCredentials      *credentials,
+                             gpointer           user_data)
+{
+    if (credentials == NULL)
+        return FALSE;
 
-    static const struct {
-        gchar *member;
-        guint  signal_id;
-    } no_arg_methods[] = {
-        { "FocusIn",     FOCUS_IN },
-        { "FocusOut",    FOCUS_OUT },
-        { "Reset",       RESET },
-        { "Enable",      ENABLE },
-        { "Disable",     DISABLE },
-        { "PageUp",      PAGE_UP },
-        { "PageDown",    PAGE_DOWN },
-        { "CursorUp",    CURSOR_UP },
-        { "CursorDown",  CURSOR_DOWN },
-    };
+    return g_credentials_get_unix_user (credentials, NULL) == getuid ();
+}
 
-    gint i;
-    for (i = 0; i < G_N_ELEMENTS (no_arg_methods); i++) {
-        if (g_strcmp0 (method_name, no_arg_methods[i].member) == 0) {
-            g_signal_emit (engine, engine_signals[no_arg_methods[i].signal_id], 0);
-            g_dbus_method_invocation_return_value (invocation, NULL);
-            return;
-        }
+/* Escape a value of a D-Bus address, e.g. the path of a unix socket. */
+static gchar *
+_address_escape_value (const gchar *value)
+{
+    GString *s = g_string_new ("");
+    const guchar *p;
+
+    for (p = (const guchar *) value; *p != '\0'; p++) {
+        if (g_ascii_isalnum (*p) || strchr ("-_/.\\", *p) != NULL)
+            g_string_append_c (s, *p);
+        else
+            g_string_append_printf (s, "%%%02x", *p);
     }
+    return g_string_free (s, FALSE);
+}
 
-    if (g_strcmp0 (method_name, "CandidateClicked") == 0) {
-        guint index, button, state;
-        g_variant_get (parameters, "(uuu)", &index, &button, &state);
-        g_signal_emit (engine,
-                       engine_signals[CANDIDATE_CLICKED],
-                       0,
-                       index,
-                       button,
-                       state);
-        g_dbus_method_invocation_return_value (invocation, NULL);
-        return;
+/**
+ * ibus_engine_open_direct_channel:
+ *
+ * Implement the "OpenDirectChannel" method call. Start a private D-Bus
+ * server on a socket in the directory of the ibus-daemon socket, which is
+ * only accessible by the user, and return its address so the client of the
+ * input context can call ProcessKeyEvent and receive the key event results
+ * without going through ibus-daemon. The server accepts one connection of a
+ * process of the same user, then stops listening.
+ */
+static void
+ibus_engine_open_direct_channel (IBusEngine            *engine,
+                                 GDBusMethodInvocation *invocation)
+{
+    GError *error = NULL;
+    GDBusAuthObserver *observer;
+    gchar *dir;
+    gchar *guid;
+    gchar *name;
+    gchar *escaped;
+    gchar *address;
+
+    /* ibus-daemon brokers a new channel, e.g. for another input context,
+     * so the old client and a client which has not connected yet lose
+     * theirs. */
+    if (engine->priv->direct_connection != NULL) {
+        ibus_engine_close_direct_channel (engine);
+        ibus_service_emit_signal ((IBusService *) engine,
+                                  NULL,
+                                  IBUS_INTERFACE_ENGINE,
+                                  "DirectChannelDisconnected",
+                                  NULL,
+                                  NULL);
     }
-
-    if (g_strcmp0 (method_name, "PropertyActivate") == 0) {
-        gchar *name;
-        guint state;
-        g_variant_get (parameters, "(&su)", &name, &state);
-        g_signal_emit (engine,
-                       engine_signals[PROPERTY_ACTIVATE],
-                       0,
-                       name,
-                       state);
-        g_dbus_method_invocation_return_value (invocation, NULL);
+    ibus_engine_free_direct_server (engine);
+
+    dir = g_path_get_dirname (ibus_get_socket_path ());
+    g_mkdir_with_parents (dir, 0700);
+    guid = g_dbus_generate_guid ();
+    name = g_strdup_printf ("engine-%s", guid);
+    engine->priv->direct_socket_path = g_build_filename (dir, name, NULL);
+    escaped = _address_escape_value (engine->priv->direct_socket_path);
+    address = g_strdup_printf ("unix:path=%s", escaped);
+
+    observer = g_dbus_auth_observer_new ();
+    g_signal_connect (observer, "authorize-authenticated-peer",
+                      G_CALLBACK (_direct_server_authorize_cb), NULL);
+
+    engine->priv->direct_server = g_dbus_server_new_sync (address,
+                                                          G_DBUS_SERVER_FLAGS_NONE,
+                                                          guid,
+                                                          observer,
+                                                          NULL,
+                                                          &error);
+    g_object_unref (observer);
+    g_free (dir);
+    g_free (guid);
+    g_free (name);
+    g_free (escaped);
+    g_free (address);
+
+    if (engine->priv->direct_server == NULL) {
+        g_free (engine->priv->direct_socket_path);
+        engine->priv->direct_socket_path = NULL;
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
         return;
     }
+    g_signal_connect (engine->priv->direct_server, "new-connection",
+                      G_CALLBACK (_direct_server_new_connection_cb), engine);
+    g_dbus_server_start (engine->priv->direct_server);
 
-    if (g_strcmp0 (method_name, "PropertyShow") == 0) {
-        gchar *name;
-        g_variant_get (parameters, "(&s)", &name);
-        g_signal_emit (engine,
-                       engine_signals[PROPERTY_SHOW],
-                       0,
-                       name);
-        g_dbus_method_invocation_return_value (invocation, NULL);
-        return;
-    }
+    g_dbus_method_invocation_return_value (invocation,
+            g_variant_new ("(s)",
+                    g_dbus_server_get_client_address (engine->priv->direct_server)));
+}
+
+static void
+_engine_open_direct_channel (IBusEngine            *engine,
+                             GVariant              *parameters,
+                             GDBusMethodInvocation *invocation)
+{
+    ibus_engine_open_direct_channel (engine, invocation);
+}
 
-    if (g_strcmp0 (method_name, "PropertyHide") == 0) {
-        gchar *name;
-        g_variant_get (parameters, "(&s)", &name);
-        g_signal_emit (engine,
-                       engine_signals[PROPERTY_HIDE],
-                       0,
-                       name);
-        g_dbus_method_invocation_return_value (invocation, NULL);
+static void
+_engine_process_key_event (IBusEngine            *engine,
+                           GVariant              *parameters,
+                           GDBusMethodInvocation *invocation)
+{
+    guint keyval, keycode, state;
+    gboolean retval = FALSE;
+    g_variant_get (parameters, "(uuu)", &keyval, &keycode, &state);
+
+    IBusEngineClass *class = IBUS_ENGINE_GET_CLASS (engine);
+    if (class->process_key_event_async != NULL) {
+        IBusKeyEventReply *reply = g_slice_new (IBusKeyEventReply);
+        reply->engine = g_object_ref (engine);
+        reply->invocation = invocation;
+        reply->context = g_main_context_get_thread_default ();
+        if (reply->context == NULL)
+            reply->context = g_main_context_default ();
+        g_main_context_ref (reply->context);
+        engine->priv->key_event_pending = TRUE;
+        class->process_key_event_async (engine, keyval, keycode, state, reply);
         return;
     }
 
-    if (g_strcmp0 (method_name, "SetCursorLocation") == 0) {
-        gint x, y, w, h;
-        g_variant_get (parameters, "(iiii)", &x, &y, &w, &h);
-        engine->cursor_area.x = x;
-        engine->cursor_area.y = y;
-        engine->cursor_area.width = w;
-        engine->cursor_area.height = h;
-
-        g_signal_emit (engine,
-                       engine_signals[SET_CURSOR_LOCATION],
-                       0,
-                       x, y, w, h);
-        g_dbus_method_invocation_return_value (invocation, NULL);
+    g_signal_emit (engine,
+                   engine_signals[PROCESS_KEY_EVENT],
+                   0,
+                   keyval,
+                   keycode,
+                   state,
+                   &retval);
+    g_dbus_method_invocation_return_value (invocation, g_variant_new ("(b)", retval));
+}
+
+static void
+_engine_candidate_clicked (IBusEngine            *engine,
+                           GVariant              *parameters,
+                           GDBusMethodInvocation *invocation)
+{
+    guint index, button, state;
+    g_variant_get (parameters, "(uuu)", &index, &button, &state);
+    g_signal_emit (engine,
+                   engine_signals[CANDIDATE_CLICKED],
+                   0,
+                   index,
+                   button,
+                   state);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_engine_property_activate (IBusEngine            *engine,
+                           GVariant              *parameters,
+                           GDBusMethodInvocation *invocation)
+{
+    gchar *name;
+    guint state;
+    g_variant_get (parameters, "(&su)", &name, &state);
+    g_signal_emit (engine,
+                   engine_signals[PROPERTY_ACTIVATE],
+                   0,
+                   name,
+                   state);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_engine_property_show (IBusEngine            *engine,
+                       GVariant              *parameters,
+                       GDBusMethodInvocation *invocation)
+{
+    gchar *name;
+    g_variant_get (parameters, "(&s)", &name);
+    g_signal_emit (engine,
+                   engine_signals[PROPERTY_SHOW],
+                   0,
+                   name);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_engine_property_hide (IBusEngine            *engine,
+                       GVariant              *parameters,
+                       GDBusMethodInvocation *invocation)
+{
+    gchar *name;
+    g_variant_get (parameters, "(&s)", &name);
+    g_signal_emit (engine,
+                   engine_signals[PROPERTY_HIDE],
+                   0,
+                   name);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_engine_set_cursor_location (IBusEngine            *engine,
+                             GVariant              *parameters,
+                             GDBusMethodInvocation *invocation)
+{
+    gint x, y, w, h;
+    g_variant_get (parameters, "(iiii)", &x, &y, &w, &h);
+    engine->cursor_area.x = x;
+    engine->cursor_area.y = y;
+    engine->cursor_area.width = w;
+    engine->cursor_area.height = h;
+
+    g_signal_emit (engine,
+                   engine_signals[SET_CURSOR_LOCATION],
+                   0,
+                   x, y, w, h);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_engine_set_capabilities (IBusEngine            *engine,
+                          GVariant              *parameters,
+                          GDBusMethodInvocation *invocation)
+{
+    guint caps;
+    g_variant_get (parameters, "(u)", &caps);
+    engine->client_capabilities = caps;
+    g_signal_emit (engine, engine_signals[SET_CAPABILITIES], 0, caps);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_engine_set_surrounding_text (IBusEngine            *engine,
+                              GVariant              *parameters,
+                              GDBusMethodInvocation *invocation)
+{
+    GVariant *variant = NULL;
+    IBusText *text;
+    guint cursor_pos;
+    guint anchor_pos;
+
+    g_variant_get (parameters,
+                   "(vuu)",
+                   &variant,
+                   &cursor_pos,
+                   &anchor_pos);
+    text = IBUS_TEXT (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
+
+    g_object_ref_sink (text);
+    g_object_unref (engine->priv->surrounding_base);
+    engine->priv->surrounding_base = text;
+
+    g_signal_emit (engine, engine_signals[SET_SURROUNDING_TEXT],
+                   0,
+                   text,
+                   cursor_pos,
+                   anchor_pos);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_engine_update_surrounding_text (IBusEngine            *engine,
+                                 GVariant              *parameters,
+                                 GDBusMethodInvocation *invocation)
+{
+    IBusText *text;
+    guint start;
+    guint end;
+    const gchar *replacement;
+    guint cursor_pos;
+    guint anchor_pos;
+
+    g_variant_get (parameters,
+                   "(uu&suu)",
+                   &start,
+                   &end,
+                   &replacement,
+                   &cursor_pos,
+                   &anchor_pos);
+    text = ibus_text_new_from_edit (engine->priv->surrounding_base,
+                                    start,
+                                    end,
+                                    replacement);
+    if (text == NULL) {
+        g_dbus_method_invocation_return_error (invocation,
+                                               G_DBUS_ERROR,
+                                               G_DBUS_ERROR_INVALID_ARGS,
+                                               "Invalid surrounding text range %u-%u",
+                                               start, end);
         return;
     }
 
-    if (g_strcmp0 (method_name, "SetCapabilities") == 0) {
-        guint caps;
-        g_variant_get (parameters, "(u)", &caps);
-        engine->client_capabilities = caps;
-        g_signal_emit (engine, engine_signals[SET_CAPABILITIES], 0, caps);
-        g_dbus_method_invocation_return_value (invocation, NULL);
+    g_object_ref_sink (text);
+    g_object_unref (engine->priv->surrounding_base);
+    engine->priv->surrounding_base = text;
+
+    g_signal_emit (engine, engine_signals[SET_SURROUNDING_TEXT],
+                   0,
+                   text,
+                   cursor_pos,
+                   anchor_pos);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_engine_process_hand_writing_event (IBusEngine            *engine,
+                                    GVariant              *parameters,
+                                    GDBusMethodInvocation *invocation)
+{
+    const gdouble *coordinates;
+    gsize coordinates_len = 0;
+
+    coordinates = g_variant_get_fixed_array (g_variant_get_child_value (parameters, 0), &coordinates_len, sizeof (gdouble));
+    g_return_if_fail (coordinates != NULL);
+    g_return_if_fail (coordinates_len >= 4); /* The array should contain at least one line. */
+    g_return_if_fail (coordinates_len <= G_MAXUINT); /* to prevent overflow in the cast in g_signal_emit */
+    g_return_if_fail ((coordinates_len & 1) == 0);
+
+    g_signal_emit (engine, engine_signals[PROCESS_HAND_WRITING_EVENT], 0,
+                   coordinates, (guint) coordinates_len);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_engine_cancel_hand_writing (IBusEngine            *engine,
+                             GVariant              *parameters,
+                             GDBusMethodInvocation *invocation)
+{
+    guint n_strokes = 0;
+    g_variant_get (parameters, "(u)", &n_strokes);
+    g_signal_emit (engine, engine_signals[CANCEL_HAND_WRITING], 0, n_strokes);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+ibus_engine_service_method_call (IBusService           *service,
+                                 GDBusConnection       *connection,
+                                 const gchar           *sender,
+                                 const gchar           *object_path,
+                                 const gchar           *interface_name,
+                                 const gchar           *method_name,
+                                 GVariant              *parameters,
+                                 GDBusMethodInvocation *invocation)
+{
+    IBusEngine *engine = IBUS_ENGINE (service);
+
+    if (g_strcmp0 (interface_name, IBUS_INTERFACE_ENGINE) != 0) {
+        IBUS_SERVICE_CLASS (ibus_engine_parent_class)->
+                service_method_call (service,
+                                     connection,
+                                     sender,
+                                     object_path,
+                                     interface_name,
+                                     method_name,
+                                     parameters,
+                                     invocation);
         return;
     }
 
-    if (g_strcmp0 (method_name, "SetSurroundingText") == 0) {
-        GVariant *variant = NULL;
-        IBusText *text;
-        guint cursor_pos;
-        guint anchor_pos;
-
-        g_variant_get (parameters,
-                       "(vuu)",
-                       &variant,
-                       &cursor_pos,
-                       &anchor_pos);
-        text = IBUS_TEXT (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
-
-        g_signal_emit (engine, engine_signals[SET_SURROUNDING_TEXT],
-                       0,
-                       text,
-                       cursor_pos,
-                       anchor_pos);
-        if (g_object_is_floating (text)) {
-            g_object_unref (text);
+    /* Keep the order of the events while a key event is processed
+     * asynchronously. */
+    if (engine->priv->key_event_pending) {
+        if (engine->priv->pending_calls != NULL) {
+            g_queue_push_tail (engine->priv->pending_calls, invocation);
+        }
+        else {
+            g_dbus_method_invocation_return_error (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   "The engine is destroyed.");
         }
-        g_dbus_method_invocation_return_value (invocation, NULL);
         return;
     }
 
-    if (g_strcmp0 (method_name, "ProcessHandWritingEvent") == 0) {
-        const gdouble *coordinates;
-        gsize coordinates_len = 0;
+    /* The list of methods. Methods without arguments just emit the glib
+     * signal signal_id, the others are handled by method_callback. */
+    static const struct {
+        const gchar *method_name;
+        guint        signal_id;
+        void (* method_callback) (IBusEngine *, GVariant *, GDBusMethodInvocation *);
+    } methods[] = {
+        { "ProcessKeyEvent",    0,  _engine_process_key_event },
+        { "SetCursorLocation",  0,  _engine_set_cursor_location },
+        { "SetSurroundingText", 0,  _engine_set_surrounding_text },
+        { "UpdateSurroundingText",
+                                0,  _engine_update_surrounding_text },
+        { "SetCapabilities",    0,  _engine_set_capabilities },
+        { "CandidateClicked",   0,  _engine_candidate_clicked },
+        { "PropertyActivate",   0,  _engine_property_activate },
+        { "PropertyShow",       0,  _engine_property_show },
+        { "PropertyHide",       0,  _engine_property_hide },
+        { "ProcessHandWritingEvent",
+                                0,  _engine_process_hand_writing_event },
+        { "CancelHandWriting",  0,  _engine_cancel_hand_writing },
+        { "OpenDirectChannel",  0,  _engine_open_direct_channel },
+        { "FocusIn",     FOCUS_IN,      NULL },
+        { "FocusOut",    FOCUS_OUT,     NULL },
+        { "Reset",       RESET,         NULL },
+        { "Enable",      ENABLE,        NULL },
+        { "Disable",     DISABLE,       NULL },
+        { "PageUp",      PAGE_UP,       NULL },
+        { "PageDown",    PAGE_DOWN,     NULL },
+        { "CursorUp",    CURSOR_UP,     NULL },
+        { "CursorDown",  CURSOR_DOWN,   NULL },
+    };
 
-        coordinates = g_variant_get_fixed_array (g_variant_get_child_value (parameters, 0), &coordinates_len, sizeof (gdouble));
-        g_return_if_fail (coordinates != NULL);
-        g_return_if_fail (coordinates_len >= 4); /* The array should contain at least one line. */
-        g_return_if_fail (coordinates_len <= G_MAXUINT); /* to prevent overflow in the cast in g_signal_emit */
-        g_return_if_fail ((coordinates_len & 1) == 0);
+    /* A map from a method name to its index + 1 in methods. Engines may
+     * be served in several threads, so it is built only once. */
+    static gsize methods_table = 0;
 
-        g_signal_emit (engine, engine_signals[PROCESS_HAND_WRITING_EVENT], 0,
-                       coordinates, (guint) coordinates_len);
-        g_dbus_method_invocation_return_value (invocation, NULL);
-        return;
+    gint i;
+    if (g_once_init_enter (&methods_table)) {
+        GHashTable *table = g_hash_table_new (g_str_hash, g_str_equal);
+        for (i = 0; i < G_N_ELEMENTS (methods); i++) {
+            g_hash_table_insert (table,
+                                 (gpointer) methods[i].method_name,
+                                 GINT_TO_POINTER (i + 1));
+        }
+        g_once_init_leave (&methods_table, (gsize) table);
     }
 
-    if (g_strcmp0 (method_name, "CancelHandWriting") == 0) {
-        guint n_strokes = 0;
-        g_variant_get (parameters, "(u)", &n_strokes);
-        g_signal_emit (engine, engine_signals[CANCEL_HAND_WRITING], 0, n_strokes);
-        g_dbus_method_invocation_return_value (invocation, NULL);
+    i = GPOINTER_TO_INT (g_hash_table_lookup ((GHashTable *) methods_table,
+                                              method_name)) - 1;
+    /* should not be reached */
+    g_return_if_fail (i >= 0);
+
+    if (methods[i].method_callback != NULL) {
+        methods[i].method_callback (engine, parameters, invocation);
         return;
     }
 
-    /* should not be reached */
-    g_return_if_reached ();
+    g_signal_emit (engine, engine_signals[methods[i].signal_id], 0);
+    g_dbus_method_invocation_return_value (invocation, NULL);
 }
 
 static GVariant *
@@ -1160,11 +1693,48 @@ ibus_engine_cancel_hand_writing (IBusEngine         *engine,
     // g_debug ("cancel-hand-writing (%u)", n_strokes);
 }
 
+/* The signals which are also sent to the client through the direct
+ * channel. ibus-daemon does not relay them to a client using the channel. */
+static const gchar *direct_signals[] = {
+    "CommitText",
+    "ForwardKeyEvent",
+    "DeleteSurroundingText",
+};
+
 static void
 ibus_engine_emit_signal (IBusEngine  *engine,
                          const gchar *signal_name,
                          GVariant    *parameters)
 {
+    gint i;
+
+    if (engine->priv->direct_connection != NULL) {
+        for (i = 0; i < G_N_ELEMENTS (direct_signals); i++) {
+            if (g_strcmp0 (signal_name, direct_signals[i]) == 0)
+                break;
+        }
+        if (i < G_N_ELEMENTS (direct_signals)) {
+            if (parameters)
+                g_variant_ref_sink (parameters);
+            g_dbus_connection_emit_signal (engine->priv->direct_connection,
+                                           NULL,
+                                           ibus_service_get_object_path ((IBusService *)engine),
+                                           IBUS_INTERFACE_ENGINE,
+                                           signal_name,
+                                           parameters,
+                                           NULL);
+            ibus_service_emit_signal ((IBusService *)engine,
+                                      NULL,
+                                      IBUS_INTERFACE_ENGINE,
+                                      signal_name,
+                                      parameters,
+                                      NULL);
+            if (parameters)
+                g_variant_unref (parameters);
+            return;
+        }
+    }
+
     ibus_service_emit_signal ((IBusService *)engine,
                               NULL,
                               IBUS_INTERFACE_ENGINE,
@@ -1420,9 +1990,35 @@ ibus_engine_get_surrounding_text (IBusEngine   *engine,
                              "RequireSurroundingText",
                              NULL);
 
+    /* ibus-daemon remembers the window, so it is sent only once. */
+    if (!priv->surrounding_window_sent) {
+        ibus_engine_set_surrounding_text_window (engine,
+                                                 priv->surrounding_chars_before,
+                                                 priv->surrounding_chars_after);
+    }
+
     // g_debug ("get-surrounding-text ('%s', %d, %d)", (*text)->text, *cursor_pos, *anchor_pos);
 }
 
+void
+ibus_engine_set_surrounding_text_window (IBusEngine *engine,
+                                         guint       chars_before,
+                                         guint       chars_after)
+{
+    IBusEnginePrivate *priv;
+
+    g_return_if_fail (IBUS_IS_ENGINE (engine));
+
+    priv = IBUS_ENGINE_GET_PRIVATE (engine);
+    priv->surrounding_chars_before = chars_before;
+    priv->surrounding_chars_after = chars_after;
+    priv->surrounding_window_sent = TRUE;
+
+    ibus_engine_emit_signal (engine,
+                             "SurroundingTextWindow",
+                             g_variant_new ("(uu)", chars_before, chars_after));
+}
+
 void
 ibus_engine_register_properties (IBusEngine   *engine,
                                  IBusPropList *prop_list)
@@ -1457,6 +2053,26 @@ ibus_engine_update_property (IBusEngine   *engine,
     }
 }
 
+void
+ibus_engine_update_property_state (IBusEngine   *engine,
+                                   IBusProperty *prop)
+{
+    g_return_if_fail (IBUS_IS_ENGINE (engine));
+    g_return_if_fail (IBUS_IS_PROPERTY (prop));
+
+    ibus_engine_emit_signal (engine,
+                             "UpdatePropertyState",
+                             g_variant_new ("(subb)",
+                                            ibus_property_get_key (prop),
+                                            ibus_property_get_state (prop),
+                                            ibus_property_get_visible (prop),
+                                            ibus_property_get_sensitive (prop)));
+
+    if (g_object_is_floating (prop)) {
+        g_object_unref (prop);
+    }
+}
+
 #define DEFINE_FUNC(name, Name)                             \
     void                                                    \
     ibus_engine_##name (IBusEngine *engine)                 \
@@ -1480,3 +2096,76 @@ ibus_engine_get_name (IBusEngine *engine)
     g_return_val_if_fail (IBUS_IS_ENGINE (engine), NULL);
     return engine->priv->engine_name;
 }
+
+void
+ibus_engine_set_key_filter (IBusEngine               *engine,
+                            const IBusKeyFilterRange *ranges,
+                            guint                     n_ranges)
+{
+    g_return_if_fail (IBUS_IS_ENGINE (engine));
+    g_return_if_fail (ranges != NULL || n_ranges == 0);
+
+    GVariantBuilder builder;
+    guint i;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(uuu)"));
+    for (i = 0; i < n_ranges; i++) {
+        g_variant_builder_add (&builder, "(uuu)",
+                               ranges[i].first_keyval,
+                               ranges[i].last_keyval,
+                               ranges[i].modifiers);
+    }
+    ibus_engine_emit_signal (engine,
+                             "UpdateKeyFilter",
+                             g_variant_new ("(a(uuu))", &builder));
+}
+
+static gboolean
+_key_event_reply_done_cb (IBusKeyEventReply *reply)
+{
+    IBusEngine *engine = reply->engine;
+    GDBusMethodInvocation *invocation;
+
+    engine->priv->key_event_pending = FALSE;
+
+    /* dispatch the queued calls until another key event becomes pending */
+    while (engine->priv->pending_calls != NULL &&
+           !engine->priv->key_event_pending &&
+           (invocation = g_queue_pop_head (engine->priv->pending_calls)) != NULL) {
+        ibus_engine_service_method_call (
+                (IBusService *) engine,
+                g_dbus_method_invocation_get_connection (invocation),
+                g_dbus_method_invocation_get_sender (invocation),
+                g_dbus_method_invocation_get_object_path (invocation),
+                g_dbus_method_invocation_get_interface_name (invocation),
+                g_dbus_method_invocation_get_method_name (invocation),
+                g_dbus_method_invocation_get_parameters (invocation),
+                invocation);
+    }
+
+    g_object_unref (engine);
+    g_main_context_unref (reply->context);
+    g_slice_free (IBusKeyEventReply, reply);
+    return FALSE;
+}
+
+void
+ibus_key_event_reply_complete (IBusKeyEventReply *reply,
+                               gboolean           handled)
+{
+    g_return_if_fail (reply != NULL);
+    g_return_if_fail (reply->invocation != NULL);
+
+    g_dbus_method_invocation_return_value (reply->invocation,
+                                           g_variant_new ("(b)", handled));
+    reply->invocation = NULL;
+
+    GSource *source = g_idle_source_new ();
+    g_source_set_priority (source, G_PRIORITY_HIGH);
+    g_source_set_callback (source,
+                           (GSourceFunc) _key_event_reply_done_cb,
+                           reply,
+                           NULL);
+    g_source_attach (source, reply->context);
+    g_source_unref (source);
+}
@@ -67,6 +67,15 @@ typedef struct _IBusEngine IBusEngine;
 typedef struct _IBusEngineClass IBusEngineClass;
 typedef struct _IBusEnginePrivate IBusEnginePrivate;
 
+/**
+ * IBusKeyEventReply:
+ *
+ * An opaque handle of a pending ProcessKeyEvent call, passed to the
+ * process_key_event_async() member function of #IBusEngineClass.
+ * It must be completed with ibus_key_event_reply_complete() exactly once.
+ */
+typedef struct _IBusKeyEventReply IBusKeyEventReply;
+
 /**
  * IBusEngine:
  * @enabled: Whether the engine is enabled.
@@ -149,9 +158,19 @@ struct _IBusEngineClass {
                                     (IBusEngine     *engine,
                                      guint           n_strokes);
 
+    /* If it is not %NULL, it is called instead of emitting
+     * #IBusEngine::process-key-event, and the engine replies later with
+     * ibus_key_event_reply_complete(). */
+    void        (* process_key_event_async)
+                                    (IBusEngine        *engine,
+                                     guint              keyval,
+                                     guint              keycode,
+                                     guint              state,
+                                     IBusKeyEventReply *reply);
+
     /*< private >*/
     /* padding */
-    gpointer pdummy[5];
+    gpointer pdummy[4];
 };
 
 GType        ibus_engine_get_type       (void);
@@ -393,6 +412,24 @@ void         ibus_engine_register_properties
 void         ibus_engine_update_property(IBusEngine         *engine,
                                          IBusProperty       *prop);
 
+/**
+ * ibus_engine_update_property_state:
+ * @engine: An IBusEngine.
+ * @prop: IBusProperty to be updated.
+ *
+ * Update the state, visibility and sensitivity of a property displayed in
+ * language bar. Only these fields and the key of @prop are sent, so it is
+ * cheaper than ibus_engine_update_property() when the label, icon and
+ * tooltip of @prop are not changed.
+ *
+ * (Note: The prop object will be released, if it is floating.
+ *  If caller want to keep the object, caller should make the object
+ *  sink by g_object_ref_sink.)
+ */
+void         ibus_engine_update_property_state
+                                        (IBusEngine         *engine,
+                                         IBusProperty       *prop);
+
 /**
  * ibus_engine_delete_surrounding_text:
  * @engine: An IBusEngine.
@@ -426,6 +463,25 @@ void ibus_engine_get_surrounding_text(IBusEngine         *engine,
                                       guint              *cursor_pos,
                                       guint              *anchor_pos);
 
+/**
+ * ibus_engine_set_surrounding_text_window:
+ * @engine: An IBusEngine.
+ * @chars_before: Number of characters wanted before the cursor.
+ * @chars_after: Number of characters wanted after the cursor.
+ *
+ * Set how much surrounding text the engine wants around the cursor.
+ * The client sends at least this window of its text, instead of the whole
+ * text, and only the edited part of it when the text changes.
+ * Use %G_MAXUINT to get all the text on a side of the cursor.
+ * The default is 512 characters before and 128 characters after the
+ * cursor. It is sent to the client on the first call of
+ * ibus_engine_get_surrounding_text(), if it is not set before.
+ */
+void ibus_engine_set_surrounding_text_window
+                                     (IBusEngine         *engine,
+                                      guint               chars_before,
+                                      guint               chars_after);
+
 
 /**
  * ibus_engine_get_name:
@@ -436,5 +492,41 @@ void ibus_engine_get_surrounding_text(IBusEngine         *engine,
  */
 const gchar *ibus_engine_get_name       (IBusEngine         *engine);
 
+/**
+ * ibus_engine_set_key_filter:
+ * @engine: An IBusEngine.
+ * @ranges: (array length=n_ranges) (allow-none): The key events the engine
+ *      wants to process.
+ * @n_ranges: The number of @ranges.
+ *
+ * Tell the clients which key events the engine currently wants. The clients
+ * do not send the other key events to the engine, and handle them as not
+ * processed without a round trip to ibus-daemon. E.g. an engine in direct
+ * input mode may only want its mode switching key. Pass 0 @n_ranges to
+ * receive all key events again, which is the default.
+ *
+ * An engine changing its filter in process_key_event() should call it
+ * before returning, so that the client has the new filter for the next key.
+ */
+void         ibus_engine_set_key_filter (IBusEngine         *engine,
+                                         const IBusKeyFilterRange
+                                                            *ranges,
+                                         guint               n_ranges);
+
+/**
+ * ibus_key_event_reply_complete:
+ * @reply: An IBusKeyEventReply passed to process_key_event_async().
+ * @handled: %TRUE if the key event is processed by the engine; %FALSE
+ *      otherwise.
+ *
+ * Reply a ProcessKeyEvent call and free @reply. It may be called from any
+ * thread. The method calls received by the engine after the key event are
+ * dispatched in the main context after the reply, so the engine always
+ * sees the events of its input context in order.
+ */
+void         ibus_key_event_reply_complete
+                                        (IBusKeyEventReply  *reply,
+                                         gboolean            handled);
+
 G_END_DECLS
 #endif
@@ -21,6 +21,7 @@
  */
 #include <stdlib.h>
 #include "ibusenginedesc.h"
+#include "ibusinternal.h"
 #include "ibusxml.h"
 
 enum {
@@ -538,6 +539,38 @@ ibus_engine_desc_output (IBusEngineDesc *desc,
     g_string_append (output, "</engine>\n");
 }
 
+static gboolean
+ibus_engine_desc_set_xml_field (IBusEngineDesc *desc,
+                                const gchar    *element_name,
+                                const gchar    *text)
+{
+#define PARSE_ENTRY(field_name, element)                        \
+    if (g_strcmp0 (element_name, element) == 0) {               \
+        g_free (desc->priv->field_name);                        \
+        desc->priv->field_name = g_strdup (text);               \
+        return TRUE;                                            \
+    }
+#define PARSE_ENTRY_1(name) PARSE_ENTRY(name, #name)
+    PARSE_ENTRY_1(name);
+    PARSE_ENTRY_1(longname);
+    PARSE_ENTRY_1(description);
+    PARSE_ENTRY_1(language);
+    PARSE_ENTRY_1(license);
+    PARSE_ENTRY_1(author);
+    PARSE_ENTRY_1(icon);
+    PARSE_ENTRY_1(layout);
+    PARSE_ENTRY_1(hotkeys);
+    PARSE_ENTRY_1(symbol);
+    PARSE_ENTRY_1(setup);
+#undef PARSE_ENTRY
+#undef PARSE_ENTRY_1
+    if (g_strcmp0 (element_name, "rank") == 0) {
+        desc->priv->rank = text != NULL ? atoi (text) : 0;
+        return TRUE;
+    }
+    return FALSE;
+}
+
 static gboolean
 ibus_engine_desc_parse_xml_node (IBusEngineDesc *desc,
                                 XMLNode       *node)
@@ -547,35 +580,95 @@ ibus_engine_desc_parse_xml_node (IBusEngineDesc *desc,
     for (p = node->sub_nodes; p != NULL; p = p->next) {
         XMLNode *sub_node = (XMLNode *) p->data;
 
-#define PARSE_ENTRY(field_name, element_name)                   \
-        if (g_strcmp0 (sub_node->name, element_name) == 0) {    \
-            g_free (desc->priv->field_name);                    \
-            desc->priv->field_name = g_strdup (sub_node->text); \
-            continue;                                           \
-        }
-#define PARSE_ENTRY_1(name) PARSE_ENTRY(name, #name)
-        PARSE_ENTRY_1(name);
-        PARSE_ENTRY_1(longname);
-        PARSE_ENTRY_1(description);
-        PARSE_ENTRY_1(language);
-        PARSE_ENTRY_1(license);
-        PARSE_ENTRY_1(author);
-        PARSE_ENTRY_1(icon);
-        PARSE_ENTRY_1(layout);
-        PARSE_ENTRY_1(hotkeys);
-        PARSE_ENTRY_1(symbol);
-        PARSE_ENTRY_1(setup);
-#undef PARSE_ENTRY
-#undef PARSE_ENTRY_1
-        if (g_strcmp0 (sub_node->name , "rank") == 0) {
-            desc->priv->rank = atoi (sub_node->text);
-            continue;
-        }
-        g_warning ("<engines> element contains invalidate element <%s>", sub_node->name);
+        if (!ibus_engine_desc_set_xml_field (desc, sub_node->name, sub_node->text))
+            g_warning ("<engines> element contains invalidate element <%s>", sub_node->name);
     }
     return TRUE;
 }
 
+typedef struct {
+    IBusEngineDesc *desc;
+    /* text of the current child element of <engine> */
+    GString        *text;
+    gint            depth;
+} EngineDescMarkupData;
+
+static void
+_engine_desc_start_element_cb (GMarkupParseContext *context,
+                               const gchar         *element_name,
+                               const gchar        **attribute_names,
+                               const gchar        **attribute_values,
+                               gpointer             user_data,
+                               GError             **error)
+{
+    EngineDescMarkupData *data = (EngineDescMarkupData *) user_data;
+
+    data->depth++;
+    g_string_truncate (data->text, 0);
+}
+
+static void
+_engine_desc_end_element_cb (GMarkupParseContext *context,
+                             const gchar         *element_name,
+                             gpointer             user_data,
+                             GError             **error)
+{
+    EngineDescMarkupData *data = (EngineDescMarkupData *) user_data;
+    const gchar *text;
+
+    /* Only the direct children of <engine> are fields. */
+    if (--data->depth != 0)
+        return;
+
+    text = data->text->str;
+    if (ibus_xml_text_is_space (data->text->str, data->text->len))
+        text = "";
+
+    if (!ibus_engine_desc_set_xml_field (data->desc, element_name, text))
+        g_warning ("<engines> element contains invalidate element <%s>", element_name);
+}
+
+static void
+_engine_desc_text_cb (GMarkupParseContext *context,
+                      const gchar         *text,
+                      gsize                text_len,
+                      gpointer             user_data,
+                      GError             **error)
+{
+    EngineDescMarkupData *data = (EngineDescMarkupData *) user_data;
+
+    if (data->depth == 1)
+        g_string_append_len (data->text, text, text_len);
+}
+
+static void
+_engine_desc_markup_data_free (EngineDescMarkupData *data)
+{
+    g_string_free (data->text, TRUE);
+    g_slice_free (EngineDescMarkupData, data);
+}
+
+static void
+_engine_desc_error_cb (GMarkupParseContext *context,
+                       GError              *error,
+                       gpointer             user_data)
+{
+    EngineDescMarkupData *data = (EngineDescMarkupData *) user_data;
+
+    g_object_unref (data->desc);
+    _engine_desc_markup_data_free (data);
+
+    _ibus_xml_markup_error (context, error);
+}
+
+static const GMarkupParser _engine_desc_markup_parser = {
+    _engine_desc_start_element_cb,
+    _engine_desc_end_element_cb,
+    _engine_desc_text_cb,
+    0,
+    _engine_desc_error_cb,
+};
+
 #define IBUS_ENGINE_DESC_GET_PROPERTY(property, return_type)    \
 return_type                                                     \
 ibus_engine_desc_get_ ## property (IBusEngineDesc *desc)        \
@@ -668,3 +761,32 @@ ibus_engine_desc_new_from_xml_node (XMLNode      *node)
 
     return desc;
 }
+
+void
+ibus_engine_desc_start_markup (GMarkupParseContext *context)
+{
+    g_assert (context);
+
+    EngineDescMarkupData *data = g_slice_new0 (EngineDescMarkupData);
+
+    data->desc = (IBusEngineDesc *) g_object_new (IBUS_TYPE_ENGINE_DESC, NULL);
+    data->text = g_string_new ("");
+
+    _ibus_xml_markup_push (context, &_engine_desc_markup_parser, data);
+}
+
+IBusEngineDesc *
+ibus_engine_desc_end_markup (GMarkupParseContext *context)
+{
+    g_assert (context);
+
+    EngineDescMarkupData *data;
+    IBusEngineDesc *desc;
+
+    data = (EngineDescMarkupData *) _ibus_xml_markup_pop (context);
+    desc = data->desc;
+
+    _engine_desc_markup_data_free (data);
+
+    return desc;
+}
@@ -157,6 +157,31 @@ IBusEngineDesc  *ibus_engine_desc_new_varargs   (const gchar *first_property_nam
  */
 IBusEngineDesc  *ibus_engine_desc_new_from_xml_node
                                                 (XMLNode        *node);
+
+/**
+ * ibus_engine_desc_start_markup:
+ * @context: A GMarkupParseContext.
+ *
+ * Push a sub parser which builds an IBusEngineDesc from the content of
+ * an &lt;engine&gt; element directly, without building an XML tree.
+ * It should be called from the start_element callback of the parent
+ * parser for the &lt;engine&gt; element, and must be paired with
+ * ibus_engine_desc_end_markup() in the end_element callback of the same
+ * element.
+ */
+void             ibus_engine_desc_start_markup  (GMarkupParseContext
+                                                                *context);
+
+/**
+ * ibus_engine_desc_end_markup:
+ * @context: A GMarkupParseContext.
+ * @returns: A newly allocated IBusEngineDesc.
+ *
+ * Pop the sub parser pushed by ibus_engine_desc_start_markup(), and
+ * return the IBusEngineDesc it built.
+ */
+IBusEngineDesc  *ibus_engine_desc_end_markup    (GMarkupParseContext
+                                                                *context);
 /**
  * ibus_engine_desc_get_name:
  * @info: An IBusEngineDesc
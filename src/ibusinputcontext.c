@@ -20,6 +20,7 @@
  * Boston, MA 02111-1307, USA.
  */
 #include "ibusinputcontext.h"
+#include <string.h>
 #include <gio/gio.h>
 #include "ibusshare.h"
 #include "ibusinternal.h"
@@ -32,6 +33,12 @@
 #define IBUS_INPUT_CONTEXT_GET_PRIVATE(o)  \
    (G_TYPE_INSTANCE_GET_PRIVATE ((o), IBUS_TYPE_INPUT_CONTEXT, IBusInputContextPrivate))
 
+/* The modifiers checked by the key filter of the engine. */
+#define KEY_FILTER_MODIFIER_MASK \
+    (IBUS_SHIFT_MASK | IBUS_CONTROL_MASK | IBUS_MOD1_MASK | IBUS_MOD3_MASK | \
+     IBUS_MOD4_MASK | IBUS_MOD5_MASK | IBUS_SUPER_MASK | IBUS_HYPER_MASK | \
+     IBUS_META_MASK | IBUS_RELEASE_MASK)
+
 enum {
     ENABLED,
     DISABLED,
@@ -66,6 +73,33 @@ struct _IBusInputContextPrivate {
     IBusText *surrounding_text;
     guint     surrounding_cursor_pos;
     guint     selection_anchor_pos;
+
+    /* the window of surrounding text the current engine wants around the
+       cursor (see ibus_engine_set_surrounding_text_window) */
+    guint     surrounding_chars_before;
+    guint     surrounding_chars_after;
+
+    /* TRUE if ibus-daemon accepts "UpdateSurroundingText" */
+    gboolean  surrounding_text_incremental;
+
+    /* TRUE if surrounding_text is the text last sent to ibus-daemon */
+    gboolean  surrounding_text_sent;
+
+    /* The key events the current engine wants (see
+       ibus_engine_set_key_filter), or NULL if it wants all key events. */
+    GArray   *key_filter;
+
+    /* The direct channel to the current engine (see
+       ibus_input_context_set_direct_channel) */
+    gboolean         use_direct_channel;
+    GDBusConnection *direct_connection;
+    gchar           *direct_engine_path;
+    guint            direct_signal_id;
+    GCancellable    *direct_cancellable;
+
+    /* The properties registered by the current engine, updated in place by
+       the UpdatePropertyState signal */
+    IBusPropList    *props;
 };
 
 typedef struct _IBusInputContextPrivate IBusInputContextPrivate;
@@ -74,12 +108,26 @@ static guint            context_signals[LAST_SIGNAL] = { 0 };
 
 static IBusText *text_empty = NULL;
 
+/* The start of the surrounding text window is aligned to this many
+ * characters, so that it does not move on every key and the edits of the
+ * window stay small. */
+#define SURROUNDING_WINDOW_ALIGN    64
+
 /* functions prototype */
 static void     ibus_input_context_real_destroy (IBusProxy              *context);
 static void     ibus_input_context_g_signal     (GDBusProxy             *proxy,
                                                  const gchar            *sender_name,
                                                  const gchar            *signal_name,
                                                  GVariant               *parameters);
+static void     ibus_input_context_open_direct_channel
+                                                (IBusInputContext       *context);
+static void     ibus_input_context_close_direct_channel
+                                                (IBusInputContext       *context);
+static void     ibus_input_context_send_surrounding_text
+                                                (IBusInputContext       *context,
+                                                 IBusText               *text,
+                                                 guint32                 cursor_pos,
+                                                 guint32                 anchor_pos);
 
 G_DEFINE_TYPE (IBusInputContext, ibus_input_context, IBUS_TYPE_PROXY)
 
@@ -467,6 +515,8 @@ ibus_input_context_init (IBusInputContext *context)
 
     priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
     priv->surrounding_text = g_object_ref_sink (text_empty);
+    priv->surrounding_chars_before = G_MAXUINT;
+    priv->surrounding_chars_after = G_MAXUINT;
 }
 
 static void
@@ -480,198 +530,357 @@ ibus_input_context_real_destroy (IBusProxy *context)
         priv->surrounding_text = NULL;
     }
 
+    if (priv->key_filter) {
+        g_array_free (priv->key_filter, TRUE);
+        priv->key_filter = NULL;
+    }
+
+    if (priv->props) {
+        g_object_unref (priv->props);
+        priv->props = NULL;
+    }
+
+    priv->use_direct_channel = FALSE;
+    ibus_input_context_close_direct_channel ((IBusInputContext *) context);
+
     IBUS_PROXY_CLASS(ibus_input_context_parent_class)->destroy (context);
 }
 
 static void
-ibus_input_context_g_signal (GDBusProxy  *proxy,
-                             const gchar *sender_name,
-                             const gchar *signal_name,
-                             GVariant    *parameters)
+_context_commit_text (IBusInputContext *context,
+                      GVariant         *parameters)
 {
-    g_assert (IBUS_IS_INPUT_CONTEXT (proxy));
+    GVariant *variant = NULL;
+    g_variant_get (parameters, "(v)", &variant);
+    IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
+    g_signal_emit (context, context_signals[COMMIT_TEXT], 0, text);
 
-    IBusInputContext *context;
-    context = IBUS_INPUT_CONTEXT (proxy);
+    if (g_object_is_floating (text))
+        g_object_unref (text);
+}
 
-    static const struct {
-        const gchar *signal_name;
-        guint signal_id;
-    } signals [] = {
-        { "ShowPreeditText",        SHOW_PREEDIT_TEXT        },
-        { "HidePreeditText",        HIDE_PREEDIT_TEXT        },
-        { "ShowAuxiliaryText",      SHOW_AUXILIARY_TEXT      },
-        { "HideAuxiliaryText",      HIDE_AUXILIARY_TEXT      },
-        { "ShowLookupTable",        SHOW_LOOKUP_TABLE        },
-        { "HideLookupTable",        HIDE_LOOKUP_TABLE        },
-        { "PageUpLookupTable",      PAGE_UP_LOOKUP_TABLE     },
-        { "PageDownLookupTable",    PAGE_DOWN_LOOKUP_TABLE   },
-        { "CursorUpLookupTable",    CURSOR_UP_LOOKUP_TABLE   },
-        { "CursorDownLookupTable",  CURSOR_DOWN_LOOKUP_TABLE },
-    };
+static void
+_context_update_preedit_text (IBusInputContext *context,
+                              GVariant         *parameters)
+{
+    GVariant *variant = NULL;
+    gint32 cursor_pos;
+    gboolean visible;
+    g_variant_get (parameters, "(vub)", &variant, &cursor_pos, &visible);
+    IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
 
-    if (g_strcmp0 (signal_name, "CommitText") == 0) {
-        GVariant *variant = NULL;
-        g_variant_get (parameters, "(v)", &variant);
-        IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
-        g_signal_emit (context, context_signals[COMMIT_TEXT], 0, text);
+    g_signal_emit (context,
+                   context_signals[UPDATE_PREEDIT_TEXT],
+                   0,
+                   text,
+                   cursor_pos,
+                   visible);
 
-        if (g_object_is_floating (text))
-            g_object_unref (text);
-        return;
-    }
-    if (g_strcmp0 (signal_name, "UpdatePreeditText") == 0) {
-        GVariant *variant = NULL;
-        gint32 cursor_pos;
-        gboolean visible;
-        g_variant_get (parameters, "(vub)", &variant, &cursor_pos, &visible);
-        IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
+    if (g_object_is_floating (text))
+        g_object_unref (text);
+}
 
-        g_signal_emit (context,
-                       context_signals[UPDATE_PREEDIT_TEXT],
-                       0,
-                       text,
-                       cursor_pos,
-                       visible);
+static void
+_context_update_key_filter (IBusInputContext *context,
+                            GVariant         *parameters)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    GVariantIter *iter = NULL;
+    IBusKeyFilterRange range;
 
-        if (g_object_is_floating (text))
-            g_object_unref (text);
-        return;
+    if (priv->key_filter) {
+        g_array_free (priv->key_filter, TRUE);
+        priv->key_filter = NULL;
     }
 
-    /* lookup signal in table */
-    gint i;
-    for (i = 0;
-         i < G_N_ELEMENTS (signals) && g_strcmp0 (signal_name, signals[i].signal_name) != 0;
-         i++);
-
-    if (i < G_N_ELEMENTS (signals)) {
-        g_signal_emit (context, context_signals[signals[i].signal_id], 0);
-        return;
+    g_variant_get (parameters, "(a(uuu))", &iter);
+    if (g_variant_iter_n_children (iter) != 0) {
+        priv->key_filter = g_array_sized_new (FALSE, FALSE,
+                sizeof (IBusKeyFilterRange),
+                g_variant_iter_n_children (iter));
+        while (g_variant_iter_next (iter, "(uuu)", &range.first_keyval,
+                                                   &range.last_keyval,
+                                                   &range.modifiers)) {
+            g_array_append_val (priv->key_filter, range);
+        }
     }
+    g_variant_iter_free (iter);
+}
 
-    if (g_strcmp0 (signal_name, "UpdateAuxiliaryText") == 0) {
-        GVariant *variant = NULL;
-        gboolean visible;
-        g_variant_get (parameters, "(vb)", &variant, &visible);
-        IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
+static void
+_context_direct_channel_closed (IBusInputContext *context,
+                                GVariant         *parameters)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    ibus_input_context_close_direct_channel (context);
+    if (priv->use_direct_channel)
+        ibus_input_context_open_direct_channel (context);
+}
 
-        g_signal_emit (context,
-                       context_signals[UPDATE_AUXILIARY_TEXT],
-                       0,
-                       text,
-                       visible);
-        if (g_object_is_floating (text))
-            g_object_unref (text);
-        return;
-    }
+static void
+_context_update_auxiliary_text (IBusInputContext *context,
+                                GVariant         *parameters)
+{
+    GVariant *variant = NULL;
+    gboolean visible;
+    g_variant_get (parameters, "(vb)", &variant, &visible);
+    IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
 
-    if (g_strcmp0 (signal_name, "UpdateLookupTable") == 0) {
-        GVariant *variant = NULL;
-        gboolean visible;
-        g_variant_get (parameters, "(vb)", &variant, &visible);
+    g_signal_emit (context,
+                   context_signals[UPDATE_AUXILIARY_TEXT],
+                   0,
+                   text,
+                   visible);
+    if (g_object_is_floating (text))
+        g_object_unref (text);
+}
 
-        IBusLookupTable *table = IBUS_LOOKUP_TABLE (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
+static void
+_context_update_lookup_table (IBusInputContext *context,
+                              GVariant         *parameters)
+{
+    GVariant *variant = NULL;
+    gboolean visible;
+    g_variant_get (parameters, "(vb)", &variant, &visible);
 
-        g_signal_emit (context,
-                       context_signals[UPDATE_LOOKUP_TABLE],
-                       0,
-                       table,
-                       visible);
-        if (g_object_is_floating (table))
-            g_object_unref (table);
-        return;
+    IBusLookupTable *table = IBUS_LOOKUP_TABLE (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
 
-    }
+    g_signal_emit (context,
+                   context_signals[UPDATE_LOOKUP_TABLE],
+                   0,
+                   table,
+                   visible);
+    if (g_object_is_floating (table))
+        g_object_unref (table);
+}
 
-    if (g_strcmp0 (signal_name, "RegisterProperties") == 0) {
-        GVariant *variant = NULL;
-        g_variant_get (parameters, "(v)", &variant);
+static void
+_context_register_properties (IBusInputContext *context,
+                              GVariant         *parameters)
+{
+    GVariant *variant = NULL;
+    g_variant_get (parameters, "(v)", &variant);
 
-        IBusPropList *prop_list = IBUS_PROP_LIST (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
+    IBusPropList *prop_list = IBUS_PROP_LIST (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
 
-        g_signal_emit (context,
-                       context_signals[REGISTER_PROPERTIES],
-                       0,
-                       prop_list);
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    if (priv->props)
+        g_object_unref (priv->props);
+    priv->props = g_object_ref_sink (prop_list);
 
-        if (g_object_is_floating (prop_list))
-            g_object_unref (prop_list);
-        return;
-    }
+    g_signal_emit (context,
+                   context_signals[REGISTER_PROPERTIES],
+                   0,
+                   prop_list);
+}
 
-    if (g_strcmp0 (signal_name, "UpdateProperty") == 0) {
-        GVariant *variant = NULL;
-        g_variant_get (parameters, "(v)", &variant);
-        IBusProperty *prop = IBUS_PROPERTY (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
+static void
+_context_update_property (IBusInputContext *context,
+                          GVariant         *parameters)
+{
+    GVariant *variant = NULL;
+    g_variant_get (parameters, "(v)", &variant);
+    IBusProperty *prop = IBUS_PROPERTY (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
 
-        g_signal_emit (context, context_signals[UPDATE_PROPERTY], 0, prop);
+    g_signal_emit (context, context_signals[UPDATE_PROPERTY], 0, prop);
 
-        if (g_object_is_floating (prop))
-            g_object_unref (prop);
-        return;
-    }
+    if (g_object_is_floating (prop))
+        g_object_unref (prop);
+}
 
-    if (g_strcmp0 (signal_name, "ForwardKeyEvent") == 0) {
-        guint32 keyval;
-        guint32 keycode;
-        guint32 state;
-
-        g_variant_get (parameters, "(uuu)", &keyval, &keycode, &state);
-
-        /* Forward key event back with IBUS_FORWARD_MASK. And process_key_event will
-         * not process key event with IBUS_FORWARD_MASK again. */
-        g_signal_emit (context,
-                       context_signals[FORWARD_KEY_EVENT],
-                       0,
-                       keyval,
-                       keycode,
-                       state | IBUS_FORWARD_MASK);
+static void
+_context_update_property_state (IBusInputContext *context,
+                                GVariant         *parameters)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    const gchar *key = NULL;
+    guint state = 0;
+    gboolean visible = FALSE;
+    gboolean sensitive = FALSE;
+
+    g_variant_get (parameters, "(&subb)",
+                   &key, &state, &visible, &sensitive);
+
+    /* Apply the change to the registered property, and emit
+     * update-property with it, so the handlers do not need to know
+     * the partial update. */
+    if (priv->props == NULL ||
+        !ibus_prop_list_update_property_state (priv->props,
+                                               key,
+                                               state,
+                                               visible,
+                                               sensitive))
         return;
-    }
 
-    if (g_strcmp0 (signal_name, "DeleteSurroundingText") == 0) {
-        gint offset_from_cursor;
-        guint nchars;
+    g_signal_emit (context,
+                   context_signals[UPDATE_PROPERTY],
+                   0,
+                   ibus_prop_list_lookup (priv->props, key));
+}
 
-        g_variant_get (parameters, "(iu)", &offset_from_cursor, &nchars);
+static void
+_context_forward_key_event (IBusInputContext *context,
+                            GVariant         *parameters)
+{
+    guint32 keyval;
+    guint32 keycode;
+    guint32 state;
+
+    g_variant_get (parameters, "(uuu)", &keyval, &keycode, &state);
+
+    /* Forward key event back with IBUS_FORWARD_MASK. And process_key_event will
+     * not process key event with IBUS_FORWARD_MASK again. */
+    g_signal_emit (context,
+                   context_signals[FORWARD_KEY_EVENT],
+                   0,
+                   keyval,
+                   keycode,
+                   state | IBUS_FORWARD_MASK);
+}
 
-        g_signal_emit (context,
-                       context_signals[DELETE_SURROUNDING_TEXT],
-                       0,
-                       offset_from_cursor,
-                       nchars);
-        return;
-    }
+static void
+_context_delete_surrounding_text (IBusInputContext *context,
+                                  GVariant         *parameters)
+{
+    gint offset_from_cursor;
+    guint nchars;
 
-    IBusInputContextPrivate *priv;
-    priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (IBUS_INPUT_CONTEXT (context));
+    g_variant_get (parameters, "(iu)", &offset_from_cursor, &nchars);
 
-    if (g_strcmp0 (signal_name, "Enabled") == 0) {
-        priv->needs_surrounding_text = FALSE;
-        g_signal_emit (context, context_signals[ENABLED], 0);
-        return;
+    g_signal_emit (context,
+                   context_signals[DELETE_SURROUNDING_TEXT],
+                   0,
+                   offset_from_cursor,
+                   nchars);
+}
+
+static void
+_context_enabled (IBusInputContext *context,
+                  GVariant         *parameters)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    priv->needs_surrounding_text = FALSE;
+    if (priv->use_direct_channel)
+        ibus_input_context_open_direct_channel (context);
+    g_signal_emit (context, context_signals[ENABLED], 0);
+}
+
+static void
+_context_disabled (IBusInputContext *context,
+                   GVariant         *parameters)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    priv->needs_surrounding_text = FALSE;
+    g_signal_emit (context, context_signals[DISABLED], 0);
+}
+
+static void
+_context_require_surrounding_text (IBusInputContext *context,
+                                   GVariant         *parameters)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    priv->needs_surrounding_text = TRUE;
+
+    /* ibus-daemon could not apply an edit, so it asks for the whole text,
+     * which is the base of the next edits. */
+    if (priv->surrounding_text != NULL && priv->surrounding_text_sent) {
+        ibus_input_context_send_surrounding_text (context,
+                                                  priv->surrounding_text,
+                                                  priv->surrounding_cursor_pos,
+                                                  priv->selection_anchor_pos);
     }
+}
 
-    if (g_strcmp0 (signal_name, "Disabled") == 0) {
-        priv->needs_surrounding_text = FALSE;
-        g_signal_emit (context, context_signals[DISABLED], 0);
-        return;
+static void
+_context_surrounding_text_window (IBusInputContext *context,
+                                  GVariant         *parameters)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    g_variant_get (parameters, "(uu)",
+                   &priv->surrounding_chars_before,
+                   &priv->surrounding_chars_after);
+    priv->surrounding_text_incremental = TRUE;
+}
+
+static void
+ibus_input_context_g_signal (GDBusProxy  *proxy,
+                             const gchar *sender_name,
+                             const gchar *signal_name,
+                             GVariant    *parameters)
+{
+    g_assert (IBUS_IS_INPUT_CONTEXT (proxy));
+
+    IBusInputContext *context;
+    context = IBUS_INPUT_CONTEXT (proxy);
+
+    /* Nullary signals just emit the glib signal signal_id, the others are
+     * handled by signal_callback. */
+    static const struct {
+        const gchar *signal_name;
+        guint signal_id;
+        void (* signal_callback) (IBusInputContext *, GVariant *);
+    } signals [] = {
+        { "CommitText",             0, _context_commit_text },
+        { "UpdatePreeditText",      0, _context_update_preedit_text },
+        { "UpdateAuxiliaryText",    0, _context_update_auxiliary_text },
+        { "UpdateLookupTable",      0, _context_update_lookup_table },
+        { "RegisterProperties",     0, _context_register_properties },
+        { "UpdateProperty",         0, _context_update_property },
+        { "UpdatePropertyState",    0, _context_update_property_state },
+        { "ForwardKeyEvent",        0, _context_forward_key_event },
+        { "DeleteSurroundingText",  0, _context_delete_surrounding_text },
+        { "UpdateKeyFilter",        0, _context_update_key_filter },
+        { "DirectChannelClosed",    0, _context_direct_channel_closed },
+        { "Enabled",                0, _context_enabled },
+        { "Disabled",               0, _context_disabled },
+        { "RequireSurroundingText", 0, _context_require_surrounding_text },
+        { "SurroundingTextWindow",  0, _context_surrounding_text_window },
+        { "ShowPreeditText",        SHOW_PREEDIT_TEXT,        NULL },
+        { "HidePreeditText",        HIDE_PREEDIT_TEXT,        NULL },
+        { "ShowAuxiliaryText",      SHOW_AUXILIARY_TEXT,      NULL },
+        { "HideAuxiliaryText",      HIDE_AUXILIARY_TEXT,      NULL },
+        { "ShowLookupTable",        SHOW_LOOKUP_TABLE,        NULL },
+        { "HideLookupTable",        HIDE_LOOKUP_TABLE,        NULL },
+        { "PageUpLookupTable",      PAGE_UP_LOOKUP_TABLE,     NULL },
+        { "PageDownLookupTable",    PAGE_DOWN_LOOKUP_TABLE,   NULL },
+        { "CursorUpLookupTable",    CURSOR_UP_LOOKUP_TABLE,   NULL },
+        { "CursorDownLookupTable",  CURSOR_DOWN_LOOKUP_TABLE, NULL },
+    };
+
+    /* A map from a signal name to its index + 1 in signals. Contexts may
+     * be used in several threads, so it is built only once. */
+    static gsize signals_table = 0;
+
+    gint i;
+    if (g_once_init_enter (&signals_table)) {
+        GHashTable *table = g_hash_table_new (g_str_hash, g_str_equal);
+        for (i = 0; i < G_N_ELEMENTS (signals); i++) {
+            g_hash_table_insert (table,
+                                 (gpointer) signals[i].signal_name,
+                                 GINT_TO_POINTER (i + 1));
+        }
+        g_once_init_leave (&signals_table, (gsize) table);
     }
 
-    if (g_strcmp0 (signal_name, "RequireSurroundingText") == 0) {
-        priv->needs_surrounding_text = TRUE;
+    /* lookup signal in table */
+    i = GPOINTER_TO_INT (g_hash_table_lookup ((GHashTable *) signals_table,
+                                              signal_name)) - 1;
+    if (i < 0) {
+        G_DBUS_PROXY_CLASS (ibus_input_context_parent_class)->g_signal (
+                                    proxy, sender_name, signal_name, parameters);
         return;
     }
 
-    G_DBUS_PROXY_CLASS (ibus_input_context_parent_class)->g_signal (
-                                proxy, sender_name, signal_name, parameters);
+    if (signals[i].signal_callback != NULL)
+        signals[i].signal_callback (context, parameters);
+    else
+        g_signal_emit (context, context_signals[signals[i].signal_id], 0);
 }
 
 IBusInputContext *
@@ -850,6 +1059,64 @@ ibus_input_context_cancel_hand_writing (IBusInputContext   *context,
                        );
 }
 
+/**
+ * ibus_input_context_wants_key_event:
+ *
+ * Check the key event against the key filter published by the engine.
+ * Returns FALSE if the engine declared it ignores the key event, so the key
+ * event does not need to be sent to ibus-daemon.
+ */
+static gboolean
+ibus_input_context_wants_key_event (IBusInputContext *context,
+                                    guint32           keyval,
+                                    guint32           state)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    guint i;
+
+    if (priv->key_filter == NULL)
+        return TRUE;
+
+    state &= KEY_FILTER_MODIFIER_MASK;
+    for (i = 0; i < priv->key_filter->len; i++) {
+        IBusKeyFilterRange *range =
+                &g_array_index (priv->key_filter, IBusKeyFilterRange, i);
+        if (keyval >= range->first_keyval &&
+            keyval <= range->last_keyval &&
+            (state & ~range->modifiers) == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * _direct_process_key_event_reply_cb:
+ *
+ * A GAsyncReadyCallback function to be called when the engine replies the
+ * "ProcessKeyEvent" call sent through the direct channel.
+ */
+static void
+_direct_process_key_event_reply_cb (GDBusConnection    *connection,
+                                    GAsyncResult       *res,
+                                    GSimpleAsyncResult *simple)
+{
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish (connection, res, &error);
+
+    if (result != NULL) {
+        gboolean processed = FALSE;
+        g_variant_get (result, "(b)", &processed);
+        g_variant_unref (result);
+        g_simple_async_result_set_op_res_gboolean (simple, processed);
+    }
+    else {
+        g_simple_async_result_set_from_error (simple, error);
+        g_error_free (error);
+    }
+    g_simple_async_result_complete (simple);
+    g_object_unref (simple);
+}
+
 void
 ibus_input_context_process_key_event_async (IBusInputContext   *context,
                                             guint32             keyval,
@@ -862,6 +1129,40 @@ ibus_input_context_process_key_event_async (IBusInputContext   *context,
 {
     g_assert (IBUS_IS_INPUT_CONTEXT (context));
 
+    if (!ibus_input_context_wants_key_event (context, keyval, state)) {
+        GSimpleAsyncResult *simple =
+                g_simple_async_result_new ((GObject *) context,
+                                           callback,
+                                           user_data,
+                                           ibus_input_context_process_key_event_async);
+        g_simple_async_result_set_op_res_gboolean (simple, FALSE);
+        g_simple_async_result_complete_in_idle (simple);
+        g_object_unref (simple);
+        return;
+    }
+
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    if (priv->direct_connection != NULL) {
+        GSimpleAsyncResult *simple =
+                g_simple_async_result_new ((GObject *) context,
+                                           callback,
+                                           user_data,
+                                           ibus_input_context_process_key_event_async);
+        g_dbus_connection_call (priv->direct_connection,
+                                NULL,
+                                priv->direct_engine_path,
+                                IBUS_INTERFACE_ENGINE,
+                                "ProcessKeyEvent",
+                                g_variant_new ("(uuu)", keyval, keycode, state),
+                                G_VARIANT_TYPE ("(b)"),
+                                G_DBUS_CALL_FLAGS_NONE,
+                                timeout_msec,
+                                cancellable,
+                                (GAsyncReadyCallback) _direct_process_key_event_reply_cb,
+                                simple);
+        return;
+    }
+
     g_dbus_proxy_call ((GDBusProxy *) context,
                        "ProcessKeyEvent",                   /* method_name */
                        g_variant_new ("(uuu)",
@@ -885,6 +1186,15 @@ ibus_input_context_process_key_event_async_finish (IBusInputContext  *context,
 
     gboolean processed = FALSE;
 
+    /* the key event is filtered out or sent through the direct channel */
+    if (g_simple_async_result_is_valid (res, (GObject *) context,
+                                        ibus_input_context_process_key_event_async)) {
+        GSimpleAsyncResult *simple = (GSimpleAsyncResult *) res;
+        if (g_simple_async_result_propagate_error (simple, error))
+            return FALSE;
+        return g_simple_async_result_get_op_res_gboolean (simple);
+    }
+
     GVariant *variant = g_dbus_proxy_call_finish ((GDBusProxy *) context,
                                                    res, error);
     if (variant != NULL) {
@@ -903,7 +1213,26 @@ ibus_input_context_process_key_event (IBusInputContext *context,
 {
     g_assert (IBUS_IS_INPUT_CONTEXT (context));
 
-    GVariant *result = g_dbus_proxy_call_sync ((GDBusProxy *) context,
+    if (!ibus_input_context_wants_key_event (context, keyval, state))
+        return FALSE;
+
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    GVariant *result;
+    if (priv->direct_connection != NULL) {
+        result = g_dbus_connection_call_sync (priv->direct_connection,
+                            NULL,
+                            priv->direct_engine_path,
+                            IBUS_INTERFACE_ENGINE,
+                            "ProcessKeyEvent",
+                            g_variant_new ("(uuu)", keyval, keycode, state),
+                            G_VARIANT_TYPE ("(b)"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            NULL,
+                            NULL);
+    }
+    else {
+        result = g_dbus_proxy_call_sync ((GDBusProxy *) context,
                             "ProcessKeyEvent",              /* method_name */
                             g_variant_new ("(uuu)",
                                  keyval, keycode, state),   /* parameters */
@@ -911,6 +1240,7 @@ ibus_input_context_process_key_event (IBusInputContext *context,
                             -1,                             /* timeout */
                             NULL,                           /* cancellable */
                             NULL);
+    }
 
     if (result != NULL) {
         gboolean processed = FALSE;
@@ -1009,6 +1339,128 @@ ibus_input_context_property_hide (IBusInputContext *context,
                        );
 }
 
+/**
+ * ibus_input_context_clip_surrounding_text:
+ *
+ * Return the part of text in the window the current engine wants around
+ * the cursor, and make cursor_pos and anchor_pos relative to it. The
+ * reference of text is taken over. A static text is copied, because it is
+ * kept after the call.
+ */
+static IBusText *
+ibus_input_context_clip_surrounding_text (IBusInputContext *context,
+                                          IBusText         *text,
+                                          guint32          *cursor_pos,
+                                          guint32          *anchor_pos)
+{
+    IBusInputContextPrivate *priv;
+    priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+
+    const gchar *start = text->text;
+    const gchar *cursor;
+    const gchar *end;
+    guint offset = 0;
+    guint chars_after;
+    guint i = 0;
+    gchar *str;
+    IBusText *window;
+
+    if (priv->surrounding_chars_before == G_MAXUINT &&
+        priv->surrounding_chars_after == G_MAXUINT) {
+        if (!ibus_text_get_is_static (text))
+            return text;
+        window = ibus_text_new_from_string (text->text);
+        g_object_ref_sink (window);
+        g_object_unref (text);
+        return window;
+    }
+
+    if (*cursor_pos > priv->surrounding_chars_before) {
+        offset = *cursor_pos - priv->surrounding_chars_before;
+        offset -= offset % SURROUNDING_WINDOW_ALIGN;
+    }
+    for (i = 0; i < offset && *start != '\0'; i++)
+        start = g_utf8_next_char (start);
+    offset = i;
+
+    cursor = start;
+    for (; i < *cursor_pos && *cursor != '\0'; i++)
+        cursor = g_utf8_next_char (cursor);
+    *cursor_pos = i - offset;
+
+    end = cursor;
+    for (chars_after = 0;
+         chars_after < priv->surrounding_chars_after && *end != '\0';
+         chars_after++) {
+        end = g_utf8_next_char (end);
+    }
+
+    if (*anchor_pos < offset)
+        *anchor_pos = 0;
+    else
+        *anchor_pos = MIN (*anchor_pos - offset, *cursor_pos + chars_after);
+
+    if (start == text->text && *end == '\0' &&
+        !ibus_text_get_is_static (text)) {
+        return text;
+    }
+
+    str = g_strndup (start, end - start);
+    window = ibus_text_new_from_string (str);
+    g_free (str);
+    g_object_ref_sink (window);
+    g_object_unref (text);
+    return window;
+}
+
+/**
+ * ibus_input_context_send_surrounding_text:
+ *
+ * Send the whole surrounding text with "SetSurroundingText".
+ */
+static void
+ibus_input_context_send_surrounding_text (IBusInputContext *context,
+                                          IBusText         *text,
+                                          guint32           cursor_pos,
+                                          guint32           anchor_pos)
+{
+    GVariant *variant = ibus_serializable_serialize ((IBusSerializable *)text);
+    g_dbus_proxy_call ((GDBusProxy *) context,
+                       "SetSurroundingText",        /* method_name */
+                       g_variant_new ("(vuu)",
+                                      variant,
+                                      cursor_pos,
+                                      anchor_pos),  /* parameters */
+                       G_DBUS_CALL_FLAGS_NONE,      /* flags */
+                       -1,                          /* timeout */
+                       NULL,                        /* cancellable */
+                       NULL,                        /* callback */
+                       NULL                         /* user_data */
+                       );
+}
+
+static void
+_update_surrounding_text_cb (GDBusProxy       *proxy,
+                             GAsyncResult     *res,
+                             IBusInputContext *context)
+{
+    GError *error = NULL;
+    GVariant *retval = g_dbus_proxy_call_finish (proxy, res, &error);
+
+    if (retval != NULL) {
+        g_variant_unref (retval);
+    }
+    else {
+        /* ibus-daemon does not have the text the edit was made from, so
+         * send the whole text next time. */
+        IBusInputContextPrivate *priv;
+        priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+        priv->surrounding_text_sent = FALSE;
+        g_error_free (error);
+    }
+    g_object_unref (context);
+}
+
 void
 ibus_input_context_set_surrounding_text (IBusInputContext   *context,
                                          IBusText           *text,
@@ -1021,31 +1473,289 @@ ibus_input_context_set_surrounding_text (IBusInputContext   *context,
     IBusInputContextPrivate *priv;
     priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
 
-    if (cursor_pos != priv->surrounding_cursor_pos ||
-        anchor_pos != priv->selection_anchor_pos ||
-        priv->surrounding_text == NULL ||
-        g_strcmp0 (text->text, priv->surrounding_text->text) != 0) {
-        if (priv->surrounding_text)
-            g_object_unref (priv->surrounding_text);
-        priv->surrounding_text = (IBusText *) g_object_ref_sink (text);
-        priv->surrounding_cursor_pos = cursor_pos;
-        priv->selection_anchor_pos = anchor_pos;
-
-        if (priv->needs_surrounding_text) {
-            GVariant *variant = ibus_serializable_serialize ((IBusSerializable *)text);
+    g_object_ref_sink (text);
+    text = ibus_input_context_clip_surrounding_text (context,
+                                                     text,
+                                                     &cursor_pos,
+                                                     &anchor_pos);
+
+    if (cursor_pos == priv->surrounding_cursor_pos &&
+        anchor_pos == priv->selection_anchor_pos &&
+        priv->surrounding_text != NULL &&
+        g_strcmp0 (text->text, priv->surrounding_text->text) == 0 &&
+        (priv->surrounding_text_sent || !priv->needs_surrounding_text)) {
+        g_object_unref (text);
+        return;
+    }
+
+    if (priv->needs_surrounding_text) {
+        gchar *replacement = NULL;
+        guint start = 0;
+        guint end = 0;
+
+        /* send only the edited part if it is smaller than the text */
+        if (priv->surrounding_text_incremental && priv->surrounding_text_sent) {
+            replacement = ibus_text_get_edit (priv->surrounding_text,
+                                              text, &start, &end);
+            if (strlen (replacement) >= strlen (text->text)) {
+                g_free (replacement);
+                replacement = NULL;
+            }
+        }
+
+        if (replacement != NULL) {
             g_dbus_proxy_call ((GDBusProxy *) context,
-                               "SetSurroundingText",        /* method_name */
-                               g_variant_new ("(vuu)",
-                                              variant,
+                               "UpdateSurroundingText",     /* method_name */
+                               g_variant_new ("(uusuu)",
+                                              start,
+                                              end,
+                                              replacement,
                                               cursor_pos,
                                               anchor_pos),  /* parameters */
-                                G_DBUS_CALL_FLAGS_NONE,     /* flags */
-                                -1,                         /* timeout */
-                                NULL,                       /* cancellable */
-                                NULL,                       /* callback */
-                                NULL                        /* user_data */
-                                );
+                               G_DBUS_CALL_FLAGS_NONE,      /* flags */
+                               -1,                          /* timeout */
+                               NULL,                        /* cancellable */
+                               (GAsyncReadyCallback) _update_surrounding_text_cb,
+                                                            /* callback */
+                               g_object_ref (context)       /* user_data */
+                               );
+            g_free (replacement);
         }
+        else {
+            ibus_input_context_send_surrounding_text (context,
+                                                      text,
+                                                      cursor_pos,
+                                                      anchor_pos);
+        }
+        priv->surrounding_text_sent = TRUE;
+    }
+    else {
+        priv->surrounding_text_sent = FALSE;
+    }
+
+    if (priv->surrounding_text)
+        g_object_unref (priv->surrounding_text);
+    priv->surrounding_text = text;
+    priv->surrounding_cursor_pos = cursor_pos;
+    priv->selection_anchor_pos = anchor_pos;
+}
+
+/**
+ * _direct_channel_signal_cb:
+ *
+ * Handle the signals the engine sends through the direct channel like the
+ * ones relayed by ibus-daemon.
+ */
+static void
+_direct_channel_signal_cb (GDBusConnection  *connection,
+                           const gchar      *sender_name,
+                           const gchar      *object_path,
+                           const gchar      *interface_name,
+                           const gchar      *signal_name,
+                           GVariant         *parameters,
+                           IBusInputContext *context)
+{
+    ibus_input_context_g_signal ((GDBusProxy *) context,
+                                 sender_name,
+                                 signal_name,
+                                 parameters);
+}
+
+static void
+_direct_channel_closed_cb (GDBusConnection  *connection,
+                           gboolean          remote_peer_vanished,
+                           GError           *error,
+                           IBusInputContext *context)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+
+    ibus_input_context_close_direct_channel (context);
+
+    /* let ibus-daemon relay the signals of the engine again. */
+    g_dbus_proxy_call ((GDBusProxy *) context,
+                       "CloseDirectChannel",
+                       NULL,
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1,
+                       NULL,
+                       NULL,
+                       NULL);
+    if (priv->use_direct_channel)
+        ibus_input_context_open_direct_channel (context);
+}
+
+static void
+_direct_channel_connect_cb (GObject          *source,
+                            GAsyncResult     *res,
+                            IBusInputContext *context)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    GError *error = NULL;
+    GDBusConnection *connection =
+            g_dbus_connection_new_for_address_finish (res, &error);
+
+    if (connection == NULL) {
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_warning ("Can not connect to the engine: %s", error->message);
+            g_object_unref (priv->direct_cancellable);
+            priv->direct_cancellable = NULL;
+            /* fall back to sending key events through ibus-daemon, and let
+             * it relay the signals of the engine. */
+            g_dbus_proxy_call ((GDBusProxy *) context,
+                               "CloseDirectChannel",
+                               NULL,
+                               G_DBUS_CALL_FLAGS_NONE,
+                               -1,
+                               NULL,
+                               NULL,
+                               NULL);
+        }
+        g_error_free (error);
+        g_object_unref (context);
+        return;
+    }
+
+    /* the channel is closed while connecting to the engine. */
+    if (priv->direct_cancellable == NULL) {
+        g_dbus_connection_close (connection, NULL, NULL, NULL);
+        g_object_unref (connection);
+        g_object_unref (context);
+        return;
+    }
+
+    g_object_unref (priv->direct_cancellable);
+    priv->direct_cancellable = NULL;
+
+    priv->direct_connection = connection;
+    priv->direct_signal_id =
+            g_dbus_connection_signal_subscribe (connection,
+                                                NULL,
+                                                IBUS_INTERFACE_ENGINE,
+                                                NULL,
+                                                priv->direct_engine_path,
+                                                NULL,
+                                                G_DBUS_SIGNAL_FLAGS_NONE,
+                                                (GDBusSignalCallback) _direct_channel_signal_cb,
+                                                context,
+                                                NULL);
+    g_signal_connect (connection, "closed",
+                      G_CALLBACK (_direct_channel_closed_cb), context);
+    g_object_unref (context);
+}
+
+static void
+_open_direct_channel_reply_cb (GObject          *source,
+                               GAsyncResult     *res,
+                               IBusInputContext *context)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+    GError *error = NULL;
+    GVariant *result = g_dbus_proxy_call_finish ((GDBusProxy *) source,
+                                                 res, &error);
+
+    if (result == NULL) {
+        /* ibus-daemon does not allow the direct channel, so key events
+         * are sent through ibus-daemon. */
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_object_unref (priv->direct_cancellable);
+            priv->direct_cancellable = NULL;
+        }
+        g_error_free (error);
+        g_object_unref (context);
+        return;
+    }
+
+    /* the channel is closed while waiting for the reply. */
+    if (priv->direct_cancellable == NULL) {
+        g_variant_unref (result);
+        g_object_unref (context);
+        return;
+    }
+
+    const gchar *address = NULL;
+    g_variant_get (result, "(&so)", &address, &priv->direct_engine_path);
+    g_dbus_connection_new_for_address (address,
+            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+            NULL,
+            priv->direct_cancellable,
+            (GAsyncReadyCallback) _direct_channel_connect_cb,
+            context);
+    g_variant_unref (result);
+}
+
+static void
+ibus_input_context_open_direct_channel (IBusInputContext *context)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+
+    /* the channel is open or being opened. */
+    if (priv->direct_connection != NULL || priv->direct_cancellable != NULL)
+        return;
+
+    priv->direct_cancellable = g_cancellable_new ();
+    g_dbus_proxy_call ((GDBusProxy *) context,
+                       "OpenDirectChannel",
+                       NULL,
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1,
+                       priv->direct_cancellable,
+                       (GAsyncReadyCallback) _open_direct_channel_reply_cb,
+                       g_object_ref (context));
+}
+
+static void
+ibus_input_context_close_direct_channel (IBusInputContext *context)
+{
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+
+    if (priv->direct_cancellable != NULL) {
+        g_cancellable_cancel (priv->direct_cancellable);
+        g_object_unref (priv->direct_cancellable);
+        priv->direct_cancellable = NULL;
+    }
+
+    if (priv->direct_connection != NULL) {
+        g_dbus_connection_signal_unsubscribe (priv->direct_connection,
+                                              priv->direct_signal_id);
+        g_signal_handlers_disconnect_by_func (priv->direct_connection,
+                                              G_CALLBACK (_direct_channel_closed_cb),
+                                              context);
+        if (!g_dbus_connection_is_closed (priv->direct_connection))
+            g_dbus_connection_close (priv->direct_connection, NULL, NULL, NULL);
+        g_object_unref (priv->direct_connection);
+        priv->direct_connection = NULL;
+        priv->direct_signal_id = 0;
+    }
+
+    g_free (priv->direct_engine_path);
+    priv->direct_engine_path = NULL;
+}
+
+void
+ibus_input_context_set_direct_channel (IBusInputContext *context,
+                                       gboolean          enabled)
+{
+    g_assert (IBUS_IS_INPUT_CONTEXT (context));
+
+    IBusInputContextPrivate *priv = IBUS_INPUT_CONTEXT_GET_PRIVATE (context);
+
+    if (priv->use_direct_channel == enabled)
+        return;
+
+    priv->use_direct_channel = enabled;
+    if (enabled) {
+        ibus_input_context_open_direct_channel (context);
+    }
+    else {
+        ibus_input_context_close_direct_channel (context);
+        g_dbus_proxy_call ((GDBusProxy *) context,
+                           "CloseDirectChannel",
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           NULL,
+                           NULL,
+                           NULL);
     }
 }
 
@@ -245,6 +245,10 @@ void         ibus_input_context_cancel_hand_writing
  *
  * Use ibus_keymap_lookup_keysym() to convert keycode to keysym in given keyboard layout.
  *
+ * If the engine published a key filter with ibus_engine_set_key_filter() and
+ * the key event is not in it, the key event is not sent to ibus-daemon and
+ * the result is %FALSE.
+ *
  * see_also: #IBusEngine::process-key-event
  */
 void        ibus_input_context_process_key_event_async
@@ -433,6 +437,12 @@ void         ibus_input_context_set_engine  (IBusInputContext   *context,
  * @text: An #IBusText surrounding the current cursor on the application.
  * @cursor_pos: Current cursor position in characters in @text.
  * @anchor_pos: Anchor position of selection in @text.
+ *
+ * Send the surrounding text to the engine. Only the window around the
+ * cursor the engine asks for is kept, and when the engine has the previous
+ * text, only the edited part of it is sent. @text may be made by
+ * ibus_text_new_from_static_string() to avoid copying all of it; it is
+ * not used after the call.
 */
 void         ibus_input_context_set_surrounding_text
                                             (IBusInputContext   *context,
@@ -451,5 +461,24 @@ void         ibus_input_context_set_surrounding_text
 gboolean     ibus_input_context_needs_surrounding_text
                                             (IBusInputContext   *context);
 
+/**
+ * ibus_input_context_set_direct_channel:
+ * @context: An #IBusInputContext.
+ * @enabled: %TRUE to send key events to the engine directly.
+ *
+ * Ask ibus-daemon for a direct channel to the current engine of the input
+ * context. Once the channel is established, key events are sent to the engine
+ * without going through ibus-daemon, and the committed text, forwarded key
+ * events and surrounding text deletions are received from the engine
+ * directly. The other signals still come through ibus-daemon.
+ *
+ * ibus-daemon refuses the channel unless it is started with --direct-channel
+ * and the system keyboard layout is used; then key events are sent through
+ * ibus-daemon as before. The channel is reopened when the engine is changed.
+ */
+void         ibus_input_context_set_direct_channel
+                                            (IBusInputContext   *context,
+                                             gboolean            enabled);
+
 G_END_DECLS
 #endif
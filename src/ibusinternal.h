@@ -37,6 +37,7 @@
 #define __IBUS_INTERNEL_H_
 
 #include <glib.h>
+#include <glib-object.h>
 /**
  * I_:
  * @string: A string
@@ -47,5 +48,31 @@
  */
 #define I_(string) g_intern_static_string (string)
 
+/* Create an object of the serializable type, reusing one from the
+ * recycling pool of the current thread if possible. */
+gpointer _ibus_serializable_new     (GType      type);
+
+/* Put an object into the recycling pool of the current thread, if it is
+ * disposed by its last reference. Call it at the end of dispose. */
+void     _ibus_serializable_recycle (gpointer   object);
+
+/* Push a sub parser like g_markup_parse_context_push() on a context of
+ * ibus_xml_parse_file_with_parser() or ibus_xml_parse_buffer_with_parser().
+ * The sub parsers are kept by the parse functions, so the parsers below can
+ * clean up after a parsing error, and the context can be freed. */
+void     _ibus_xml_markup_push      (GMarkupParseContext *context,
+                                     const GMarkupParser *parser,
+                                     gpointer             user_data);
+
+/* Pop the sub parser pushed by _ibus_xml_markup_push() and return its
+ * user data, like g_markup_parse_context_pop(). */
+gpointer _ibus_xml_markup_pop       (GMarkupParseContext *context);
+
+/* GMarkup only calls the error callback of the current sub parser. The
+ * error callback of a sub parser pushed by _ibus_xml_markup_push() frees
+ * its state, then calls this to pass the error to the parser below it. */
+void     _ibus_xml_markup_error     (GMarkupParseContext *context,
+                                     GError              *error);
+
 #endif
 
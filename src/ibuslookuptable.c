@@ -141,21 +141,26 @@ ibus_lookup_table_deserialize (IBusLookupTable *table,
     g_variant_get_child (variant, retval++, "i", &table->orientation);
 
     GVariant *var;
+    GVariant *array;
+    GVariantIter iter;
+
     // deserialize candidates
-    GVariantIter *iter = NULL;
-    g_variant_get_child (variant, retval++, "av", &iter);
-    while (g_variant_iter_loop (iter, "v", &var)) {
+    array = g_variant_get_child_value (variant, retval++);
+    g_variant_iter_init (&iter, array);
+    while ((var = g_variant_iter_next_value (&iter)) != NULL) {
         ibus_lookup_table_append_candidate (table, IBUS_TEXT (ibus_serializable_deserialize (var)));
+        g_variant_unref (var);
     }
-    g_variant_iter_free (iter);
+    g_variant_unref (array);
 
     // deserialize labels
-    iter = NULL;
-    g_variant_get_child (variant, retval++, "av", &iter);
-    while (g_variant_iter_loop (iter, "v", &var)) {
+    array = g_variant_get_child_value (variant, retval++);
+    g_variant_iter_init (&iter, array);
+    while ((var = g_variant_iter_next_value (&iter)) != NULL) {
         ibus_lookup_table_append_label (table, IBUS_TEXT (ibus_serializable_deserialize (var)));
+        g_variant_unref (var);
     }
-    g_variant_iter_free (iter);
+    g_variant_unref (array);
 
     return retval;
 }
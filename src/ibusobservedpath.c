@@ -22,6 +22,7 @@
 #include <glib/gstdio.h>
 #include <stdlib.h>
 #include "ibusobservedpath.h"
+#include "ibusinternal.h"
 
 
 enum {
@@ -216,6 +217,42 @@ ibus_observed_path_traverse (IBusObservedPath *path)
     return paths;
 }
 
+static gboolean
+ibus_observed_path_set_path (IBusObservedPath *path,
+                             const gchar      *text)
+{
+    if (text[0] == '~' && text[1] != G_DIR_SEPARATOR) {
+        g_warning ("invalide path \"%s\"", text);
+        return FALSE;
+    }
+
+    if (text[0] == '~') {
+        const gchar *homedir = g_getenv ("HOME");
+        if (homedir == NULL)
+            homedir = g_get_home_dir ();
+        path->path = g_build_filename (homedir, text + 2, NULL);
+    }
+    else {
+        path->path = g_strdup (text);
+    }
+
+    return TRUE;
+}
+
+static void
+ibus_observed_path_set_attributes (IBusObservedPath *path,
+                                   const gchar     **attribute_names,
+                                   const gchar     **attribute_values)
+{
+    for (; *attribute_names != NULL; attribute_names++, attribute_values++) {
+        if (g_strcmp0 (*attribute_names, "mtime") == 0) {
+            path->mtime = atol (*attribute_values);
+            continue;
+        }
+        g_warning ("Unkonwn attribute %s", *attribute_names);
+    }
+}
+
 static gboolean
 ibus_observed_path_parse_xml_node (IBusObservedPath *path,
                                    XMLNode          *node)
@@ -227,21 +264,10 @@ ibus_observed_path_parse_xml_node (IBusObservedPath *path,
         return FALSE;
     }
 
-    if (node->text[0] == '~' && node->text[1] != G_DIR_SEPARATOR) {
-        g_warning ("invalide path \"%s\"", node->text);
+    if (!ibus_observed_path_set_path (path, node->text)) {
         return FALSE;
     }
 
-    if (node->text[0] == '~') {
-        const gchar *homedir = g_getenv ("HOME");
-        if (homedir == NULL)
-            homedir = g_get_home_dir ();
-        path->path = g_build_filename (homedir, node->text + 2, NULL);
-    }
-    else {
-        path->path = g_strdup (node->text);
-    }
-
     gchar **attr;
     for (attr = node->attributes; attr[0]; attr += 2) {
         if (g_strcmp0 (*attr, "mtime") == 0) {
@@ -254,6 +280,126 @@ ibus_observed_path_parse_xml_node (IBusObservedPath *path,
     return TRUE;
 }
 
+typedef struct {
+    IBusObservedPath *path;
+    GString          *text;
+    gint              depth;
+} ObservedPathMarkupData;
+
+static void
+_observed_path_start_element_cb (GMarkupParseContext *context,
+                                 const gchar         *element_name,
+                                 const gchar        **attribute_names,
+                                 const gchar        **attribute_values,
+                                 gpointer             user_data,
+                                 GError             **error)
+{
+    ObservedPathMarkupData *data = (ObservedPathMarkupData *) user_data;
+
+    /* <path> does not have child elements. Ignore them. */
+    data->depth++;
+}
+
+static void
+_observed_path_end_element_cb (GMarkupParseContext *context,
+                               const gchar         *element_name,
+                               gpointer             user_data,
+                               GError             **error)
+{
+    ObservedPathMarkupData *data = (ObservedPathMarkupData *) user_data;
+
+    data->depth--;
+}
+
+static void
+_observed_path_text_cb (GMarkupParseContext *context,
+                        const gchar         *text,
+                        gsize                text_len,
+                        gpointer             user_data,
+                        GError             **error)
+{
+    ObservedPathMarkupData *data = (ObservedPathMarkupData *) user_data;
+
+    if (data->depth == 0)
+        g_string_append_len (data->text, text, text_len);
+}
+
+static void
+_observed_path_markup_data_free (ObservedPathMarkupData *data)
+{
+    g_string_free (data->text, TRUE);
+    g_slice_free (ObservedPathMarkupData, data);
+}
+
+static void
+_observed_path_error_cb (GMarkupParseContext *context,
+                         GError              *error,
+                         gpointer             user_data)
+{
+    ObservedPathMarkupData *data = (ObservedPathMarkupData *) user_data;
+
+    g_object_unref (data->path);
+    _observed_path_markup_data_free (data);
+
+    _ibus_xml_markup_error (context, error);
+}
+
+static const GMarkupParser _observed_path_markup_parser = {
+    _observed_path_start_element_cb,
+    _observed_path_end_element_cb,
+    _observed_path_text_cb,
+    0,
+    _observed_path_error_cb,
+};
+
+void
+ibus_observed_path_start_markup (GMarkupParseContext *context,
+                                 const gchar        **attribute_names,
+                                 const gchar        **attribute_values)
+{
+    g_assert (context);
+
+    ObservedPathMarkupData *data = g_slice_new0 (ObservedPathMarkupData);
+
+    data->path = (IBusObservedPath *) g_object_new (IBUS_TYPE_OBSERVED_PATH, NULL);
+    data->text = g_string_new ("");
+    ibus_observed_path_set_attributes (data->path,
+                                       attribute_names,
+                                       attribute_values);
+
+    _ibus_xml_markup_push (context, &_observed_path_markup_parser, data);
+}
+
+IBusObservedPath *
+ibus_observed_path_end_markup (GMarkupParseContext *context,
+                               gboolean             fill_stat)
+{
+    g_assert (context);
+
+    ObservedPathMarkupData *data;
+    IBusObservedPath *path;
+    const gchar *text;
+
+    data = (ObservedPathMarkupData *) _ibus_xml_markup_pop (context);
+    path = data->path;
+
+    text = data->text->str;
+    if (ibus_xml_text_is_space (data->text->str, data->text->len))
+        text = "";
+
+    if (!ibus_observed_path_set_path (path, text)) {
+        g_object_unref (path);
+        path = NULL;
+    }
+    else if (fill_stat) {
+        ibus_observed_path_fill_stat (path);
+    }
+
+    _observed_path_markup_data_free (data);
+
+    return path;
+}
+
 IBusObservedPath *
 ibus_observed_path_new_from_xml_node (XMLNode *node,
                                      gboolean fill_stat)
@@ -101,6 +101,36 @@ GType                ibus_observed_path_get_type            (void);
 IBusObservedPath    *ibus_observed_path_new_from_xml_node   (XMLNode            *node,
                                                              gboolean            fill_stat);
 
+/**
+ * ibus_observed_path_start_markup:
+ * @context: A GMarkupParseContext.
+ * @attribute_names: Attribute names of the &lt;path&gt; element.
+ * @attribute_values: Attribute values of the &lt;path&gt; element.
+ *
+ * Push a sub parser which builds an IBusObservedPath from a &lt;path&gt;
+ * element directly, without building an XML tree. It must be paired
+ * with ibus_observed_path_end_markup() in the end_element callback of the
+ * same element.
+ */
+void                 ibus_observed_path_start_markup        (GMarkupParseContext
+                                                                                *context,
+                                                             const gchar       **attribute_names,
+                                                             const gchar       **attribute_values);
+
+/**
+ * ibus_observed_path_end_markup:
+ * @context: A GMarkupParseContext.
+ * @fill_stat: Auto-fill the path status.
+ * @returns: A newly allocated IBusObservedPath, or NULL if the path is
+ * invalid.
+ *
+ * Pop the sub parser pushed by ibus_observed_path_start_markup(), and
+ * return the IBusObservedPath it built.
+ */
+IBusObservedPath    *ibus_observed_path_end_markup          (GMarkupParseContext
+                                                                                *context,
+                                                             gboolean            fill_stat);
+
 /**
  * ibus_observed_path_new:
  * @path: The path string.
@@ -55,6 +55,17 @@ enum {
     PROP_0,
 };
 
+/* IBusPanelServicePrivate */
+struct _IBusPanelServicePrivate {
+    /* The registered properties, updated in place by the
+       UpdatePropertyState method */
+    IBusPropList *props;
+};
+typedef struct _IBusPanelServicePrivate IBusPanelServicePrivate;
+
+#define IBUS_PANEL_SERVICE_GET_PRIVATE(o)  \
+   (G_TYPE_INSTANCE_GET_PRIVATE ((o), IBUS_TYPE_PANEL_SERVICE, IBusPanelServicePrivate))
+
 static guint            panel_signals[LAST_SIGNAL] = { 0 };
 
 /* functions prototype */
@@ -150,6 +161,12 @@ static const gchar introspection_xml[] =
     "    <method name='UpdateProperty'>"
     "      <arg direction='in'  type='v' name='prop' />"
     "    </method>"
+    "    <method name='UpdatePropertyState'>"
+    "      <arg direction='in'  type='s' name='key' />"
+    "      <arg direction='in'  type='u' name='state' />"
+    "      <arg direction='in'  type='b' name='visible' />"
+    "      <arg direction='in'  type='b' name='sensitive' />"
+    "    </method>"
     "    <method name='FocusIn'>"
     "      <arg direction='in'  type='o' name='ic' />"
     "    </method>"
@@ -196,6 +213,8 @@ ibus_panel_service_class_init (IBusPanelServiceClass *class)
     GObjectClass *gobject_class = G_OBJECT_CLASS (class);
     ibus_panel_service_parent_class = IBUS_SERVICE_CLASS (g_type_class_peek_parent (class));
 
+    g_type_class_add_private (class, sizeof (IBusPanelServicePrivate));
+
     gobject_class->set_property = (GObjectSetPropertyFunc) ibus_panel_service_set_property;
     gobject_class->get_property = (GObjectGetPropertyFunc) ibus_panel_service_get_property;
 
@@ -695,6 +714,13 @@ ibus_panel_service_get_property (IBusPanelService *panel,
 static void
 ibus_panel_service_real_destroy (IBusPanelService *panel)
 {
+    IBusPanelServicePrivate *priv = IBUS_PANEL_SERVICE_GET_PRIVATE (panel);
+
+    if (priv->props) {
+        g_object_unref (priv->props);
+        priv->props = NULL;
+    }
+
     IBUS_OBJECT_CLASS(ibus_panel_service_parent_class)->destroy (IBUS_OBJECT (panel));
 }
 
@@ -706,6 +732,152 @@ _g_object_unref_if_floating (gpointer instance)
         g_object_unref (instance);
 }
 
+static void
+_panel_update_preedit_text (IBusPanelService      *panel,
+                            GVariant              *parameters,
+                            GDBusMethodInvocation *invocation)
+{
+    GVariant *variant = NULL;
+    guint cursor = 0;
+    gboolean visible = FALSE;
+
+    g_variant_get (parameters, "(vub)", &variant, &cursor, &visible);
+    IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
+
+    g_signal_emit (panel, panel_signals[UPDATE_PREEDIT_TEXT], 0, text, cursor, visible);
+    _g_object_unref_if_floating (text);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_panel_update_auxiliary_text (IBusPanelService      *panel,
+                              GVariant              *parameters,
+                              GDBusMethodInvocation *invocation)
+{
+    GVariant *variant = NULL;
+    gboolean visible = FALSE;
+
+    g_variant_get (parameters, "(vb)", &variant, &visible);
+    IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
+
+    g_signal_emit (panel, panel_signals[UPDATE_AUXILIARY_TEXT], 0, text, visible);
+    _g_object_unref_if_floating (text);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_panel_update_lookup_table (IBusPanelService      *panel,
+                            GVariant              *parameters,
+                            GDBusMethodInvocation *invocation)
+{
+    GVariant *variant = NULL;
+    gboolean visible = FALSE;
+
+    g_variant_get (parameters, "(vb)", &variant, &visible);
+    IBusLookupTable *table = IBUS_LOOKUP_TABLE (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
+
+    g_signal_emit (panel, panel_signals[UPDATE_LOOKUP_TABLE], 0, table, visible);
+    _g_object_unref_if_floating (table);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_panel_focus_in (IBusPanelService      *panel,
+                 GVariant              *parameters,
+                 GDBusMethodInvocation *invocation)
+{
+    const gchar *path;
+    g_variant_get (parameters, "(&o)", &path);
+    g_signal_emit (panel, panel_signals[FOCUS_IN], 0, path);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_panel_focus_out (IBusPanelService      *panel,
+                  GVariant              *parameters,
+                  GDBusMethodInvocation *invocation)
+{
+    const gchar *path;
+    g_variant_get (parameters, "(&o)", &path);
+    g_signal_emit (panel, panel_signals[FOCUS_OUT], 0, path);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_panel_register_properties (IBusPanelService      *panel,
+                            GVariant              *parameters,
+                            GDBusMethodInvocation *invocation)
+{
+    GVariant *variant = g_variant_get_child_value (parameters, 0);
+    IBusPropList *prop_list = IBUS_PROP_LIST (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
+
+    IBusPanelServicePrivate *priv = IBUS_PANEL_SERVICE_GET_PRIVATE (panel);
+    if (priv->props)
+        g_object_unref (priv->props);
+    priv->props = g_object_ref_sink (prop_list);
+
+    g_signal_emit (panel, panel_signals[REGISTER_PROPERTIES], 0, prop_list);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_panel_update_property (IBusPanelService      *panel,
+                        GVariant              *parameters,
+                        GDBusMethodInvocation *invocation)
+{
+    GVariant *variant = g_variant_get_child_value (parameters, 0);
+    IBusProperty *property = IBUS_PROPERTY (ibus_serializable_deserialize (variant));
+    g_variant_unref (variant);
+
+    g_signal_emit (panel, panel_signals[UPDATE_PROPERTY], 0, property);
+    _g_object_unref_if_floating (property);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_panel_update_property_state (IBusPanelService      *panel,
+                              GVariant              *parameters,
+                              GDBusMethodInvocation *invocation)
+{
+    IBusPanelServicePrivate *priv = IBUS_PANEL_SERVICE_GET_PRIVATE (panel);
+    const gchar *key = NULL;
+    guint state = 0;
+    gboolean visible = FALSE;
+    gboolean sensitive = FALSE;
+
+    g_variant_get (parameters, "(&subb)",
+                   &key, &state, &visible, &sensitive);
+
+    /* Apply the change to the registered property and pass it to
+     * update_property(), so the panels do not need to handle the
+     * partial update. */
+    if (priv->props != NULL &&
+        ibus_prop_list_update_property_state (priv->props,
+                                              key,
+                                              state,
+                                              visible,
+                                              sensitive)) {
+        g_signal_emit (panel, panel_signals[UPDATE_PROPERTY], 0,
+                       ibus_prop_list_lookup (priv->props, key));
+    }
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_panel_set_cursor_location (IBusPanelService      *panel,
+                            GVariant              *parameters,
+                            GDBusMethodInvocation *invocation)
+{
+    gint x, y, w, h;
+    g_variant_get (parameters, "(iiii)", &x, &y, &w, &h);
+    g_signal_emit (panel, panel_signals[SET_CURSOR_LOCATION], 0, x, y, w, h);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
 static void
 ibus_panel_service_service_method_call (IBusService           *service,
                                         GDBusConnection       *connection,
@@ -731,129 +903,67 @@ ibus_panel_service_service_method_call (IBusService           *service,
         return;
     }
 
-    if (g_strcmp0 (method_name, "UpdatePreeditText") == 0) {
-        GVariant *variant = NULL;
-        guint cursor = 0;
-        gboolean visible = FALSE;
-
-        g_variant_get (parameters, "(vub)", &variant, &cursor, &visible);
-        IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
-
-        g_signal_emit (panel, panel_signals[UPDATE_PREEDIT_TEXT], 0, text, cursor, visible);
-        _g_object_unref_if_floating (text);
-        g_dbus_method_invocation_return_value (invocation, NULL);
-        return;
-    }
-
-    if (g_strcmp0 (method_name, "UpdateAuxiliaryText") == 0) {
-        GVariant *variant = NULL;
-        gboolean visible = FALSE;
-
-        g_variant_get (parameters, "(vb)", &variant, &visible);
-        IBusText *text = IBUS_TEXT (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
-
-        g_signal_emit (panel, panel_signals[UPDATE_AUXILIARY_TEXT], 0, text, visible);
-        _g_object_unref_if_floating (text);
-        g_dbus_method_invocation_return_value (invocation, NULL);
-        return;
-    }
-
-    if (g_strcmp0 (method_name, "UpdateLookupTable") == 0) {
-        GVariant *variant = NULL;
-        gboolean visible = FALSE;
-
-        g_variant_get (parameters, "(vb)", &variant, &visible);
-        IBusLookupTable *table = IBUS_LOOKUP_TABLE (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
-
-        g_signal_emit (panel, panel_signals[UPDATE_LOOKUP_TABLE], 0, table, visible);
-        _g_object_unref_if_floating (table);
-        g_dbus_method_invocation_return_value (invocation, NULL);
-        return;
-    }
-
-    if (g_strcmp0 (method_name, "FocusIn") == 0) {
-        const gchar *path;
-        g_variant_get (parameters, "(&o)", &path);
-        g_signal_emit (panel, panel_signals[FOCUS_IN], 0, path);
-        g_dbus_method_invocation_return_value (invocation, NULL);
-        return;
-    }
-
-    if (g_strcmp0 (method_name, "FocusOut") == 0) {
-        const gchar *path;
-        g_variant_get (parameters, "(&o)", &path);
-        g_signal_emit (panel, panel_signals[FOCUS_OUT], 0, path);
-        g_dbus_method_invocation_return_value (invocation, NULL);
-        return;
-    }
-
-    if (g_strcmp0 (method_name, "RegisterProperties") == 0) {
-        GVariant *variant = g_variant_get_child_value (parameters, 0);
-        IBusPropList *prop_list = IBUS_PROP_LIST (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
-
-        g_signal_emit (panel, panel_signals[REGISTER_PROPERTIES], 0, prop_list);
-        _g_object_unref_if_floating (prop_list);
-        g_dbus_method_invocation_return_value (invocation, NULL);
-        return;
-    }
-
-    if (g_strcmp0 (method_name, "UpdateProperty") == 0) {
-        GVariant *variant = g_variant_get_child_value (parameters, 0);
-        IBusProperty *property = IBUS_PROPERTY (ibus_serializable_deserialize (variant));
-        g_variant_unref (variant);
-
-        g_signal_emit (panel, panel_signals[UPDATE_PROPERTY], 0, property);
-        _g_object_unref_if_floating (property);
-        g_dbus_method_invocation_return_value (invocation, NULL);
-        return;
-    }
-
-    if (g_strcmp0 (method_name, "SetCursorLocation") == 0) {
-        gint x, y, w, h;
-        g_variant_get (parameters, "(iiii)", &x, &y, &w, &h);
-        g_signal_emit (panel, panel_signals[SET_CURSOR_LOCATION], 0, x, y, w, h);
-        g_dbus_method_invocation_return_value (invocation, NULL);
-        return;
-    }
-
+    /* Methods without arguments just emit the glib signal signal_id, the
+     * others are handled by method_callback. */
     const static struct {
         const gchar *name;
         const gint signal_id;
-    } no_arg_methods [] = {
-        { "CursorUpLookupTable",   CURSOR_UP_LOOKUP_TABLE },
-        { "CursorDownLookupTable", CURSOR_DOWN_LOOKUP_TABLE },
-        { "HideAuxiliaryText",     HIDE_AUXILIARY_TEXT },
-        { "HideLanguageBar",       HIDE_LANGUAGE_BAR },
-        { "HideLookupTable",       HIDE_LOOKUP_TABLE },
-        { "HidePreeditText",       HIDE_PREEDIT_TEXT },
-        { "PageUpLookupTable",     PAGE_UP_LOOKUP_TABLE },
-        { "PageDownLookupTable",   PAGE_DOWN_LOOKUP_TABLE },
-        { "Reset",                 RESET },
-        { "ShowAuxiliaryText",     SHOW_AUXILIARY_TEXT },
-        { "ShowLanguageBar",       SHOW_LANGUAGE_BAR },
-        { "ShowLookupTable",       SHOW_LOOKUP_TABLE },
-        { "ShowPreeditText",       SHOW_PREEDIT_TEXT },
-        { "StartSetup",            START_SETUP },
-        { "StateChanged",          STATE_CHANGED },
+        void (* method_callback) (IBusPanelService *, GVariant *, GDBusMethodInvocation *);
+    } methods [] = {
+        { "UpdatePreeditText",     -1, _panel_update_preedit_text },
+        { "UpdateAuxiliaryText",   -1, _panel_update_auxiliary_text },
+        { "UpdateLookupTable",     -1, _panel_update_lookup_table },
+        { "FocusIn",               -1, _panel_focus_in },
+        { "FocusOut",              -1, _panel_focus_out },
+        { "RegisterProperties",    -1, _panel_register_properties },
+        { "UpdateProperty",        -1, _panel_update_property },
+        { "UpdatePropertyState",   -1, _panel_update_property_state },
+        { "SetCursorLocation",     -1, _panel_set_cursor_location },
+        { "CursorUpLookupTable",   CURSOR_UP_LOOKUP_TABLE,   NULL },
+        { "CursorDownLookupTable", CURSOR_DOWN_LOOKUP_TABLE, NULL },
+        { "HideAuxiliaryText",     HIDE_AUXILIARY_TEXT,      NULL },
+        { "HideLanguageBar",       HIDE_LANGUAGE_BAR,        NULL },
+        { "HideLookupTable",       HIDE_LOOKUP_TABLE,        NULL },
+        { "HidePreeditText",       HIDE_PREEDIT_TEXT,        NULL },
+        { "PageUpLookupTable",     PAGE_UP_LOOKUP_TABLE,     NULL },
+        { "PageDownLookupTable",   PAGE_DOWN_LOOKUP_TABLE,   NULL },
+        { "Reset",                 RESET,                    NULL },
+        { "ShowAuxiliaryText",     SHOW_AUXILIARY_TEXT,      NULL },
+        { "ShowLanguageBar",       SHOW_LANGUAGE_BAR,        NULL },
+        { "ShowLookupTable",       SHOW_LOOKUP_TABLE,        NULL },
+        { "ShowPreeditText",       SHOW_PREEDIT_TEXT,        NULL },
+        { "StartSetup",            START_SETUP,              NULL },
+        { "StateChanged",          STATE_CHANGED,            NULL },
     };
 
+    /* A map from a method name to its index + 1 in methods. */
+    static gsize methods_table = 0;
+
     gint i;
-    for (i = 0; i < G_N_ELEMENTS (no_arg_methods); i++) {
-        if (g_strcmp0 (method_name, no_arg_methods[i].name) == 0) {
-            if (no_arg_methods[i].signal_id >= 0) {
-                g_signal_emit (panel, panel_signals[no_arg_methods[i].signal_id], 0);
-            }
-            g_dbus_method_invocation_return_value (invocation, NULL);
-            return;
+    if (g_once_init_enter (&methods_table)) {
+        GHashTable *table = g_hash_table_new (g_str_hash, g_str_equal);
+        for (i = 0; i < G_N_ELEMENTS (methods); i++) {
+            g_hash_table_insert (table,
+                                 (gpointer) methods[i].name,
+                                 GINT_TO_POINTER (i + 1));
         }
+        g_once_init_leave (&methods_table, (gsize) table);
     }
 
+    i = GPOINTER_TO_INT (g_hash_table_lookup ((GHashTable *) methods_table,
+                                              method_name)) - 1;
     /* should not be reached */
-    g_return_if_reached ();
+    g_return_if_fail (i >= 0);
+
+    if (methods[i].method_callback != NULL) {
+        methods[i].method_callback (panel, parameters, invocation);
+        return;
+    }
+
+    if (methods[i].signal_id >= 0) {
+        g_signal_emit (panel, panel_signals[methods[i].signal_id], 0);
+    }
+    g_dbus_method_invocation_return_value (invocation, NULL);
 }
 
 static GVariant *
@@ -600,6 +600,11 @@ ibus_property_update (IBusProperty *prop,
     IBusPropertyPrivate *priv = prop->priv;
     IBusPropertyPrivate *priv_update = prop_update->priv;
 
+    /* prop_update may be the property itself, e.g. the property updated by
+     * ibus_prop_list_update_property_state. */
+    if (prop == prop_update)
+        return TRUE;
+
     if (g_strcmp0 (priv->key, priv_update->key) != 0) {
         return ibus_prop_list_update_property (priv->sub_props, prop_update);
     }
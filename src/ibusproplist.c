@@ -21,6 +21,17 @@
  */
 #include "ibusproplist.h"
 
+/* IBusPropListPrivate */
+struct _IBusPropListPrivate {
+    /* A map from the key of a property in the list to the property.
+       Properties in the sub lists are not included. */
+    GHashTable *index;
+};
+typedef struct _IBusPropListPrivate IBusPropListPrivate;
+
+#define IBUS_PROP_LIST_GET_PRIVATE(o)  \
+   (G_TYPE_INSTANCE_GET_PRIVATE ((o), IBUS_TYPE_PROP_LIST, IBusPropListPrivate))
+
 /* functions prototype */
 static void         ibus_prop_list_destroy      (IBusPropList       *prop_list);
 static gboolean     ibus_prop_list_serialize    (IBusPropList       *prop_list,
@@ -38,6 +49,8 @@ ibus_prop_list_class_init (IBusPropListClass *class)
     IBusObjectClass *object_class = IBUS_OBJECT_CLASS (class);
     IBusSerializableClass *serializable_class = IBUS_SERIALIZABLE_CLASS (class);
 
+    g_type_class_add_private (class, sizeof (IBusPropListPrivate));
+
     object_class->destroy = (IBusObjectDestroyFunc) ibus_prop_list_destroy;
 
     serializable_class->serialize   = (IBusSerializableSerializeFunc) ibus_prop_list_serialize;
@@ -48,15 +61,24 @@ ibus_prop_list_class_init (IBusPropListClass *class)
 static void
 ibus_prop_list_init (IBusPropList *prop_list)
 {
+    IBusPropListPrivate *priv = IBUS_PROP_LIST_GET_PRIVATE (prop_list);
+
     prop_list->properties = g_array_new (TRUE, TRUE, sizeof (IBusProperty *));
+    priv->index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 static void
 ibus_prop_list_destroy (IBusPropList *prop_list)
 {
+    IBusPropListPrivate *priv = IBUS_PROP_LIST_GET_PRIVATE (prop_list);
     IBusProperty **p;
     gint i;
 
+    if (priv->index) {
+        g_hash_table_destroy (priv->index);
+        priv->index = NULL;
+    }
+
     p = (IBusProperty **) g_array_free (prop_list->properties, FALSE);
 
     for (i = 0; p[i] != NULL; i++) {
@@ -160,9 +182,17 @@ ibus_prop_list_append (IBusPropList *prop_list,
     g_assert (IBUS_IS_PROP_LIST (prop_list));
     g_assert (IBUS_IS_PROPERTY (prop));
 
+    IBusPropListPrivate *priv = IBUS_PROP_LIST_GET_PRIVATE (prop_list);
+    const gchar *key = ibus_property_get_key (prop);
+
     g_object_ref_sink (prop);
 
     g_array_append_val (prop_list->properties, prop);
+
+    /* Keep the first property if keys are duplicated, like the lookup
+     * by walking the list did. */
+    if (key != NULL && g_hash_table_lookup (priv->index, key) == NULL)
+        g_hash_table_insert (priv->index, g_strdup (key), prop);
 }
 
 IBusProperty *
@@ -180,6 +210,38 @@ ibus_prop_list_get (IBusPropList *prop_list,
 
 
 
+IBusProperty *
+ibus_prop_list_lookup (IBusPropList *prop_list,
+                       const gchar  *key)
+{
+    g_assert (IBUS_IS_PROP_LIST (prop_list));
+    g_assert (key != NULL);
+
+    IBusPropListPrivate *priv = IBUS_PROP_LIST_GET_PRIVATE (prop_list);
+    IBusProperty *prop;
+    guint i;
+
+    prop = (IBusProperty *) g_hash_table_lookup (priv->index, key);
+    if (prop != NULL)
+        return prop;
+
+    /* Only the properties with sub properties (menus) need to be visited. */
+    for (i = 0; i < prop_list->properties->len; i ++) {
+        IBusPropList *sub_props;
+
+        prop = g_array_index (prop_list->properties, IBusProperty *, i);
+        sub_props = ibus_property_get_sub_props (prop);
+        if (sub_props == NULL || sub_props->properties->len == 0)
+            continue;
+
+        prop = ibus_prop_list_lookup (sub_props, key);
+        if (prop != NULL)
+            return prop;
+    }
+
+    return NULL;
+}
+
 gboolean
 ibus_prop_list_update_property (IBusPropList *prop_list,
                                 IBusProperty *prop_update)
@@ -187,14 +249,33 @@ ibus_prop_list_update_property (IBusPropList *prop_list,
     g_assert (IBUS_IS_PROP_LIST (prop_list));
     g_assert (IBUS_IS_PROPERTY (prop_update));
 
-    gint i;
+    IBusProperty *prop;
 
-    for (i = 0; i < prop_list->properties->len; i ++) {
-        IBusProperty *prop = g_array_index (prop_list->properties, IBusProperty *, i);
-        if (ibus_property_update (prop, prop_update)) {
-            return TRUE;
-        }
-    }
+    prop = ibus_prop_list_lookup (prop_list,
+                                  ibus_property_get_key (prop_update));
+    if (prop == NULL)
+        return FALSE;
 
-    return FALSE;
+    return ibus_property_update (prop, prop_update);
+}
+
+gboolean
+ibus_prop_list_update_property_state (IBusPropList  *prop_list,
+                                      const gchar   *key,
+                                      IBusPropState  state,
+                                      gboolean       visible,
+                                      gboolean       sensitive)
+{
+    g_assert (IBUS_IS_PROP_LIST (prop_list));
+    g_assert (key != NULL);
+
+    IBusProperty *prop = ibus_prop_list_lookup (prop_list, key);
+    if (prop == NULL)
+        return FALSE;
+
+    ibus_property_set_state (prop, state);
+    ibus_property_set_visible (prop, visible);
+    ibus_property_set_sensitive (prop, sensitive);
+
+    return TRUE;
 }
@@ -123,5 +123,36 @@ IBusProperty    *ibus_prop_list_get         (IBusPropList   *prop_list,
 gboolean         ibus_prop_list_update_property
                                             (IBusPropList   *prop_list,
                                              IBusProperty   *prop);
+
+/**
+ * ibus_prop_list_lookup:
+ * @prop_list: An IBusPropList.
+ * @key: The key of an IBusProperty.
+ * @returns: (transfer none): The IBusProperty with @key in @prop_list or its
+ * sub lists, NULL if no such IBusProperty.
+ *
+ * Look up an IBusProperty by key. Borrowed reference.
+ */
+IBusProperty    *ibus_prop_list_lookup      (IBusPropList   *prop_list,
+                                             const gchar    *key);
+
+/**
+ * ibus_prop_list_update_property_state:
+ * @prop_list: An IBusPropList.
+ * @key: The key of the IBusProperty to be updated.
+ * @state: The new state of the IBusProperty.
+ * @visible: The new visibility of the IBusProperty.
+ * @sensitive: The new sensitivity of the IBusProperty.
+ * @returns: TRUE if succeeded, FALSE otherwise.
+ *
+ * Update the state, visibility and sensitivity of an IBusProperty in
+ * IBusPropList. The other fields of the IBusProperty are kept.
+ */
+gboolean         ibus_prop_list_update_property_state
+                                            (IBusPropList   *prop_list,
+                                             const gchar    *key,
+                                             IBusPropState   state,
+                                             gboolean        visible,
+                                             gboolean        sensitive);
 G_END_DECLS
 #endif
@@ -21,6 +21,9 @@
  */
 #include "ibusinternal.h"
 #include "ibusserializable.h"
+#include "ibusattribute.h"
+#include "ibusattrlist.h"
+#include "ibustext.h"
 
 #define IBUS_SERIALIZABLE_GET_PRIVATE(o)  \
    (G_TYPE_INSTANCE_GET_PRIVATE ((o), IBUS_TYPE_SERIALIZABLE, IBusSerializablePrivate))
@@ -50,6 +53,33 @@ static gboolean  ibus_serializable_real_copy        (IBusSerializable       *des
 
 static IBusObjectClass *parent_class = NULL;
 
+/* A map from a type name to the serializable GType, so deserializing an
+ * object does not need to look up and check the type every time. */
+G_LOCK_DEFINE_STATIC (serializable_types);
+static GHashTable *serializable_types = NULL;
+
+/* The recycling pools are enabled by $IBUS_OBJECT_POOL. Each thread has
+ * its own pools, so no lock is needed to take or put an object. Only
+ * IBusText, IBusAttrList and IBusAttribute are pooled, not their
+ * subclasses, whose dispose may not leave them reusable. */
+#define POOL_SIZE       64
+#define N_POOL_TYPES    3
+
+typedef struct {
+    GType      type;
+    GPtrArray *objects;
+} IBusSerializablePoolEntry;
+
+typedef struct {
+    gboolean                  destroyed;
+    IBusSerializablePoolEntry entries[N_POOL_TYPES];
+} IBusSerializablePool;
+
+static GStaticPrivate pool_key = G_STATIC_PRIVATE_INIT;
+static gint pool_enabled = -1;
+static volatile gint pool_hits = 0;
+static volatile gint pool_misses = 0;
+
 GType
 ibus_serializable_get_type (void)
 {
@@ -153,9 +183,17 @@ ibus_serializable_real_deserialize (IBusSerializable *object,
 {
     const gchar *key;
     GVariant *value;
-    GVariantIter *iter = NULL;
-    g_variant_get_child (variant, 1, "a{sv}", &iter);
-    while (g_variant_iter_loop (iter, "{&sv}", &key, &value)) {
+    GVariantIter iter;
+    GVariant *array = g_variant_get_child_value (variant, 1);
+
+    /* Most objects do not have any attachments. */
+    if (g_variant_n_children (array) == 0) {
+        g_variant_unref (array);
+        return 2;
+    }
+
+    g_variant_iter_init (&iter, array);
+    while (g_variant_iter_loop (&iter, "{&sv}", &key, &value)) {
         GVariant *attachment = g_variant_get_variant (value);
         ibus_serializable_set_attachment (object,
                                           key,
@@ -163,7 +201,7 @@ ibus_serializable_real_deserialize (IBusSerializable *object,
         g_variant_unref (attachment);
         g_variant_unref (value);
     }
-    g_variant_iter_free (iter);
+    g_variant_unref (array);
     return 2;
 }
 
@@ -230,6 +268,132 @@ ibus_serializable_remove_qattachment (IBusSerializable *serializable,
     g_datalist_id_set_data (&serializable->priv->attachments, key, NULL);
 }
 
+static gboolean
+ibus_serializable_pool_is_enabled (void)
+{
+    if (G_UNLIKELY (pool_enabled == -1)) {
+        const gchar *env = g_getenv ("IBUS_OBJECT_POOL");
+        g_atomic_int_set (&pool_enabled,
+                          env != NULL && g_strcmp0 (env, "0") != 0);
+    }
+    return pool_enabled;
+}
+
+static void
+ibus_serializable_pool_free (IBusSerializablePool *pool)
+{
+    gint i;
+
+    /* the objects are finalized instead of going back to the pool. */
+    pool->destroyed = TRUE;
+    for (i = 0; i < N_POOL_TYPES && pool->entries[i].type != 0; i++) {
+        g_ptr_array_foreach (pool->entries[i].objects,
+                             (GFunc) g_object_unref,
+                             NULL);
+        g_ptr_array_free (pool->entries[i].objects, TRUE);
+    }
+    g_slice_free (IBusSerializablePool, pool);
+}
+
+static GPtrArray *
+ibus_serializable_pool_lookup (GType    type,
+                               gboolean create)
+{
+    IBusSerializablePool *pool = g_static_private_get (&pool_key);
+    gint i;
+
+    if (pool == NULL) {
+        if (!create)
+            return NULL;
+        pool = g_slice_new0 (IBusSerializablePool);
+        g_static_private_set (&pool_key,
+                              pool,
+                              (GDestroyNotify) ibus_serializable_pool_free);
+    }
+
+    if (pool->destroyed)
+        return NULL;
+
+    for (i = 0; i < N_POOL_TYPES && pool->entries[i].type != 0; i++) {
+        if (pool->entries[i].type == type)
+            return pool->entries[i].objects;
+    }
+
+    if (!create || i == N_POOL_TYPES)
+        return NULL;
+
+    pool->entries[i].type = type;
+    pool->entries[i].objects = g_ptr_array_sized_new (POOL_SIZE);
+    return pool->entries[i].objects;
+}
+
+static gboolean
+ibus_serializable_pool_has_type (GType type)
+{
+    return type == IBUS_TYPE_TEXT ||
+           type == IBUS_TYPE_ATTR_LIST ||
+           type == IBUS_TYPE_ATTRIBUTE;
+}
+
+gpointer
+_ibus_serializable_new (GType type)
+{
+    if (ibus_serializable_pool_has_type (type) &&
+        ibus_serializable_pool_is_enabled ()) {
+        GPtrArray *objects = ibus_serializable_pool_lookup (type, FALSE);
+
+        if (objects != NULL && objects->len > 0) {
+            IBusObject *object = g_ptr_array_remove_index_fast (objects,
+                                                                objects->len - 1);
+            /* The pool owned the only reference. Give it to the caller as
+             * a floating reference, like g_object_new. */
+            IBUS_OBJECT_UNSET_FLAGS (object, IBUS_DESTROYED);
+            g_object_force_floating ((GObject *) object);
+            g_atomic_int_inc (&pool_hits);
+            return object;
+        }
+        g_atomic_int_inc (&pool_misses);
+    }
+    return g_object_new (type, NULL);
+}
+
+void
+_ibus_serializable_recycle (gpointer object)
+{
+    GObject *gobject = (GObject *) object;
+    GPtrArray *objects;
+
+    if (!ibus_serializable_pool_has_type (G_OBJECT_TYPE (object)) ||
+        !ibus_serializable_pool_is_enabled ())
+        return;
+
+    /* Only recycle the object when it is disposed by the last unref, and
+     * nothing (e.g. data, weak or toggle refs of bindings) is attached
+     * to it any more. */
+    if (gobject->ref_count != 1 ||
+        ((gsize) gobject->qdata & ~(gsize) G_DATALIST_FLAGS_MASK) != 0)
+        return;
+
+    objects = ibus_serializable_pool_lookup (G_OBJECT_TYPE (object), TRUE);
+    if (objects == NULL || objects->len >= POOL_SIZE)
+        return;
+
+    /* Keep the object alive. g_object_unref returns without finalizing
+     * it, since the reference count is not 0 after dispose. */
+    g_ptr_array_add (objects, g_object_ref (object));
+}
+
+gboolean
+ibus_serializable_get_pool_stats (guint *hits,
+                                  guint *misses)
+{
+    if (hits != NULL)
+        *hits = g_atomic_int_get (&pool_hits);
+    if (misses != NULL)
+        *misses = g_atomic_int_get (&pool_misses);
+    return ibus_serializable_pool_is_enabled ();
+}
+
 IBusSerializable *
 ibus_serializable_copy (IBusSerializable *object)
 {
@@ -240,7 +404,7 @@ ibus_serializable_copy (IBusSerializable *object)
 
     type = G_OBJECT_TYPE (object);
 
-    new_object = g_object_new (type, NULL);
+    new_object = _ibus_serializable_new (type);
     g_return_val_if_fail (new_object != NULL, NULL);
 
     if (IBUS_SERIALIZABLE_GET_CLASS (new_object)->copy (new_object, object)) {
@@ -267,6 +431,36 @@ ibus_serializable_serialize (IBusSerializable *object)
     return g_variant_builder_end (&builder);
 }
 
+static GType
+ibus_serializable_lookup_type (const gchar *type_name)
+{
+    GType type;
+
+    G_LOCK (serializable_types);
+    if (serializable_types == NULL)
+        serializable_types = g_hash_table_new (g_str_hash, g_str_equal);
+    type = (GType) g_hash_table_lookup (serializable_types, type_name);
+    G_UNLOCK (serializable_types);
+
+    if (type != 0)
+        return type;
+
+    type = g_type_from_name (type_name);
+    if (!g_type_is_a (type, IBUS_TYPE_SERIALIZABLE))
+        return G_TYPE_INVALID;
+
+    /* Only cache static types. The name of a dynamic type is freed with
+     * its plugin. */
+    if (g_type_get_plugin (type) == NULL) {
+        G_LOCK (serializable_types);
+        g_hash_table_insert (serializable_types,
+                             (gpointer) g_type_name (type),
+                             (gpointer) type);
+        G_UNLOCK (serializable_types);
+    }
+    return type;
+}
+
 IBusSerializable *
 ibus_serializable_deserialize (GVariant *variant)
 {
@@ -284,13 +478,17 @@ ibus_serializable_deserialize (GVariant *variant)
         g_return_val_if_reached (NULL);
     }
 
-    gchar *type_name = NULL;
-    g_variant_get_child (var, 0, "&s", &type_name);
-    GType type = g_type_from_name (type_name);
+    GVariant *type_name = g_variant_get_child_value (var, 0);
+    GType type = ibus_serializable_lookup_type (
+                            g_variant_get_string (type_name, NULL));
+    g_variant_unref (type_name);
 
-    g_return_val_if_fail (g_type_is_a (type, IBUS_TYPE_SERIALIZABLE), NULL);
+    if (type == G_TYPE_INVALID) {
+        g_variant_unref (var);
+        g_return_val_if_reached (NULL);
+    }
 
-    IBusSerializable *object = g_object_new (type, NULL);
+    IBusSerializable *object = _ibus_serializable_new (type);
 
     gint retval = IBUS_SERIALIZABLE_GET_CLASS (object)->deserialize (object, var);
     g_variant_unref (var);
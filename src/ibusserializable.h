@@ -266,6 +266,19 @@ GVariant            *ibus_serializable_serialize        (IBusSerializable   *ser
  */
 IBusSerializable    *ibus_serializable_deserialize      (GVariant           *variant);
 
+/**
+ * ibus_serializable_get_pool_stats:
+ * @hits: (out) (allow-none): Number of objects reused from the recycling pools.
+ * @misses: (out) (allow-none): Number of objects created because the pools were empty.
+ * @returns: %TRUE if the recycling pools are enabled; %FALSE otherwise.
+ *
+ * Get the counters of the recycling pools of #IBusText, #IBusAttrList and
+ * #IBusAttribute. The pools are enabled by setting $IBUS_OBJECT_POOL to a
+ * non-zero value before any of these objects are created.
+ */
+gboolean             ibus_serializable_get_pool_stats   (guint              *hits,
+                                                         guint              *misses);
+
 G_END_DECLS
 #endif
 
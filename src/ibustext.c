@@ -19,9 +19,12 @@
  * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
  * Boston, MA 02111-1307, USA.
  */
+#include <string.h>
+#include "ibusinternal.h"
 #include "ibustext.h"
 
 /* functions prototype */
+static void         ibus_text_dispose      (GObject             *object);
 static void         ibus_text_destroy      (IBusText            *text);
 static gboolean     ibus_text_serialize    (IBusText            *text,
                                             GVariantBuilder     *builder);
@@ -35,11 +38,14 @@ G_DEFINE_TYPE (IBusText, ibus_text, IBUS_TYPE_SERIALIZABLE)
 static void
 ibus_text_class_init (IBusTextClass *class)
 {
+    GObjectClass *gobject_class = G_OBJECT_CLASS (class);
     IBusObjectClass *object_class = IBUS_OBJECT_CLASS (class);
     IBusSerializableClass *serializable_class = IBUS_SERIALIZABLE_CLASS (class);
 
     ibus_text_parent_class = (IBusSerializableClass *) g_type_class_peek_parent (class);
 
+    gobject_class->dispose = ibus_text_dispose;
+
     object_class->destroy = (IBusObjectDestroyFunc) ibus_text_destroy;
 
     serializable_class->serialize   = (IBusSerializableSerializeFunc) ibus_text_serialize;
@@ -55,13 +61,21 @@ ibus_text_init (IBusText *text)
     text->attrs = NULL;
 }
 
+static void
+ibus_text_dispose (GObject *object)
+{
+    G_OBJECT_CLASS (ibus_text_parent_class)->dispose (object);
+    _ibus_serializable_recycle (object);
+}
+
 static void
 ibus_text_destroy (IBusText *text)
 {
-    if (text->text != NULL && text->is_static == FALSE) {
+    /* leave the text as newly created, so it can be recycled. */
+    if (text->text != NULL && text->is_static == FALSE)
         g_free (text->text);
-        text->text = NULL;
-    }
+    text->text = "";
+    text->is_static = TRUE;
 
     if (text->attrs) {
         g_object_unref (text->attrs);
@@ -147,7 +161,7 @@ ibus_text_new_from_string (const gchar *str)
 
     IBusText *text;
 
-    text= g_object_new (IBUS_TYPE_TEXT, NULL);
+    text= _ibus_serializable_new (IBUS_TYPE_TEXT);
 
     text->is_static = FALSE;
     text->text = g_strdup (str);
@@ -163,7 +177,7 @@ ibus_text_new_from_ucs4 (const gunichar *str)
     gchar *buf = g_ucs4_to_utf8 (str, -1, NULL, NULL, NULL);
     g_return_val_if_fail (buf != NULL, NULL);
 
-    IBusText *text= g_object_new (IBUS_TYPE_TEXT, NULL);
+    IBusText *text= _ibus_serializable_new (IBUS_TYPE_TEXT);
 
     text->is_static = FALSE;
     text->text = buf;
@@ -178,7 +192,7 @@ ibus_text_new_from_static_string (const gchar *str)
 
     IBusText *text;
 
-    text= g_object_new (IBUS_TYPE_TEXT, NULL);
+    text= _ibus_serializable_new (IBUS_TYPE_TEXT);
 
     text->is_static = TRUE;
     text->text = (gchar *)str;
@@ -202,7 +216,7 @@ ibus_text_new_from_printf (const gchar *format,
 
     g_return_val_if_fail (str != NULL, NULL);
 
-    text= g_object_new (IBUS_TYPE_TEXT, NULL);
+    text= _ibus_serializable_new (IBUS_TYPE_TEXT);
     text->is_static = FALSE;
     text->text = (gchar *)str;
 
@@ -217,7 +231,7 @@ ibus_text_new_from_unichar (gunichar c)
 
     g_return_val_if_fail (g_unichar_validate (c), NULL);
 
-    text= g_object_new (IBUS_TYPE_TEXT, NULL);
+    text= _ibus_serializable_new (IBUS_TYPE_TEXT);
 
     text->is_static = FALSE;
     text->text = (gchar *)g_malloc (12);
@@ -287,3 +301,91 @@ ibus_text_set_attributes (IBusText     *text,
     text->attrs = attrs;
     g_object_ref_sink (text->attrs);
 }
+
+/* Like g_utf8_offset_to_pointer, but returns NULL if @str has less than
+ * @offset characters. */
+static const gchar *
+ibus_text_offset_to_pointer (const gchar *str,
+                             guint        offset)
+{
+    while (offset > 0) {
+        if (*str == '\0')
+            return NULL;
+        str = g_utf8_next_char (str);
+        offset--;
+    }
+    return str;
+}
+
+IBusText *
+ibus_text_new_from_edit (IBusText    *text,
+                         guint        start,
+                         guint        end,
+                         const gchar *replacement)
+{
+    g_assert (IBUS_IS_TEXT (text));
+    g_assert (replacement != NULL);
+
+    const gchar *start_p;
+    const gchar *end_p;
+    GString *str;
+    IBusText *new_text;
+
+    if (start > end)
+        return NULL;
+
+    start_p = ibus_text_offset_to_pointer (text->text, start);
+    if (start_p == NULL)
+        return NULL;
+    end_p = ibus_text_offset_to_pointer (start_p, end - start);
+    if (end_p == NULL)
+        return NULL;
+
+    str = g_string_sized_new ((start_p - text->text) +
+                              strlen (replacement) + strlen (end_p));
+    g_string_append_len (str, text->text, start_p - text->text);
+    g_string_append (str, replacement);
+    g_string_append (str, end_p);
+
+    new_text = _ibus_serializable_new (IBUS_TYPE_TEXT);
+    new_text->is_static = FALSE;
+    new_text->text = g_string_free (str, FALSE);
+
+    return new_text;
+}
+
+gchar *
+ibus_text_get_edit (IBusText *text,
+                    IBusText *new_text,
+                    guint    *start,
+                    guint    *end)
+{
+    g_assert (IBUS_IS_TEXT (text));
+    g_assert (IBUS_IS_TEXT (new_text));
+    g_assert (start != NULL && end != NULL);
+
+    const gchar *a = text->text;
+    const gchar *b = new_text->text;
+    gsize a_len = strlen (a);
+    gsize b_len = strlen (b);
+    gsize prefix = 0;
+    gsize suffix = 0;
+
+    while (prefix < a_len && prefix < b_len && a[prefix] == b[prefix])
+        prefix++;
+    /* do not split a character */
+    while (prefix > 0 &&
+           ((a[prefix] & 0xc0) == 0x80 || (b[prefix] & 0xc0) == 0x80))
+        prefix--;
+
+    while (suffix < a_len - prefix && suffix < b_len - prefix &&
+           a[a_len - suffix - 1] == b[b_len - suffix - 1])
+        suffix++;
+    while (suffix > 0 && (a[a_len - suffix] & 0xc0) == 0x80)
+        suffix--;
+
+    *start = g_utf8_strlen (a, prefix);
+    *end = *start + g_utf8_strlen (a + prefix, a_len - prefix - suffix);
+
+    return g_strndup (b + prefix, b_len - prefix - suffix);
+}
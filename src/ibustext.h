@@ -204,6 +204,42 @@ IBusAttrList *   ibus_text_get_attributes           (IBusText       *text);
 void             ibus_text_set_attributes           (IBusText       *text,
                                                      IBusAttrList   *attrs);
 
+/**
+ * ibus_text_new_from_edit:
+ * @text: An IBusText.
+ * @start: The first character of @text to replace.
+ * @end: The character after the last one to replace.
+ * @replacement: The string replacing the characters.
+ * @returns: A newly allocated IBusText, or %NULL if @start and @end are not
+ * a range of characters in @text.
+ *
+ * Return a new IBusText made from the string of @text with the characters
+ * from @start to @end replaced by @replacement. The attributes of @text
+ * are not copied.
+ */
+IBusText        *ibus_text_new_from_edit            (IBusText       *text,
+                                                     guint           start,
+                                                     guint           end,
+                                                     const gchar    *replacement);
+
+/**
+ * ibus_text_get_edit:
+ * @text: An IBusText.
+ * @new_text: An IBusText edited from @text.
+ * @start: (out): The first character of @text which is changed.
+ * @end: (out): The character after the last one of @text which is changed.
+ * @returns: The string replacing the characters from @start to @end.
+ * Free it with g_free().
+ *
+ * Find the smallest range of characters of @text which is changed in
+ * @new_text, so that ibus_text_new_from_edit() with the results makes
+ * the string of @new_text from @text.
+ */
+gchar           *ibus_text_get_edit                 (IBusText       *text,
+                                                     IBusText       *new_text,
+                                                     guint          *start,
+                                                     guint          *end);
+
 
 G_END_DECLS
 #endif
@@ -214,6 +214,26 @@ struct _IBusRectangle {
     gint height;
 };
 
+/**
+ * IBusKeyFilterRange:
+ * @first_keyval: The first key symbol of the range.
+ * @last_keyval: The last key symbol of the range.
+ * @modifiers: The modifiers which may be set on the keys of the range.
+ *
+ * A range of key events an engine wants to process. A key event is in the
+ * range if its key symbol is between @first_keyval and @last_keyval, and its
+ * shift, control, alt, super, hyper, meta and release modifiers are all in
+ * @modifiers. Caps lock and num lock are ignored.
+ *
+ * See also: ibus_engine_set_key_filter().
+ */
+typedef struct _IBusKeyFilterRange IBusKeyFilterRange;
+struct _IBusKeyFilterRange {
+    guint first_keyval;
+    guint last_keyval;
+    guint modifiers;
+};
+
 /**
  * IBusFreeFunc:
  * @object: object to be freed.
@@ -27,8 +27,10 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <gio/gio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "ibusxml.h"
+#include "ibusisocodes.h"
 
 #ifdef ENABLE_NLS
 #include <libintl.h>
@@ -39,6 +41,29 @@
 
 static GHashTable *__languages_dict;
 
+static int
+_iso639_entry_cmp (const void *key,
+                   const void *entry)
+{
+    return strcmp ((const gchar *) key,
+                   __iso639_strings + ((const ISO639Entry *) entry)->code);
+}
+
+static const gchar *
+_iso639_table_lookup (const gchar *lang)
+{
+    const ISO639Entry *entry;
+
+    entry = (const ISO639Entry *) bsearch (lang,
+                                           __iso639_entries,
+                                           IBUS_ISO639_N_ENTRIES,
+                                           sizeof (__iso639_entries[0]),
+                                           _iso639_entry_cmp);
+    if (entry == NULL)
+        return NULL;
+    return __iso639_strings + entry->name;
+}
+
 static gboolean
 _iso_codes_parse_xml_node (XMLNode          *node)
 {
@@ -126,9 +151,6 @@ ibus_get_language_name(const gchar *_locale) {
     gchar *p = NULL;
     gchar *lang = NULL;
 
-    if (__languages_dict == NULL ) {
-        _load_lang();
-    }
     if ((p = strchr (_locale, '_')) !=  NULL) {
         p = g_strndup (_locale, p - _locale);
     } else {
@@ -136,7 +158,16 @@ ibus_get_language_name(const gchar *_locale) {
     }
     lang = g_ascii_strdown (p, -1);
     g_free (p);
-    retval = (const gchar *) g_hash_table_lookup (__languages_dict, lang);
+    if (IBUS_ISO639_N_ENTRIES > 0) {
+        /* Use the table generated from iso_639.xml at build time. */
+        retval = _iso639_table_lookup (lang);
+    }
+    else {
+        if (__languages_dict == NULL) {
+            _load_lang();
+        }
+        retval = (const gchar *) g_hash_table_lookup (__languages_dict, lang);
+    }
     g_free (lang);
     if (retval != NULL) {
 #ifdef ENABLE_NLS
@@ -22,8 +22,36 @@
 #include <stdio.h>
 #include <string.h>
 #include "ibusxml.h"
-
-static GMarkupParser parser;
+#include "ibusinternal.h"
+
+/* The state of ibus_xml_parse_file() and ibus_xml_parse_buffer(). The tree
+ * is built without sub parsers, so a parse error leaves nothing pushed on
+ * the parse context. */
+typedef struct {
+    XMLNode *root;
+    /* the elements being parsed, the innermost one first */
+    GSList  *nodes;
+} XMLParseData;
+
+/* A parser pushed by _ibus_xml_markup_push(). */
+typedef struct {
+    const GMarkupParser *parser;
+    gpointer             user_data;
+    /* the depth of the element whose start_element pushed the parser */
+    guint                depth;
+} MarkupFrame;
+
+/* The user data of the parse contexts of ibus_xml_parse_file_with_parser()
+ * and ibus_xml_parse_buffer_with_parser(). The sub parsers are dispatched
+ * here instead of with g_markup_parse_context_push(), so the context can be
+ * freed after a parse error with sub parsers left on the stack. */
+typedef struct {
+    MarkupFrame  root;
+    /* the pushed parsers, the top one first */
+    GSList      *frames;
+    /* the number of open elements */
+    guint        depth;
+} MarkupParseData;
 
 void
 ibus_xml_free (XMLNode *node)
@@ -39,38 +67,6 @@ ibus_xml_free (XMLNode *node)
     g_slice_free (XMLNode, node);
 }
 
-static void
-_start_root_element_cb (GMarkupParseContext *context,
-                        const gchar         *element_name,
-                        const gchar        **attribute_names,
-                        const gchar        **attribute_values,
-                        gpointer             user_data,
-                        GError             **error)
-{
-    XMLNode **node = (XMLNode **) user_data;
-    g_assert (node != NULL);
-
-    XMLNode *p = g_slice_new0 (XMLNode);
-
-
-    p->name = g_strdup (element_name);
-
-    GArray *attributes = g_array_new (TRUE, TRUE, sizeof (gchar *));
-    while (*attribute_names != NULL && *attribute_values != NULL) {
-        gchar *p;
-        p = g_strdup (*attribute_names++);
-        g_array_append_val (attributes, p);
-        p = g_strdup (*attribute_values++);
-        g_array_append_val (attributes, p);
-    }
-
-    p->attributes = (gchar **) g_array_free (attributes, FALSE);
-
-    g_markup_parse_context_push (context, &parser, p);
-    *node = p;
-}
-
-
 static void
 _start_element_cb (GMarkupParseContext *context,
                    const gchar         *element_name,
@@ -79,17 +75,21 @@ _start_element_cb (GMarkupParseContext *context,
                    gpointer             user_data,
                    GError             **error)
 {
-    XMLNode *node = (XMLNode *) user_data;
+    XMLParseData *data = (XMLParseData *) user_data;
+    XMLNode *node = data->nodes != NULL ? (XMLNode *) data->nodes->data : NULL;
 
-    if (node->text) {
+    if (node != NULL && node->text) {
         g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT, " ");
         return;
     }
 
     XMLNode *p = g_slice_new0 (XMLNode);
 
-    node->sub_nodes = g_list_append (node->sub_nodes, p);
-    g_markup_parse_context_push (context, &parser, p);
+    if (node != NULL)
+        node->sub_nodes = g_list_append (node->sub_nodes, p);
+    else
+        data->root = p;
+    data->nodes = g_slist_prepend (data->nodes, p);
 
     p->name = g_strdup (element_name);
 
@@ -111,7 +111,10 @@ _end_element_cb (GMarkupParseContext *context,
                  gpointer             user_data,
                  GError             **error)
 {
-    XMLNode *p = (XMLNode *) g_markup_parse_context_pop (context);
+    XMLParseData *data = (XMLParseData *) user_data;
+    XMLNode *p = (XMLNode *) data->nodes->data;
+
+    data->nodes = g_slist_delete_link (data->nodes, data->nodes);
 
     if (p->text && p->sub_nodes) {
         g_warning ("Error");
@@ -122,9 +125,9 @@ _end_element_cb (GMarkupParseContext *context,
     }
 }
 
-static gboolean
-_is_space (const gchar *text,
-           gsize        text_len)
+gboolean
+ibus_xml_text_is_space (const gchar *text,
+                        gsize        text_len)
 {
     gsize i = 0;
 
@@ -150,12 +153,14 @@ _text_cb (GMarkupParseContext *context,
           gpointer             user_data,
           GError             **error)
 {
-    XMLNode *p = (XMLNode *)user_data;
+    XMLParseData *data = (XMLParseData *) user_data;
 
-    if (_is_space (text, text_len)) {
+    if (ibus_xml_text_is_space (text, text_len)) {
         return;
     }
 
+    XMLNode *p = (XMLNode *) data->nodes->data;
+
     if (p->sub_nodes || p->text) {
         g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT, " ");
         return;
@@ -164,7 +169,7 @@ _text_cb (GMarkupParseContext *context,
     p->text = g_strndup (text, text_len);
 }
 
-static GMarkupParser parser = {
+static const GMarkupParser parser = {
     _start_element_cb,
     _end_element_cb,
     _text_cb,
@@ -172,10 +177,22 @@ static GMarkupParser parser = {
     0,
 };
 
+/* Free the partial tree of a failed parse. */
+static void
+_xml_parse_data_clear (XMLParseData *data)
+{
+    g_slist_free (data->nodes);
+    data->nodes = NULL;
+    if (data->root != NULL) {
+        ibus_xml_free (data->root);
+        data->root = NULL;
+    }
+}
+
 XMLNode *
 ibus_xml_parse_file (const gchar *filename)
 {
-    gboolean retval = FALSE;
+    gboolean retval = TRUE;
     GError *error = NULL;
     FILE *pf = fopen (filename, "r");
 
@@ -184,46 +201,29 @@ ibus_xml_parse_file (const gchar *filename)
     }
 
     GMarkupParseContext *context;
-    XMLNode *node;
-
-    const static GMarkupParser root_parser = {
-        _start_root_element_cb,
-        _end_element_cb,
-        _text_cb,
-        0,
-        0,
-    };
-
-    do {
-        context = g_markup_parse_context_new (&root_parser, 0, &node, 0);
+    XMLParseData data = { NULL, NULL };
 
-        while (!feof (pf)) {
-            gchar buf[1024];
-            gssize len = 0;
+    context = g_markup_parse_context_new (&parser, 0, &data, 0);
 
-            len = fread (buf, 1, sizeof (buf), pf);
-            retval = g_markup_parse_context_parse (context, buf, len, &error);
+    while (retval && !feof (pf)) {
+        gchar buf[1024];
+        gssize len = 0;
 
-            if (!retval)
-                break;
-        }
-        fclose (pf);
-
-        if (!retval)
-            break;
+        len = fread (buf, 1, sizeof (buf), pf);
+        retval = g_markup_parse_context_parse (context, buf, len, &error);
+    }
+    fclose (pf);
 
+    if (retval)
         retval = g_markup_parse_context_end_parse (context, &error);
-        if (!retval)
-            break;
-
-        g_markup_parse_context_free (context);
+    g_markup_parse_context_free (context);
 
-        return node;
-    } while (0);
+    if (retval)
+        return data.root;
 
     g_warning ("Parse %s failed: %s", filename, error->message);
     g_error_free (error);
-    g_markup_parse_context_free (context);
+    _xml_parse_data_clear (&data);
     return NULL;
 }
 
@@ -234,36 +234,257 @@ ibus_xml_parse_buffer (const gchar *buffer)
     GError *error = NULL;
 
     GMarkupParseContext *context;
-    XMLNode *node;
-
-    const static GMarkupParser root_parser = {
-        _start_root_element_cb,
-        _end_element_cb,
-        _text_cb,
-        0,
-        0,
-    };
+    XMLParseData data = { NULL, NULL };
 
-    context = g_markup_parse_context_new (&root_parser, 0, &node, 0);
+    context = g_markup_parse_context_new (&parser, 0, &data, 0);
 
-    do {
-        retval = g_markup_parse_context_parse (context, buffer, strlen (buffer), &error);
-        if (!retval)
-            break;
+    retval = g_markup_parse_context_parse (context, buffer, strlen (buffer), &error) &&
+             g_markup_parse_context_end_parse (context, &error);
+    g_markup_parse_context_free (context);
 
-        retval = g_markup_parse_context_end_parse (context, &error);
-        if (!retval)
-            break;
-        g_markup_parse_context_free (context);
-        return node;
-    } while (0);
+    if (retval)
+        return data.root;
 
     g_warning ("Parse buffer failed: %s", error->message);
     g_error_free (error);
-    g_markup_parse_context_free (context);
+    _xml_parse_data_clear (&data);
     return NULL;
 }
 
+static MarkupFrame *
+_markup_top_frame (MarkupParseData *data)
+{
+    return data->frames != NULL ? (MarkupFrame *) data->frames->data : &data->root;
+}
+
+static void
+_markup_start_element_cb (GMarkupParseContext *context,
+                          const gchar         *element_name,
+                          const gchar        **attribute_names,
+                          const gchar        **attribute_values,
+                          gpointer             user_data,
+                          GError             **error)
+{
+    MarkupParseData *data = (MarkupParseData *) user_data;
+    MarkupFrame *frame = _markup_top_frame (data);
+
+    data->depth++;
+    if (frame->parser->start_element != NULL)
+        frame->parser->start_element (context, element_name,
+                                      attribute_names, attribute_values,
+                                      frame->user_data, error);
+}
+
+static void
+_markup_end_element_cb (GMarkupParseContext *context,
+                        const gchar         *element_name,
+                        gpointer             user_data,
+                        GError             **error)
+{
+    MarkupParseData *data = (MarkupParseData *) user_data;
+    MarkupFrame *frame = _markup_top_frame (data);
+
+    /* Like g_markup_parse_context_push(), the end of the element which
+     * pushed a parser is passed to the parser below, which pops it. */
+    if (frame != &data->root && frame->depth == data->depth) {
+        frame = data->frames->next != NULL ?
+                (MarkupFrame *) data->frames->next->data : &data->root;
+    }
+
+    if (frame->parser->end_element != NULL)
+        frame->parser->end_element (context, element_name,
+                                    frame->user_data, error);
+    data->depth--;
+}
+
+static void
+_markup_text_cb (GMarkupParseContext *context,
+                 const gchar         *text,
+                 gsize                text_len,
+                 gpointer             user_data,
+                 GError             **error)
+{
+    MarkupFrame *frame = _markup_top_frame ((MarkupParseData *) user_data);
+
+    if (frame->parser->text != NULL)
+        frame->parser->text (context, text, text_len, frame->user_data, error);
+}
+
+static void
+_markup_passthrough_cb (GMarkupParseContext *context,
+                        const gchar         *passthrough_text,
+                        gsize                text_len,
+                        gpointer             user_data,
+                        GError             **error)
+{
+    MarkupFrame *frame = _markup_top_frame ((MarkupParseData *) user_data);
+
+    if (frame->parser->passthrough != NULL)
+        frame->parser->passthrough (context, passthrough_text, text_len,
+                                    frame->user_data, error);
+}
+
+static void
+_markup_error_cb (GMarkupParseContext *context,
+                  GError              *error,
+                  gpointer             user_data)
+{
+    MarkupFrame *frame = _markup_top_frame ((MarkupParseData *) user_data);
+
+    if (frame->parser->error != NULL)
+        frame->parser->error (context, error, frame->user_data);
+}
+
+static const GMarkupParser markup_parser = {
+    _markup_start_element_cb,
+    _markup_end_element_cb,
+    _markup_text_cb,
+    _markup_passthrough_cb,
+    _markup_error_cb,
+};
+
+static void
+_markup_parse_data_init (MarkupParseData     *data,
+                         const GMarkupParser *parser,
+                         gpointer             user_data)
+{
+    data->root.parser = parser;
+    data->root.user_data = user_data;
+    data->root.depth = 0;
+    data->frames = NULL;
+    data->depth = 0;
+}
+
+/* Free the frames of the sub parsers left pushed by a failed parse. Their
+ * error callbacks have freed their user data. */
+static void
+_markup_parse_data_clear (MarkupParseData *data)
+{
+    while (data->frames != NULL) {
+        g_slice_free (MarkupFrame, data->frames->data);
+        data->frames = g_slist_delete_link (data->frames, data->frames);
+    }
+}
+
+void
+_ibus_xml_markup_push (GMarkupParseContext *context,
+                       const GMarkupParser *parser,
+                       gpointer             user_data)
+{
+    MarkupParseData *data =
+            (MarkupParseData *) g_markup_parse_context_get_user_data (context);
+    MarkupFrame *frame = g_slice_new (MarkupFrame);
+
+    frame->parser = parser;
+    frame->user_data = user_data;
+    frame->depth = data->depth;
+    data->frames = g_slist_prepend (data->frames, frame);
+}
+
+/* Remove the top frame of the context, and return its user data. */
+static gpointer
+_ibus_xml_markup_remove_frame (MarkupParseData *data)
+{
+    MarkupFrame *frame;
+    gpointer user_data;
+
+    g_return_val_if_fail (data->frames != NULL, NULL);
+
+    frame = (MarkupFrame *) data->frames->data;
+    user_data = frame->user_data;
+    g_slice_free (MarkupFrame, frame);
+    data->frames = g_slist_delete_link (data->frames, data->frames);
+    return user_data;
+}
+
+gpointer
+_ibus_xml_markup_pop (GMarkupParseContext *context)
+{
+    return _ibus_xml_markup_remove_frame (
+            (MarkupParseData *) g_markup_parse_context_get_user_data (context));
+}
+
+void
+_ibus_xml_markup_error (GMarkupParseContext *context,
+                        GError              *error)
+{
+    MarkupParseData *data =
+            (MarkupParseData *) g_markup_parse_context_get_user_data (context);
+    MarkupFrame *next;
+
+    _ibus_xml_markup_remove_frame (data);
+
+    /* The user data of the root parser is owned by the caller of the parse
+     * functions, so the error is passed down to the pushed parsers only. */
+    next = _markup_top_frame (data);
+    if (next != &data->root && next->parser->error != NULL)
+        next->parser->error (context, error, next->user_data);
+}
+
+gboolean
+ibus_xml_parse_buffer_with_parser (const gchar         *buffer,
+                                   const GMarkupParser *parser,
+                                   gpointer             user_data)
+{
+    g_assert (buffer);
+    g_assert (parser);
+
+    gboolean retval;
+    GError *error = NULL;
+    GMarkupParseContext *context;
+    MarkupParseData data;
+
+    _markup_parse_data_init (&data, parser, user_data);
+    context = g_markup_parse_context_new (&markup_parser, 0, &data, NULL);
+
+    retval = g_markup_parse_context_parse (context, buffer, strlen (buffer), &error) &&
+             g_markup_parse_context_end_parse (context, &error);
+
+    if (!retval) {
+        g_warning ("Parse buffer failed: %s", error->message);
+        g_error_free (error);
+    }
+
+    g_markup_parse_context_free (context);
+    _markup_parse_data_clear (&data);
+    return retval;
+}
+
+gboolean
+ibus_xml_parse_file_with_parser (const gchar         *filename,
+                                 const GMarkupParser *parser,
+                                 gpointer             user_data)
+{
+    g_assert (filename);
+    g_assert (parser);
+
+    gboolean retval;
+    GError *error = NULL;
+    gchar *contents = NULL;
+    gsize length = 0;
+    GMarkupParseContext *context;
+    MarkupParseData data;
+
+    if (!g_file_get_contents (filename, &contents, &length, NULL)) {
+        return FALSE;
+    }
+
+    _markup_parse_data_init (&data, parser, user_data);
+    context = g_markup_parse_context_new (&markup_parser, 0, &data, NULL);
+
+    retval = g_markup_parse_context_parse (context, contents, length, &error) &&
+             g_markup_parse_context_end_parse (context, &error);
+
+    if (!retval) {
+        g_warning ("Parse %s failed: %s", filename, error->message);
+        g_error_free (error);
+    }
+
+    g_markup_parse_context_free (context);
+    _markup_parse_data_clear (&data);
+    g_free (contents);
+    return retval;
+}
 
 static void
 output_indent (int level, GString *output)
@@ -88,4 +88,47 @@ void     ibus_xml_free          (XMLNode        *node);
  */
 void     ibus_xml_output        (const XMLNode  *node,
                                  GString        *output);
+
+/**
+ * ibus_xml_parse_file_with_parser:
+ * @name: File name to be parsed.
+ * @parser: A #GMarkupParser which receives the parsing events.
+ * @user_data: User data passed to the callbacks of @parser.
+ * @returns: %TRUE if the file was parsed successfully.
+ *
+ * Parse an XML file and feed it to @parser without building an XML tree.
+ * The callbacks of @parser may use g_markup_parse_context_push() to
+ * delegate elements to sub parsers, e.g. ibus_component_start_markup().
+ */
+gboolean ibus_xml_parse_file_with_parser
+                                (const gchar            *name,
+                                 const GMarkupParser    *parser,
+                                 gpointer                user_data);
+
+/**
+ * ibus_xml_parse_buffer_with_parser:
+ * @buffer: Buffer to be parsed.
+ * @parser: A #GMarkupParser which receives the parsing events.
+ * @user_data: User data passed to the callbacks of @parser.
+ * @returns: %TRUE if the buffer was parsed successfully.
+ *
+ * Parse a string buffer which contains an XML-formatted string and feed it
+ * to @parser without building an XML tree.
+ */
+gboolean ibus_xml_parse_buffer_with_parser
+                                (const gchar            *buffer,
+                                 const GMarkupParser    *parser,
+                                 gpointer                user_data);
+
+/**
+ * ibus_xml_text_is_space:
+ * @text: Text to be checked.
+ * @text_len: Length of @text in bytes.
+ * @returns: %TRUE if @text only contains white spaces.
+ *
+ * Check whether a text passed to the text callback of a #GMarkupParser
+ * should be ignored.
+ */
+gboolean ibus_xml_text_is_space (const gchar            *text,
+                                 gsize                   text_len);
 #endif
@@ -0,0 +1,109 @@
+# vim:set et sts=4 sw=4:
+#
+# ibus - The Input Bus
+#
+# Copyright (c) 2007-2010 Peng Huang <shawn.p.huang@gmail.com>
+# Copyright (c) 2007-2010 Red Hat, Inc.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this program; if not, write to the
+# Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+# Boston, MA  02111-1307  USA
+
+# Generate ibusisocodes.h from iso-codes' iso_639.xml.
+#
+# The output is a sorted table of (code, name) offsets into one string
+# pool, so that ibus_get_language_name can bsearch it without parsing any
+# XML.  Offsets instead of pointers keep the table free of relocations, so
+# its pages stay read-only and shared between all processes using libibus.
+# If iso_639.xml can not be read, an empty table is generated and libibus
+# falls back to parsing the XML file at runtime.
+
+import sys
+from xml.dom import minidom
+
+CODE_ATTRS = ("iso_639_2B_code", "iso_639_2T_code", "iso_639_1_code")
+
+def parse_entries(filename):
+    entries = {}
+    dom = minidom.parse(filename)
+    for node in dom.getElementsByTagName("iso_639_entry"):
+        name = node.getAttribute("name")
+        if not name:
+            continue
+        for attr in CODE_ATTRS:
+            code = node.getAttribute(attr)
+            if code and code not in entries:
+                entries[code] = name
+    return entries
+
+def c_string(s):
+    out = []
+    for c in bytearray(s.encode("utf-8")):
+        if c == 0x22 or c == 0x5c:
+            out.append("\\" + chr(c))
+        elif 0x20 <= c < 0x7f:
+            out.append(chr(c))
+        else:
+            out.append("\\%03o" % c)
+    return "\"" + "".join(out) + "\\0\""
+
+def main():
+    entries = {}
+    if len(sys.argv) > 1:
+        try:
+            entries = parse_entries(sys.argv[1])
+        except Exception:
+            sys.stderr.write("Can not parse %s, generate empty table\n" %
+                             sys.argv[1])
+            entries = {}
+
+    strings = []
+    offsets = {}
+    size = [0]
+    def intern(s):
+        if s not in offsets:
+            offsets[s] = size[0]
+            strings.append(s)
+            size[0] += len(s.encode("utf-8")) + 1
+        return offsets[s]
+
+    codes = sorted(entries.keys())
+    table = [(intern(code), intern(entries[code])) for code in codes]
+
+    out = sys.stdout
+    out.write("/* This file is generated by isocodes-gen.py. Do not edit. */\n")
+    out.write("#ifndef __IBUS_ISOCODES_H_\n")
+    out.write("#define __IBUS_ISOCODES_H_\n\n")
+    out.write("#define IBUS_ISO639_N_ENTRIES %d\n\n" % len(table))
+    out.write("static const gchar __iso639_strings[] =\n")
+    if strings:
+        for s in strings:
+            out.write("    %s\n" % c_string(s))
+    else:
+        out.write("    \"\"\n")
+    out.write("    ;\n\n")
+    out.write("typedef struct {\n")
+    out.write("    guint32 code;\n")
+    out.write("    guint32 name;\n")
+    out.write("} ISO639Entry;\n\n")
+    out.write("static const ISO639Entry __iso639_entries[] = {\n")
+    for code, name in table:
+        out.write("    { %d, %d },\n" % (code, name))
+    if not table:
+        out.write("    { 0, 0 },\n")
+    out.write("};\n\n")
+    out.write("#endif\n")
+
+if __name__ == "__main__":
+    main()
@@ -553,13 +553,32 @@ test_get_engines_by_names (void)
         g_assert_cmpstr (names[i], ==, ibus_engine_desc_get_name (*p));
         i++;
         g_object_unref (*p);
-        // The ref should be zero, *p is released.
-        g_assert (!IBUS_IS_ENGINE_DESC (*p));
+        // *p is still referenced by the engine cache of the bus.
+        g_assert (IBUS_IS_ENGINE_DESC (*p));
     }
     g_free (engines);
     engines = NULL;
 }
 
+static void
+test_list_engines_cached (void)
+{
+    GList *engines1, *engines2, *p1, *p2;
+
+    engines1 = ibus_bus_list_engines (bus);
+    engines2 = ibus_bus_list_engines (bus);
+
+    g_assert_cmpuint (g_list_length (engines1), ==, g_list_length (engines2));
+    /* the second call is served from the cache of the bus */
+    for (p1 = engines1, p2 = engines2; p1 != NULL; p1 = p1->next, p2 = p2->next)
+        g_assert (p1->data == p2->data);
+
+    g_list_foreach (engines1, (GFunc) g_object_unref, NULL);
+    g_list_free (engines1);
+    g_list_foreach (engines2, (GFunc) g_object_unref, NULL);
+    g_list_free (engines2);
+}
+
 static void
 test_async_apis (void)
 {
@@ -615,6 +634,7 @@ main (gint    argc,
     g_test_add_func ("/ibus/create-input-context-async",
                      test_create_input_context_async);
     g_test_add_func ("/ibus/get-engines-by-names", test_get_engines_by_names);
+    g_test_add_func ("/ibus/list-engines-cached", test_list_engines_cached);
     g_test_add_func ("/ibus/async-apis", test_async_apis);
 
     result = g_test_run ();
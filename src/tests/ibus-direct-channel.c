@@ -0,0 +1,338 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+#include <stdlib.h>
+#include <glib/gstdio.h>
+#include "ibus.h"
+
+/* Test the direct channel of IBusEngine. The engine is exported on a peer
+ * to peer connection, which stands for the connection to ibus-daemon, so no
+ * ibus-daemon is needed.
+ */
+
+#define TEST_TYPE_ENGINE (test_engine_get_type ())
+
+#define ENGINE_PATH "/org/freedesktop/IBus/Engine/1"
+
+typedef struct _TestEngine TestEngine;
+typedef struct _TestEngineClass TestEngineClass;
+
+struct _TestEngine {
+    IBusEngine parent;
+};
+
+struct _TestEngineClass {
+    IBusEngineClass parent;
+};
+
+static GType test_engine_get_type (void);
+G_DEFINE_TYPE (TestEngine, test_engine, IBUS_TYPE_ENGINE)
+
+static GMainLoop *loop = NULL;
+static GDBusConnection *server_connection = NULL;
+static GDBusConnection *client_connection = NULL;
+static GDBusConnection *direct_connection = NULL;
+
+/* the signals received from ibus-daemon's connection */
+static GString *bus_log = NULL;
+/* the signals received through the direct channel */
+static GString *direct_log = NULL;
+
+static gboolean
+test_engine_process_key_event (IBusEngine *engine,
+                               guint       keyval,
+                               guint       keycode,
+                               guint       state)
+{
+    /* The engine only handles lower case letters, and commits them. */
+    if (keyval < IBUS_KEY_a || keyval > IBUS_KEY_z)
+        return FALSE;
+
+    ibus_engine_commit_text (engine,
+                             ibus_text_new_from_unichar (keyval));
+    return TRUE;
+}
+
+static void
+test_engine_class_init (TestEngineClass *class)
+{
+    IBusEngineClass *engine_class = IBUS_ENGINE_CLASS (class);
+
+    engine_class->process_key_event = test_engine_process_key_event;
+}
+
+static void
+test_engine_init (TestEngine *engine)
+{
+}
+
+static void
+_signal_cb (GDBusConnection *connection,
+            const gchar     *sender_name,
+            const gchar     *object_path,
+            const gchar     *interface_name,
+            const gchar     *signal_name,
+            GVariant        *parameters,
+            GString         *log)
+{
+    g_string_append_printf (log, "%s;", signal_name);
+    if (g_strcmp0 (signal_name, "DirectChannelConnected") == 0 ||
+        g_strcmp0 (signal_name, "DirectChannelDisconnected") == 0) {
+        g_main_loop_quit (loop);
+    }
+}
+
+static void
+_call_done_cb (GDBusConnection *connection,
+               GAsyncResult    *res,
+               GVariant       **result)
+{
+    GError *error = NULL;
+
+    *result = g_dbus_connection_call_finish (connection, res, &error);
+    if (*result == NULL) {
+        gchar *name = g_dbus_error_get_remote_error (error);
+        *result = g_variant_ref_sink (g_variant_new_string (name));
+        g_free (name);
+        g_error_free (error);
+    }
+    g_main_loop_quit (loop);
+}
+
+/* Call a method of the engine, and return its result, or the name of the
+ * error as a string. The engine is served by the main loop of this thread,
+ * so the call can not block it. */
+static GVariant *
+_call (GDBusConnection *connection,
+       const gchar     *method_name,
+       GVariant        *parameters)
+{
+    GVariant *result = NULL;
+
+    g_dbus_connection_call (connection,
+                            NULL,
+                            ENGINE_PATH,
+                            IBUS_INTERFACE_ENGINE,
+                            method_name,
+                            parameters,
+                            NULL,
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            NULL,
+                            (GAsyncReadyCallback) _call_done_cb,
+                            &result);
+    g_main_loop_run (loop);
+    return result;
+}
+
+static gboolean
+_process_key_event (GDBusConnection *connection,
+                    guint            keyval)
+{
+    GVariant *result;
+    gboolean handled = FALSE;
+
+    result = _call (connection, "ProcessKeyEvent",
+                    g_variant_new ("(uuu)", keyval, 0, 0));
+    g_assert (g_variant_is_of_type (result, G_VARIANT_TYPE ("(b)")));
+    g_variant_get (result, "(b)", &handled);
+    g_variant_unref (result);
+    return handled;
+}
+
+static void
+_direct_connected_cb (GObject      *source_object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+    GError *error = NULL;
+
+    direct_connection = g_dbus_connection_new_for_address_finish (res, &error);
+    g_assert_no_error (error);
+}
+
+static void
+test_direct_channel (void)
+{
+    IBusEngine *engine;
+    GVariant *result;
+    const gchar *address;
+    guint bus_signal_id;
+    guint direct_signal_id;
+
+    engine = ibus_engine_new_with_type (TEST_TYPE_ENGINE,
+                                        "test",
+                                        ENGINE_PATH,
+                                        server_connection);
+    bus_signal_id =
+            g_dbus_connection_signal_subscribe (client_connection,
+                                                NULL,
+                                                IBUS_INTERFACE_ENGINE,
+                                                NULL,
+                                                ENGINE_PATH,
+                                                NULL,
+                                                G_DBUS_SIGNAL_FLAGS_NONE,
+                                                (GDBusSignalCallback) _signal_cb,
+                                                bus_log,
+                                                NULL);
+
+    /* Open the channel, and connect to it as the client of the input
+     * context does. The engine announces the channel on the connection to
+     * ibus-daemon when the client connects. */
+    result = _call (client_connection, "OpenDirectChannel", NULL);
+    g_assert (g_variant_is_of_type (result, G_VARIANT_TYPE ("(s)")));
+    g_variant_get (result, "(&s)", &address);
+    g_dbus_connection_new_for_address (address,
+                                       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                       NULL,
+                                       NULL,
+                                       _direct_connected_cb,
+                                       NULL);
+    g_main_loop_run (loop);
+    g_variant_unref (result);
+    g_assert_cmpstr (bus_log->str, ==, "DirectChannelConnected;");
+    while (direct_connection == NULL)
+        g_main_context_iteration (NULL, TRUE);
+
+    direct_signal_id =
+            g_dbus_connection_signal_subscribe (direct_connection,
+                                                NULL,
+                                                IBUS_INTERFACE_ENGINE,
+                                                NULL,
+                                                ENGINE_PATH,
+                                                NULL,
+                                                G_DBUS_SIGNAL_FLAGS_NONE,
+                                                (GDBusSignalCallback) _signal_cb,
+                                                direct_log,
+                                                NULL);
+
+    /* A key event round-trips through the channel, and the text committed
+     * for it is received before the reply. */
+    g_string_truncate (bus_log, 0);
+    g_assert (_process_key_event (direct_connection, IBUS_KEY_a));
+    g_assert (!_process_key_event (direct_connection, IBUS_KEY_1));
+    g_assert_cmpstr (direct_log->str, ==, "CommitText;");
+
+    /* Only the key events are exported on the channel. */
+    result = _call (direct_connection, "FocusIn", NULL);
+    g_assert_cmpstr (g_variant_get_string (result, NULL), ==,
+                     "org.freedesktop.DBus.Error.UnknownMethod");
+    g_variant_unref (result);
+    result = _call (direct_connection, "OpenDirectChannel", NULL);
+    g_assert_cmpstr (g_variant_get_string (result, NULL), ==,
+                     "org.freedesktop.DBus.Error.UnknownMethod");
+    g_variant_unref (result);
+
+    /* When the client closes the channel, the engine tells ibus-daemon, and
+     * the key events are sent through ibus-daemon again. */
+    g_dbus_connection_signal_unsubscribe (direct_connection, direct_signal_id);
+    g_dbus_connection_close (direct_connection, NULL, NULL, NULL);
+    g_main_loop_run (loop);
+    g_assert_cmpstr (bus_log->str, ==, "CommitText;DirectChannelDisconnected;");
+
+    g_string_truncate (bus_log, 0);
+    g_string_truncate (direct_log, 0);
+    g_assert (_process_key_event (client_connection, IBUS_KEY_b));
+    g_assert_cmpstr (bus_log->str, ==, "CommitText;");
+    g_assert_cmpstr (direct_log->str, ==, "");
+
+    g_dbus_connection_signal_unsubscribe (client_connection, bus_signal_id);
+    g_object_unref (direct_connection);
+    direct_connection = NULL;
+    ibus_object_destroy ((IBusObject *) engine);
+}
+
+static gboolean
+_new_connection_cb (GDBusServer     *server,
+                    GDBusConnection *connection,
+                    gpointer         user_data)
+{
+    server_connection = g_object_ref (connection);
+    if (client_connection != NULL)
+        g_main_loop_quit (loop);
+    return TRUE;
+}
+
+static void
+_client_connected_cb (GObject      *source_object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+    GError *error = NULL;
+
+    client_connection = g_dbus_connection_new_for_address_finish (res, &error);
+    g_assert_no_error (error);
+    if (server_connection != NULL)
+        g_main_loop_quit (loop);
+}
+
+static GDBusServer *
+_connect (void)
+{
+    GDBusServer *server;
+    GError *error = NULL;
+    gchar *guid = g_dbus_generate_guid ();
+
+    server = g_dbus_server_new_sync ("unix:tmpdir=/tmp",
+                                     G_DBUS_SERVER_FLAGS_NONE,
+                                     guid,
+                                     NULL,
+                                     NULL,
+                                     &error);
+    g_assert_no_error (error);
+    g_free (guid);
+
+    g_signal_connect (server, "new-connection",
+                      G_CALLBACK (_new_connection_cb), NULL);
+    g_dbus_server_start (server);
+
+    g_dbus_connection_new_for_address (g_dbus_server_get_client_address (server),
+                                       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                       NULL,
+                                       NULL,
+                                       _client_connected_cb,
+                                       NULL);
+    g_main_loop_run (loop);
+    return server;
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+    GDBusServer *server;
+    gchar *tmpdir;
+    gchar *address_file;
+    gint retval;
+
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+    g_test_init (&argc, &argv, NULL);
+    ibus_init ();
+
+    /* The engine listens for the direct channel in the directory of the
+     * ibus-daemon socket. */
+    tmpdir = g_build_filename (g_get_tmp_dir (), "ibus-test-XXXXXX", NULL);
+    g_assert (mkdtemp (tmpdir) != NULL);
+    address_file = g_build_filename (tmpdir, "address", NULL);
+    g_setenv ("IBUS_ADDRESS_FILE", address_file, TRUE);
+
+    loop = g_main_loop_new (NULL, FALSE);
+    bus_log = g_string_new ("");
+    direct_log = g_string_new ("");
+    server = _connect ();
+
+    g_test_add_func ("/ibus/engine-direct-channel", test_direct_channel);
+
+    retval = g_test_run ();
+
+    g_object_unref (client_connection);
+    g_object_unref (server_connection);
+    g_dbus_server_stop (server);
+    g_object_unref (server);
+    g_string_free (bus_log, TRUE);
+    g_string_free (direct_log, TRUE);
+    g_main_loop_unref (loop);
+    g_rmdir (tmpdir);
+    g_free (address_file);
+    g_free (tmpdir);
+    return retval;
+}
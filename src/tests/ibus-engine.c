@@ -1,17 +1,299 @@
 /* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
 #include "ibus.h"
 
-int main()
+/* Test the process_key_event_async member of IBusEngineClass. The engine is
+ * exported on a peer to peer connection, so no ibus-daemon is needed.
+ */
+
+#define TEST_TYPE_ENGINE (test_engine_get_type ())
+
+typedef struct _TestEngine TestEngine;
+typedef struct _TestEngineClass TestEngineClass;
+
+struct _TestEngine {
+    IBusEngine parent;
+};
+
+struct _TestEngineClass {
+    IBusEngineClass parent;
+};
+
+typedef enum {
+    COMPLETE_IN_IDLE,
+    COMPLETE_IN_THREAD,
+} CompleteMode;
+
+typedef struct {
+    IBusKeyEventReply *reply;
+    guint keyval;
+} KeyEventData;
+
+static GType test_engine_get_type (void);
+G_DEFINE_TYPE (TestEngine, test_engine, IBUS_TYPE_ENGINE)
+
+static GMainLoop *loop = NULL;
+static GDBusConnection *server_connection = NULL;
+static GDBusConnection *client_connection = NULL;
+
+static CompleteMode complete_mode;
+/* the events in the order the engine sees them */
+static GString *engine_log = NULL;
+/* the replies in the order the client receives them */
+static GString *client_log = NULL;
+static gint n_pending_calls = 0;
+
+static gboolean
+_complete_key_event (KeyEventData *data)
+{
+    /* The engine only handles lower case letters. */
+    ibus_key_event_reply_complete (data->reply,
+                                   data->keyval >= IBUS_KEY_a &&
+                                   data->keyval <= IBUS_KEY_z);
+    g_slice_free (KeyEventData, data);
+    return FALSE;
+}
+
+static gpointer
+_complete_key_event_thread (KeyEventData *data)
+{
+    /* Let the client send the following calls first. */
+    g_usleep (G_USEC_PER_SEC / 100);
+    _complete_key_event (data);
+    return NULL;
+}
+
+static void
+test_engine_process_key_event_async (IBusEngine        *engine,
+                                     guint              keyval,
+                                     guint              keycode,
+                                     guint              state,
+                                     IBusKeyEventReply *reply)
+{
+    KeyEventData *data = g_slice_new (KeyEventData);
+    data->reply = reply;
+    data->keyval = keyval;
+
+    g_string_append_printf (engine_log, "key %s;", ibus_keyval_name (keyval));
+
+    if (complete_mode == COMPLETE_IN_IDLE) {
+        g_idle_add ((GSourceFunc) _complete_key_event, data);
+    }
+    else {
+        GError *error = NULL;
+        if (g_thread_create ((GThreadFunc) _complete_key_event_thread,
+                             data, FALSE, &error) == NULL) {
+            g_error ("Can not create thread: %s", error->message);
+        }
+    }
+}
+
+static void
+test_engine_focus_in (IBusEngine *engine)
+{
+    g_string_append (engine_log, "focus-in;");
+}
+
+static void
+test_engine_focus_out (IBusEngine *engine)
 {
-	g_type_init ();
+    g_string_append (engine_log, "focus-out;");
+}
+
+static void
+test_engine_class_init (TestEngineClass *class)
+{
+    IBusEngineClass *engine_class = IBUS_ENGINE_CLASS (class);
+
+    engine_class->process_key_event_async = test_engine_process_key_event_async;
+    engine_class->focus_in = test_engine_focus_in;
+    engine_class->focus_out = test_engine_focus_out;
+}
+
+static void
+test_engine_init (TestEngine *engine)
+{
+}
+
+static void
+_call_done_cb (GDBusConnection *connection,
+               GAsyncResult    *res,
+               const gchar     *name)
+{
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish (connection, res, &error);
+
+    g_assert_no_error (error);
+    if (g_variant_is_of_type (result, G_VARIANT_TYPE ("(b)"))) {
+        gboolean handled;
+        g_variant_get (result, "(b)", &handled);
+        g_string_append_printf (client_log, "%s:%d;", name, handled);
+    }
+    else {
+        g_string_append_printf (client_log, "%s;", name);
+    }
+    g_variant_unref (result);
+
+    if (--n_pending_calls == 0)
+        g_main_loop_quit (loop);
+}
+
+static void
+_call (const gchar *path,
+       const gchar *method_name,
+       GVariant    *parameters,
+       const gchar *name)
+{
+    n_pending_calls++;
+    g_dbus_connection_call (client_connection,
+                            NULL,
+                            path,
+                            IBUS_INTERFACE_ENGINE,
+                            method_name,
+                            parameters,
+                            NULL,
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            NULL,
+                            (GAsyncReadyCallback) _call_done_cb,
+                            (gpointer) name);
+}
+
+static void
+_process_key_event (const gchar *path,
+                    guint        keyval)
+{
+    _call (path, "ProcessKeyEvent",
+           g_variant_new ("(uuu)", keyval, 0, 0),
+           ibus_keyval_name (keyval));
+}
+
+static void
+test_key_event_reply (CompleteMode  mode,
+                      const gchar  *path)
+{
+    IBusEngine *engine;
+
+    complete_mode = mode;
+    g_string_truncate (engine_log, 0);
+    g_string_truncate (client_log, 0);
+
+    engine = ibus_engine_new_with_type (TEST_TYPE_ENGINE,
+                                        "test",
+                                        path,
+                                        server_connection);
+
+    /* All calls are sent before the first reply, so the calls after a key
+     * event have to be queued by the engine until the key event is replied.
+     */
+    _process_key_event (path, IBUS_KEY_a);
+    _call (path, "FocusIn", NULL, "focus-in");
+    _process_key_event (path, IBUS_KEY_b);
+    _process_key_event (path, IBUS_KEY_1);
+    _call (path, "FocusOut", NULL, "focus-out");
+    g_main_loop_run (loop);
+
+    g_assert_cmpstr (engine_log->str, ==,
+                     "key a;focus-in;key b;key 1;focus-out;");
+    g_assert_cmpstr (client_log->str, ==,
+                     "a:1;focus-in;b:1;1:0;focus-out;");
+
+    ibus_object_destroy ((IBusObject *) engine);
+}
+
+static void
+test_reply_in_idle (void)
+{
+    test_key_event_reply (COMPLETE_IN_IDLE, "/org/freedesktop/IBus/Engine/1");
+}
+
+static void
+test_reply_in_thread (void)
+{
+    test_key_event_reply (COMPLETE_IN_THREAD, "/org/freedesktop/IBus/Engine/2");
+}
+
+static gboolean
+_new_connection_cb (GDBusServer     *server,
+                    GDBusConnection *connection,
+                    gpointer         user_data)
+{
+    server_connection = g_object_ref (connection);
+    if (client_connection != NULL)
+        g_main_loop_quit (loop);
+    return TRUE;
+}
+
+static void
+_client_connected_cb (GObject      *source_object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+    GError *error = NULL;
+
+    client_connection = g_dbus_connection_new_for_address_finish (res, &error);
+    g_assert_no_error (error);
+    if (server_connection != NULL)
+        g_main_loop_quit (loop);
+}
+
+static GDBusServer *
+_connect (void)
+{
+    GDBusServer *server;
+    GError *error = NULL;
+    gchar *guid = g_dbus_generate_guid ();
+
+    server = g_dbus_server_new_sync ("unix:tmpdir=/tmp",
+                                     G_DBUS_SERVER_FLAGS_NONE,
+                                     guid,
+                                     NULL,
+                                     NULL,
+                                     &error);
+    g_assert_no_error (error);
+    g_free (guid);
+
+    g_signal_connect (server, "new-connection",
+                      G_CALLBACK (_new_connection_cb), NULL);
+    g_dbus_server_start (server);
+
+    g_dbus_connection_new_for_address (g_dbus_server_get_client_address (server),
+                                       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                       NULL,
+                                       NULL,
+                                       _client_connected_cb,
+                                       NULL);
+    g_main_loop_run (loop);
+    return server;
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+    GDBusServer *server;
+    gint retval;
+
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+    g_test_init (&argc, &argv, NULL);
+    ibus_init ();
+
+    loop = g_main_loop_new (NULL, FALSE);
+    engine_log = g_string_new ("");
+    client_log = g_string_new ("");
+    server = _connect ();
+
+    g_test_add_func ("/ibus/engine-key-event-reply-in-idle", test_reply_in_idle);
+    g_test_add_func ("/ibus/engine-key-event-reply-in-thread", test_reply_in_thread);
 
-	GMainLoop *mainloop;
-	IBusConnection *connection;
-	IBusService *service;
+    retval = g_test_run ();
 
-	mainloop = g_main_loop_new (NULL, FALSE);
-	connection = ibus_connection_open ("unix:path=/tmp/ibus-phuang/ibus--0.0");
-	service = IBUS_SERVICE (ibus_engine_new ("/a/Engine", connection));
-	g_main_loop_run (mainloop);
-	return 0;
+    g_object_unref (client_connection);
+    g_object_unref (server_connection);
+    g_dbus_server_stop (server);
+    g_object_unref (server);
+    g_string_free (engine_log, TRUE);
+    g_string_free (client_log, TRUE);
+    g_main_loop_unref (loop);
+    return retval;
 }
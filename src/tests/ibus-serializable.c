@@ -1,3 +1,5 @@
+#include <stdlib.h>
+#include <glib/gstdio.h>
 #include "ibus.h"
 
 void g_variant_type_info_assert_no_infos (void);
@@ -54,6 +56,62 @@ test_text (void)
     g_variant_type_info_assert_no_infos ();
 }
 
+static void
+check_text_edit (const gchar *old_str,
+                 const gchar *new_str,
+                 guint        expected_start,
+                 guint        expected_end,
+                 const gchar *expected_replacement)
+{
+    IBusText *text = ibus_text_new_from_string (old_str);
+    IBusText *new_text = ibus_text_new_from_string (new_str);
+    IBusText *edited;
+    gchar *replacement;
+    guint start, end;
+
+    g_object_ref_sink (text);
+    g_object_ref_sink (new_text);
+
+    replacement = ibus_text_get_edit (text, new_text, &start, &end);
+    g_assert_cmpuint (start, ==, expected_start);
+    g_assert_cmpuint (end, ==, expected_end);
+    g_assert_cmpstr (replacement, ==, expected_replacement);
+
+    edited = ibus_text_new_from_edit (text, start, end, replacement);
+    g_object_ref_sink (edited);
+    g_assert_cmpstr (ibus_text_get_text (edited), ==, new_str);
+
+    g_free (replacement);
+    g_object_unref (edited);
+    g_object_unref (new_text);
+    g_object_unref (text);
+}
+
+static void
+test_text_edit (void)
+{
+    IBusText *text;
+
+    check_text_edit ("Hello", "Hello", 5, 5, "");
+    check_text_edit ("Hello", "Hello!", 5, 5, "!");
+    check_text_edit ("Hello", "Hell", 4, 5, "");
+    check_text_edit ("Hello", "Jello", 0, 1, "J");
+    check_text_edit ("Hello", "Heyllo", 2, 2, "y");
+    check_text_edit ("", "Hello", 0, 0, "Hello");
+    check_text_edit ("aaa", "aa", 2, 3, "");
+    /* "\xc3\xa9" and "\xc3\xa8" share the first byte */
+    check_text_edit ("caf\xc3\xa9s", "caf\xc3\xa8s", 3, 4, "\xc3\xa8");
+    check_text_edit ("\xe4\xbd\xa0\xe5\xa5\xbd",
+                     "\xe4\xbd\xa0\xe4\xbb\xac\xe5\xa5\xbd",
+                     1, 1, "\xe4\xbb\xac");
+
+    text = ibus_text_new_from_string ("Hello");
+    g_object_ref_sink (text);
+    g_assert (ibus_text_new_from_edit (text, 3, 2, "") == NULL);
+    g_assert (ibus_text_new_from_edit (text, 4, 6, "") == NULL);
+    g_object_unref (text);
+}
+
 static void
 test_engine_desc (void)
 {
@@ -128,6 +186,69 @@ test_property (void)
     g_variant_type_info_assert_no_infos ();
 }
 
+static IBusProperty *
+new_property (const gchar  *key,
+              IBusPropType  type,
+              IBusPropList *sub_props)
+{
+    return ibus_property_new (key,
+                              type,
+                              ibus_text_new_from_static_string (key),
+                              "icon",
+                              ibus_text_new_from_static_string ("tooltip"),
+                              TRUE,
+                              TRUE,
+                              PROP_STATE_UNCHECKED,
+                              sub_props);
+}
+
+static void
+test_prop_list_update (void)
+{
+    IBusPropList *menu = ibus_prop_list_new ();
+    ibus_prop_list_append (menu, new_property ("sub1", PROP_TYPE_RADIO, NULL));
+    ibus_prop_list_append (menu, new_property ("sub2", PROP_TYPE_RADIO, NULL));
+
+    IBusPropList *list = ibus_prop_list_new ();
+    g_object_ref_sink (list);
+    ibus_prop_list_append (list, new_property ("mode", PROP_TYPE_NORMAL, NULL));
+    ibus_prop_list_append (list, new_property ("menu", PROP_TYPE_MENU, menu));
+
+    IBusProperty *prop = ibus_prop_list_lookup (list, "sub2");
+    g_assert (prop != NULL);
+    g_assert_cmpstr (ibus_property_get_key (prop), ==, "sub2");
+    g_assert (ibus_prop_list_lookup (list, "mode") == ibus_prop_list_get (list, 0));
+    g_assert (ibus_prop_list_lookup (list, "none") == NULL);
+
+    g_assert (ibus_prop_list_update_property_state (list,
+                                                    "sub2",
+                                                    PROP_STATE_CHECKED,
+                                                    FALSE,
+                                                    FALSE));
+    g_assert_cmpuint (ibus_property_get_state (prop), ==, PROP_STATE_CHECKED);
+    g_assert (!ibus_property_get_visible (prop));
+    g_assert (!ibus_property_get_sensitive (prop));
+    g_assert_cmpstr (ibus_text_get_text (ibus_property_get_label (prop)), ==, "sub2");
+    g_assert (!ibus_prop_list_update_property_state (list,
+                                                     "none",
+                                                     PROP_STATE_CHECKED,
+                                                     TRUE,
+                                                     TRUE));
+
+    IBusProperty *update = new_property ("mode", PROP_TYPE_NORMAL, NULL);
+    ibus_property_set_icon (update, "icon_updated");
+    g_object_ref_sink (update);
+    g_assert (ibus_prop_list_update_property (list, update));
+    g_assert_cmpstr (ibus_property_get_icon (ibus_prop_list_get (list, 0)), ==, "icon_updated");
+    g_object_unref (update);
+
+    /* Updating a property with itself keeps it unchanged. */
+    g_assert (ibus_prop_list_update_property (list, prop));
+    g_assert_cmpstr (ibus_text_get_text (ibus_property_get_label (prop)), ==, "sub2");
+
+    g_object_unref (list);
+}
+
 static void
 test_attachment (void)
 {
@@ -179,20 +300,171 @@ test_attachment (void)
     g_variant_type_info_assert_no_infos ();
 }
 
+static void
+test_component_parse_error (void)
+{
+    /* truncated inside the sub parsers of the component and the engine */
+    const gchar *xml =
+        "<component><name>test</name><engines><engine><name>test</name>";
+    gchar *filename = g_build_filename (g_get_tmp_dir (),
+                                        "ibus-test-component.xml", NULL);
+
+    g_assert (g_file_set_contents (filename, xml, -1, NULL));
+
+    /* The parse error is a warning, so check in a child process that it
+     * is the only message. */
+    if (g_test_trap_fork (0, G_TEST_TRAP_SILENCE_STDERR)) {
+        g_log_set_always_fatal (G_LOG_LEVEL_CRITICAL);
+        g_assert (ibus_component_new_from_file (filename) == NULL);
+        g_assert (ibus_xml_parse_buffer (xml) == NULL);
+        exit (0);
+    }
+    g_test_trap_assert_passed ();
+    g_test_trap_assert_stderr ("*Parse*failed*");
+
+    g_unlink (filename);
+    g_free (filename);
+}
+
+/* A subclass of IBusText, which must not be recycled as an IBusText. */
+typedef struct {
+    IBusText parent;
+} TestText;
+
+typedef struct {
+    IBusTextClass parent;
+} TestTextClass;
+
+static GType test_text_get_type (void);
+G_DEFINE_TYPE (TestText, test_text, IBUS_TYPE_TEXT)
+
+static gint n_test_texts_finalized = 0;
+
+static void
+test_text_finalize (GObject *object)
+{
+    n_test_texts_finalized++;
+    G_OBJECT_CLASS (test_text_parent_class)->finalize (object);
+}
+
+static void
+test_text_class_init (TestTextClass *class)
+{
+    G_OBJECT_CLASS (class)->finalize = test_text_finalize;
+}
+
+static void
+test_text_init (TestText *text)
+{
+}
+
+static void
+test_pool (void)
+{
+    guint hits, hits2;
+    IBusText *text;
+
+    if (!ibus_serializable_get_pool_stats (NULL, NULL))
+        return;
+
+    /* a subclass instance is finalized, not recycled */
+    text = g_object_new (test_text_get_type (), NULL);
+    g_object_unref (text);
+    g_assert_cmpint (n_test_texts_finalized, ==, 1);
+
+    text = g_object_new (test_text_get_type (), NULL);
+    g_assert (G_OBJECT_TYPE (text) == test_text_get_type ());
+    g_object_unref (text);
+    g_assert_cmpint (n_test_texts_finalized, ==, 2);
+
+    /* an IBusText is recycled */
+    g_object_unref (ibus_text_new_from_static_string ("a"));
+    ibus_serializable_get_pool_stats (&hits, NULL);
+    text = ibus_text_new_from_static_string ("b");
+    ibus_serializable_get_pool_stats (&hits2, NULL);
+    g_assert_cmpuint (hits2, ==, hits + 1);
+    g_assert (G_OBJECT_TYPE (text) == IBUS_TYPE_TEXT);
+    g_assert_cmpstr (ibus_text_get_text (text), ==, "b");
+    g_object_unref (text);
+}
+
+/* A lookup table like the one of a pinyin engine: 4 pages of 9
+ * candidates, each with an underline and a color attribute. */
+static IBusLookupTable *
+new_pinyin_lookup_table (void)
+{
+    IBusLookupTable *table = ibus_lookup_table_new (9, 0, TRUE, FALSE);
+    gint i;
+
+    for (i = 0; i < 36; i++) {
+        IBusText *text = ibus_text_new_from_printf ("\xe5\x80\x99\xe9\x80\x89%d", i);
+        ibus_text_append_attribute (text, IBUS_ATTR_TYPE_UNDERLINE,
+                                    IBUS_ATTR_UNDERLINE_SINGLE, 0, -1);
+        ibus_text_append_attribute (text, IBUS_ATTR_TYPE_FOREGROUND,
+                                    0x0000ff, 0, 2);
+        ibus_lookup_table_append_candidate (table, text);
+    }
+    for (i = 0; i < 9; i++) {
+        ibus_lookup_table_append_label (table,
+                                        ibus_text_new_from_printf ("%d.", i + 1));
+    }
+    return table;
+}
+
+static void
+test_deserialize_perf (void)
+{
+    const gint n = 10000;
+    IBusLookupTable *table = new_pinyin_lookup_table ();
+    GVariant *variant = ibus_serializable_serialize ((IBusSerializable *) table);
+    g_object_unref (table);
+    g_variant_get_data (variant);
+
+    gint i;
+    g_test_timer_start ();
+    for (i = 0; i < n; i++) {
+        IBusSerializable *object = ibus_serializable_deserialize (variant);
+        g_object_unref (object);
+    }
+    gdouble elapsed = g_test_timer_elapsed ();
+    g_variant_unref (variant);
+
+    guint hits = 0;
+    guint misses = 0;
+    if (ibus_serializable_get_pool_stats (&hits, &misses)) {
+        g_test_message ("object pool: %u hits, %u misses, %.1f%% hit rate",
+                        hits, misses, 100.0 * hits / MAX (hits + misses, 1));
+    }
+
+    /* table + 45 texts + 45 attr lists + 72 attributes */
+    g_test_minimized_result (elapsed * 1e6 / n,
+                             "%.2f usec per deserialize of a lookup table "
+                             "with 163 objects",
+                             elapsed * 1e6 / n);
+}
+
 gint
 main (gint    argc,
       gchar **argv)
 {
     g_mem_set_vtable (glib_mem_profiler_table);
+    /* exercise the recycling pools, unless they are disabled explicitly */
+    g_setenv ("IBUS_OBJECT_POOL", "1", FALSE);
 	g_type_init ();
     g_test_init (&argc, &argv, NULL);
     g_test_add_func ("/ibus/varianttypeinfo", test_varianttypeinfo);
     g_test_add_func ("/ibus/attrlist", test_attr_list);
     g_test_add_func ("/ibus/text", test_text);
+    g_test_add_func ("/ibus/textedit", test_text_edit);
     g_test_add_func ("/ibus/enginedesc", test_engine_desc);
     g_test_add_func ("/ibus/lookuptable", test_lookup_table);
     g_test_add_func ("/ibus/property", test_property);
+    g_test_add_func ("/ibus/proplistupdate", test_prop_list_update);
     g_test_add_func ("/ibus/attachment", test_attachment);
+    g_test_add_func ("/ibus/component-parse-error", test_component_parse_error);
+    g_test_add_func ("/ibus/pool", test_pool);
+    if (g_test_perf ())
+        g_test_add_func ("/ibus/deserialize-perf", test_deserialize_perf);
 
     return g_test_run ();
 }
@@ -13,6 +13,8 @@ int main (int argc, char **argv)
     setlocale(LC_ALL, "en_US.Utf-8");
 
     g_assert_cmpstr (ibus_get_language_name ("eng"), ==, "English");
+    g_assert_cmpstr (ibus_get_language_name ("en_US"), ==, "English");
+    g_assert_cmpstr (ibus_get_language_name ("FR"), ==, "French");
 
     return 0;
 }
@@ -24,6 +24,7 @@ using IBus;
 
 
 bool name_only = false;
+int interval = 1;
 
 class EngineList {
     public EngineDesc[] data = {};
@@ -129,6 +130,223 @@ int exit_daemon(string[] argv) {
     return 0;
 }
 
+Variant? get_stats(IBus.Bus bus) {
+    try {
+        return bus.get_connection().call_sync(IBus.SERVICE_IBUS,
+                                              IBus.PATH_IBUS,
+                                              IBus.INTERFACE_IBUS,
+                                              "Stats",
+                                              null,
+                                              new VariantType("(a{st}a(sasuut))"),
+                                              DBusCallFlags.NONE,
+                                              -1,
+                                              null);
+    } catch (Error e) {
+        warning("Get statistics of ibus-daemon failed: %s", e.message);
+        return null;
+    }
+}
+
+uint64 get_counter(Variant counters, string name) {
+    for (size_t i = 0; i < counters.n_children(); i++) {
+        var entry = counters.get_child_value(i);
+        if (entry.get_child_value(0).get_string() == name)
+            return entry.get_child_value(1).get_uint64();
+    }
+    return 0;
+}
+
+Variant? get_connection_stats(Variant connections, string name) {
+    for (size_t i = 0; i < connections.n_children(); i++) {
+        var connection = connections.get_child_value(i);
+        if (connection.get_child_value(0).get_string() == name)
+            return connection;
+    }
+    return null;
+}
+
+int print_stats(string[] argv) {
+    const OptionEntry[] options =  {
+        { "interval", 0, 0, OptionArg.INT, out interval, "seconds between two samples", "seconds" },
+        { null }
+    };
+
+    var option = new OptionContext("command [OPTIONS]");
+    option.add_main_entries(options, "ibus");
+
+    try {
+        option.parse(ref argv);
+    } catch (OptionError e) {
+    }
+
+    if (interval <= 0)
+        interval = 1;
+
+    var bus = get_bus();
+
+    /* The daemon only counts up, so take two samples to get the rates. */
+    var first = get_stats(bus);
+    if (first == null)
+        return -1;
+    Thread.usleep(interval * 1000000);
+    var second = get_stats(bus);
+    if (second == null)
+        return -1;
+
+    var counters = second.get_child_value(0);
+    var old_counters = first.get_child_value(0);
+    for (size_t i = 0; i < counters.n_children(); i++) {
+        var entry = counters.get_child_value(i);
+        string name = entry.get_child_value(0).get_string();
+        uint64 value = entry.get_child_value(1).get_uint64();
+        if (name == "forwarded" || name == "dispatched") {
+            double rate = (value - get_counter(old_counters, name)) /
+                          (double) interval;
+            print("%-16s %" + uint64.FORMAT + " (%.1f/s)\n",
+                  name, value, rate);
+        } else {
+            print("%-16s %" + uint64.FORMAT + "\n", name, value);
+        }
+    }
+
+    print("\n%-10s %10s %10s %12s  %s\n",
+          "connection", "recv/s", "sent/s", "bytes/s", "names");
+    var connections = second.get_child_value(1);
+    var old_connections = first.get_child_value(1);
+    for (size_t i = 0; i < connections.n_children(); i++) {
+        var connection = connections.get_child_value(i);
+        string unique_name = connection.get_child_value(0).get_string();
+        string[] names = connection.get_child_value(1).dup_strv();
+        uint32 received = connection.get_child_value(2).get_uint32();
+        uint32 sent = connection.get_child_value(3).get_uint32();
+        uint64 bytes = connection.get_child_value(4).get_uint64();
+
+        /* A connection opened between the samples starts from zero. */
+        var old = get_connection_stats(old_connections, unique_name);
+        if (old != null) {
+            received -= old.get_child_value(2).get_uint32();
+            sent -= old.get_child_value(3).get_uint32();
+            bytes -= old.get_child_value(4).get_uint64();
+        }
+
+        print("%-10s %10.1f %10.1f %12.1f  %s\n",
+              unique_name,
+              received / (double) interval,
+              sent / (double) interval,
+              bytes / (double) interval,
+              string.joinv(",", names));
+    }
+
+    return 0;
+}
+
+string? dump_flight_recorder(IBus.Bus bus) {
+    try {
+        var result = bus.get_connection().call_sync(IBus.SERVICE_IBUS,
+                                                    IBus.PATH_IBUS,
+                                                    IBus.INTERFACE_IBUS,
+                                                    "DumpFlightRecorder",
+                                                    null,
+                                                    new VariantType("(s)"),
+                                                    DBusCallFlags.NONE,
+                                                    -1,
+                                                    null);
+        return result.get_child_value(0).get_string();
+    } catch (Error e) {
+        warning("Dump the flight recorder of ibus-daemon failed: %s",
+                e.message);
+        return null;
+    }
+}
+
+const string[] record_types = {
+    "?", "key-event", "focus-in", "focus-out", "engine-changed", "key-reply"
+};
+
+int print_flight_recorder(string[] argv) {
+    /* Decode a file written by the flight recorder of ibus-daemon, see
+     * bus/recorder.h for the format. Without a file, ask the running
+     * daemon to dump its recorder first. */
+    string? path = argv.length >= 2 ? argv[1] : null;
+    if (path == null) {
+        path = dump_flight_recorder(get_bus());
+        if (path == null)
+            return -1;
+    }
+
+    uint8[] data;
+    try {
+        FileUtils.get_data(path, out data);
+    } catch (FileError e) {
+        warning("Can not read %s: %s", path, e.message);
+        return -1;
+    }
+
+    if (data.length < 16 || Memory.cmp(data, "IBUSFREC", 8) != 0) {
+        warning("%s is not a flight recorder file.", path);
+        return -1;
+    }
+
+    var stream = new DataInputStream(new MemoryInputStream.from_data(data, null));
+    stream.set_byte_order(data[8] == 'B' ?
+                          DataStreamByteOrder.BIG_ENDIAN :
+                          DataStreamByteOrder.LITTLE_ENDIAN);
+
+    try {
+        stream.skip(10);
+        uint16 record_size = stream.read_uint16();
+        stream.read_uint32();
+        if (record_size < 32) {
+            warning("%s has a bad record size %u.", path, record_size);
+            return -1;
+        }
+
+        print("%12s %8s %-15s %-16s %10s %10s %6s\n",
+              "time(ms)", "context", "event", "keyval",
+              "modifiers", "latency", "depth");
+
+        uint64 start = 0;
+        int n = (data.length - 16) / record_size;
+        for (int i = 0; i < n; i++) {
+            uint64 time = stream.read_uint64();
+            uint32 context_id = stream.read_uint32();
+            uint16 type = stream.read_uint16();
+            uint16 depth = stream.read_uint16();
+            uint32 keyval = stream.read_uint32();
+            uint32 modifiers = stream.read_uint32();
+            uint32 latency = stream.read_uint32();
+            stream.read_uint32();
+            /* Skip the fields added by later versions. */
+            if (record_size > 32)
+                stream.skip(record_size - 32);
+
+            if (i == 0)
+                start = time;
+            string event = type < record_types.length ?
+                           record_types[type] : "?";
+            if (type == 1 || type == 5) {
+                /* A key event without a key-reply record after it is
+                 * still waiting for the engine. */
+                string? name = IBus.keyval_name(keyval);
+                print("%12.3f %8u %-15s %-16s 0x%08x %10s %6u\n",
+                      (time - start) / 1000.0, context_id, event,
+                      name != null ? name : "0x%x".printf(keyval),
+                      modifiers,
+                      type == 5 ? "%8.3fms".printf(latency / 1000.0) : "",
+                      depth);
+            } else {
+                print("%12.3f %8u %-15s\n",
+                      (time - start) / 1000.0, context_id, event);
+            }
+        }
+    } catch (Error e) {
+        warning("Can not decode %s: %s", path, e.message);
+        return -1;
+    }
+
+    return 0;
+}
+
 delegate int EntryFunc(string[] argv);
 
 struct CommandEntry {
@@ -142,7 +360,9 @@ public int main(string[] argv) {
         { "exit", exit_daemon },
         { "list-engine", list_engine },
         { "watch", message_watch },
-        { "restart", restart_daemon }
+        { "restart", restart_daemon },
+        { "stats", print_stats },
+        { "flight-recorder", print_flight_recorder }
     };
 
     if (argv.length >= 2) {
@@ -28,6 +28,8 @@ using Posix;
 public extern const string IBUS_VERSION;
 public extern const string BINDIR;
 
+extern bool xkb_set_layout(Gdk.Display display, string layout);
+
 class Panel : IBus.PanelService {
     private IBus.Bus m_bus;
     private IBus.Config m_config;
@@ -100,6 +102,26 @@ class Panel : IBus.PanelService {
         }
     }
 
+    private void switch_layout(string layout) {
+        var timer = new GLib.Timer();
+
+        // Switch xkb layout in process. Fallback to setxkbmap if it is not
+        // available.
+        if (!xkb_set_layout(Gdk.Display.get_default(), layout)) {
+            string cmdline = "setxkbmap %s".printf(layout);
+            try {
+                if (!GLib.Process.spawn_command_line_sync(cmdline)) {
+                    warning("Switch xkb layout to %s failed.", layout);
+                }
+            } catch (GLib.SpawnError e) {
+                warning("execute setxkblayout failed");
+            }
+        }
+
+        debug("Switch xkb layout to %s in %.3f ms",
+              layout, timer.elapsed() * 1000);
+    }
+
     private void switch_engine(int i, bool force = false) {
         GLib.assert(i >= 0 && i < m_engines.length);
 
@@ -118,16 +140,7 @@ class Panel : IBus.PanelService {
             warning("Switch engine to %s failed.", engine.get_name());
             return;
         }
-        // set xkb layout
-        string cmdline = "setxkbmap %s".printf(engine.get_layout());
-        try {
-            if (!GLib.Process.spawn_command_line_sync(cmdline)) {
-                warning("Switch xkb layout to %s failed.",
-                    engine.get_layout());
-            }
-        } catch (GLib.SpawnError e) {
-            warning("execute setxkblayout failed");
-        }
+        switch_layout(engine.get_layout());
 
         string[] names = {};
         foreach(var desc in m_engines) {
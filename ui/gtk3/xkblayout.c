@@ -0,0 +1,186 @@
+/* vim:set et sts=4 sw=4:
+ *
+ * ibus - The Input Bus
+ *
+ * Copyright(c) 2011 Peng Huang <shawn.p.huang@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <gdk/gdkx.h>
+
+#ifdef HAVE_XKBFILE
+#include <X11/XKBlib.h>
+#include <X11/extensions/XKBrules.h>
+
+/* The rules and the model and options of the keyboard are read from the
+ * X server once, like setxkbmap does.
+ */
+static char *rules_name = NULL;
+static XkbRF_RulesPtr rules = NULL;
+static XkbRF_VarDefsRec default_vardefs;
+
+/* A map from a layout string (e.g. "us(dvorak)") to the xkb component names
+ * resolved from the rules for it, so switching back to a layout does not
+ * need to look up the rules again.
+ */
+static GHashTable *components_cache = NULL;
+
+static gboolean
+xkb_layout_init (Display *xdisplay)
+{
+    gchar *path;
+
+    if (rules != NULL)
+        return TRUE;
+
+    memset (&default_vardefs, 0, sizeof (default_vardefs));
+    if (!XkbRF_GetNamesProp (xdisplay, &rules_name, &default_vardefs) ||
+        rules_name == NULL) {
+        g_warning ("Can not get the xkb rules names of the display.");
+        return FALSE;
+    }
+
+    path = g_build_filename (XKB_RULES_DIR, rules_name, NULL);
+    rules = XkbRF_Load (path, "C", False, True);
+    if (rules == NULL) {
+        g_warning ("Can not load xkb rules %s.", path);
+        g_free (path);
+        return FALSE;
+    }
+    g_free (path);
+
+    components_cache = g_hash_table_new (g_str_hash, g_str_equal);
+    return TRUE;
+}
+
+/* Split "us(dvorak)" into "us" and "dvorak". */
+static void
+xkb_layout_split (const gchar  *layout,
+                  gchar       **name,
+                  gchar       **variant)
+{
+    const gchar *p = strchr (layout, '(');
+
+    if (p == NULL || p[strlen (p) - 1] != ')') {
+        *name = g_strdup (layout);
+        *variant = NULL;
+        return;
+    }
+    *name = g_strndup (layout, p - layout);
+    *variant = g_strndup (p + 1, strlen (p + 1) - 1);
+}
+
+static XkbComponentNamesPtr
+xkb_layout_get_components (const gchar *layout)
+{
+    XkbComponentNamesPtr names;
+    XkbRF_VarDefsRec vardefs;
+    gchar *name;
+    gchar *variant;
+    Bool retval;
+
+    names = (XkbComponentNamesPtr) g_hash_table_lookup (components_cache,
+                                                        layout);
+    if (names != NULL)
+        return names;
+
+    xkb_layout_split (layout, &name, &variant);
+
+    vardefs = default_vardefs;
+    vardefs.layout = name;
+    vardefs.variant = variant;
+
+    names = g_slice_new0 (XkbComponentNamesRec);
+    retval = XkbRF_GetComponents (rules, &vardefs, names);
+
+    g_free (name);
+    g_free (variant);
+
+    if (!retval) {
+        g_slice_free (XkbComponentNamesRec, names);
+        return NULL;
+    }
+
+    g_hash_table_insert (components_cache, g_strdup (layout), names);
+    return names;
+}
+#endif
+
+/**
+ * xkb_set_layout:
+ * @display: A GdkDisplay.
+ * @layout: A layout string like "us" or "us(dvorak)".
+ * @returns: TRUE if the layout is switched, FALSE if it fails or the
+ * in-process switching is not available, then the caller should fallback
+ * to setxkbmap.
+ *
+ * Switch the xkb layout of the core keyboard in process.
+ */
+gboolean
+xkb_set_layout (GdkDisplay  *display,
+                const gchar *layout)
+{
+#ifdef HAVE_XKBFILE
+    Display *xdisplay = GDK_DISPLAY_XDISPLAY (display);
+    XkbComponentNamesPtr names;
+    XkbDescPtr xkb;
+    XkbRF_VarDefsRec vardefs;
+    gchar *name;
+    gchar *variant;
+
+    if (!xkb_layout_init (xdisplay))
+        return FALSE;
+
+    names = xkb_layout_get_components (layout);
+    if (names == NULL) {
+        g_warning ("Can not get xkb components of layout %s.", layout);
+        return FALSE;
+    }
+
+    xkb = XkbGetKeyboardByName (xdisplay,
+                                XkbUseCoreKbd,
+                                names,
+                                XkbGBN_AllComponentsMask,
+                                XkbGBN_AllComponentsMask &
+                                    (~XkbGBN_GeometryMask),
+                                True);
+    if (xkb == NULL) {
+        g_warning ("Can not load xkb keymap of layout %s.", layout);
+        return FALSE;
+    }
+    XkbFreeKeyboard (xkb, XkbAllComponentsMask, True);
+
+    /* Update the _XKB_RULES_NAMES property like setxkbmap. */
+    xkb_layout_split (layout, &name, &variant);
+    vardefs = default_vardefs;
+    vardefs.layout = name;
+    vardefs.variant = variant;
+    XkbRF_SetNamesProp (xdisplay, rules_name, &vardefs);
+    g_free (name);
+    g_free (variant);
+
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
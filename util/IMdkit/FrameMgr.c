@@ -213,11 +213,24 @@ NO_VALUE : (it)->max_count)
 
 #define FrameInstIsEnd(fi) ((fi)->template[(fi)->cur_no].type == EOL)
 
+/* Freed FrameMgrRec and FrameInstRec are kept for the next messages, so
+   parsing or building a message does not need to call malloc. */
+#define FRAME_POOL_SIZE 16
+
+static FrameMgr fm_pool[FRAME_POOL_SIZE];
+static int fm_pool_num = 0;
+static FrameInst fi_pool[FRAME_POOL_SIZE];
+static int fi_pool_num = 0;
+
 FrameMgr FrameMgrInit (XimFrame frame, char* area, Bool byte_swap)
 {
     FrameMgr fm;
 
-    fm = (FrameMgr) Xmalloc (sizeof (FrameMgrRec));
+    if (fm_pool_num > 0)
+        fm = fm_pool[--fm_pool_num];
+    else
+        fm = (FrameMgr) Xmalloc (sizeof (FrameMgrRec));
+    /*endif*/
 
     fm->frame = frame;
     fm->fi = FrameInstInit (frame);
@@ -259,7 +272,11 @@ void FrameMgrFree (FrameMgr fm)
     /*endwhile*/
 
     FrameInstFree (fm->fi);
-    Xfree (fm);
+    if (fm_pool_num < FRAME_POOL_SIZE)
+        fm_pool[fm_pool_num++] = fm;
+    else
+        Xfree (fm);
+    /*endif*/
 }
 
 FmStatus FrameMgrSetBuffer (FrameMgr fm, void* area)
@@ -867,7 +884,11 @@ static FrameInst FrameInstInit (XimFrame frame)
 {
     FrameInst fi;
 
-    fi = (FrameInst) Xmalloc (sizeof (FrameInstRec));
+    if (fi_pool_num > 0)
+        fi = fi_pool[--fi_pool_num];
+    else
+        fi = (FrameInst) Xmalloc (sizeof (FrameInstRec));
+    /*endif*/
 
     fi->template = frame;
     fi->cur_no = 0;
@@ -904,7 +925,11 @@ static void FrameInstFree (FrameInst fi)
     /*endwhile*/
     ChainIterFree (&ci);
     ChainMgrFree (&fi->cm);
-    Xfree (fi);
+    if (fi_pool_num < FRAME_POOL_SIZE)
+        fi_pool[fi_pool_num++] = fi;
+    else
+        Xfree (fi);
+    /*endif*/
 }
 
 static XimFrameType FrameInstGetNextType(FrameInst fi, XimFrameTypeInfo info)
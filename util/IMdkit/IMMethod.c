@@ -63,3 +63,10 @@ int IMSyncXlib(XIMS ims, XPointer call_data)
     ims->sync = True;
     return (ims->methods->syncXlib) (ims, call_data);
 }
+
+/* Send the messages queued by the transport. The server should call it
+   once per main loop iteration. */
+void IMFlush (XIMS ims)
+{
+    (ims->methods->flush) (ims);
+}
@@ -107,6 +107,7 @@ typedef struct
     int		(*preeditStart) (XIMS, XPointer);
     int		(*preeditEnd) (XIMS, XPointer);
     int		(*syncXlib) (XIMS, XPointer);
+    void	(*flush) (XIMS);
 } IMMethodsRec, *IMMethods;
 
 typedef struct
@@ -136,6 +137,7 @@ int IMCallCallback (XIMS, XPointer);
 int IMPreeditStart (XIMS, XPointer);
 int IMPreeditEnd (XIMS, XPointer);
 int IMSyncXlib (XIMS, XPointer);
+void IMFlush (XIMS);
 
 #ifdef __cplusplus
 }
@@ -152,6 +152,11 @@ typedef struct _Xi18nClient
     /* property offset to read next data */
     long        property_offset;
     void *trans_rec;		/* contains transport specific data  */
+    /* buffers kept for the messages sent to the client */
+    unsigned char *reply_buffer;	/* see _Xi18nGetReplyBuffer */
+    long	reply_buffer_size;
+    unsigned char *send_buffer;		/* used by _Xi18nSendMessage */
+    long	send_buffer_size;
     struct _Xi18nClient *next;
 } Xi18nClient;
 
@@ -486,6 +491,9 @@ typedef struct _Xi18nAddressRec
     /* clients table */
     Xi18nClient *clients;
     Xi18nClient *free_clients;
+    /* clients indexed by connect_id */
+    Xi18nClient **client_table;
+    int		client_table_size;
 } Xi18nAddressRec;
 
 typedef struct _Xi18nMethodsRec
@@ -495,6 +503,7 @@ typedef struct _Xi18nMethodsRec
     Bool (*send) (XIMS, CARD16, unsigned char*, long);
     Bool (*wait) (XIMS, CARD16, CARD8, CARD8);
     Bool (*disconnect) (XIMS, CARD16);
+    Bool (*flush) (XIMS);
 } Xi18nMethodsRec;
 
 typedef struct _Xi18nCore
@@ -37,16 +37,43 @@ IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define XCM_DATA_LIMIT		20
 
+/* number of property atoms of a connection, used in turn */
+#define XIM_PROPERTY_ATOM_NUM	4
+/* the queued messages are sent once this much property data is queued */
+#define XIM_SEND_QUEUE_LIMIT	(64*1024)
+
+/* a message waiting for Xi18nXFlush. The data of a message larger than
+   XCM_DATA_LIMIT is in the property data of the client. */
+typedef struct
+{
+    long	length;
+    unsigned char data[XCM_DATA_LIMIT];
+} XSendRec;
+
 typedef struct _XClient
 {
     Window	client_win;	/* client window */
     Window	accept_win;	/* accept window */
+    CARD16	connect_id;
+    /* property atoms to send large messages, interned once */
+    Atom	prop_atoms[XIM_PROPERTY_ATOM_NUM];
+    int		prop_atom_index;
+    /* messages waiting to be sent */
+    XSendRec	*send_queue;
+    int		send_queue_num;
+    int		send_queue_size;
+    unsigned char *prop_data;
+    long	prop_data_length;
+    long	prop_data_size;
+    Bool	queued;
+    struct _XClient *next_queued;
 } XClient;
 
 typedef struct
 {
     Atom	xim_request;
     Atom	connect_request;
+    XClient	*send_queue;	/* clients having queued messages */
 } XSpecRec;
 
 #endif
@@ -57,6 +57,9 @@ int _Xi18nNeedSwap (Xi18n i18n_core, CARD16 connect_id);
 Xi18nClient *_Xi18nNewClient(Xi18n i18n_core);
 Xi18nClient *_Xi18nFindClient (Xi18n i18n_core, CARD16 connect_id);
 void _Xi18nDeleteClient (Xi18n i18n_core, CARD16 connect_id);
+void _Xi18nFreeClients (Xi18n i18n_core);
+unsigned char *_Xi18nGetReplyBuffer (Xi18n i18n_core, CARD16 connect_id,
+                                     long length);
 void _Xi18nSendMessage (XIMS ims, CARD16 connect_id, CARD8 major_opcode,
                         CARD8 minor_opcode, unsigned char *data, long length);
 void _Xi18nSendTriggerKey (XIMS ims, CARD16 connect_id);
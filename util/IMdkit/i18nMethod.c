@@ -54,6 +54,7 @@ static int xi18n_callCallback (XIMS, XPointer);
 static int xi18n_preeditStart (XIMS, XPointer);
 static int xi18n_preeditEnd (XIMS, XPointer);
 static int xi18n_syncXlib (XIMS, XPointer);
+static void xi18n_flush (XIMS);
 
 #ifndef XIM_SERVERS
 #define XIM_SERVERS "XIM_SERVERS"
@@ -74,6 +75,7 @@ IMMethodsRec Xi18n_im_methods =
     xi18n_preeditStart,
     xi18n_preeditEnd,
     xi18n_syncXlib,
+    xi18n_flush,
 };
 
 extern Bool _Xi18nCheckXAddress (Xi18n, TransportSW *, char *);
@@ -787,6 +789,7 @@ static Status xi18n_closeIM(XIMS ims)
                         i18n_core->address.im_window,
                         WaitXSelectionRequest,
                         (XPointer)ims);
+    _Xi18nFreeClients (i18n_core);
     XFree (i18n_core->address.im_name);
     XFree (i18n_core->address.im_locale);
     XFree (i18n_core->address.im_addr);
@@ -886,9 +889,12 @@ static Status xi18n_forwardEvent (XIMS ims, XPointer xp)
 
     total_size = FrameMgrGetTotalSize (fm);
     event_size = sizeof (xEvent);
-    reply = (unsigned char *) malloc (total_size + event_size);
+    reply = _Xi18nGetReplyBuffer (i18n_core,
+                                  call_data->connect_id,
+                                  total_size + event_size);
     if (!reply)
     {
+        FrameMgrFree (fm);
         _Xi18nSendMessage (ims,
                            call_data->connect_id,
                            XIM_ERROR,
@@ -898,7 +904,6 @@ static Status xi18n_forwardEvent (XIMS ims, XPointer xp)
         return False;
     }
     /*endif*/
-    memset (reply, 0, total_size + event_size);
     FrameMgrSetBuffer (fm, reply);
     replyp = reply;
 
@@ -924,7 +929,6 @@ static Status xi18n_forwardEvent (XIMS ims, XPointer xp)
                        reply,
                        total_size + event_size);
 
-    XFree (reply);
     FrameMgrFree (fm);
 
     return True;
@@ -955,9 +959,12 @@ static Status xi18n_commit (XIMS ims, XPointer xp)
         str_length = strlen (call_data->commit_string);
         FrameMgrSetSize (fm, str_length);
         total_size = FrameMgrGetTotalSize (fm);
-        reply = (unsigned char *) malloc (total_size);
+        reply = _Xi18nGetReplyBuffer (i18n_core,
+                                      call_data->connect_id,
+                                      total_size);
         if (!reply)
         {
+            FrameMgrFree (fm);
             _Xi18nSendMessage (ims,
                                call_data->connect_id,
                                XIM_ERROR,
@@ -967,7 +974,6 @@ static Status xi18n_commit (XIMS ims, XPointer xp)
             return False;
         }
         /*endif*/
-        memset (reply, 0, total_size);
         FrameMgrSetBuffer (fm, reply);
 
         str_length = FrameMgrGetSize (fm);
@@ -988,9 +994,12 @@ static Status xi18n_commit (XIMS ims, XPointer xp)
             FrameMgrSetSize (fm, str_length);
         /*endif*/
         total_size = FrameMgrGetTotalSize (fm);
-        reply = (unsigned char *) malloc (total_size);
+        reply = _Xi18nGetReplyBuffer (i18n_core,
+                                      call_data->connect_id,
+                                      total_size);
         if (!reply)
         {
+            FrameMgrFree (fm);
             _Xi18nSendMessage (ims,
                                call_data->connect_id,
                                XIM_ERROR,
@@ -1021,7 +1030,6 @@ static Status xi18n_commit (XIMS ims, XPointer xp)
                        reply,
                        total_size);
     FrameMgrFree (fm);
-    XFree (reply);
 
     return True;
 }
@@ -1129,12 +1137,12 @@ static int xi18n_syncXlib (XIMS ims, XPointer xp)
     fm = FrameMgrInit (sync_fr, NULL,
                        _Xi18nNeedSwap (i18n_core, connect_id));
     total_size = FrameMgrGetTotalSize(fm);
-    reply = (unsigned char *) malloc (total_size);
+    reply = _Xi18nGetReplyBuffer (i18n_core, connect_id, total_size);
     if (!reply) {
+        FrameMgrFree (fm);
         _Xi18nSendMessage (ims, connect_id, XIM_ERROR, 0, 0, 0);
         return False;
     }
-    memset (reply, 0, total_size);
     FrameMgrSetBuffer (fm, reply);
 
     /* input input-method ID */
@@ -1144,7 +1152,14 @@ static int xi18n_syncXlib (XIMS ims, XPointer xp)
     _Xi18nSendMessage (ims, connect_id, XIM_SYNC, 0, reply, total_size);
 
     FrameMgrFree (fm);
-    XFree(reply);
     return True;
 }
 
+static void xi18n_flush (XIMS ims)
+{
+    Xi18n i18n_core = ims->protocol;
+
+    if (i18n_core->methods.flush)
+        i18n_core->methods.flush (ims);
+    /*endif*/
+}
@@ -1022,14 +1022,14 @@ static void ResetICMessageProc (XIMS ims,
     FrameMgrSetSize (fm, resetic->length);
 
     total_size = FrameMgrGetTotalSize (fm);
-    reply = (unsigned char *) malloc (total_size);
+    reply = _Xi18nGetReplyBuffer (i18n_core, connect_id, total_size);
     if (!reply)
     {
+        FrameMgrFree (fm);
         _Xi18nSendMessage (ims, connect_id, XIM_ERROR, 0, 0, 0);
         return;
     }
     /*endif*/
-    memset (reply, 0, total_size);
     FrameMgrSetBuffer (fm, reply);
 
     FrameMgrPutToken (fm, input_method_ID);
@@ -1044,7 +1044,6 @@ static void ResetICMessageProc (XIMS ims,
                        reply,
                        total_size);
     FrameMgrFree (fm);
-    XFree(reply);
 }
 
 static int WireEventToEvent (Xi18n i18n_core,
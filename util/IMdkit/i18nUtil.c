@@ -29,6 +29,7 @@ IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  
 ******************************************************************/
 
+#include <string.h>
 #include <X11/Xlib.h>
 #include "IMdkit.h"
 #include "Xi18n.h"
@@ -46,17 +47,78 @@ _Xi18nNeedSwap (Xi18n i18n_core, CARD16 connect_id)
     return (client->byte_order != im_byteOrder);
 }
 
+/* Grow a buffer kept in the client to at least length bytes. */
+static unsigned char *GrowBuffer (unsigned char **buffer,
+                                  long *buffer_size,
+                                  long length)
+{
+    if (*buffer_size < length)
+    {
+        long size = (*buffer_size > 0) ? *buffer_size : 64;
+        unsigned char *p;
+
+        while (size < length)
+            size *= 2;
+        /*endwhile*/
+        if ((p = (unsigned char *) realloc (*buffer, size)) == NULL)
+            return NULL;
+        /*endif*/
+        *buffer = p;
+        *buffer_size = size;
+    }
+    /*endif*/
+    return *buffer;
+}
+
+static Bool AddClientToTable (Xi18n i18n_core, Xi18nClient *client)
+{
+    Xi18nAddressRec *address = &i18n_core->address;
+
+    if (client->connect_id >= address->client_table_size)
+    {
+        int size = (address->client_table_size > 0)
+                   ? address->client_table_size : 32;
+        Xi18nClient **table;
+
+        while (size <= client->connect_id)
+            size *= 2;
+        /*endwhile*/
+        table = (Xi18nClient **) realloc (address->client_table,
+                                          size*sizeof (Xi18nClient *));
+        if (table == NULL)
+            return False;
+        /*endif*/
+        memset (table + address->client_table_size,
+                0,
+                (size - address->client_table_size)*sizeof (Xi18nClient *));
+        address->client_table = table;
+        address->client_table_size = size;
+    }
+    /*endif*/
+    address->client_table[client->connect_id] = client;
+    return True;
+}
+
 Xi18nClient *_Xi18nNewClient(Xi18n i18n_core)
 {
     static CARD16 connect_id = 0;
     int new_connect_id;
     Xi18nClient *client;
+    unsigned char *reply_buffer = NULL;
+    long reply_buffer_size = 0;
+    unsigned char *send_buffer = NULL;
+    long send_buffer_size = 0;
 
     if (i18n_core->address.free_clients)
     {
         client = i18n_core->address.free_clients;
         i18n_core->address.free_clients = client->next;
 	new_connect_id = client->connect_id;
+        /* reuse the buffers of the old client */
+        reply_buffer = client->reply_buffer;
+        reply_buffer_size = client->reply_buffer_size;
+        send_buffer = client->send_buffer;
+        send_buffer_size = client->send_buffer_size;
     }
     else
     {
@@ -66,11 +128,22 @@ Xi18nClient *_Xi18nNewClient(Xi18n i18n_core)
     /*endif*/
     memset (client, 0, sizeof (Xi18nClient));
     client->connect_id = new_connect_id;
+    client->reply_buffer = reply_buffer;
+    client->reply_buffer_size = reply_buffer_size;
+    client->send_buffer = send_buffer;
+    client->send_buffer_size = send_buffer_size;
     client->pending = (XIMPending *) NULL;
     client->sync = False;
     client->byte_order = '?'; 	/* initial value */
     memset (&client->pending, 0, sizeof (XIMPending *));
     client->property_offset = 0;
+    if (!AddClientToTable (i18n_core, client))
+    {
+        client->next = i18n_core->address.free_clients;
+        i18n_core->address.free_clients = client;
+        return NULL;
+    }
+    /*endif*/
     client->next = i18n_core->address.clients;
     i18n_core->address.clients = client;
 
@@ -79,17 +152,10 @@ Xi18nClient *_Xi18nNewClient(Xi18n i18n_core)
 
 Xi18nClient *_Xi18nFindClient (Xi18n i18n_core, CARD16 connect_id)
 {
-    Xi18nClient *client = i18n_core->address.clients;
-
-    while (client)
-    {
-        if (client->connect_id == connect_id)
-            return client;
-        /*endif*/
-        client = client->next;
-    }
-    /*endwhile*/
-    return NULL;
+    if (connect_id >= i18n_core->address.client_table_size)
+        return NULL;
+    /*endif*/
+    return i18n_core->address.client_table[connect_id];
 }
 
 void _Xi18nDeleteClient (Xi18n i18n_core, CARD16 connect_id)
@@ -109,6 +175,7 @@ void _Xi18nDeleteClient (Xi18n i18n_core, CARD16 connect_id)
             else
                 ccp0->next = ccp->next;
             /*endif*/
+            i18n_core->address.client_table[connect_id] = NULL;
             /* put it back to free list */
             target->next = i18n_core->address.free_clients;
             i18n_core->address.free_clients = target;
@@ -119,6 +186,59 @@ void _Xi18nDeleteClient (Xi18n i18n_core, CARD16 connect_id)
     /*endfor*/
 }
 
+void _Xi18nFreeClients (Xi18n i18n_core)
+{
+    Xi18nClient *lists[2];
+    int i;
+
+    lists[0] = i18n_core->address.clients;
+    lists[1] = i18n_core->address.free_clients;
+    for (i = 0;  i < 2;  i++)
+    {
+        Xi18nClient *client = lists[i];
+
+        while (client)
+        {
+            Xi18nClient *next = client->next;
+
+            XFree (client->reply_buffer);
+            XFree (client->send_buffer);
+            XFree (client);
+            client = next;
+        }
+        /*endwhile*/
+    }
+    /*endfor*/
+    XFree (i18n_core->address.client_table);
+    i18n_core->address.clients = NULL;
+    i18n_core->address.free_clients = NULL;
+    i18n_core->address.client_table = NULL;
+    i18n_core->address.client_table_size = 0;
+}
+
+/* Return a zero-filled buffer of length bytes to build a message for the
+ * client. The buffer is owned by the client and reused for the next
+ * messages, so the caller must not free it, and must send the message
+ * before getting the buffer again. */
+unsigned char *_Xi18nGetReplyBuffer (Xi18n i18n_core,
+                                     CARD16 connect_id,
+                                     long length)
+{
+    Xi18nClient *client = _Xi18nFindClient (i18n_core, connect_id);
+    unsigned char *buffer;
+
+    if (client == NULL)
+        return NULL;
+    /*endif*/
+    buffer = GrowBuffer (&client->reply_buffer,
+                         &client->reply_buffer_size,
+                         length);
+    if (buffer != NULL)
+        memset (buffer, 0, length);
+    /*endif*/
+    return buffer;
+}
+
 void _Xi18nSendMessage (XIMS ims,
                         CARD16 connect_id,
                         CARD8 major_opcode,
@@ -127,45 +247,48 @@ void _Xi18nSendMessage (XIMS ims,
                         long length)
 {
     Xi18n i18n_core = ims->protocol;
+    Xi18nClient *client = _Xi18nFindClient (i18n_core, connect_id);
     FrameMgr fm;
     extern XimFrameRec packet_header_fr[];
-    unsigned char *reply_hdr = NULL;
     int header_size;
     unsigned char *reply = NULL;
-    unsigned char *replyp;
     int reply_length;
     long p_len = length/4;
 
+    if (client == NULL)
+        return;
+    /*endif*/
+
     fm = FrameMgrInit (packet_header_fr,
                        NULL,
-                       _Xi18nNeedSwap (i18n_core, connect_id));
+                       client->byte_order != i18n_core->address.im_byteOrder);
 
     header_size = FrameMgrGetTotalSize (fm);
-    reply_hdr = (unsigned char *) malloc (header_size);
-    if (reply_hdr == NULL)
+    reply_length = header_size + length;
+    /* the header and the data are put in the send buffer of the client,
+       which is reused for the next messages */
+    reply = GrowBuffer (&client->send_buffer,
+                        &client->send_buffer_size,
+                        reply_length);
+    if (reply == NULL)
     {
-        _Xi18nSendMessage (ims, connect_id, XIM_ERROR, 0, 0, 0);
+        FrameMgrFree (fm);
         return;
     }
     /*endif*/
-    FrameMgrSetBuffer (fm, reply_hdr);
+    FrameMgrSetBuffer (fm, reply);
 
     /* put data */
     FrameMgrPutToken (fm, major_opcode);
     FrameMgrPutToken (fm, minor_opcode);
     FrameMgrPutToken (fm, p_len);
 
-    reply_length = header_size + length;
-    reply = (unsigned char *) malloc (reply_length);
-    replyp = reply;
-    memmove (reply, reply_hdr, header_size);
-    replyp += header_size;
-    memmove (replyp, data, length);
+    if (length > 0)
+        memmove (reply + header_size, data, length);
+    /*endif*/
 
     i18n_core->methods.send (ims, connect_id, reply, reply_length);
 
-    XFree (reply);
-    XFree (reply_hdr);
     FrameMgrFree (fm);
 }
 
@@ -32,6 +32,7 @@ IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <limits.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
+#include <X11/Xutil.h>
 #include "FrameMgr.h"
 #include "IMdkit.h"
 #include "Xi18n.h"
@@ -44,6 +45,11 @@ extern void _Xi18nDeleteClient(Xi18n, CARD16);
 static Bool WaitXConnectMessage(Display*, Window,
                                 XEvent*, XPointer);
 static Bool WaitXIMProtocol(Display*, Window, XEvent*, XPointer);
+static Bool Xi18nXFlush (XIMS ims);
+
+/* Maps the accept window of a client to its Xi18nClient, so a message
+   does not need to be matched against all clients. */
+static XContext client_context = 0;
 
 static XClient *NewXClient (Xi18n i18n_core, Window new_client)
 {
@@ -51,8 +57,16 @@ static XClient *NewXClient (Xi18n i18n_core, Window new_client)
     Xi18nClient *client = _Xi18nNewClient (i18n_core);
     XClient *x_client;
 
+    if (client == NULL)
+        return NULL;
+    /*endif*/
     x_client = (XClient *) malloc (sizeof (XClient));
+    if (x_client == NULL)
+        return NULL;
+    /*endif*/
+    memset (x_client, 0, sizeof (XClient));
     x_client->client_win = new_client;
+    x_client->connect_id = client->connect_id;
     x_client->accept_win = XCreateSimpleWindow (dpy,
                                                 DefaultRootWindow(dpy),
                                                 0,
@@ -63,6 +77,10 @@ static XClient *NewXClient (Xi18n i18n_core, Window new_client)
                                                 0,
                                                 0);
     client->trans_rec = x_client;
+    if (client_context == 0)
+        client_context = XUniqueContext ();
+    /*endif*/
+    XSaveContext (dpy, x_client->accept_win, client_context, (XPointer) client);
     return ((XClient *) x_client);
 }
 
@@ -71,21 +89,22 @@ static unsigned char *ReadXIMMessage (XIMS ims,
                                       int *connect_id)
 {
     Xi18n i18n_core = ims->protocol;
-    Xi18nClient *client = i18n_core->address.clients;
+    Xi18nClient *client = NULL;
     XClient *x_client = NULL;
     FrameMgr fm;
     extern XimFrameRec packet_header_fr[];
     unsigned char *p = NULL;
     unsigned char *p1;
 
-    while (client != NULL) {
-        x_client = (XClient *) client->trans_rec;
-        if (x_client->accept_win == ev->window) {
-            *connect_id = client->connect_id;
-            break;
-        }
-        client = client->next;
-    }
+    if (client_context == 0 ||
+        XFindContext (i18n_core->address.dpy,
+                      ev->window,
+                      client_context,
+                      (XPointer *) &client) != 0)
+        return (unsigned char *) NULL;
+    /*endif*/
+    x_client = (XClient *) client->trans_rec;
+    *connect_id = client->connect_id;
 
     if (ev->format == 8) {
         /* ClientMessage only */
@@ -183,9 +202,18 @@ static unsigned char *ReadXIMMessage (XIMS ims,
             client->property_offset = 0;
             return NULL;
         }
+        /* the property data of format 8 is the message itself, so it is
+           returned without copying. The caller frees it with XFree. */
+        if (actual_format_ret == 8)
+            return prop;
+        /*endif*/
         /* if hit, it might be an error */
         if ((p = (unsigned char *) malloc (length)) == NULL)
+        {
+            XFree (prop);
             return (unsigned char *) NULL;
+        }
+        /*endif*/
 
         memmove (p, prop, length);
         XFree (prop);
@@ -204,6 +232,9 @@ static void ReadXConnectMessage (XIMS ims, XClientMessageEvent *ev)
     CARD32 minor_version = ev->data.l[2];
     XClient *x_client = NewXClient (i18n_core, new_client);
 
+    if (x_client == NULL)
+        return;
+    /*endif*/
     if (ev->window != i18n_core->address.im_window)
         return; /* incorrect connection request */
     /*endif*/
@@ -265,6 +296,7 @@ static Bool Xi18nXEnd(XIMS ims)
     Xi18n i18n_core = ims->protocol;
     Display *dpy = i18n_core->address.dpy;
 
+    Xi18nXFlush (ims);
     _XUnregisterFilter (dpy,
                         i18n_core->address.im_window,
                         WaitXConnectMessage,
@@ -272,17 +304,111 @@ static Bool Xi18nXEnd(XIMS ims)
     return True;
 }
 
-static char *MakeNewAtom (CARD16 connect_id, char *atomName)
+static Atom GetPropertyAtom (Xi18n i18n_core, XClient *x_client)
 {
-    static int sequence = 0;
-    
-    sprintf (atomName,
-             "_server%d_%d",
-             connect_id,
-             ((sequence > 20)  ?  (sequence = 0)  :  sequence++));
-    return atomName;
+    Atom *atom = &x_client->prop_atoms[x_client->prop_atom_index];
+    char atomName[32];
+
+    if (*atom == None)
+    {
+        sprintf (atomName,
+                 "_server%d_%d",
+                 x_client->connect_id,
+                 x_client->prop_atom_index);
+        *atom = XInternAtom (i18n_core->address.dpy, atomName, False);
+    }
+    /*endif*/
+    return *atom;
 }
 
+/* Send the queued messages of a client. The data of all the large messages
+   are appended to one property with a single request, then a ClientMessage
+   is sent for each message in order, so the client reads them one by one
+   from the front of the property. */
+static void FlushXClient (Xi18n i18n_core, XClient *x_client)
+{
+    Display *dpy = i18n_core->address.dpy;
+    XSpecRec *spec = (XSpecRec *) i18n_core->address.connect_addr;
+    XEvent event;
+    Atom atom = None;
+    int i;
+
+    if (x_client->send_queue_num == 0)
+        return;
+    /*endif*/
+
+    if (x_client->prop_data_length > 0)
+    {
+        atom = GetPropertyAtom (i18n_core, x_client);
+        x_client->prop_atom_index =
+            (x_client->prop_atom_index + 1) % XIM_PROPERTY_ATOM_NUM;
+        XChangeProperty (dpy,
+                         x_client->client_win,
+                         atom,
+                         XA_STRING,
+                         8,
+                         PropModeAppend,
+                         x_client->prop_data,
+                         x_client->prop_data_length);
+    }
+    /*endif*/
+
+    memset (&event, 0, sizeof (XEvent));
+    event.type = ClientMessage;
+    event.xclient.window = x_client->client_win;
+    event.xclient.message_type = spec->xim_request;
+    for (i = 0;  i < x_client->send_queue_num;  i++)
+    {
+        XSendRec *rec = &x_client->send_queue[i];
+
+        if (rec->length > XCM_DATA_LIMIT)
+        {
+            event.xclient.format = 32;
+            event.xclient.data.l[0] = rec->length;
+            event.xclient.data.l[1] = atom;
+        }
+        else
+        {
+            /* unused field is cleared with NULL */
+            event.xclient.format = 8;
+            memmove (event.xclient.data.b, rec->data, XCM_DATA_LIMIT);
+        }
+        /*endif*/
+        XSendEvent (dpy,
+                    x_client->client_win,
+                    False,
+                    NoEventMask,
+                    &event);
+    }
+    /*endfor*/
+    x_client->send_queue_num = 0;
+    x_client->prop_data_length = 0;
+}
+
+static Bool Xi18nXFlush (XIMS ims)
+{
+    Xi18n i18n_core = ims->protocol;
+    XSpecRec *spec = (XSpecRec *) i18n_core->address.connect_addr;
+    XClient *x_client;
+
+    if (spec->send_queue == NULL)
+        return True;
+    /*endif*/
+    while ((x_client = spec->send_queue) != NULL)
+    {
+        spec->send_queue = x_client->next_queued;
+        x_client->next_queued = NULL;
+        x_client->queued = False;
+        FlushXClient (i18n_core, x_client);
+    }
+    /*endwhile*/
+    XFlush (i18n_core->address.dpy);
+    return True;
+}
+
+/* Queue a message. The queued messages are sent by Xi18nXFlush, which is
+   called after an incoming message is handled and by IMFlush, so the
+   replies and callbacks produced together cost one property write. */
 static Bool Xi18nXSend (XIMS ims,
                         CARD16 connect_id,
                         unsigned char *reply,
@@ -291,78 +417,77 @@ static Bool Xi18nXSend (XIMS ims,
     Xi18n i18n_core = ims->protocol;
     Xi18nClient *client = _Xi18nFindClient (i18n_core, connect_id);
     XSpecRec *spec = (XSpecRec *) i18n_core->address.connect_addr;
-    XClient *x_client = (XClient *) client->trans_rec;
-    XEvent event;
+    XClient *x_client;
+    XSendRec *rec;
 
-    event.type = ClientMessage;
-    event.xclient.window = x_client->client_win;
-    event.xclient.message_type = spec->xim_request;
+    if (client == NULL)
+        return False;
+    /*endif*/
+    x_client = (XClient *) client->trans_rec;
 
-    if (length > XCM_DATA_LIMIT)
+    if (x_client->send_queue_num == x_client->send_queue_size)
     {
-        Atom atom;
-        char atomName[16];
-        Atom actual_type_ret;
-        int actual_format_ret;
-        int return_code;
-        unsigned long nitems_ret;
-        unsigned long bytes_after_ret;
-        unsigned char *win_data;
+        int size = (x_client->send_queue_size > 0)
+                   ? x_client->send_queue_size*2 : 8;
+        XSendRec *queue = (XSendRec *) realloc (x_client->send_queue,
+                                                size*sizeof (XSendRec));
 
-        event.xclient.format = 32;
-        atom = XInternAtom (i18n_core->address.dpy,
-                            MakeNewAtom (connect_id, atomName),
-                            False);
-        return_code = XGetWindowProperty (i18n_core->address.dpy,
-                                          x_client->client_win,
-                                          atom,
-                                          0L,
-                                          10000L,
-                                          False,
-                                          XA_STRING,
-                                          &actual_type_ret,
-                                          &actual_format_ret,
-                                          &nitems_ret,
-                                          &bytes_after_ret,
-                                          &win_data);
-        if (return_code != Success)
+        if (queue == NULL)
             return False;
         /*endif*/
-        if (win_data)
-            XFree ((char *) win_data);
+        x_client->send_queue = queue;
+        x_client->send_queue_size = size;
+    }
+    /*endif*/
+
+    if (length > XCM_DATA_LIMIT)
+    {
+        long needed = x_client->prop_data_length + length;
+
+        if (needed > x_client->prop_data_size)
+        {
+            long size = (x_client->prop_data_size > 0)
+                        ? x_client->prop_data_size : 256;
+            unsigned char *data;
+
+            while (size < needed)
+                size *= 2;
+            /*endwhile*/
+            if ((data = (unsigned char *) realloc (x_client->prop_data,
+                                                   size)) == NULL)
+            {
+                return False;
+            }
+            /*endif*/
+            x_client->prop_data = data;
+            x_client->prop_data_size = size;
+        }
         /*endif*/
-        XChangeProperty (i18n_core->address.dpy,
-                         x_client->client_win,
-                         atom,
-                         XA_STRING,
-                         8,
-                         PropModeAppend,
-                         (unsigned char *) reply,
-                         length);
-        event.xclient.data.l[0] = length;
-        event.xclient.data.l[1] = atom;
+        memmove (x_client->prop_data + x_client->prop_data_length,
+                 reply,
+                 length);
+        x_client->prop_data_length += length;
     }
-    else
+    /*endif*/
+
+    rec = &x_client->send_queue[x_client->send_queue_num++];
+    rec->length = length;
+    memset (rec->data, 0, XCM_DATA_LIMIT);
+    if (length <= XCM_DATA_LIMIT)
+        memmove (rec->data, reply, length);
+    /*endif*/
+
+    if (!x_client->queued)
     {
-        unsigned char buffer[XCM_DATA_LIMIT];
-        int i;
-
-        event.xclient.format = 8;
-
-        /* Clear unused field with NULL */
-        memmove(buffer, reply, length);
-        for (i = length; i < XCM_DATA_LIMIT; i++)
-            buffer[i] = (char) 0;
-        /*endfor*/
-        length = XCM_DATA_LIMIT;
-        memmove (event.xclient.data.b, buffer, length);
+        x_client->queued = True;
+        x_client->next_queued = spec->send_queue;
+        spec->send_queue = x_client;
     }
-    XSendEvent (i18n_core->address.dpy,
-                x_client->client_win,
-                False,
-                NoEventMask,
-                &event);
-    XFlush (i18n_core->address.dpy);
+    /*endif*/
+
+    if (x_client->prop_data_length >= XIM_SEND_QUEUE_LIMIT)
+        Xi18nXFlush (ims);
+    /*endif*/
     return True;
 }
 
@@ -391,6 +516,8 @@ static Bool Xi18nXWait (XIMS ims,
     Xi18nClient *client = _Xi18nFindClient (i18n_core, connect_id);
     XClient *x_client = (XClient *) client->trans_rec;
 
+    /* the client may wait for the queued messages before replying */
+    Xi18nXFlush (ims);
     for (;;)
     {
         unsigned char *packet;
@@ -437,11 +564,18 @@ static Bool Xi18nXDisconnect (XIMS ims, CARD16 connect_id)
     Xi18nClient *client = _Xi18nFindClient (i18n_core, connect_id);
     XClient *x_client = (XClient *) client->trans_rec;
 
+    /* send XIM_DISCONNECT_REPLY and the other queued messages */
+    if (x_client->queued)
+        Xi18nXFlush (ims);
+    /*endif*/
+    XDeleteContext (dpy, x_client->accept_win, client_context);
     XDestroyWindow (dpy, x_client->accept_win);
     _XUnregisterFilter (dpy,
                         x_client->accept_win,
                         WaitXIMProtocol,
                         (XPointer)ims);
+    XFree (x_client->send_queue);
+    XFree (x_client->prop_data);
     XFree (x_client);
     _Xi18nDeleteClient (i18n_core, connect_id);
     return True;
@@ -457,12 +591,14 @@ Bool _Xi18nCheckXAddress (Xi18n i18n_core,
         return False;
     /*endif*/
     
+    spec->send_queue = NULL;
     i18n_core->address.connect_addr = (XSpecRec *) spec;
     i18n_core->methods.begin = Xi18nXBegin;
     i18n_core->methods.end = Xi18nXEnd;
     i18n_core->methods.send = Xi18nXSend;
     i18n_core->methods.wait = Xi18nXWait;
     i18n_core->methods.disconnect = Xi18nXDisconnect;
+    i18n_core->methods.flush = Xi18nXFlush;
     return True;
 }
 
@@ -513,6 +649,8 @@ static Bool WaitXIMProtocol (Display *dpy,
         if (delete == True)
             XFree (packet);
         /*endif*/
+        /* send the replies to the message */
+        Xi18nXFlush (ims);
         return True;
     }
     /*endif*/
@@ -0,0 +1,171 @@
+/* vim:set et sts=4 sw=4:
+ *
+ * ibus - The Input Bus
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ */
+
+/* Measure the cost of handling XIM_FORWARD_EVENT in the XIM server, like
+ * ibus-x11 does for a key event the engine does not handle: the message is
+ * parsed, the key event is passed to the protocol handler, and the handler
+ * forwards it back to the client.
+ *
+ * No X server is needed. The messages are passed to _Xi18nMessageHandler
+ * directly, and the replies are dropped by a dummy transport.
+ *
+ * Usage: test-forward-event [N_EVENTS [N_CLIENTS]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <X11/Xlib.h>
+#include <X11/Xproto.h>
+#include "FrameMgr.h"
+#include "IMdkit.h"
+#include "Xi18n.h"
+#include "XimFunc.h"
+
+#define DEFAULT_N_EVENTS    1000000
+#define DEFAULT_N_CLIENTS   200
+
+extern IMMethodsRec Xi18n_im_methods;
+extern void _Xi18nMessageHandler (XIMS, CARD16, unsigned char *, Bool *);
+
+static long n_forwarded = 0;
+static long n_sent = 0;
+
+static Bool
+Send (XIMS ims, CARD16 connect_id, unsigned char *reply, long length)
+{
+    n_sent++;
+    return True;
+}
+
+static int
+ProtocolHandler (XIMS ims, IMProtocol *call_data)
+{
+    Xi18nClient *client;
+
+    if (call_data->major_code != XIM_FORWARD_EVENT)
+        return 1;
+
+    /* the engine does not handle the key, so send it back to the client. */
+    IMForwardEvent (ims, (XPointer) &call_data->forwardevent);
+    n_forwarded++;
+
+    /* emulate XIM_SYNC_REPLY from the client. */
+    client = _Xi18nFindClient ((Xi18n) ims->protocol,
+                               call_data->any.connect_id);
+    client->sync = False;
+    return 1;
+}
+
+static unsigned char *
+NewForwardEventMessage (CARD16 connect_id)
+{
+    unsigned char *p;
+    XimProtoHdr *hdr;
+    CARD16 *body;
+    xEvent *event;
+    int length = sizeof (CARD16) * 4 + sizeof (xEvent);
+
+    p = (unsigned char *) calloc (1, sizeof (XimProtoHdr) + length);
+    hdr = (XimProtoHdr *) p;
+    hdr->major_opcode = XIM_FORWARD_EVENT;
+    hdr->minor_opcode = 0;
+    hdr->length = length / 4;
+
+    body = (CARD16 *) (hdr + 1);
+    body[0] = connect_id;   /* input-method-ID */
+    body[1] = 1;            /* input-context-ID */
+    body[2] = 0;            /* flag */
+    body[3] = 0;            /* sequence number */
+
+    event = (xEvent *) (body + 4);
+    event->u.u.type = KeyPress;
+    event->u.u.detail = 38;
+    event->u.keyButtonPointer.time = 1;
+    event->u.keyButtonPointer.root = 1;
+    event->u.keyButtonPointer.event = 1;
+    return p;
+}
+
+int
+main (int argc, char **argv)
+{
+    XIMProtocolRec ims_rec;
+    XIMS ims = &ims_rec;
+    Xi18n i18n_core;
+    unsigned char **messages;
+    CARD16 *connect_ids;
+    int n_events = DEFAULT_N_EVENTS;
+    int n_clients = DEFAULT_N_CLIENTS;
+    struct timeval start, end;
+    double elapsed;
+    unsigned int endian = 1;
+    int i;
+
+    if (argc > 1)
+        n_events = atoi (argv[1]);
+    if (argc > 2)
+        n_clients = atoi (argv[2]);
+    if (n_events <= 0 || n_clients <= 0) {
+        fprintf (stderr, "Usage: %s [N_EVENTS [N_CLIENTS]]\n", argv[0]);
+        return 1;
+    }
+
+    memset (ims, 0, sizeof (XIMProtocolRec));
+    ims->methods = &Xi18n_im_methods;
+    i18n_core = (Xi18n) calloc (1, sizeof (Xi18nCore));
+    ims->protocol = i18n_core;
+    i18n_core->address.im_byteOrder = (*(char *) &endian) ? 'l' : 'B';
+    i18n_core->address.improto = ProtocolHandler;
+    i18n_core->methods.send = Send;
+
+    /* the key events come from the client connected first, so its entry
+     * is the last one of the client list. */
+    messages = (unsigned char **) malloc (n_clients * sizeof (unsigned char *));
+    connect_ids = (CARD16 *) malloc (n_clients * sizeof (CARD16));
+    for (i = 0; i < n_clients; i++) {
+        Xi18nClient *client = _Xi18nNewClient (i18n_core);
+        client->byte_order = i18n_core->address.im_byteOrder;
+        connect_ids[i] = client->connect_id;
+        messages[i] = NewForwardEventMessage (client->connect_id);
+    }
+
+    gettimeofday (&start, NULL);
+    for (i = 0; i < n_events; i++) {
+        Bool delete = True;
+        _Xi18nMessageHandler (ims, connect_ids[0], messages[0], &delete);
+    }
+    gettimeofday (&end, NULL);
+
+    elapsed = (end.tv_sec - start.tv_sec) * 1e9 +
+              (end.tv_usec - start.tv_usec) * 1e3;
+    printf ("%d clients, %ld events forwarded, %ld messages sent\n",
+            n_clients, n_forwarded, n_sent);
+    printf ("%.1f ns per XIM_FORWARD_EVENT\n", elapsed / n_events);
+
+    for (i = 0; i < n_clients; i++)
+        free (messages[i]);
+    free (messages);
+    free (connect_ids);
+    _Xi18nFreeClients (i18n_core);
+    free (i18n_core);
+    return 0;
+}